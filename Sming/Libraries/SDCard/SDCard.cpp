@@ -33,6 +33,7 @@ Descr: Low-level SDCard functions
 
 /-------------------------------------------------------------------------*/
 #include "SDCard.h"
+#include "SDCardCache.h"
 #include "diskio.h"		/* Declarations of disk I/O functions */
 
 FATFS *pFatFs = NULL;		/* FatFs work area needed for each volume */
@@ -43,6 +44,11 @@ uint8 SPI_CS;				/* SPI client selector */
 #define SCK_SLOW_INIT 10
 #define SCK_NORMAL 0
 
+/* The card usually answers within a few bytes, so poll flat out for a while
+   before backing off: a fixed delay on every poll costs more than the transfer
+   of a block at full clock speed */
+#define POLL_FAST 64
+
 void SDCard_begin(uint8 PIN_CARD_SS)
 {
 	FIL file;
@@ -60,6 +66,11 @@ void SDCard_begin(uint8 PIN_CARD_SS)
 
 	SDCardSPI->begin();
 
+	if(!sdcache_init(SDCARD_CACHE_SECTORS))
+	{
+		debugf("No heap for SDCard cache");
+	}
+
 	/*this must be allocated for the whole program life ~512Bytes*/
 	pFatFs = new FATFS;
 	if(!pFatFs)
@@ -135,12 +146,12 @@ int wait_ready (void)	/* 1:OK, 0:Timeout */
 	uint8 d = 0xFF;
 	UINT tmr;
 
-	for (tmr = 5000; tmr; tmr--) {	/* Wait for ready in timeout of 500ms */
+	for (tmr = 5000 + POLL_FAST; tmr; tmr--) {	/* Wait for ready in timeout of 500ms */
 		SDCardSPI->transfer(&d, 1);
 		if (d == 0xFF)
 			break;
 		d = 0xFF;		// reset buffer
-		dly_us(100);
+		if (tmr <= 5000) dly_us(100);
 	}
 	return tmr ? 1 : 0;
 }
@@ -200,11 +211,11 @@ int rcvr_datablock (	/* 1:OK, 0:Failed */
 
 //	SDCardSPI->setMOSI(HIGH); /* Send 0xFF */
 	memset(buff, 0xFF, btr); /* Send 0xFF */
-	for (tmr = 1000; tmr; tmr--) {	/* Wait for data packet in timeout of 100ms */
+	for (tmr = 1000 + POLL_FAST; tmr; tmr--) {	/* Wait for data packet in timeout of 100ms */
 		d[0] = 0xFF;
 		SDCardSPI->transfer(&d[0], 1);
 		if (d[0] != 0xFF) break;
-		dly_us(100);
+		if (tmr <= 1000) dly_us(100);
 	}
 	if (d[0] != 0xFE) return 0;		/* If not valid data token, return with error */
 
@@ -412,6 +423,7 @@ DSTATUS disk_initialize (
 		debugf( "SDCard ERROR: %x", retCmd);
 	}
 	CardType = ty;
+	sdcache_invalidate();	/* May be a different card */
 
 	if(ty == 0)
 	{
@@ -448,7 +460,11 @@ DRESULT disk_read (
 	BYTE cmd;
 
 
+	BYTE* start = buff;
+	DWORD lba = sector;
+
 	if (disk_status(drv) & STA_NOINIT) return RES_NOTRDY;
+	if (count == 1 && sdcache_read(lba, buff)) return RES_OK;	/* FAT and directory sectors are usually cached */
 	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert LBA to byte address if needed */
 
 	cmd = count > 1 ? CMD18 : CMD17;			/*  READ_MULTIPLE_BLOCK : READ_SINGLE_BLOCK */
@@ -461,7 +477,9 @@ DRESULT disk_read (
 	}
 	deselect();
 
-	return count ? RES_ERROR : RES_OK;
+	if (count) return RES_ERROR;
+	if (cmd == CMD17) sdcache_store(lba, start);
+	return RES_OK;
 }
 
 
@@ -478,6 +496,9 @@ DRESULT disk_write (
 )
 {
 	if (disk_status(drv) & STA_NOINIT) return RES_NOTRDY;
+
+	sdcache_write(sector, buff, count);	/* Keep cached copies current */
+
 	if (!(CardType & CT_BLOCK)) sector *= 512;	/* Convert LBA to byte address if needed */
 
 	if (count == 1) {	/* Single block write */
@@ -498,7 +519,11 @@ DRESULT disk_write (
 	}
 	deselect();
 
-	return count ? RES_ERROR : RES_OK;
+	if (count) {
+		sdcache_invalidate();	/* Card contents are uncertain */
+		return RES_ERROR;
+	}
+	return RES_OK;
 }
 
 
@@ -554,3 +579,26 @@ DRESULT disk_ioctl (
 }
 
 
+
+
+/*-----------------------------------------------------------------------*/
+/* Fast seek                                                             */
+/*-----------------------------------------------------------------------*/
+
+FRESULT SDCard_createLinkMap (
+	FIL* file,		/* Open file */
+	DWORD* table,	/* Work area for the cluster link map */
+	UINT tableSize	/* Number of items in the table */
+)
+{
+	FRESULT res;
+
+	file->cltbl = table;
+	table[0] = tableSize;
+	res = f_lseek(file, CREATE_LINKMAP);
+	if (res != FR_OK) {
+		debugf("SDCard link map needs %u items", (unsigned)table[0]);
+		file->cltbl = NULL;
+	}
+	return res;
+}
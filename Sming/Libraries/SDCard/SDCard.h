@@ -10,9 +10,20 @@ Descr: Low-level SDCard functions
 
 #include <SmingCore.h>
 #include "SPISoft.h"
+#include "SDCardCache.h"
 
 void SDCard_begin(uint8 PIN_CARD_SS);
 
+/* Let f_lseek() and f_read() on a large file find clusters without following
+   the FAT chain from the start, see the FatFs fast seek documentation.
+   Each fragment of the file takes two items of the table, plus one item;
+   a file written in one go usually needs only a few.
+   The table must stay valid until the file is closed, and the file can't
+   be made longer while the map is in use.
+   Returns FR_NOT_ENOUGH_CORE if the table is too small, with table[0] set to
+   the number of items needed */
+FRESULT SDCard_createLinkMap(FIL* file, DWORD* table, UINT tableSize);
+
 //extern SPISoft *SDCardSPI;
 
 extern SPIBase	*SDCardSPI;
@@ -0,0 +1,119 @@
+/*
+Project: Sming for ESP8266 - https://github.com/anakod/Sming
+License: MIT
+Descr: Small LRU cache of SDCard sectors
+*/
+#include "SDCardCache.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR_SIZE 512
+#define NO_SECTOR 0xFFFFFFFF
+
+typedef struct {
+	DWORD sector;
+	DWORD used; /* Value of the use counter when last read */
+} cache_entry;
+
+static cache_entry* entries = NULL;
+static BYTE* data = NULL;
+static UINT size = 0;
+static DWORD use_count = 0;
+static sdcache_stats stats;
+
+int sdcache_init(UINT sectors)
+{
+	sdcache_free();
+	if (sectors == 0) return 1;
+
+	entries = (cache_entry*)malloc(sectors * sizeof(cache_entry));
+	data = (BYTE*)malloc(sectors * SECTOR_SIZE);
+	if (!entries || !data) {
+		sdcache_free();
+		return 0;
+	}
+	size = sectors;
+	sdcache_invalidate();
+	memset(&stats, 0, sizeof(stats));
+	return 1;
+}
+
+void sdcache_free(void)
+{
+	free(entries);
+	free(data);
+	entries = NULL;
+	data = NULL;
+	size = 0;
+}
+
+static int find(DWORD sector)
+{
+	UINT i;
+	for (i = 0; i < size; i++) {
+		if (entries[i].sector == sector) return i;
+	}
+	return -1;
+}
+
+int sdcache_read(DWORD sector, BYTE* buff)
+{
+	int i;
+
+	if (size == 0) return 0;
+	i = find(sector);
+	if (i < 0) {
+		stats.misses++;
+		return 0;
+	}
+	memcpy(buff, data + i * SECTOR_SIZE, SECTOR_SIZE);
+	entries[i].used = ++use_count;
+	stats.hits++;
+	return 1;
+}
+
+void sdcache_store(DWORD sector, const BYTE* buff)
+{
+	UINT i, victim = 0;
+
+	if (size == 0) return;
+	for (i = 0; i < size; i++) {
+		if (entries[i].sector == sector) {
+			victim = i;
+			break;
+		}
+		/* Free entries have never been used, so they go first */
+		if (entries[i].used < entries[victim].used) victim = i;
+	}
+	entries[victim].sector = sector;
+	entries[victim].used = ++use_count;
+	memcpy(data + victim * SECTOR_SIZE, buff, SECTOR_SIZE);
+}
+
+void sdcache_write(DWORD sector, const BYTE* buff, UINT count)
+{
+	UINT i;
+
+	for (i = 0; i < size; i++) {
+		DWORD n = entries[i].sector - sector;
+		if (entries[i].sector != NO_SECTOR && n < count) {
+			memcpy(data + i * SECTOR_SIZE, buff + n * SECTOR_SIZE, SECTOR_SIZE);
+			stats.updates++;
+		}
+	}
+}
+
+void sdcache_invalidate(void)
+{
+	UINT i;
+	for (i = 0; i < size; i++) {
+		entries[i].sector = NO_SECTOR;
+		entries[i].used = 0;
+	}
+	use_count = 0;
+}
+
+void sdcache_get_stats(sdcache_stats* s)
+{
+	*s = stats;
+}
@@ -0,0 +1,56 @@
+/*
+Project: Sming for ESP8266 - https://github.com/anakod/Sming
+License: MIT
+Descr: Small LRU cache of SDCard sectors
+
+FatFs reads FAT and directory sectors one at a time, and goes back to the
+same few sectors over and over while a file grows or a path is followed.
+Single sector reads are kept here so that those round trips to the card are
+avoided. Writes go straight through to the card and update any cached copy,
+so the cache never holds anything the card doesn't.
+
+Multiple sector reads (file data) bypass the cache.
+*/
+#ifndef _SD_CARD_CACHE_
+#define _SD_CARD_CACHE_
+
+#include "../../Services/FATFS/integer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sectors cached, 512 bytes of heap each, 0 to disable the cache */
+#ifndef SDCARD_CACHE_SECTORS
+#define SDCARD_CACHE_SECTORS 4
+#endif
+
+typedef struct {
+	DWORD hits;
+	DWORD misses;
+	DWORD updates; /* Cached sectors rewritten */
+} sdcache_stats;
+
+/* Allocate the cache, returns 0 if there's not enough heap */
+int sdcache_init(UINT sectors);
+void sdcache_free(void);
+
+/* Get a sector from the cache, returns 1 on a hit */
+int sdcache_read(DWORD sector, BYTE* buff);
+
+/* Keep a sector just read from the card, in place of the least recently used one */
+void sdcache_store(DWORD sector, const BYTE* buff);
+
+/* Sectors written to the card: refresh any cached copies */
+void sdcache_write(DWORD sector, const BYTE* buff, UINT count);
+
+/* Forget everything, for a card change or an I/O error */
+void sdcache_invalidate(void);
+
+void sdcache_get_stats(sdcache_stats* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /*_SD_CARD_CACHE_*/
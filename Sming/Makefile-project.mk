@@ -44,6 +44,8 @@ DEBUG_VERBOSE_LEVEL ?= 2
 
 # Path to spiffy
 SPIFFY ?= $(SMING_HOME)/../tools/spiffy/spiffy
+# Path to assetfs
+ASSETFS ?= $(SMING_HOME)/../tools/assetfs/assetfs
 
 #ESPTOOL2 config to generate rBootLESS images
 IMAGE_MAIN	?= 0x00000.bin
@@ -176,6 +178,10 @@ STRIP   := $(XTENSA_TOOLS_ROOT)/xtensa-lx106-elf-strip
 CURRENT_DIR := $(dir $(abspath $(firstword $(MAKEFILE_LIST))))
 
 SPIFF_FILES ?= files
+# Static content for the read-only asset image, see SmingCore/Data/AssetFS/AssetFileSystem.h
+ASSET_FILES ?= assets
+# File data alignment within the asset image, a flash sector by default
+ASSET_ALIGN ?= 4096
 
 BUILD_BASE	= out/build
 FW_BASE		= out/firmware
@@ -224,6 +230,7 @@ EXTRA_INCDIR += $(SMING_HOME)/include $(SMING_HOME)/ $(LWIP_INCDIR) $(SMING_HOME
 				$(THIRD_PARTY_DIR)/rboot $(THIRD_PARTY_DIR)/rboot/appcode $(THIRD_PARTY_DIR)/spiffs/src
 
 ENABLE_CUSTOM_HEAP ?= 0
+ENABLE_HEAP_POOL ?= 0
  
 USER_LIBDIR = $(SMING_HOME)/compiler/lib/
  
@@ -325,6 +332,12 @@ endif
 
 # linker flags used to generate the main object file
 LDFLAGS		= -nostdlib -u call_user_start -u custom_crash_callback -Wl,-static -Wl,--gc-sections -Wl,-Map=$(FW_BASE)/firmware.map -Wl,-wrap,system_restart_local 
+ifeq ($(ENABLE_CUSTOM_HEAP),1)
+ifeq ($(ENABLE_HEAP_POOL),1)
+	# Send all heap calls through the small object pools in custom_heap/heap_pool.c
+	LDFLAGS += -Wl,-wrap,malloc -Wl,-wrap,free -Wl,-wrap,realloc -Wl,-wrap,calloc
+endif
+endif
 
 # linker script used for the above linkier step
 LD_PATH     = $(SMING_HOME)/compiler/ld
@@ -404,6 +417,12 @@ AS_OBJ		:= $(patsubst %.s,$(BUILD_BASE)/%.o,$(AS_SRC))
 
 OBJ		:= $(AS_OBJ) $(C_OBJ) $(CXX_OBJ)
 
+# The application binds the asset image with IMPORT_FSTR(name, ASSETFS_IMAGE)
+ifneq ($(wildcard $(ASSET_FILES)),)
+	ASSET_BIN_OUT := $(FW_BASE)/assets.bin
+	CFLAGS += -DASSETFS_IMAGE=\"$(abspath $(ASSET_BIN_OUT))\"
+endif
+
 LIBS		:= $(addprefix -l,$(LIBS))
 APP_AR		:= $(addprefix $(BUILD_BASE)/,$(TARGET)_app.a)
 TARGET_OUT	:= $(addprefix $(BUILD_BASE)/,$(TARGET).out)
@@ -528,6 +547,15 @@ $(BUILD_DIR):
 $(FW_BASE):
 	$(Q) mkdir -p $@
 
+ifdef ASSET_BIN_OUT
+# Objects can't tell whether they include the image, so all are rebuilt when it changes
+$(OBJ): $(ASSET_BIN_OUT)
+
+$(ASSET_BIN_OUT): $(shell find $(ASSET_FILES) -type f) | $(FW_BASE)
+	$(vecho) "Creating $@ from $(ASSET_FILES)"
+	$(Q) $(ASSETFS) -a $(ASSET_ALIGN) $(ASSET_FILES) $@
+endif
+
 spiff_clean: 
 	$(vecho) "Cleaning $(SPIFF_BIN_OUT)"
 	$(Q) rm -rf $(SPIFF_BIN_OUT)
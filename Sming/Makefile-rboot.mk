@@ -43,6 +43,8 @@ RBOOT_LD_1 ?= rom1.ld
 ESPTOOL2 ?= $(SMING_HOME)/../tools/esptool2/esptool2
 # path to spiffy
 SPIFFY ?= $(SMING_HOME)/../tools/spiffy/spiffy
+# path to assetfs
+ASSETFS ?= $(SMING_HOME)/../tools/assetfs/assetfs
 INIT_BIN_ADDR  = 0x7c000
 BLANK_BIN_ADDR = 0x4b000
 # filenames and options for generating rBoot rom images with esptool2
@@ -189,6 +191,10 @@ STRIP   := $(XTENSA_TOOLS_ROOT)/xtensa-lx106-elf-strip
 CURRENT_DIR := $(dir $(abspath $(firstword $(MAKEFILE_LIST))))
 
 SPIFF_FILES ?= files
+# Static content for the read-only asset image, see SmingCore/Data/AssetFS/AssetFileSystem.h
+ASSET_FILES ?= assets
+# File data alignment within the asset image, a flash sector by default
+ASSET_ALIGN ?= 4096
 
 BUILD_BASE	= out/build
 FW_BASE		= out/firmware
@@ -275,6 +281,7 @@ CFLAGS  += -DCUST_FILE_BASE=$$* -DDEBUG_VERBOSE_LEVEL=$(DEBUG_VERBOSE_LEVEL) -DD
 CXXFLAGS = $(CFLAGS) -fno-rtti -fno-exceptions -std=c++11 -felide-constructors
 
 ENABLE_CUSTOM_HEAP ?= 0
+ENABLE_HEAP_POOL ?= 0
  
 LIBMAIN = main
 ifeq ($(ENABLE_CUSTOM_HEAP),1)
@@ -365,6 +372,12 @@ endif
 
 # linker flags used to generate the main object file
 LDFLAGS		= -nostdlib -u call_user_start -u Cache_Read_Enable_New -u spiffs_get_storage_config -u custom_crash_callback -Wl,-static -Wl,--gc-sections -Wl,-Map=$(basename $@).map -Wl,-wrap,system_restart_local 
+ifeq ($(ENABLE_CUSTOM_HEAP),1)
+ifeq ($(ENABLE_HEAP_POOL),1)
+	# Send all heap calls through the small object pools in custom_heap/heap_pool.c
+	LDFLAGS += -Wl,-wrap,malloc -Wl,-wrap,free -Wl,-wrap,realloc -Wl,-wrap,calloc
+endif
+endif
 
 ifeq ($(SPI_SPEED), 26)
 	flashimageoptions = -ff 26m
@@ -440,6 +453,12 @@ AS_OBJ		:= $(patsubst %.s,$(BUILD_BASE)/%.o,$(AS_SRC))
 
 OBJ		:= $(AS_OBJ) $(C_OBJ) $(CXX_OBJ)
 
+# The application binds the asset image with IMPORT_FSTR(name, ASSETFS_IMAGE)
+ifneq ($(wildcard $(ASSET_FILES)),)
+	ASSET_BIN_OUT := $(FW_BASE)/assets.bin
+	CFLAGS += -DASSETFS_IMAGE=\"$(abspath $(ASSET_BIN_OUT))\"
+endif
+
 LIBS		:= $(addprefix -l,$(LIBS))
 APP_AR		:= $(addprefix $(BUILD_BASE)/,$(TARGET)_app.a)
 TARGET_OUT_0 := $(addprefix $(BUILD_BASE)/,$(TARGET)_0.out)
@@ -595,6 +614,15 @@ $(BUILD_DIR):
 $(FW_BASE):
 	$(Q) mkdir -p $@
 
+ifdef ASSET_BIN_OUT
+# Objects can't tell whether they include the image, so all are rebuilt when it changes
+$(OBJ): $(ASSET_BIN_OUT)
+
+$(ASSET_BIN_OUT): $(shell find $(ASSET_FILES) -type f) | $(FW_BASE)
+	$(vecho) "Creating $@ from $(ASSET_FILES)"
+	$(Q) $(ASSETFS) -a $(ASSET_ALIGN) $(ASSET_FILES) $@
+endif
+
 spiff_clean: 
 	$(vecho) "Cleaning $(SPIFF_BIN_OUT)"
 	$(Q) rm -rf $(SPIFF_BIN_OUT)
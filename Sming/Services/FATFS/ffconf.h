@@ -8,12 +8,17 @@
 / Functions and Buffer Configurations
 /---------------------------------------------------------------------------*/
 
-#define	_FS_TINY		1
+#ifndef _FS_TINY
+#define	_FS_TINY		0
+#endif
 /* This option switches tiny buffer configuration. (0:Normal or 1:Tiny)
 /  At the tiny configuration, size of the file object (FIL) is reduced _MAX_SS
 /  bytes. Instead of private sector buffer eliminated from the file object,
 /  common sector buffer in the file system object (FATFS) is used for the file
-/  data transfer. */
+/  data transfer.
+/  Sming: with a buffer in each file, writing data doesn't throw the FAT and
+/  directory sectors out of the common buffer, at a cost of 512 bytes of RAM
+/  per open file. */
 
 
 #define _FS_READONLY	0
@@ -47,11 +52,13 @@
 /  f_findfirst() and f_findnext(). (0:Disable or 1:Enable) */
 
 
+#ifndef _USE_MKFS
 #define	_USE_MKFS		0
+#endif
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
-#define	_USE_FASTSEEK	0
+#define	_USE_FASTSEEK	1
 /* This option switches fast seek feature. (0:Disable or 1:Enable) */
 
 
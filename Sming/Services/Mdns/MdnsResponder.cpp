@@ -0,0 +1,999 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * MdnsResponder.cpp
+ *
+ ****/
+
+#include "MdnsResponder.h"
+#include <lwip/igmp.h>
+
+static_assert(1 + MDNS_MAX_SERVICES * 4 <= 32, "MDNS_MAX_SERVICES too large for record masks");
+
+#define MDNS_HEADER_SIZE 12
+#define MDNS_MAX_POINTERS 16   ///< Compression pointers followed in one name
+#define MDNS_WRITER_MAX_NAMES 32 ///< Name offsets remembered for compression
+#define MDNS_LEGACY_TTL 10
+
+#define MDNS_FLAG_QR 0x80
+#define MDNS_FLAG_AA 0x04
+#define MDNS_OPCODE_MASK 0x78
+
+#define MDNS_TYPE_A 1
+#define MDNS_TYPE_PTR 12
+#define MDNS_TYPE_TXT 16
+#define MDNS_TYPE_SRV 33
+#define MDNS_TYPE_ANY 255
+
+#define MDNS_CLASS_IN 1
+#define MDNS_CLASS_ANY 255
+#define MDNS_CLASS_MASK 0x7FFF
+#define MDNS_CACHE_FLUSH 0x8000		 ///< In a record class
+#define MDNS_UNICAST_RESPONSE 0x8000 ///< In a question class
+
+// Response delay for shared records, spread so responders on the network don't collide
+#define MDNS_RESPONSE_DELAY_MIN_MS 20
+#define MDNS_RESPONSE_DELAY_MAX_MS 120
+
+static const uint8_t servicesName[] = "\x09_services\x07_dns-sd\x04_udp\x05local";
+
+static inline uint8_t toLower(uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline uint16_t getUint16(const uint8_t* buffer)
+{
+	return (buffer[0] << 8) | buffer[1];
+}
+
+static inline uint32_t getUint32(const uint8_t* buffer)
+{
+	return (uint32_t(getUint16(buffer)) << 16) | getUint16(buffer + 2);
+}
+
+static inline void setUint16(uint8_t* buffer, uint16_t value)
+{
+	buffer[0] = value >> 8;
+	buffer[1] = value;
+}
+
+static IPAddress getGroupAddress()
+{
+	return IPAddress(224, 0, 0, 251);
+}
+
+/** @brief Get the offset following a name in a packet, or -1 if it is malformed */
+static int skipName(const uint8_t* data, unsigned length, unsigned offset)
+{
+	while(offset < length) {
+		uint8_t labelLength = data[offset];
+		if(labelLength == 0) {
+			return offset + 1;
+		}
+		if((labelLength & 0xC0) == 0xC0) {
+			return (offset + 2 <= length) ? int(offset + 2) : -1;
+		}
+		if(labelLength > 63) {
+			return -1;
+		}
+		offset += labelLength + 1;
+	}
+	return -1;
+}
+
+/** @brief Compare a possibly compressed name in a packet against a wire format name, ignoring case */
+static bool nameEquals(const uint8_t* data, unsigned length, unsigned offset, const uint8_t* name)
+{
+	unsigned jumps = 0;
+	for(;;) {
+		if(offset >= length) {
+			return false;
+		}
+		uint8_t labelLength = data[offset];
+		if((labelLength & 0xC0) == 0xC0) {
+			if(offset + 1 >= length || ++jumps > MDNS_MAX_POINTERS) {
+				return false;
+			}
+			offset = ((labelLength & 0x3F) << 8) | data[offset + 1];
+			continue;
+		}
+		if(labelLength != name[0] || labelLength > 63 || offset + 1 + labelLength > length) {
+			return false;
+		}
+		if(labelLength == 0) {
+			return true;
+		}
+		for(unsigned i = 1; i <= labelLength; ++i) {
+			if(toLower(data[offset + i]) != toLower(name[i])) {
+				return false;
+			}
+		}
+		offset += labelLength + 1;
+		name += labelLength + 1;
+	}
+}
+
+static bool addLabel(MdnsName& name, const char* label, unsigned length)
+{
+	if(length == 0 || length > 63 || name.length + length + 2 > MDNS_MAX_NAME) {
+		return false;
+	}
+	name.data[name.length++] = length;
+	memcpy(&name.data[name.length], label, length);
+	name.length += length;
+	name.data[name.length] = 0;
+	return true;
+}
+
+static bool addLabels(MdnsName& name, const String& labels)
+{
+	const char* s = labels.c_str();
+	unsigned length = labels.length();
+	while(length != 0) {
+		auto dot = static_cast<const char*>(memchr(s, '.', length));
+		unsigned labelLength = (dot == nullptr) ? length : dot - s;
+		if(!addLabel(name, s, labelLength)) {
+			return false;
+		}
+		if(dot == nullptr) {
+			break;
+		}
+		s += labelLength + 1;
+		length -= labelLength + 1;
+	}
+	return true;
+}
+
+static unsigned countBits(uint32_t mask)
+{
+	unsigned count = 0;
+	for(; mask != 0; mask &= mask - 1) {
+		++count;
+	}
+	return count;
+}
+
+/*
+ * Builds a packet, compressing names against those already written.
+ */
+class MdnsResponder::Writer
+{
+public:
+	Writer(uint16_t id, uint8_t flags)
+	{
+		reset(id, flags);
+	}
+
+	void reset(uint16_t id, uint8_t flags)
+	{
+		memset(buffer, 0, MDNS_HEADER_SIZE);
+		setUint16(buffer, id);
+		buffer[2] = flags;
+		pos = MDNS_HEADER_SIZE;
+		nameCount = 0;
+		memset(counts, 0, sizeof(counts));
+	}
+
+	unsigned getPosition() const
+	{
+		return pos;
+	}
+
+	/** @brief Discard everything written after a position, such as a record which didn't fit */
+	void rollback(unsigned position)
+	{
+		pos = position;
+		while(nameCount != 0 && names[nameCount - 1] >= position) {
+			--nameCount;
+		}
+	}
+
+	bool write(const void* data, unsigned length)
+	{
+		if(pos + length > sizeof(buffer)) {
+			return false;
+		}
+		memcpy(&buffer[pos], data, length);
+		pos += length;
+		return true;
+	}
+
+	bool writeUint16(uint16_t value)
+	{
+		if(pos + 2 > sizeof(buffer)) {
+			return false;
+		}
+		setUint16(&buffer[pos], value);
+		pos += 2;
+		return true;
+	}
+
+	bool writeUint32(uint32_t value)
+	{
+		return writeUint16(value >> 16) && writeUint16(value);
+	}
+
+	void setUint16At(unsigned offset, uint16_t value)
+	{
+		setUint16(&buffer[offset], value);
+	}
+
+	bool writeName(const uint8_t* name)
+	{
+		// Look for the longest suffix already in the packet
+		for(const uint8_t* suffix = name; *suffix != 0; suffix += *suffix + 1) {
+			for(unsigned i = 0; i < nameCount; ++i) {
+				if(nameEquals(buffer, pos, names[i], suffix)) {
+					uint16_t pointer = 0xC000 | names[i];
+					return writeLabels(name, suffix - name) && writeUint16(pointer);
+				}
+			}
+		}
+
+		unsigned length = 0;
+		while(name[length] != 0) {
+			length += name[length] + 1;
+		}
+		return writeLabels(name, length) && write("", 1);
+	}
+
+	const uint8_t* finish()
+	{
+		for(unsigned i = 0; i < 4; ++i) {
+			setUint16(&buffer[4 + i * 2], counts[i]);
+		}
+		return buffer;
+	}
+
+public:
+	uint16_t counts[4]; ///< Questions, answers, authority and additional records
+
+private:
+	bool writeLabels(const uint8_t* labels, unsigned length)
+	{
+		if(pos + length > sizeof(buffer)) {
+			return false;
+		}
+		for(unsigned offset = 0; offset < length; offset += labels[offset] + 1) {
+			// Offsets beyond 14 bits can't be pointed to
+			if(nameCount < MDNS_WRITER_MAX_NAMES && pos + offset < 0x4000) {
+				names[nameCount++] = pos + offset;
+			}
+		}
+		return write(labels, length);
+	}
+
+private:
+	uint8_t buffer[MDNS_MAX_PACKET];
+	unsigned pos = 0;
+	uint16_t names[MDNS_WRITER_MAX_NAMES];
+	unsigned nameCount = 0;
+};
+
+bool MdnsService::addText(const String& key, const String& value)
+{
+	unsigned length = key.length() + 1 + value.length();
+	if(key.length() == 0 || length > 255 || text.length() + 1 + length > MDNS_MAX_TEXT) {
+		return false;
+	}
+
+	text += char(length);
+	text += key;
+	text += '=';
+	text += value;
+	return true;
+}
+
+MdnsResponder::MdnsResponder()
+{
+	stateTimer.callback = staticOnStateTimer;
+	stateTimer.arg = this;
+	responseTimer.callback = staticOnResponseTimer;
+	responseTimer.arg = this;
+}
+
+bool MdnsResponder::begin(const String& hostName, IPAddress ip)
+{
+	end();
+
+	if(!setHostName(hostName)) {
+		return false;
+	}
+	baseHostName = hostName;
+	hostRenames = 0;
+	recentConflicts = 0;
+	this->ip = ip;
+
+	if(!listen(MDNS_PORT)) {
+		debug_e("mDNS: port %u unavailable", MDNS_PORT);
+		return false;
+	}
+
+	// Responses must not be routed off the link, and RFC 6762 asks for 255 so receivers can check
+	udp->ttl = 255;
+	IPAddress any;
+	IPAddress group = getGroupAddress();
+	igmp_joingroup(any, group);
+
+	uint32_t now = millis();
+	for(auto& time : lastMulticast) {
+		time = now - MDNS_MIN_MULTICAST_INTERVAL_MS;
+	}
+
+	startProbing();
+	return true;
+}
+
+void MdnsResponder::end()
+{
+	if(state == eMRS_Idle) {
+		return;
+	}
+
+	timerScheduler.disarm(stateTimer);
+	timerScheduler.disarm(responseTimer);
+	pendingAnswers = 0;
+	pendingAdditionals = 0;
+
+	if(state != eMRS_Probing) {
+		sendRecords(getAllRecords(), 0, eRT_Goodbye, getGroupAddress(), MDNS_PORT);
+	}
+	state = eMRS_Idle;
+
+	IPAddress any;
+	IPAddress group = getGroupAddress();
+	igmp_leavegroup(any, group);
+	close();
+}
+
+void MdnsResponder::setIp(IPAddress ip)
+{
+	this->ip = ip;
+	if(state != eMRS_Probing) {
+		announce();
+	}
+}
+
+void MdnsResponder::announce()
+{
+	if(state == eMRS_Idle || state == eMRS_Probing) {
+		return;
+	}
+
+	state = eMRS_Announcing;
+	stateCount = 0;
+	step();
+}
+
+MdnsService* MdnsResponder::addService(const String& instance, const String& type, uint16_t port)
+{
+	if(serviceCount >= MDNS_MAX_SERVICES) {
+		debug_e("mDNS: no room for service '%s'", instance.c_str());
+		return nullptr;
+	}
+
+	auto& service = services[serviceCount];
+	service = MdnsService();
+	service.instance = instance;
+	service.baseInstance = instance;
+	service.type = type;
+	service.port = port;
+	if(!setServiceName(service)) {
+		debug_e("mDNS: invalid service name '%s.%s'", instance.c_str(), type.c_str());
+		return nullptr;
+	}
+	++serviceCount;
+
+	if(state != eMRS_Idle) {
+		startProbing();
+	}
+
+	return &service;
+}
+
+bool MdnsResponder::setHostName(const String& name)
+{
+	MdnsName wire;
+	if(!addLabel(wire, name.c_str(), name.length()) || !addLabel(wire, "local", 5)) {
+		debug_e("mDNS: invalid host name '%s'", name.c_str());
+		return false;
+	}
+
+	hostName = name;
+	hostWire = wire;
+	return true;
+}
+
+bool MdnsResponder::setServiceName(MdnsService& service)
+{
+	MdnsName wire;
+	if(!addLabel(wire, service.instance.c_str(), service.instance.length())) {
+		return false;
+	}
+	uint8_t typeOffset = wire.length;
+	if(service.type.length() == 0 || !addLabels(wire, service.type) || !addLabel(wire, "local", 5)) {
+		return false;
+	}
+
+	service.name = wire;
+	service.typeOffset = typeOffset;
+	return true;
+}
+
+void MdnsResponder::getRecord(unsigned index, Record& record) const
+{
+	if(index == 0) {
+		record = Record{hostWire.data, nullptr, nullptr, MDNS_TYPE_A, MDNS_HOST_TTL, true};
+		return;
+	}
+
+	auto& service = services[(index - 1) / 4];
+	const uint8_t* instanceName = service.name.data;
+	const uint8_t* typeName = &service.name.data[service.typeOffset];
+	switch((index - 1) % 4) {
+	case 0:
+		record = Record{typeName, instanceName, &service, MDNS_TYPE_PTR, MDNS_SERVICE_TTL, false};
+		break;
+	case 1:
+		record = Record{instanceName, hostWire.data, &service, MDNS_TYPE_SRV, MDNS_HOST_TTL, true};
+		break;
+	case 2:
+		record = Record{instanceName, nullptr, &service, MDNS_TYPE_TXT, MDNS_SERVICE_TTL, true};
+		break;
+	default:
+		record = Record{servicesName, typeName, &service, MDNS_TYPE_PTR, MDNS_SERVICE_TTL, false};
+	}
+}
+
+uint32_t MdnsResponder::getAllRecords() const
+{
+	uint32_t records = 0x01;
+	for(unsigned i = 0; i < serviceCount; ++i) {
+		unsigned base = 1 + i * 4;
+		records |= 0x07 << base;
+
+		// Enumerate each type once
+		bool first = true;
+		for(unsigned j = 0; j < i; ++j) {
+			if(services[j].type.equalsIgnoreCase(services[i].type)) {
+				first = false;
+				break;
+			}
+		}
+		if(first) {
+			records |= 0x08 << base;
+		}
+	}
+	return records;
+}
+
+uint32_t MdnsResponder::getSharedRecords() const
+{
+	uint32_t records = 0;
+	for(unsigned i = 0; i < serviceCount; ++i) {
+		records |= 0x09 << (1 + i * 4);
+	}
+	return records & getAllRecords();
+}
+
+uint32_t MdnsResponder::getAdditionals(uint32_t answers) const
+{
+	// RFC 6763 section 12: a PTR brings its SRV, TXT and address, an SRV its address
+	uint32_t additionals = 0;
+	for(unsigned i = 0; i < serviceCount; ++i) {
+		unsigned base = 1 + i * 4;
+		if(answers & (0x01 << base)) {
+			additionals |= (0x06 << base) | 0x01;
+		}
+		if(answers & (0x02 << base)) {
+			additionals |= 0x01;
+		}
+	}
+	return additionals & ~answers;
+}
+
+uint32_t MdnsResponder::matchName(const uint8_t* data, unsigned length, unsigned nameOffset, uint16_t type) const
+{
+	uint32_t matches = 0;
+	uint32_t records = getAllRecords();
+	for(unsigned index = 0; records != 0; ++index, records >>= 1) {
+		if((records & 1) == 0) {
+			continue;
+		}
+		Record record;
+		getRecord(index, record);
+		if((type == MDNS_TYPE_ANY || type == record.type) && nameEquals(data, length, nameOffset, record.name)) {
+			matches |= 1U << index;
+		}
+	}
+	return matches;
+}
+
+bool MdnsResponder::rdataEquals(const Record& record, const uint8_t* data, unsigned length, unsigned rdataOffset,
+								unsigned rdataLength) const
+{
+	const uint8_t* rdata = &data[rdataOffset];
+	switch(record.type) {
+	case MDNS_TYPE_A:
+		return rdataLength == 4 && rdata[0] == ip[0] && rdata[1] == ip[1] && rdata[2] == ip[2] && rdata[3] == ip[3];
+	case MDNS_TYPE_PTR:
+		return nameEquals(data, length, rdataOffset, record.target);
+	case MDNS_TYPE_SRV:
+		return rdataLength > 6 && getUint16(&rdata[4]) == record.service->port &&
+			   nameEquals(data, length, rdataOffset + 6, record.target);
+	case MDNS_TYPE_TXT: {
+		auto& text = record.service->text;
+		if(text.length() == 0) {
+			return rdataLength == 1 && rdata[0] == 0;
+		}
+		return rdataLength == text.length() && memcmp(rdata, text.c_str(), rdataLength) == 0;
+	}
+	default:
+		return false;
+	}
+}
+
+uint32_t MdnsResponder::matchKnownAnswer(const uint8_t* data, unsigned length, unsigned nameOffset, uint16_t type,
+										 uint32_t ttl, unsigned rdataOffset, unsigned rdataLength) const
+{
+	// RFC 6762 section 7.1: a known answer only counts if it has at least half its lifetime left
+	uint32_t matches = 0;
+	uint32_t records = matchName(data, length, nameOffset, type);
+	for(unsigned index = 0; records != 0; ++index, records >>= 1) {
+		if((records & 1) == 0) {
+			continue;
+		}
+		Record record;
+		getRecord(index, record);
+		if(ttl >= record.ttl / 2 && rdataEquals(record, data, length, rdataOffset, rdataLength)) {
+			matches |= 1U << index;
+		}
+	}
+	return matches;
+}
+
+bool MdnsResponder::checkConflict(const uint8_t* data, unsigned length, unsigned nameOffset, uint16_t type,
+								  unsigned rdataOffset, unsigned rdataLength)
+{
+	bool probing = (state == eMRS_Probing);
+
+	// While probing any record using one of our names is a conflict, afterwards only differing unique records
+	if(nameEquals(data, length, nameOffset, hostWire.data)) {
+		Record record;
+		getRecord(0, record);
+		if(probing || (type == MDNS_TYPE_A && !rdataEquals(record, data, length, rdataOffset, rdataLength))) {
+			onConflict(true, 0);
+			return true;
+		}
+	}
+
+	for(unsigned i = 0; i < serviceCount; ++i) {
+		if(!nameEquals(data, length, nameOffset, services[i].name.data)) {
+			continue;
+		}
+		Record record;
+		getRecord(2 + i * 4, record);
+		if(probing || (type == MDNS_TYPE_SRV && !rdataEquals(record, data, length, rdataOffset, rdataLength))) {
+			onConflict(false, i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void MdnsResponder::onReceive(pbuf* buf, IPAddress remoteIP, uint16_t remotePort)
+{
+	// Chained buffers are rare for mDNS packets, only copy those
+	if(buf->len == buf->tot_len) {
+		processPacket(static_cast<const uint8_t*>(buf->payload), buf->len, remoteIP, remotePort);
+	} else {
+		auto data = new uint8_t[buf->tot_len];
+		if(data != nullptr) {
+			pbuf_copy_partial(buf, data, buf->tot_len, 0);
+			processPacket(data, buf->tot_len, remoteIP, remotePort);
+			delete[] data;
+		}
+	}
+}
+
+bool MdnsResponder::processPacket(const uint8_t* data, unsigned length, IPAddress remoteIP, uint16_t remotePort)
+{
+	if(length < MDNS_HEADER_SIZE) {
+		return false;
+	}
+
+	// Ignore our own packets if they are looped back
+	if(state == eMRS_Idle || uint32_t(remoteIP) == uint32_t(ip)) {
+		return true;
+	}
+
+	if((data[2] & MDNS_OPCODE_MASK) != 0) {
+		return true;
+	}
+
+	bool isResponse = (data[2] & MDNS_FLAG_QR) != 0;
+	unsigned questionCount = getUint16(&data[4]);
+	unsigned answerCount = getUint16(&data[6]);
+	unsigned recordCount = answerCount + getUint16(&data[8]) + getUint16(&data[10]);
+
+	if(!isResponse) {
+		++stats.queries;
+	}
+
+	uint32_t answers = 0;
+	bool unicastOnly = true;
+	unsigned offset = MDNS_HEADER_SIZE;
+	for(unsigned i = 0; i < questionCount; ++i) {
+		unsigned nameOffset = offset;
+		int pos = skipName(data, length, offset);
+		if(pos < 0 || unsigned(pos) + 4 > length) {
+			return false;
+		}
+		offset = pos + 4;
+
+		// Names aren't ours until probing completes. Simultaneous probes are not tie-broken.
+		if(isResponse || state == eMRS_Probing) {
+			continue;
+		}
+
+		uint16_t qtype = getUint16(&data[pos]);
+		uint16_t qclass = getUint16(&data[pos + 2]);
+		if((qclass & MDNS_CLASS_MASK) != MDNS_CLASS_IN && (qclass & MDNS_CLASS_MASK) != MDNS_CLASS_ANY) {
+			continue;
+		}
+		answers |= matchName(data, length, nameOffset, qtype);
+		if((qclass & MDNS_UNICAST_RESPONSE) == 0) {
+			unicastOnly = false;
+		}
+	}
+	unsigned questionLength = offset - MDNS_HEADER_SIZE;
+
+	uint32_t known = 0;
+	for(unsigned i = 0; i < recordCount; ++i) {
+		unsigned nameOffset = offset;
+		int pos = skipName(data, length, offset);
+		if(pos < 0 || unsigned(pos) + 10 > length) {
+			return false;
+		}
+		uint16_t type = getUint16(&data[pos]);
+		uint32_t ttl = getUint32(&data[pos + 4]);
+		unsigned rdataLength = getUint16(&data[pos + 8]);
+		unsigned rdataOffset = pos + 10;
+		if(rdataOffset + rdataLength > length) {
+			return false;
+		}
+		offset = rdataOffset + rdataLength;
+
+		if(isResponse) {
+			if(checkConflict(data, length, nameOffset, type, rdataOffset, rdataLength)) {
+				return true;
+			}
+		} else if(i >= answerCount) {
+			// Authority records belong to a probe, additional records aren't known answers
+			continue;
+		}
+
+		if(state != eMRS_Probing && ttl != 0) {
+			known |= matchKnownAnswer(data, length, nameOffset, type, ttl, rdataOffset, rdataLength);
+		}
+	}
+
+	if(isResponse) {
+		// Another responder has just sent what we were about to (RFC 6762 section 7.4)
+		uint32_t duplicates = known & pendingAnswers;
+		stats.suppressed += countBits(duplicates);
+		pendingAnswers &= ~duplicates;
+		return true;
+	}
+
+	if((answers & known) != 0) {
+		stats.suppressed += countBits(answers & known);
+		answers &= ~known;
+	}
+	if(answers == 0) {
+		return true;
+	}
+	uint32_t additionals = getAdditionals(answers) & ~known;
+
+	if(remotePort != MDNS_PORT) {
+		sendRecords(answers, additionals, eRT_Legacy, remoteIP, remotePort, data, questionLength);
+		return true;
+	}
+
+	if(unicastOnly) {
+		sendRecords(answers, additionals, eRT_Unicast, remoteIP, MDNS_PORT);
+		return true;
+	}
+
+	uint32_t now = millis();
+	for(unsigned index = 0; index < ARRAY_SIZE(lastMulticast); ++index) {
+		uint32_t bit = 1U << index;
+		if((answers & bit) && now - lastMulticast[index] < MDNS_MIN_MULTICAST_INTERVAL_MS) {
+			++stats.rateLimited;
+			answers &= ~bit;
+		}
+	}
+	if(answers == 0) {
+		return true;
+	}
+
+	pendingAnswers |= answers;
+	pendingAdditionals |= additionals;
+	if(responseTimer.isArmed()) {
+		++stats.aggregated;
+	} else if(answers & getSharedRecords()) {
+		unsigned delay = MDNS_RESPONSE_DELAY_MIN_MS +
+						 os_random() % (MDNS_RESPONSE_DELAY_MAX_MS - MDNS_RESPONSE_DELAY_MIN_MS + 1);
+		timerScheduler.arm(responseTimer, delay, false);
+	} else {
+		// Only this device can answer for unique records, so there's no need to wait
+		sendPending();
+	}
+
+	return true;
+}
+
+bool MdnsResponder::writeRecord(Writer& writer, unsigned index, ResponseType type) const
+{
+	Record record;
+	getRecord(index, record);
+
+	uint16_t rclass = MDNS_CLASS_IN;
+	if(record.unique && type != eRT_Legacy && type != eRT_Probe) {
+		rclass |= MDNS_CACHE_FLUSH;
+	}
+	uint32_t ttl = record.ttl;
+	if(type == eRT_Goodbye) {
+		ttl = 0;
+	} else if(type == eRT_Legacy && ttl > MDNS_LEGACY_TTL) {
+		ttl = MDNS_LEGACY_TTL;
+	}
+
+	if(!writer.writeName(record.name) || !writer.writeUint16(record.type) || !writer.writeUint16(rclass) ||
+	   !writer.writeUint32(ttl) || !writer.writeUint16(0)) {
+		return false;
+	}
+	unsigned rdataOffset = writer.getPosition();
+
+	bool ok;
+	switch(record.type) {
+	case MDNS_TYPE_A: {
+		const uint8_t address[] = {ip[0], ip[1], ip[2], ip[3]};
+		ok = writer.write(address, sizeof(address));
+		break;
+	}
+	case MDNS_TYPE_PTR:
+		ok = writer.writeName(record.target);
+		break;
+	case MDNS_TYPE_SRV:
+		// Priority and weight are unused with a single target
+		ok = writer.writeUint16(0) && writer.writeUint16(0) && writer.writeUint16(record.service->port) &&
+			 writer.writeName(record.target);
+		break;
+	default: {
+		// An empty TXT record still needs one empty string
+		auto& text = record.service->text;
+		ok = (text.length() == 0) ? writer.write("", 1) : writer.write(text.c_str(), text.length());
+	}
+	}
+	if(!ok) {
+		return false;
+	}
+
+	writer.setUint16At(rdataOffset - 2, writer.getPosition() - rdataOffset);
+	return true;
+}
+
+bool MdnsResponder::send(Writer& writer, IPAddress remoteIP, uint16_t remotePort)
+{
+	unsigned length = writer.getPosition();
+	const uint8_t* data = writer.finish();
+	++stats.packetsSent;
+	return sendPacket(data, length, remoteIP, remotePort);
+}
+
+bool MdnsResponder::sendPacket(const uint8_t* data, unsigned length, IPAddress remoteIP, uint16_t remotePort)
+{
+	return udp != nullptr && sendTo(remoteIP, remotePort, reinterpret_cast<const char*>(data), length);
+}
+
+void MdnsResponder::sendRecords(uint32_t answers, uint32_t additionals, ResponseType type, IPAddress remoteIP,
+								uint16_t remotePort, const uint8_t* query, unsigned questionLength)
+{
+	// Legacy resolvers expect the query ID and question back
+	bool legacy = (type == eRT_Legacy);
+	uint16_t id = legacy ? getUint16(query) : 0;
+	auto start = [&](Writer& writer) {
+		writer.reset(id, MDNS_FLAG_QR | MDNS_FLAG_AA);
+		if(legacy && writer.write(&query[MDNS_HEADER_SIZE], questionLength)) {
+			writer.counts[0] = getUint16(&query[4]);
+		}
+	};
+
+	Writer writer(0, 0);
+	start(writer);
+
+	bool multicast = (type == eRT_Multicast || type == eRT_Goodbye);
+	uint32_t now = millis();
+	for(unsigned section = 1; section <= 3; section += 2) {
+		uint32_t records = (section == 1) ? answers : additionals;
+		for(unsigned index = 0; records != 0; ++index, records >>= 1) {
+			if((records & 1) == 0) {
+				continue;
+			}
+
+			unsigned position = writer.getPosition();
+			if(!writeRecord(writer, index, type)) {
+				writer.rollback(position);
+				// Additional records are optional, but answers that don't fit go in another packet
+				if(section != 1 || writer.counts[1] == 0) {
+					continue;
+				}
+				send(writer, remoteIP, remotePort);
+				start(writer);
+				position = writer.getPosition();
+				if(!writeRecord(writer, index, type)) {
+					debug_w("mDNS: record %u too large", index);
+					writer.rollback(position);
+					continue;
+				}
+			}
+
+			++writer.counts[section];
+			if(section == 1) {
+				++stats.answersSent;
+			}
+			if(multicast) {
+				lastMulticast[index] = now;
+			}
+		}
+	}
+
+	if(writer.counts[1] != 0) {
+		send(writer, remoteIP, remotePort);
+	}
+}
+
+void MdnsResponder::sendPending()
+{
+	uint32_t answers = pendingAnswers;
+	uint32_t additionals = pendingAdditionals & ~answers;
+	pendingAnswers = 0;
+	pendingAdditionals = 0;
+
+	if(answers != 0) {
+		sendRecords(answers, additionals, eRT_Multicast, getGroupAddress(), MDNS_PORT);
+	}
+}
+
+void MdnsResponder::sendProbe()
+{
+	Writer writer(0, 0);
+
+	// The first probe asks for unicast replies, so a conflict is found without adding to multicast traffic
+	uint16_t qclass = MDNS_CLASS_IN | ((stateCount == 0) ? MDNS_UNICAST_RESPONSE : 0);
+	bool ok = writer.writeName(hostWire.data) && writer.writeUint16(MDNS_TYPE_ANY) && writer.writeUint16(qclass);
+	++writer.counts[0];
+	for(unsigned i = 0; ok && i < serviceCount; ++i) {
+		ok = writer.writeName(services[i].name.data) && writer.writeUint16(MDNS_TYPE_ANY) &&
+			 writer.writeUint16(qclass);
+		++writer.counts[0];
+	}
+	if(!ok) {
+		debug_e("mDNS: probe too large");
+		return;
+	}
+
+	// Proposed records go in the authority section
+	uint32_t records = getAllRecords() & ~getSharedRecords();
+	for(unsigned index = 0; records != 0; ++index, records >>= 1) {
+		if((records & 1) == 0) {
+			continue;
+		}
+		unsigned position = writer.getPosition();
+		if(writeRecord(writer, index, eRT_Probe)) {
+			++writer.counts[2];
+		} else {
+			writer.rollback(position);
+		}
+	}
+
+	send(writer, getGroupAddress(), MDNS_PORT);
+}
+
+void MdnsResponder::startProbing()
+{
+	timerScheduler.disarm(responseTimer);
+	pendingAnswers = 0;
+	pendingAdditionals = 0;
+	state = eMRS_Probing;
+	stateCount = 0;
+
+	// A random start keeps devices powered up together from probing in step
+	unsigned delay = 1 + os_random() % MDNS_PROBE_INTERVAL_MS;
+	if(recentConflicts >= MDNS_MAX_CONFLICTS) {
+		delay = MDNS_CONFLICT_HOLDOFF_MS;
+	}
+	timerScheduler.arm(stateTimer, delay, false);
+}
+
+void MdnsResponder::onConflict(bool host, unsigned serviceIndex)
+{
+	++stats.conflicts;
+
+	uint32_t now = millis();
+	if(now - conflictTime >= MDNS_CONFLICT_WINDOW_MS) {
+		conflictTime = now;
+		recentConflicts = 0;
+	}
+	if(recentConflicts < MDNS_MAX_CONFLICTS) {
+		++recentConflicts;
+	}
+
+	// Try "name-2", "name-3", etc. for the host and "Name (2)" etc. for a service instance
+	if(host) {
+		++hostRenames;
+		String name = baseHostName;
+		name += '-';
+		name += hostRenames + 1;
+		debug_w("mDNS: host name '%s' in use, trying '%s'", hostName.c_str(), name.c_str());
+		setHostName(name);
+	} else {
+		auto& service = services[serviceIndex];
+		++service.renames;
+		String instance = service.baseInstance;
+		instance += " (";
+		instance += service.renames + 1;
+		instance += ')';
+		debug_w("mDNS: service '%s' in use, trying '%s'", service.instance.c_str(), instance.c_str());
+		String previous = service.instance;
+		service.instance = instance;
+		if(!setServiceName(service)) {
+			service.instance = previous;
+		}
+	}
+
+	startProbing();
+}
+
+void MdnsResponder::step()
+{
+	if(state == eMRS_Probing) {
+		if(stateCount < 3) {
+			sendProbe();
+			++stateCount;
+			timerScheduler.arm(stateTimer, MDNS_PROBE_INTERVAL_MS, false);
+			return;
+		}
+
+		debug_d("mDNS: %s.local is ours", hostName.c_str());
+		state = eMRS_Announcing;
+		stateCount = 0;
+	}
+
+	if(state == eMRS_Announcing) {
+		timerScheduler.disarm(stateTimer);
+		sendRecords(getAllRecords(), 0, eRT_Multicast, getGroupAddress(), MDNS_PORT);
+		++stateCount;
+		if(stateCount < 2) {
+			timerScheduler.arm(stateTimer, MDNS_ANNOUNCE_INTERVAL_MS, false);
+		} else {
+			state = eMRS_Running;
+		}
+	}
+}
+
+void MdnsResponder::staticOnStateTimer(void* arg)
+{
+	static_cast<MdnsResponder*>(arg)->step();
+}
+
+void MdnsResponder::staticOnResponseTimer(void* arg)
+{
+	static_cast<MdnsResponder*>(arg)->sendPending();
+}
@@ -0,0 +1,279 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * MdnsResponder.h
+ *
+ * Multicast DNS (RFC 6762) and DNS service discovery (RFC 6763) responder.
+ *
+ * Answers for "<host>.local" and for each registered service instance, e.g.
+ * "Kitchen._http._tcp.local", after probing to make sure the names are unique
+ * and announcing them. To keep multicast traffic down:
+ * - answers the querier already holds (known-answer list) are not sent
+ * - answers to queries arriving within the response delay go out in one packet
+ * - a record is multicast at most once a second
+ * - questions asking for a unicast reply, and legacy resolvers not using port
+ *   5353, are answered directly
+ *
+ * Packets may be fed to processPacket() and captured by overriding
+ * sendPacket(), so the responder can be exercised without a network.
+ *
+ * Simultaneous probe tie-breaking and multi-packet known-answer lists are not
+ * implemented: a conflict always renames this device, and only the known
+ * answers in the query packet itself are considered.
+ *
+ ****/
+
+/** @defgroup   mdns mDNS responder
+ *  @brief      Advertises the device and its services on the local network
+ *  @ingroup    udp
+ *  @{
+ */
+
+#ifndef _SMING_SERVICES_MDNS_RESPONDER_H_
+#define _SMING_SERVICES_MDNS_RESPONDER_H_
+
+#include "Network/UdpConnection.h"
+#include "TimerScheduler.h"
+#include "WString.h"
+
+#define MDNS_PORT 5353
+
+/** @brief Number of services which may be registered, at most 7 */
+#ifndef MDNS_MAX_SERVICES
+#define MDNS_MAX_SERVICES 4
+#endif
+
+/** @brief Largest packet sent, larger responses are split */
+#ifndef MDNS_MAX_PACKET
+#define MDNS_MAX_PACKET 512
+#endif
+
+/** @brief Longest name in wire format, the instance label plus service type */
+#ifndef MDNS_MAX_NAME
+#define MDNS_MAX_NAME 128
+#endif
+
+/** @brief Longest TXT record */
+#ifndef MDNS_MAX_TEXT
+#define MDNS_MAX_TEXT 200
+#endif
+
+#define MDNS_HOST_TTL 120	 ///< Seconds, records containing the host name
+#define MDNS_SERVICE_TTL 4500 ///< Seconds, other records
+
+#define MDNS_PROBE_INTERVAL_MS 250
+#define MDNS_ANNOUNCE_INTERVAL_MS 1000
+#define MDNS_MIN_MULTICAST_INTERVAL_MS 1000 ///< Minimum time between multicasts of a record
+
+// After 15 conflicts within 10 seconds wait 5 seconds before each further attempt
+#define MDNS_MAX_CONFLICTS 15
+#define MDNS_CONFLICT_WINDOW_MS 10000
+#define MDNS_CONFLICT_HOLDOFF_MS 5000
+
+enum MdnsResponderState {
+	eMRS_Idle = 0,
+	eMRS_Probing,
+	eMRS_Announcing,
+	eMRS_Running,
+};
+
+typedef struct {
+	uint32_t queries = 0;	 ///< Query packets received
+	uint32_t packetsSent = 0; ///< Response, probe and announcement packets sent
+	uint32_t answersSent = 0; ///< Records sent in answer sections
+	uint32_t suppressed = 0;  ///< Answers left out because the querier already knew them
+	uint32_t aggregated = 0;  ///< Queries answered in a response already scheduled for another query
+	uint32_t rateLimited = 0; ///< Answers left out because the record was multicast within the last second
+	uint32_t conflicts = 0;   ///< Names which had to be changed because another device claimed them
+} MdnsResponderStats;
+
+/** @brief A name in DNS wire format: length-prefixed labels ending in a zero-length label */
+struct MdnsName {
+	uint8_t length = 0; ///< Excluding the terminating zero
+	uint8_t data[MDNS_MAX_NAME] = {0};
+};
+
+class MdnsService
+{
+	friend class MdnsResponder;
+
+public:
+	/** @brief Add a "key=value" entry to the service's TXT record
+	 *  @retval bool false if the entry is too long
+	 *  @note Call MdnsResponder::announce() after changing entries of a running service
+	 */
+	bool addText(const String& key, const String& value);
+
+	void clearText()
+	{
+		text = nullptr;
+	}
+
+	/** @brief Get the instance name, which may have changed after a conflict */
+	const String& getInstance() const
+	{
+		return instance;
+	}
+
+	/** @brief Get the service type, e.g. "_http._tcp" */
+	const String& getType() const
+	{
+		return type;
+	}
+
+	uint16_t getPort() const
+	{
+		return port;
+	}
+
+private:
+	String instance;
+	String baseInstance; ///< Instance name as registered, before any renaming
+	String type;
+	String text;			///< TXT record data, length-prefixed strings
+	MdnsName name;			///< Instance name, e.g. "Kitchen._http._tcp.local"
+	uint8_t typeOffset = 0; ///< Start of the service type within `name`
+	uint8_t renames = 0;
+	uint16_t port = 0;
+};
+
+class MdnsResponder : protected UdpConnection
+{
+public:
+	MdnsResponder();
+
+	virtual ~MdnsResponder()
+	{
+		end();
+	}
+
+	/** @brief Start responding for a host name
+	 *  @param hostName Name without the ".local" domain
+	 *  @param ip Address of the interface to advertise
+	 *  @retval bool false if the name is invalid or the socket could not be opened
+	 *  @note Probing takes about a second, the name is not answered for until it completes
+	 */
+	bool begin(const String& hostName, IPAddress ip);
+
+	/** @brief Stop, telling other hosts to drop cached records */
+	void end();
+
+	/** @brief Change the advertised address, e.g. after reconnecting to the network */
+	void setIp(IPAddress ip);
+
+	/** @brief Announce all records again, e.g. after changing TXT entries */
+	void announce();
+
+	/** @brief Register a service
+	 *  @param instance Instance name, e.g. "Kitchen light"
+	 *  @param type Service type, e.g. "_http._tcp"
+	 *  @param port
+	 *  @retval MdnsService* Add TXT entries through this, nullptr if there is no room or a name is invalid
+	 *  @note Services are kept across end() and begin(). Adding one while running probes all names again.
+	 */
+	MdnsService* addService(const String& instance, const String& type, uint16_t port);
+
+	/** @brief Get the host name, which may have changed after a conflict */
+	const String& getHostName() const
+	{
+		return hostName;
+	}
+
+	MdnsResponderState getState() const
+	{
+		return state;
+	}
+
+	const MdnsResponderStats& getStats() const
+	{
+		return stats;
+	}
+
+	/** @brief Handle a received packet
+	 *  @retval bool false if the packet was malformed
+	 */
+	bool processPacket(const uint8_t* data, unsigned length, IPAddress remoteIP, uint16_t remotePort);
+
+protected:
+	virtual void onReceive(pbuf* buf, IPAddress remoteIP, uint16_t remotePort);
+
+	/** @brief Send a packet, override to capture output */
+	virtual bool sendPacket(const uint8_t* data, unsigned length, IPAddress remoteIP, uint16_t remotePort);
+
+private:
+	enum ResponseType {
+		eRT_Multicast,
+		eRT_Unicast, ///< Question asked for a unicast reply
+		eRT_Legacy,  ///< Resolver not using port 5353, echoes the question and caps TTLs
+		eRT_Probe,   ///< Proposed records in a probe, without the cache-flush bit
+		eRT_Goodbye, ///< Zero TTL, telling caches to drop the records
+	};
+
+	/*
+	 * Records are numbered for use in bit masks. Record 0 is the host address,
+	 * followed by four records for each service: PTR from the service type to
+	 * the instance, SRV, TXT and the PTR from the service enumeration name to
+	 * the service type. The enumeration PTR is only used for the first service
+	 * of each type.
+	 */
+	struct Record {
+		const uint8_t* name;
+		const uint8_t* target; ///< PTR or SRV target name
+		const MdnsService* service;
+		uint16_t type;
+		uint32_t ttl;
+		bool unique; ///< Owned by this device alone, sent with the cache-flush bit
+	};
+
+	class Writer;
+
+	void getRecord(unsigned index, Record& record) const;
+	uint32_t getAllRecords() const;
+	uint32_t getSharedRecords() const;
+	uint32_t getAdditionals(uint32_t answers) const;
+	uint32_t matchName(const uint8_t* data, unsigned length, unsigned nameOffset, uint16_t type) const;
+	uint32_t matchKnownAnswer(const uint8_t* data, unsigned length, unsigned nameOffset, uint16_t type, uint32_t ttl,
+							  unsigned rdataOffset, unsigned rdataLength) const;
+	bool rdataEquals(const Record& record, const uint8_t* data, unsigned length, unsigned rdataOffset,
+					 unsigned rdataLength) const;
+	bool checkConflict(const uint8_t* data, unsigned length, unsigned nameOffset, uint16_t type,
+					   unsigned rdataOffset, unsigned rdataLength);
+	bool writeRecord(Writer& writer, unsigned index, ResponseType type) const;
+	bool send(Writer& writer, IPAddress remoteIP, uint16_t remotePort);
+	void sendRecords(uint32_t answers, uint32_t additionals, ResponseType type, IPAddress remoteIP,
+					 uint16_t remotePort, const uint8_t* query = nullptr, unsigned questionLength = 0);
+	void sendProbe();
+	void sendPending();
+	void startProbing();
+	void onConflict(bool host, unsigned serviceIndex);
+	void step();
+	bool setHostName(const String& name);
+	static bool setServiceName(MdnsService& service);
+	static void staticOnStateTimer(void* arg);
+	static void staticOnResponseTimer(void* arg);
+
+private:
+	String hostName;
+	String baseHostName; ///< Host name as passed to begin(), before any renaming
+	MdnsName hostWire;
+	IPAddress ip;
+	MdnsService services[MDNS_MAX_SERVICES];
+	uint8_t serviceCount = 0;
+	MdnsResponderState state = eMRS_Idle;
+	uint8_t stateCount = 0; ///< Probes or announcements sent
+	uint8_t hostRenames = 0;
+	uint8_t recentConflicts = 0;
+	uint32_t conflictTime = 0;		///< millis() at the start of the conflict window
+	uint32_t pendingAnswers = 0;	///< Records awaiting a multicast response
+	uint32_t pendingAdditionals = 0;
+	uint32_t lastMulticast[1 + MDNS_MAX_SERVICES * 4] = {}; ///< millis() per record
+	TimerScheduler::Entry stateTimer;
+	TimerScheduler::Entry responseTimer;
+	MdnsResponderStats stats;
+};
+
+/** @} */
+#endif /* _SMING_SERVICES_MDNS_RESPONDER_H_ */
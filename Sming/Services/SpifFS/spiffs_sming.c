@@ -1,10 +1,14 @@
 #include "spiffs_sming.h"
+#include "spiffs_nucleus.h"
 
 spiffs _filesystemStorageHandle;
 
+static spiffs_sming_stats fs_stats;
+static bool gc_running;
+
 static u8_t spiffs_work_buf[LOG_PAGE_SIZE*2];
 static u8_t spiffs_fds[32*7]; // sizeof(spiffs_fd) * K
-static u8_t spiffs_cache[(LOG_PAGE_SIZE+32)*4];
+static u8_t spiffs_cache_buf[(LOG_PAGE_SIZE+32)*4];
 
 static s32_t api_spiffs_read(u32_t addr, u32_t size, u8_t *dst)
 {
@@ -22,11 +26,20 @@ static s32_t api_spiffs_write(u32_t addr, u32_t size, u8_t *src)
 static s32_t api_spiffs_erase(u32_t addr, u32_t size)
 {
   debugf("api_spiffs_erase");
+  u32_t start = system_get_time();
   u32_t sect_first = flashmem_get_sector_of_address(addr);
   u32_t sect_last = sect_first;
   while( sect_first <= sect_last )
     if( !flashmem_erase_sector( sect_first ++ ) )
       return SPIFFS_ERR_INTERNAL;
+
+  u32_t elapsed = system_get_time() - start;
+  fs_stats.erase_count++;
+  fs_stats.erase_time += elapsed;
+  if (elapsed > fs_stats.erase_time_max)
+    fs_stats.erase_time_max = elapsed;
+  if (gc_running)
+    fs_stats.gc_erase_count++;
   return SPIFFS_OK;
 } 
 
@@ -122,10 +135,11 @@ static void spiffs_mount_internal(spiffs_config *cfg)
     spiffs_work_buf,
     spiffs_fds,
     sizeof(spiffs_fds),
-    spiffs_cache,
-    sizeof(spiffs_cache),
+    spiffs_cache_buf,
+    sizeof(spiffs_cache_buf),
     NULL);
   debugf("mount res: %d\n", res);
+  spiffs_reset_stats();
 
   if (writeFirst)
   {
@@ -183,3 +197,142 @@ bool spiffs_format_manual(u32_t phys_addr, u32_t phys_size)
   spiffs_mount_manual(phys_addr, phys_size);
   return true;
 }
+
+static s32_t spiffs_free_pages(spiffs *fs)
+{
+  // As calculated by spiffs_gc_check()
+  return (SPIFFS_PAGES_PER_BLOCK(fs) - SPIFFS_OBJ_LOOKUP_PAGES(fs)) * (fs->block_count - 2)
+      - fs->stats_p_allocated - fs->stats_p_deleted;
+}
+
+// Compacting moves live pages, so only do it when free blocks are running low and it will recover at least a block
+static bool spiffs_compaction_wanted(spiffs *fs)
+{
+  return fs->free_blocks <= SPIFFS_GC_FREE_BLOCKS && fs->stats_p_deleted >= SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(fs);
+}
+
+/* Reclaim space ahead of time, so writes don't have to stall while GC runs.
+ * Work is done a block at a time until time_slice (in microseconds) has been
+ * used. A block takes tens of milliseconds, or longer if live pages must be
+ * moved, so the slice can overrun by that much.
+ * Returns the number of blocks reclaimed, 0 if there was nothing to do, or a
+ * negative SPIFFS error code.
+ */
+s32_t spiffs_gc_step(u32_t time_slice)
+{
+  spiffs *fs = &_filesystemStorageHandle;
+  if (!SPIFFS_mounted(fs))
+	return SPIFFS_ERR_NOT_MOUNTED;
+
+  u32_t start = system_get_time();
+  u32_t elapsed;
+  s32_t blocks = 0;
+  s32_t res;
+  gc_running = true;
+  do {
+	// Blocks holding nothing but deleted pages just need erasing
+	res = SPIFFS_gc_quick(fs, 0);
+	if (res == SPIFFS_ERR_NO_DELETED_BLOCKS)
+	{
+	  if (!spiffs_compaction_wanted(fs))
+	  {
+		res = SPIFFS_OK;
+		break;
+	  }
+	  // Asking for all the free space makes SPIFFS compact its best candidate block
+	  u32_t free_blocks = fs->free_blocks;
+	  s32_t free_pages = spiffs_free_pages(fs);
+	  res = SPIFFS_gc(fs, free_pages > 0 ? free_pages * SPIFFS_DATA_PAGE_SIZE(fs) : 0);
+	  if (res == SPIFFS_OK && fs->free_blocks <= free_blocks)
+		break; // No candidate
+	}
+	if (res < 0)
+	  break;
+	blocks++;
+	elapsed = system_get_time() - start;
+  } while (elapsed < time_slice);
+  gc_running = false;
+
+  if (res < 0)
+  {
+	debugf("gc step errno %d\n", res);
+	if (blocks == 0)
+	  return res;
+  }
+  SPIFFS_clearerr(fs);
+
+  if (blocks != 0)
+  {
+	elapsed = system_get_time() - start;
+	fs_stats.gc_steps++;
+	fs_stats.gc_time += elapsed;
+	if (elapsed > fs_stats.gc_time_max)
+	  fs_stats.gc_time_max = elapsed;
+  }
+  return blocks;
+}
+
+u16_t spiffs_get_block_erase_count(u32_t block)
+{
+  spiffs *fs = &_filesystemStorageHandle;
+  spiffs_obj_id count = 0;
+  if (SPIFFS_mounted(fs) && block < fs->block_count)
+	flashmem_read(&count, SPIFFS_ERASE_COUNT_PADDR(fs, block), sizeof(count));
+  return count;
+}
+
+void spiffs_get_stats(spiffs_sming_stats *stats)
+{
+  spiffs *fs = &_filesystemStorageHandle;
+  *stats = fs_stats;
+  if (!SPIFFS_mounted(fs))
+	return;
+
+  stats->block_count = fs->block_count;
+  stats->free_blocks = fs->free_blocks;
+  stats->pages_total = (SPIFFS_PAGES_PER_BLOCK(fs) - SPIFFS_OBJ_LOOKUP_PAGES(fs)) * (fs->block_count - 2);
+  stats->pages_used = fs->stats_p_allocated;
+  stats->pages_deleted = fs->stats_p_deleted;
+  stats->pages_free = spiffs_free_pages(fs);
+
+  stats->block_erase_min = 0xFFFF;
+  stats->block_erase_max = 0;
+  u32_t block;
+  for (block = 0; block < fs->block_count; block++)
+  {
+	u16_t count = spiffs_get_block_erase_count(block);
+	if (count < stats->block_erase_min)
+	  stats->block_erase_min = count;
+	if (count > stats->block_erase_max)
+	  stats->block_erase_max = count;
+  }
+
+#if SPIFFS_GC_STATS
+  stats->gc_runs = fs->stats_gc_runs;
+#endif
+#if SPIFFS_CACHE && SPIFFS_CACHE_STATS
+  stats->cache_hits = fs->cache_hits;
+  stats->cache_misses = fs->cache_misses;
+#endif
+}
+
+void spiffs_reset_stats()
+{
+  spiffs *fs = &_filesystemStorageHandle;
+  memset(&fs_stats, 0, sizeof(fs_stats));
+#if SPIFFS_GC_STATS
+  fs->stats_gc_runs = 0;
+#endif
+#if SPIFFS_CACHE && SPIFFS_CACHE_STATS
+  fs->cache_hits = 0;
+  fs->cache_misses = 0;
+#endif
+}
+
+void spiffs_record_write(u32_t elapsed)
+{
+  fs_stats.write_count++;
+  fs_stats.write_time += elapsed;
+  if (elapsed > fs_stats.write_time_max)
+	fs_stats.write_time_max = elapsed;
+}
@@ -9,6 +9,37 @@ extern "C" {
 
 #define LOG_PAGE_SIZE       256
 
+/* Writes start garbage collection when 3 or fewer blocks are free, so
+ * background collection starts compacting a little before that */
+#ifndef SPIFFS_GC_FREE_BLOCKS
+#define SPIFFS_GC_FREE_BLOCKS   5
+#endif
+
+/* Storage telemetry. Counters run from mount, times are in microseconds */
+typedef struct {
+  u32_t block_count;
+  u32_t free_blocks;
+  u32_t pages_total;      // data pages, excluding lookup pages and the blocks GC keeps in reserve
+  u32_t pages_used;
+  u32_t pages_deleted;    // reclaimable by garbage collection
+  s32_t pages_free;
+  u16_t block_erase_min;  // lifetime erase counts kept in flash by SPIFFS
+  u16_t block_erase_max;
+  u32_t erase_count;
+  u32_t erase_time;
+  u32_t erase_time_max;
+  u32_t gc_erase_count;   // erases done by spiffs_gc_step(), the rest stalled a write
+  u32_t gc_runs;          // GC passes by SPIFFS, including background scans
+  u32_t gc_steps;         // background steps which reclaimed space
+  u32_t gc_time;
+  u32_t gc_time_max;
+  u32_t write_count;      // file writes, flushes and closes
+  u32_t write_time;
+  u32_t write_time_max;
+  u32_t cache_hits;
+  u32_t cache_misses;
+} spiffs_sming_stats;
+
 void spiffs_mount();
 void spiffs_mount_manual(u32_t phys_addr, u32_t phys_size);
 void spiffs_unmount();
@@ -17,6 +48,12 @@ bool spiffs_format_internal(spiffs_config *cfg);
 bool spiffs_format_manual(u32_t phys_addr, u32_t phys_size);
 spiffs_config spiffs_get_storage_config();
 
+s32_t spiffs_gc_step(u32_t time_slice);
+void spiffs_get_stats(spiffs_sming_stats *stats);
+void spiffs_reset_stats();
+u16_t spiffs_get_block_erase_count(u32_t block);
+void spiffs_record_write(u32_t elapsed);
+
 extern spiffs _filesystemStorageHandle;
 
 #if defined(__cplusplus)
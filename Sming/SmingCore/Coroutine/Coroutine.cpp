@@ -0,0 +1,231 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * Coroutine.cpp
+ *
+ ****/
+
+#include "Coroutine.h"
+#include <stdlib.h>
+
+Coroutine::~Coroutine()
+{
+	if(state == eCRS_Running) {
+		// step() would carry on with the freed object once run() returns
+		abort();
+	}
+
+	stop();
+}
+
+bool Coroutine::start()
+{
+	if(state != eCRS_Idle) {
+		return false;
+	}
+
+	crLine = 0;
+	stepCount = 0;
+	wakePending = false;
+	++scheduler.activeCount;
+	state = eCRS_Ready;
+	scheduler.schedule(*this);
+	return true;
+}
+
+void Coroutine::cancel()
+{
+	switch(state) {
+	case eCRS_Idle:
+		return;
+
+	case eCRS_Running:
+		// Cancelled from within run(), so stop when it returns
+		cancelled = true;
+		return;
+
+	default:
+		onStop();
+		stop();
+	}
+}
+
+void Coroutine::stop()
+{
+	switch(state) {
+	case eCRS_Idle:
+		return;
+
+	case eCRS_Ready:
+		scheduler.unschedule(*this);
+		break;
+
+	default:;
+	}
+
+	scheduler.disarmTimer(timer);
+	releaseAll();
+	crLine = 0;
+	state = eCRS_Idle;
+	--scheduler.activeCount;
+}
+
+void Coroutine::wake()
+{
+	switch(state) {
+	case eCRS_Waiting:
+		scheduler.disarmTimer(timer);
+		state = eCRS_Ready;
+		scheduler.schedule(*this);
+		break;
+
+	case eCRS_Running:
+		wakePending = true;
+		break;
+
+	default:; // Already queued, or not started
+	}
+}
+
+void Coroutine::sleep(uint32_t milliseconds)
+{
+	timer.callback = [](void* arg) { static_cast<Coroutine*>(arg)->wake(); };
+	timer.arg = this;
+	scheduler.armTimer(timer, milliseconds);
+}
+
+void* Coroutine::allocate(size_t size)
+{
+	size_t blockSize = sizeof(MemoryBlock) + size;
+	if(memoryUsed + blockSize > memoryBudget) {
+		return nullptr;
+	}
+
+	auto block = static_cast<MemoryBlock*>(malloc(blockSize));
+	if(block == nullptr) {
+		return nullptr;
+	}
+
+	block->size = blockSize;
+	block->next = memory;
+	memory = block;
+	memoryUsed += blockSize;
+	return block + 1;
+}
+
+void Coroutine::release(void* ptr)
+{
+	if(ptr == nullptr) {
+		return;
+	}
+
+	auto target = static_cast<MemoryBlock*>(ptr) - 1;
+	for(MemoryBlock** pblock = &memory; *pblock != nullptr; pblock = &(*pblock)->next) {
+		if(*pblock == target) {
+			*pblock = target->next;
+			memoryUsed -= target->size;
+			free(target);
+			return;
+		}
+	}
+}
+
+void Coroutine::releaseAll()
+{
+	while(memory != nullptr) {
+		MemoryBlock* next = memory->next;
+		free(memory);
+		memory = next;
+	}
+	memoryUsed = 0;
+}
+
+void Coroutine::step()
+{
+	state = eCRS_Running;
+	waitRequested = false;
+	finished = false;
+	cancelled = false;
+	++stepCount;
+
+	run();
+
+	if(finished || cancelled) {
+		bool completed = !cancelled;
+		onStop();
+		stop();
+		if(completed) {
+			// May delete this coroutine so must come last
+			onFinished();
+		}
+		return;
+	}
+
+	if(waitRequested && !wakePending) {
+		state = eCRS_Waiting;
+		return;
+	}
+
+	wakePending = false;
+	state = eCRS_Ready;
+	scheduler.schedule(*this);
+}
+
+bool CoroutineScheduler::runNext()
+{
+	Coroutine* coroutine = head;
+	if(coroutine == nullptr) {
+		return false;
+	}
+
+	head = coroutine->next;
+	if(head == nullptr) {
+		tail = nullptr;
+	}
+	coroutine->next = nullptr;
+	--readyCount;
+
+	coroutine->step();
+
+	return head != nullptr;
+}
+
+void CoroutineScheduler::schedule(Coroutine& coroutine)
+{
+	coroutine.next = nullptr;
+	if(tail == nullptr) {
+		head = &coroutine;
+	} else {
+		tail->next = &coroutine;
+	}
+	tail = &coroutine;
+
+	if(++readyCount == 1) {
+		signal();
+	}
+}
+
+void CoroutineScheduler::unschedule(Coroutine& coroutine)
+{
+	Coroutine* prev = nullptr;
+	for(Coroutine* c = head; c != nullptr; prev = c, c = c->next) {
+		if(c != &coroutine) {
+			continue;
+		}
+
+		if(prev == nullptr) {
+			head = c->next;
+		} else {
+			prev->next = c->next;
+		}
+		if(tail == c) {
+			tail = prev;
+		}
+		c->next = nullptr;
+		--readyCount;
+		return;
+	}
+}
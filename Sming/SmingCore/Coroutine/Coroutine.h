@@ -0,0 +1,276 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * Coroutine.h
+ *
+ * Stackless cooperative coroutines. A coroutine's run() method is re-entered
+ * each time it is resumed and continues from the last CR_xxx statement, so
+ * multi-step I/O can be written as straight-line code rather than a state
+ * machine, without blocking the SDK loop.
+ *
+ * Because there is no separate stack, local variables do not survive across
+ * CR_YIELD/CR_WAIT: keep state in member variables or budgeted memory.
+ *
+ * This file has no SDK dependencies; platform bindings are provided by a
+ * CoroutineScheduler implementation (see SystemCoroutine.h).
+ *
+ ****/
+
+/** @defgroup   coroutine Coroutines
+ *  @brief      Cooperative multi-step task execution
+ *  @{
+ */
+
+#ifndef _SMING_CORE_COROUTINE_H_
+#define _SMING_CORE_COROUTINE_H_
+
+#include "../TimerWheel.h"
+
+class CoroutineScheduler;
+
+/** @brief Mark start of coroutine body in run() */
+#define CR_BEGIN()                                                                                                     \
+	switch(crLine) {                                                                                                   \
+	case 0:
+
+/** @brief Give other coroutines and the system a chance to run, then continue */
+#define CR_YIELD()                                                                                                     \
+	do {                                                                                                               \
+		crLine = __LINE__;                                                                                             \
+		return;                                                                                                        \
+	case __LINE__:;                                                                                                    \
+	} while(0)
+
+/** @brief Suspend until wake() is called */
+#define CR_WAIT()                                                                                                      \
+	do {                                                                                                               \
+		crLine = __LINE__;                                                                                             \
+		suspend();                                                                                                     \
+		return;                                                                                                        \
+	case __LINE__:;                                                                                                    \
+	} while(0)
+
+/** @brief Suspend until condition is true, re-evaluated each time wake() is called */
+#define CR_WAIT_UNTIL(condition)                                                                                       \
+	do {                                                                                                               \
+		crLine = __LINE__;                                                                                             \
+	case __LINE__:                                                                                                     \
+		if(!(condition)) {                                                                                             \
+			suspend();                                                                                                 \
+			return;                                                                                                    \
+		}                                                                                                              \
+	} while(0)
+
+/** @brief Suspend for a number of milliseconds */
+#define CR_SLEEP(milliseconds)                                                                                         \
+	do {                                                                                                               \
+		sleep(milliseconds);                                                                                           \
+		CR_WAIT();                                                                                                     \
+	} while(0)
+
+/** @brief Mark end of coroutine body in run() */
+#define CR_END()                                                                                                       \
+	}                                                                                                                  \
+	finish()
+
+/** @brief Default maximum memory a coroutine may obtain via allocate() */
+#ifndef COROUTINE_DEFAULT_MEMORY_BUDGET
+#define COROUTINE_DEFAULT_MEMORY_BUDGET 1024
+#endif
+
+enum CoroutineState {
+	eCRS_Idle,	///< Not started, or finished
+	eCRS_Ready,   ///< Queued to run
+	eCRS_Running, ///< Currently executing
+	eCRS_Waiting, ///< Suspended until woken
+};
+
+class Coroutine
+{
+	friend class CoroutineScheduler;
+
+public:
+	Coroutine(CoroutineScheduler& scheduler) : scheduler(scheduler)
+	{
+	}
+
+	/** @brief Stops the coroutine, without calling onStop()
+	 *  @note By the time this runs the derived class has gone, so subclasses which
+	 *  override onStop() must call cancel() in their own destructor.
+	 *  A coroutine must not be destroyed from within its own run().
+	 */
+	virtual ~Coroutine();
+
+	/** @brief Start the coroutine from the beginning
+	 *  @retval bool false if it is already active
+	 */
+	bool start();
+
+	/** @brief Stop the coroutine and release any memory it allocated
+	 *  @note If called from within run() the coroutine stops when run() returns,
+	 *  and onFinished() is not called.
+	 */
+	void cancel();
+
+	/** @brief Resume a waiting coroutine
+	 *  @note Safe to call at any time: if the coroutine is running the wakeup
+	 *  is remembered and the following wait returns immediately.
+	 */
+	void wake();
+
+	CoroutineState getState() const
+	{
+		return state;
+	}
+
+	bool isActive() const
+	{
+		return state != eCRS_Idle;
+	}
+
+	/** @brief Set the limit for memory obtained via allocate() */
+	void setMemoryBudget(size_t budget)
+	{
+		memoryBudget = budget;
+	}
+
+	size_t getMemoryBudget() const
+	{
+		return memoryBudget;
+	}
+
+	/** @brief Memory currently allocated against the budget, including overheads */
+	size_t getMemoryUsed() const
+	{
+		return memoryUsed;
+	}
+
+	/** @brief Number of times run() has been called since start() */
+	uint32_t getStepCount() const
+	{
+		return stepCount;
+	}
+
+protected:
+	/** @brief Coroutine body, enclosed by CR_BEGIN() and CR_END() */
+	virtual void run() = 0;
+
+	/** @brief Called when the coroutine runs to completion, but not if it is cancelled
+	 *  @note The coroutine is idle by now, so it may be restarted or deleted from here
+	 */
+	virtual void onFinished()
+	{
+	}
+
+	/** @brief Called when the coroutine finishes or is cancelled, before budgeted memory is released */
+	virtual void onStop()
+	{
+	}
+
+	/** @brief Allocate memory against this coroutine's budget
+	 *  @retval void* nullptr if the budget would be exceeded or the heap is exhausted
+	 *  @note Memory still allocated when the coroutine finishes or is cancelled is freed automatically
+	 */
+	void* allocate(size_t size);
+
+	/** @brief Release memory obtained from allocate() */
+	void release(void* ptr);
+
+	/** @brief Arm the coroutine's timer, it is woken on expiry. Use CR_SLEEP(). */
+	void sleep(uint32_t milliseconds);
+
+	/** @brief Used by CR_WAIT() */
+	void suspend()
+	{
+		waitRequested = true;
+	}
+
+	/** @brief Used by CR_END() */
+	void finish()
+	{
+		finished = true;
+	}
+
+protected:
+	int crLine = 0; ///< Resume point within run()
+
+private:
+	struct MemoryBlock {
+		MemoryBlock* next;
+		size_t size;
+	};
+
+	void step();
+	void stop();
+	void releaseAll();
+
+private:
+	CoroutineScheduler& scheduler;
+	Coroutine* next = nullptr; ///< Link in scheduler ready queue
+	TimerWheel::Entry timer;
+	MemoryBlock* memory = nullptr;
+	size_t memoryBudget = COROUTINE_DEFAULT_MEMORY_BUDGET;
+	size_t memoryUsed = 0;
+	uint32_t stepCount = 0;
+	CoroutineState state = eCRS_Idle;
+	bool wakePending = false;
+	bool waitRequested = false;
+	bool finished = false;
+	bool cancelled = false; ///< cancel() called from within run()
+};
+
+/** @brief Runs ready coroutines in FIFO order
+ *  @note Implementations provide the platform hooks for signalling and timers
+ */
+class CoroutineScheduler
+{
+	friend class Coroutine;
+
+public:
+	virtual ~CoroutineScheduler()
+	{
+	}
+
+	/** @brief Run the next ready coroutine for one step
+	 *  @retval bool true if more coroutines are ready
+	 */
+	bool runNext();
+
+	/** @brief Number of coroutines waiting to run */
+	unsigned getReadyCount() const
+	{
+		return readyCount;
+	}
+
+	/** @brief Number of started coroutines which have not finished */
+	unsigned getActiveCount() const
+	{
+		return activeCount;
+	}
+
+protected:
+	/** @brief Called when the ready queue becomes non-empty */
+	virtual void signal() = 0;
+
+	/** @brief Arm a one-shot timer. The entry's callback and arg are already set. */
+	virtual void armTimer(TimerWheel::Entry& entry, uint32_t milliseconds) = 0;
+
+	virtual void disarmTimer(TimerWheel::Entry& entry) = 0;
+
+private:
+	void schedule(Coroutine& coroutine);
+	void unschedule(Coroutine& coroutine);
+
+private:
+	Coroutine* head = nullptr;
+	Coroutine* tail = nullptr;
+	unsigned readyCount = 0;
+	unsigned activeCount = 0;
+};
+
+/** @} */
+
+#endif /* _SMING_CORE_COROUTINE_H_ */
@@ -0,0 +1,179 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SystemCoroutine.cpp
+ *
+ ****/
+
+#include "SystemCoroutine.h"
+#include "../TimerScheduler.h"
+
+SystemCoroutineScheduler coroutineScheduler;
+
+void SystemCoroutineScheduler::signal()
+{
+	if(signalled) {
+		return;
+	}
+
+	if(System.queueCallback(staticRun, reinterpret_cast<uint32_t>(this), priority)) {
+		signalled = true;
+		return;
+	}
+
+	// Task queue is full, try again shortly
+	retryTimer.callback = [](void* arg) { static_cast<SystemCoroutineScheduler*>(arg)->signal(); };
+	retryTimer.arg = this;
+	timerScheduler.arm(retryTimer, 1, false);
+}
+
+void SystemCoroutineScheduler::staticRun(uint32_t param)
+{
+	auto scheduler = reinterpret_cast<SystemCoroutineScheduler*>(param);
+	scheduler->signalled = false;
+	if(scheduler->runNext()) {
+		scheduler->signal();
+	}
+}
+
+void SystemCoroutineScheduler::armTimer(TimerWheel::Entry& entry, uint32_t milliseconds)
+{
+	timerScheduler.arm(entry, milliseconds, false);
+}
+
+void SystemCoroutineScheduler::disarmTimer(TimerWheel::Entry& entry)
+{
+	timerScheduler.disarm(entry);
+}
+
+SystemCoroutine::~SystemCoroutine()
+{
+	cancel();
+	// A request or client may also be attached whilst idle
+	detachHttpRequest();
+	detachTcpClient();
+}
+
+bool SystemCoroutine::sendHttpRequest(HttpClient& client, HttpRequest* request)
+{
+	detachHttpRequest();
+	httpDone = false;
+	httpSuccess = false;
+	httpStatus = 0;
+	if(request == nullptr) {
+		return false;
+	}
+
+	httpWaiter = new HttpWaiter{this};
+	request->onRequestComplete(RequestCompletedDelegate(&HttpWaiter::complete, httpWaiter));
+	if(!client.send(request)) {
+		// The request may have been deleted, or may still be queued
+		detachHttpRequest();
+		return false;
+	}
+
+	return true;
+}
+
+void SystemCoroutine::detachHttpRequest()
+{
+	if(httpWaiter != nullptr) {
+		// Deleted when the request completes
+		httpWaiter->coroutine = nullptr;
+		httpWaiter = nullptr;
+	}
+}
+
+int SystemCoroutine::HttpWaiter::complete(HttpConnection& connection, bool successful)
+{
+	HttpRequest* request = connection.getRequest();
+	if(request != nullptr && request->retries > 0) {
+		// To be sent again
+		return 0;
+	}
+
+	int result = 0;
+	if(coroutine != nullptr) {
+		coroutine->httpWaiter = nullptr;
+		result = coroutine->httpRequestComplete(connection, successful);
+	}
+	delete this;
+	return result;
+}
+
+int SystemCoroutine::httpRequestComplete(HttpConnection& connection, bool successful)
+{
+	httpDone = true;
+	httpSuccess = successful;
+	httpStatus = connection.getResponse()->code;
+	wake();
+	return 0;
+}
+
+bool SystemCoroutine::attachTcpClient(TcpClient& client, size_t bufferSize)
+{
+	detachTcpClient();
+
+	tcpBuffer = static_cast<char*>(allocate(bufferSize));
+	if(tcpBuffer == nullptr) {
+		return false;
+	}
+
+	tcpBufferSize = bufferSize;
+	tcpReceived = 0;
+	tcpClosed = false;
+	tcpSuccess = false;
+	tcpClient = &client;
+	client.setReceiveDelegate(TcpClientDataDelegate(&SystemCoroutine::tcpReceive, this));
+	client.setCompleteDelegate(TcpClientCompleteDelegate(&SystemCoroutine::tcpComplete, this));
+	return true;
+}
+
+void SystemCoroutine::detachTcpClient()
+{
+	if(tcpClient != nullptr) {
+		tcpClient->setReceiveDelegate(nullptr);
+		tcpClient->setCompleteDelegate(nullptr);
+		tcpClient = nullptr;
+	}
+
+	release(tcpBuffer);
+	tcpBuffer = nullptr;
+	tcpBufferSize = 0;
+	tcpReceived = 0;
+}
+
+size_t SystemCoroutine::readTcpData(void* buffer, size_t size)
+{
+	if(size > tcpReceived) {
+		size = tcpReceived;
+	}
+
+	memcpy(buffer, tcpBuffer, size);
+	tcpReceived -= size;
+	memmove(tcpBuffer, tcpBuffer + size, tcpReceived);
+	return size;
+}
+
+bool SystemCoroutine::tcpReceive(TcpClient& client, char* data, int size)
+{
+	if(tcpReceived + size > tcpBufferSize) {
+		debug_w("Coroutine receive buffer full");
+		return false;
+	}
+
+	memcpy(tcpBuffer + tcpReceived, data, size);
+	tcpReceived += size;
+	wake();
+	return true;
+}
+
+void SystemCoroutine::tcpComplete(TcpClient& client, bool successful)
+{
+	tcpClosed = true;
+	tcpSuccess = successful;
+	wake();
+}
@@ -0,0 +1,160 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SystemCoroutine.h
+ *
+ * Runs coroutines from the system task queue, with sleeps driven by the
+ * global timer scheduler, and provides awaitable HttpClient and TcpClient
+ * operations.
+ *
+ * Example:
+ *
+ *	class StatusFetch : public SystemCoroutine
+ *	{
+ *	protected:
+ *		void run() override
+ *		{
+ *			CR_BEGIN();
+ *			CR_SLEEP(500);
+ *			CR_AWAIT_HTTP(httpClient, httpClient.request(url));
+ *			if(httpSuccess) {
+ *				...
+ *			}
+ *			CR_END();
+ *		}
+ *	};
+ *
+ * A coroutine may be cancelled or destroyed whilst an HTTP request it sent is
+ * outstanding: the request then completes without it. Requests re-sent by the
+ * connection, e.g. for authentication, complete once, after the last attempt.
+ *
+ ****/
+
+/** @addtogroup coroutine
+ *  @{
+ */
+
+#ifndef _SMING_CORE_SYSTEM_COROUTINE_H_
+#define _SMING_CORE_SYSTEM_COROUTINE_H_
+
+#include "Coroutine.h"
+#include "../Platform/System.h"
+#include "../Network/HttpClient.h"
+#include "../Network/TcpClient.h"
+
+/** @brief Send an HTTP request and wait for it to complete. Check httpSuccess afterwards. */
+#define CR_AWAIT_HTTP(client, request)                                                                                 \
+	do {                                                                                                               \
+		if(!sendHttpRequest(client, request)) {                                                                        \
+			break;                                                                                                     \
+		}                                                                                                              \
+		CR_WAIT_UNTIL(httpDone);                                                                                       \
+	} while(0)
+
+/** @brief Wait until at least `count` bytes have been received on the attached TcpClient, or it closes */
+#define CR_AWAIT_TCP_DATA(count) CR_WAIT_UNTIL(tcpReceived >= (count) || tcpClosed)
+
+class SystemCoroutineScheduler : public CoroutineScheduler
+{
+public:
+	/** @brief Set task queue priority for coroutine steps */
+	void setPriority(TaskPriority priority)
+	{
+		this->priority = priority;
+	}
+
+protected:
+	void signal() override;
+	void armTimer(TimerWheel::Entry& entry, uint32_t milliseconds) override;
+	void disarmTimer(TimerWheel::Entry& entry) override;
+
+private:
+	static void staticRun(uint32_t param);
+
+private:
+	TimerWheel::Entry retryTimer;
+	TaskPriority priority = eTP_Normal;
+	bool signalled = false;
+};
+
+/** @brief Scheduler for coroutines run from the system task queue */
+extern SystemCoroutineScheduler coroutineScheduler;
+
+class SystemCoroutine : public Coroutine
+{
+public:
+	SystemCoroutine(CoroutineScheduler& scheduler = coroutineScheduler) : Coroutine(scheduler)
+	{
+	}
+
+	/** @note Subclasses which override onStop() must call cancel() in their own destructor */
+	~SystemCoroutine();
+
+protected:
+	/** @brief Start an HTTP request, use CR_AWAIT_HTTP()
+	 *  @note Any request already outstanding is abandoned
+	 */
+	bool sendHttpRequest(HttpClient& client, HttpRequest* request);
+
+	/** @brief Stop waiting for an outstanding HTTP request, which completes without the coroutine */
+	void detachHttpRequest();
+
+	/** @brief Route data and completion from a TcpClient to this coroutine
+	 *  @param client
+	 *  @param bufferSize Receive buffer, allocated from the memory budget
+	 *  @retval bool false if the buffer could not be allocated
+	 *  @note Data arriving when the buffer is full aborts the connection
+	 */
+	bool attachTcpClient(TcpClient& client, size_t bufferSize);
+
+	/** @brief Stop routing TcpClient events here and free the receive buffer */
+	void detachTcpClient();
+
+	/** @brief Remove data from the front of the receive buffer
+	 *  @retval size_t Number of bytes copied
+	 */
+	size_t readTcpData(void* buffer, size_t size);
+
+	void onStop() override
+	{
+		detachHttpRequest();
+		detachTcpClient();
+	}
+
+private:
+	/** @brief Completion target for a request, which may outlive the coroutine that sent it
+	 *  @note A request deleted without completing, such as when its connection fails,
+	 *  leaves this allocated
+	 */
+	struct HttpWaiter {
+		SystemCoroutine* coroutine;
+
+		int complete(HttpConnection& connection, bool successful);
+	};
+
+	int httpRequestComplete(HttpConnection& connection, bool successful);
+	bool tcpReceive(TcpClient& client, char* data, int size);
+	void tcpComplete(TcpClient& client, bool successful);
+
+protected:
+	bool httpDone = false;
+	bool httpSuccess = false;
+	int httpStatus = 0;
+
+	size_t tcpReceived = 0; ///< Bytes waiting in the receive buffer
+	bool tcpClosed = false;
+	bool tcpSuccess = false;
+
+private:
+	HttpWaiter* httpWaiter = nullptr;
+	TcpClient* tcpClient = nullptr;
+	char* tcpBuffer = nullptr;
+	size_t tcpBufferSize = 0;
+};
+
+/** @} */
+
+#endif /* _SMING_CORE_SYSTEM_COROUTINE_H_ */
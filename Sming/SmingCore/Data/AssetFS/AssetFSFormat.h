@@ -0,0 +1,77 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * AssetFSFormat.h
+ *
+ * Layout of a read-only asset image, shared by the firmware and the host tool
+ * which builds it (tools/assetfs). All values are little-endian 32-bit words so
+ * an image in mapped flash can be read without alignment concerns.
+ *
+ * 	Header
+ * 	Hash table		hashSize words, each an entry index + 1 or 0 for an empty slot
+ * 	Directory		fileCount entries, sorted by name
+ * 	Strings			file names and content types, nul-terminated
+ * 	File data		each file starts on a multiple of dataAlign
+ *
+ * The hash table is open addressed with linear probing and kept at most half
+ * full, so a lookup usually reads one slot and one entry.
+ *
+ ****/
+
+#ifndef _SMING_CORE_DATA_ASSETFS_FORMAT_H_
+#define _SMING_CORE_DATA_ASSETFS_FORMAT_H_
+
+#include <stdint.h>
+
+#define ASSETFS_MAGIC 0x53465341 // "ASFS"
+#define ASSETFS_VERSION 1
+
+/** @brief Longest file name, excluding the terminating nul */
+#define ASSETFS_MAX_NAME 127
+
+/** @brief Longest content type, excluding the terminating nul */
+#define ASSETFS_MAX_MIME 63
+
+// Entry flags
+#define ASSETFS_FLAG_GZIP 0x01 ///< Data is gzip-compressed, send with "Content-Encoding: gzip"
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t fileCount;
+	uint32_t hashSize; ///< Slots in the hash table, a power of 2
+	uint32_t imageSize;
+	uint32_t dataAlign;
+} AssetFSHeader;
+
+typedef struct {
+	uint32_t hash;		 ///< assetfs_hash() of the name
+	uint32_t nameOffset; ///< From the start of the image
+	uint32_t nameLength;
+	uint32_t mimeOffset; ///< From the start of the image
+	uint32_t dataOffset; ///< From the start of the image
+	uint32_t dataSize;
+	uint32_t etag; ///< assetfs_hash() of the data as stored, so it changes with the content
+	uint32_t flags;
+} AssetFSEntry;
+
+/** @brief 32-bit FNV-1a, used for names and content */
+static inline uint32_t assetfs_hash_update(uint32_t hash, const void* data, uint32_t length)
+{
+	const uint8_t* p = (const uint8_t*)data;
+	while(length-- != 0) {
+		hash ^= *p++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+static inline uint32_t assetfs_hash(const void* data, uint32_t length)
+{
+	return assetfs_hash_update(2166136261U, data, length);
+}
+
+#endif /* _SMING_CORE_DATA_ASSETFS_FORMAT_H_ */
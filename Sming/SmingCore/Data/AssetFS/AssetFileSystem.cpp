@@ -0,0 +1,164 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * AssetFileSystem.cpp
+ *
+ ****/
+
+#include "AssetFileSystem.h"
+#include "FlashString.h"
+#include "flashmem.h"
+#include <algorithm>
+
+AssetFileSystem assetFS;
+
+bool AssetFileSystem::mount(const FlashString& image)
+{
+	unmount();
+	if(image.length() < sizeof(AssetFSHeader)) {
+		return false;
+	}
+	mappedImage = reinterpret_cast<const char*>(image.data());
+	if(!checkHeader()) {
+		return false;
+	}
+	if(header.imageSize > image.length()) {
+		debug_e("AssetFS: image truncated");
+		unmount();
+		return false;
+	}
+	return true;
+}
+
+bool AssetFileSystem::mount(uint32_t flashAddress)
+{
+	unmount();
+	this->flashAddress = flashAddress;
+	return checkHeader();
+}
+
+bool AssetFileSystem::checkHeader()
+{
+	// Read before mounted is set, so readImage() doesn't check against the size
+	if(!readImage(0, &header, sizeof(header))) {
+		return false;
+	}
+
+	uint32_t tableSize = header.hashSize * sizeof(uint32_t);
+	uint32_t directorySize = header.fileCount * sizeof(AssetFSEntry);
+	if(header.magic != ASSETFS_MAGIC || header.version != ASSETFS_VERSION || header.hashSize == 0 ||
+	   (header.hashSize & (header.hashSize - 1)) != 0 || header.hashSize < header.fileCount ||
+	   sizeof(header) + tableSize + directorySize > header.imageSize) {
+		debug_e("AssetFS: invalid image");
+		header = AssetFSHeader{0};
+		mappedImage = nullptr;
+		return false;
+	}
+
+	debug_i("AssetFS: %u files, %u bytes", header.fileCount, header.imageSize);
+	mounted = true;
+	return true;
+}
+
+bool AssetFileSystem::readImage(uint32_t offset, void* buffer, uint32_t length) const
+{
+	if(mounted && (offset > header.imageSize || length > header.imageSize - offset)) {
+		return false;
+	}
+
+	if(mappedImage != nullptr) {
+		memcpy_P(buffer, mappedImage + offset, length);
+		return true;
+	}
+
+	return flashmem_read(buffer, flashAddress + offset, length) == length;
+}
+
+bool AssetFileSystem::readEntry(uint32_t index, AssetFSEntry& entry) const
+{
+	uint32_t offset = sizeof(header) + header.hashSize * sizeof(uint32_t) + index * sizeof(AssetFSEntry);
+	return index < header.fileCount && readImage(offset, &entry, sizeof(entry));
+}
+
+String AssetFileSystem::readString(uint32_t offset, unsigned maxLength) const
+{
+	char buf[ASSETFS_MAX_NAME + 1];
+	unsigned length = std::min(maxLength, header.imageSize - std::min(offset, header.imageSize));
+	length = std::min(length, unsigned(sizeof(buf) - 1));
+	if(!mounted || !readImage(offset, buf, length)) {
+		return nullptr;
+	}
+	buf[length] = '\0';
+	return String(buf);
+}
+
+bool AssetFileSystem::find(const char* name, AssetInfo& info) const
+{
+	if(!mounted || name == nullptr) {
+		return false;
+	}
+
+	unsigned nameLength = strlen(name);
+	uint32_t hash = assetfs_hash(name, nameLength);
+	uint32_t tableOffset = sizeof(header);
+	uint32_t mask = header.hashSize - 1;
+
+	// The table is never full, so an empty slot always ends the probe
+	for(uint32_t probe = 0; probe < header.hashSize; ++probe) {
+		uint32_t slot;
+		if(!readImage(tableOffset + ((hash + probe) & mask) * sizeof(uint32_t), &slot, sizeof(slot)) ||
+		   slot == 0) {
+			return false;
+		}
+
+		AssetFSEntry entry;
+		if(!readEntry(slot - 1, entry)) {
+			return false;
+		}
+		if(entry.hash != hash || entry.nameLength != nameLength) {
+			continue;
+		}
+
+		char entryName[ASSETFS_MAX_NAME + 1];
+		if(nameLength > ASSETFS_MAX_NAME || !readImage(entry.nameOffset, entryName, nameLength)) {
+			return false;
+		}
+		if(memcmp(entryName, name, nameLength) == 0) {
+			return getInfo(slot - 1, info);
+		}
+	}
+
+	return false;
+}
+
+bool AssetFileSystem::getInfo(uint32_t index, AssetInfo& info) const
+{
+	AssetFSEntry entry;
+	if(!mounted || !readEntry(index, entry)) {
+		return false;
+	}
+	if(entry.dataOffset > header.imageSize || entry.dataSize > header.imageSize - entry.dataOffset) {
+		return false;
+	}
+
+	info.index = index;
+	info.dataOffset = entry.dataOffset;
+	info.size = entry.dataSize;
+	info.etag = entry.etag;
+	info.flags = entry.flags;
+	info.nameOffset = entry.nameOffset;
+	info.mimeOffset = entry.mimeOffset;
+	return true;
+}
+
+size_t AssetFileSystem::read(const AssetInfo& info, uint32_t offset, void* buffer, size_t length) const
+{
+	if(offset >= info.size) {
+		return 0;
+	}
+	length = std::min(length, size_t(info.size - offset));
+	return readImage(info.dataOffset + offset, buffer, length) ? length : 0;
+}
@@ -0,0 +1,135 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * AssetFileSystem.h
+ *
+ * Read-only file system for static content such as web pages, built on the
+ * host by tools/assetfs from the project's ASSET_FILES directory. Lookups
+ * hash the name and read one directory entry, and file data is read straight
+ * from flash, bypassing SPIFFS. Content type, ETag and compression are worked
+ * out when the image is built. Anything which changes at run time belongs in
+ * SPIFFS.
+ *
+ * The image is normally bound into the firmware, where it's mapped into memory:
+ *
+ * 	IMPORT_FSTR(assetImage, ASSETFS_IMAGE)
+ * 	...
+ * 	assetFS.mount(assetImage);
+ *
+ * It can also be written to a flash area of its own and mounted by address.
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_ASSETFS_FILE_SYSTEM_H_
+#define _SMING_CORE_DATA_ASSETFS_FILE_SYSTEM_H_
+
+#include "AssetFSFormat.h"
+#include "WString.h"
+
+struct FlashString;
+
+/** @brief Description of a file in the image */
+struct AssetInfo {
+	uint32_t index = 0;		 ///< Position in the directory, which is sorted by name
+	uint32_t dataOffset = 0; ///< From the start of the image
+	uint32_t size = 0;
+	uint32_t etag = 0;
+	uint32_t flags = 0; ///< ASSETFS_FLAG_xxx
+	uint32_t nameOffset = 0;
+	uint32_t mimeOffset = 0;
+
+	bool isCompressed() const
+	{
+		return flags & ASSETFS_FLAG_GZIP;
+	}
+};
+
+class AssetFileSystem
+{
+public:
+	/** @brief Use an image bound into the firmware with IMPORT_FSTR
+	 *  @retval bool false if the image is invalid
+	 */
+	bool mount(const FlashString& image);
+
+	/** @brief Use an image written to flash
+	 *  @param flashAddress Offset of the image from the start of flash
+	 *  @retval bool false if the image is invalid
+	 */
+	bool mount(uint32_t flashAddress);
+
+	void unmount()
+	{
+		mappedImage = nullptr;
+		mounted = false;
+	}
+
+	bool isMounted() const
+	{
+		return mounted;
+	}
+
+	uint32_t getFileCount() const
+	{
+		return header.fileCount;
+	}
+
+	/** @brief Look up a file by name, without a leading '/'
+	 *  @retval bool false if there's no such file
+	 */
+	bool find(const char* name, AssetInfo& info) const;
+
+	bool find(const String& name, AssetInfo& info) const
+	{
+		return find(name.c_str(), info);
+	}
+
+	/** @brief Get a file by its position in the directory, for listing the contents
+	 *  @retval bool false if index is out of range
+	 */
+	bool getInfo(uint32_t index, AssetInfo& info) const;
+
+	String getName(const AssetInfo& info) const
+	{
+		return readString(info.nameOffset, ASSETFS_MAX_NAME);
+	}
+
+	String getMimeType(const AssetInfo& info) const
+	{
+		return readString(info.mimeOffset, ASSETFS_MAX_MIME);
+	}
+
+	/** @brief Read file data
+	 *  @param info File to read from
+	 *  @param offset Position within the file
+	 *  @param buffer
+	 *  @param length
+	 *  @retval size_t Number of bytes read, less than length at the end of the file
+	 */
+	size_t read(const AssetInfo& info, uint32_t offset, void* buffer, size_t length) const;
+
+private:
+	bool checkHeader();
+	bool readEntry(uint32_t index, AssetFSEntry& entry) const;
+	bool readImage(uint32_t offset, void* buffer, uint32_t length) const;
+	String readString(uint32_t offset, unsigned maxLength) const;
+
+private:
+	AssetFSHeader header = {0};
+	const char* mappedImage = nullptr; ///< Image in mapped flash, or nullptr to read through flashmem
+	uint32_t flashAddress = 0;
+	bool mounted = false;
+};
+
+/** @brief The application's asset file system, used by HttpResponse::sendAsset() */
+extern AssetFileSystem assetFS;
+
+/** @} */
+#endif /* _SMING_CORE_DATA_ASSETFS_FILE_SYSTEM_H_ */
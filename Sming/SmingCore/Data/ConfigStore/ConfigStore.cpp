@@ -0,0 +1,639 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * ConfigStore.cpp
+ *
+ ****/
+
+#include "ConfigStore.h"
+#include "../HexString.h"
+#include "../../../Services/CommandProcessing/CommandProcessingIncludes.h"
+#include <algorithm>
+#include <stddef.h>
+
+#define CONFIG_STORE_MAGIC 0x53474643 // "CFGS"
+
+// Flash is read this much at a time when checking or copying entries
+#define CONFIG_STORE_CHUNK 64
+
+static uint16_t crc16(uint16_t crc, const void* data, unsigned length)
+{
+	// CRC-16/CCITT
+	auto p = static_cast<const uint8_t*>(data);
+	while(length--) {
+		crc ^= uint16_t(*p++) << 8;
+		for(unsigned i = 0; i < 8; ++i) {
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+static uint16_t keyHash(const char* key, unsigned length)
+{
+	// FNV-1a, folded
+	uint32_t hash = 2166136261;
+	while(length--) {
+		hash = (hash ^ uint8_t(*key++)) * 16777619;
+	}
+	return hash ^ (hash >> 16);
+}
+
+bool ConfigStore::open(uint32_t flashAddress, uint16_t sectorCount)
+{
+	close();
+	if(flashAddress % INTERNAL_FLASH_SECTOR_SIZE != 0 || sectorCount < 2 || sectorCount > 64 ||
+	   flashAddress + uint32_t(sectorCount) * INTERNAL_FLASH_SECTOR_SIZE > flashmem_get_size_bytes()) {
+		debug_e("ConfigStore: bad area");
+		return false;
+	}
+
+	this->flashAddress = flashAddress;
+	this->sectorCount = sectorCount;
+	headSector = sectorCount - 1;
+	headSequence = 0;
+	sectorsInUse = 0;
+	headOpen = false;
+
+	SectorHeader header;
+	for(uint16_t i = 0; i < sectorCount; ++i) {
+		if(readHeader(i, header) && header.sequence > headSequence) {
+			headSector = i;
+			headSequence = header.sequence;
+		}
+	}
+
+	// Sectors are used in turn, so the store runs back from the newest one
+	if(headSequence != 0) {
+		sectorsInUse = 1;
+		while(sectorsInUse < sectorCount && sectorsInUse < headSequence) {
+			uint16_t sector = (headSector + sectorCount - sectorsInUse) % sectorCount;
+			if(!readHeader(sector, header) || header.sequence != headSequence - sectorsInUse) {
+				break;
+			}
+			++sectorsInUse;
+		}
+	}
+
+	// No spare sector means a compaction was cut short before the old sector was given up.
+	// The newest sector then only holds copies of entries still in the old one, so drop it.
+	if(sectorsInUse == sectorCount) {
+		debug_w("ConfigStore: undoing interrupted compaction");
+		if(!flashmem_erase_sector(flashmem_get_sector_of_address(sectorAddress(headSector)))) {
+			debug_e("ConfigStore: erase failed, sector %u", headSector);
+			return false;
+		}
+		headSector = (headSector + sectorCount - 1) % sectorCount;
+		--headSequence;
+		--sectorsInUse;
+	}
+
+	index = new IndexEntry[indexSize];
+	if(index == nullptr || !buildIndex()) {
+		close();
+		return false;
+	}
+
+	debug_i("ConfigStore: %u keys, %u sectors in use", count(), sectorsInUse);
+	return true;
+}
+
+void ConfigStore::close()
+{
+	delete[] index;
+	index = nullptr;
+	sectorCount = 0;
+}
+
+bool ConfigStore::readHeader(uint16_t sector, SectorHeader& header) const
+{
+	if(flashmem_read(&header, sectorAddress(sector), sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+	return header.magic == CONFIG_STORE_MAGIC && header.sequence != 0 && header.sequence != 0xFFFFFFFF &&
+		   header.check == ~(header.magic ^ header.sequence);
+}
+
+bool ConfigStore::readEntry(uint16_t location, EntryHeader& header, String* key) const
+{
+	uint32_t addr = locationAddress(location);
+	uint32_t sectorEnd = sectorAddress(location >> 10) + INTERNAL_FLASH_SECTOR_SIZE;
+	if(addr + sizeof(header) > sectorEnd || flashmem_read(&header, addr, sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+	if(!(header.type >= eCVT_String && header.type <= eCVT_Binary) && header.type != eCVT_Deleted) {
+		return false;
+	}
+	if(header.keyLength == 0 || header.keyLength > CONFIG_STORE_MAX_KEY_LENGTH ||
+	   addr + entrySize(header) > sectorEnd) {
+		return false;
+	}
+
+	char keyBuf[CONFIG_STORE_MAX_KEY_LENGTH + 1];
+	addr += sizeof(header);
+	flashmem_read(keyBuf, addr, header.keyLength);
+	uint16_t crc = crc16(0xFFFF, &header, offsetof(EntryHeader, crc));
+	crc = crc16(crc, keyBuf, header.keyLength);
+	addr += header.keyLength;
+
+	uint8_t chunk[CONFIG_STORE_CHUNK];
+	for(unsigned done = 0; done < header.valueLength;) {
+		unsigned len = std::min<unsigned>(header.valueLength - done, sizeof(chunk));
+		flashmem_read(chunk, addr + done, len);
+		crc = crc16(crc, chunk, len);
+		done += len;
+	}
+	if(crc != header.crc) {
+		return false;
+	}
+
+	if(key != nullptr) {
+		keyBuf[header.keyLength] = '\0';
+		*key = keyBuf;
+	}
+	return true;
+}
+
+ConfigStore::IndexEntry* ConfigStore::find(const String& key) const
+{
+	if(!isOpen() || key.length() == 0 || key.length() > CONFIG_STORE_MAX_KEY_LENGTH) {
+		return nullptr;
+	}
+
+	uint16_t hash = keyHash(key.c_str(), key.length());
+	for(uint16_t probe = 0; probe < indexSize; ++probe) {
+		IndexEntry& entry = index[(hash + probe) % indexSize];
+		if(entry.location == 0xFFFF) {
+			return nullptr;
+		}
+		if(entry.hash != hash) {
+			continue;
+		}
+		EntryHeader header;
+		String entryKey;
+		if(readEntry(entry.location, header, &entryKey) && entryKey == key) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+bool ConfigStore::addToIndex(uint16_t location, const EntryHeader& header, const String& key)
+{
+	IndexEntry* entry = find(key);
+	if(entry != nullptr) {
+		entry->location = location;
+		return true;
+	}
+
+	unsigned used = 0;
+	for(uint16_t i = 0; i < indexSize; ++i) {
+		used += (index[i].location != 0xFFFF);
+	}
+	if(used >= CONFIG_STORE_MAX_KEYS) {
+		debug_e("ConfigStore: too many keys");
+		return false;
+	}
+
+	uint16_t hash = keyHash(key.c_str(), key.length());
+	for(uint16_t probe = 0;; ++probe) {
+		entry = &index[(hash + probe) % indexSize];
+		if(entry->location == 0xFFFF) {
+			entry->hash = hash;
+			entry->location = location;
+			return true;
+		}
+	}
+}
+
+bool ConfigStore::buildIndex()
+{
+	memset(index, 0xFF, indexSize * sizeof(IndexEntry));
+	headOpen = false;
+	writeOffset = INTERNAL_FLASH_SECTOR_SIZE;
+	if(sectorsInUse == 0) {
+		return true;
+	}
+
+	for(uint16_t n = sectorsInUse; n != 0; --n) {
+		uint16_t sector = (headSector + sectorCount - (n - 1)) % sectorCount;
+		uint16_t offset = sizeof(SectorHeader);
+		bool torn = false;
+		while(offset + sizeof(EntryHeader) <= INTERNAL_FLASH_SECTOR_SIZE) {
+			uint16_t location = makeLocation(sector, offset);
+			EntryHeader header;
+			String key;
+			if(!readEntry(location, header, &key)) {
+				// Erased flash is where the next entry goes, anything else is a write cut short
+				uint32_t words[2];
+				flashmem_read(words, locationAddress(location), sizeof(words));
+				torn = (words[0] != 0xFFFFFFFF || words[1] != 0xFFFFFFFF);
+				break;
+			}
+			if(!addToIndex(location, header, key)) {
+				return false;
+			}
+			offset += entrySize(header);
+		}
+
+		if(sector == headSector) {
+			writeOffset = offset;
+			headOpen = !torn;
+		} else if(torn) {
+			debug_w("ConfigStore: sector %u has a torn entry", sector);
+		}
+	}
+
+	return true;
+}
+
+bool ConfigStore::startSector()
+{
+	if(sectorsInUse >= sectorCount) {
+		return false;
+	}
+
+	uint16_t next = (headSector + 1) % sectorCount;
+	if(!flashmem_erase_sector(flashmem_get_sector_of_address(sectorAddress(next)))) {
+		debug_e("ConfigStore: erase failed, sector %u", next);
+		return false;
+	}
+
+	SectorHeader header;
+	header.magic = CONFIG_STORE_MAGIC;
+	header.sequence = headSequence + 1;
+	header.check = ~(header.magic ^ header.sequence);
+	if(flashmem_write(&header, sectorAddress(next), sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+
+	headSector = next;
+	headSequence = header.sequence;
+	++sectorsInUse;
+	writeOffset = sizeof(header);
+	headOpen = true;
+	return true;
+}
+
+bool ConfigStore::compactTail()
+{
+	uint16_t tail = (headSector + sectorCount - (sectorsInUse - 1)) % sectorCount;
+	if(!startSector()) {
+		return false;
+	}
+
+	// Keep entries the index still points at. Tombstones go, as nothing older can be left for them to hide.
+	uint16_t offset = sizeof(SectorHeader);
+	while(offset + sizeof(EntryHeader) <= INTERNAL_FLASH_SECTOR_SIZE) {
+		uint16_t location = makeLocation(tail, offset);
+		EntryHeader header;
+		String key;
+		if(!readEntry(location, header, &key)) {
+			break;
+		}
+		uint16_t size = entrySize(header);
+		IndexEntry* entry = find(key);
+		if(entry != nullptr && entry->location == location && header.type != eCVT_Deleted) {
+			uint32_t from = locationAddress(location);
+			uint32_t to = sectorAddress(headSector) + writeOffset;
+			uint8_t chunk[CONFIG_STORE_CHUNK];
+			for(unsigned done = 0; done < size;) {
+				unsigned len = std::min<unsigned>(size - done, sizeof(chunk));
+				flashmem_read(chunk, from + done, len);
+				if(flashmem_write(chunk, to + done, len) != len) {
+					headOpen = false;
+					return false;
+				}
+				done += len;
+			}
+			entry->location = makeLocation(headSector, writeOffset);
+			writeOffset += size;
+		}
+		offset += size;
+	}
+
+	// Spoil the header first, so a sector erased part way can't be taken for a valid one
+	uint32_t zero = 0;
+	flashmem_write(&zero, sectorAddress(tail), sizeof(zero));
+	if(!flashmem_erase_sector(flashmem_get_sector_of_address(sectorAddress(tail)))) {
+		debug_e("ConfigStore: erase failed, sector %u", tail);
+	}
+	--sectorsInUse;
+
+	// Drops the tombstones
+	return buildIndex();
+}
+
+uint32_t ConfigStore::liveBytes() const
+{
+	uint32_t total = 0;
+	for(uint16_t i = 0; i < indexSize; ++i) {
+		EntryHeader header;
+		if(index[i].location != 0xFFFF && flashmem_read(&header, locationAddress(index[i].location), sizeof(header)) &&
+		   header.type != eCVT_Deleted) {
+			total += entrySize(header);
+		}
+	}
+	return total;
+}
+
+bool ConfigStore::ensureSpace(uint16_t size)
+{
+	for(unsigned tries = 0; tries < sectorCount * 2u; ++tries) {
+		if(headOpen && writeOffset + size <= INTERNAL_FLASH_SECTOR_SIZE) {
+			return true;
+		}
+		// One sector is kept spare for compaction
+		if(sectorsInUse + 1 < sectorCount) {
+			if(!startSector()) {
+				return false;
+			}
+			continue;
+		}
+		// Don't wear the flash shuffling entries round when they can't fit anyway
+		if(liveBytes() + size > (sectorCount - 1u) * (INTERNAL_FLASH_SECTOR_SIZE - sizeof(SectorHeader))) {
+			break;
+		}
+		if(!compactTail()) {
+			return false;
+		}
+	}
+
+	debug_e("ConfigStore: full");
+	return false;
+}
+
+bool ConfigStore::writeEntry(uint8_t type, const String& key, const void* value, uint16_t length)
+{
+	EntryHeader header;
+	header.type = type;
+	header.keyLength = key.length();
+	header.valueLength = length;
+	header.reserved = 0xFFFF;
+	header.crc = crc16(0xFFFF, &header, offsetof(EntryHeader, crc));
+	header.crc = crc16(header.crc, key.c_str(), header.keyLength);
+	header.crc = crc16(header.crc, value, length);
+
+	if(!ensureSpace(entrySize(header))) {
+		return false;
+	}
+
+	// Usually a single flash operation; if any of it doesn't make it, the CRC shows it
+	uint32_t addr = sectorAddress(headSector) + writeOffset;
+	uint32_t keyAddr = addr + sizeof(header);
+	uint32_t valueAddr = keyAddr + header.keyLength;
+	FlashIoVec vec[] = {
+		{addr, &header, sizeof(header)},
+		{keyAddr, const_cast<char*>(key.c_str()), header.keyLength},
+		{valueAddr, const_cast<void*>(value), length},
+	};
+	uint32_t size = sizeof(header) + header.keyLength + length;
+	if(flashmem_writev(vec, ARRAY_SIZE(vec)) != size) {
+		debug_e("ConfigStore: write failed");
+		headOpen = false;
+		return false;
+	}
+
+	uint16_t location = makeLocation(headSector, writeOffset);
+	writeOffset += entrySize(header);
+	return addToIndex(location, header, key);
+}
+
+bool ConfigStore::set(const String& key, uint8_t type, const void* value, uint16_t length)
+{
+	if(!isOpen() || key.length() == 0 || key.length() > CONFIG_STORE_MAX_KEY_LENGTH ||
+	   (value == nullptr && length != 0) ||
+	   sizeof(SectorHeader) + sizeof(EntryHeader) + key.length() + length > INTERNAL_FLASH_SECTOR_SIZE) {
+		return false;
+	}
+
+	// Leave the flash alone if nothing has changed
+	IndexEntry* entry = find(key);
+	EntryHeader header;
+	if(entry != nullptr && readEntry(entry->location, header) && header.type == type && header.valueLength == length) {
+		uint32_t addr = locationAddress(entry->location) + sizeof(header) + header.keyLength;
+		auto p = static_cast<const uint8_t*>(value);
+		uint8_t chunk[CONFIG_STORE_CHUNK];
+		unsigned done = 0;
+		while(done < length) {
+			unsigned len = std::min<unsigned>(length - done, sizeof(chunk));
+			flashmem_read(chunk, addr + done, len);
+			if(memcmp(chunk, p + done, len) != 0) {
+				break;
+			}
+			done += len;
+		}
+		if(done == length) {
+			return true;
+		}
+	}
+
+	return writeEntry(type, key, value, length);
+}
+
+bool ConfigStore::remove(const String& key)
+{
+	IndexEntry* entry = find(key);
+	EntryHeader header;
+	if(entry == nullptr || !readEntry(entry->location, header) || header.type == eCVT_Deleted) {
+		return false;
+	}
+	return writeEntry(eCVT_Deleted, key, nullptr, 0);
+}
+
+bool ConfigStore::readValue(const String& key, uint8_t type, void* buffer, uint16_t size) const
+{
+	IndexEntry* entry = find(key);
+	EntryHeader header;
+	if(entry == nullptr || !readEntry(entry->location, header) || header.type != type ||
+	   header.valueLength != size) {
+		return false;
+	}
+	uint32_t addr = locationAddress(entry->location) + sizeof(header) + header.keyLength;
+	return flashmem_read(buffer, addr, size) == size;
+}
+
+ConfigValueType ConfigStore::getType(const String& key) const
+{
+	IndexEntry* entry = find(key);
+	EntryHeader header;
+	if(entry == nullptr || !readEntry(entry->location, header) || header.type == eCVT_Deleted) {
+		return eCVT_None;
+	}
+	return ConfigValueType(header.type);
+}
+
+int ConfigStore::getBinary(const String& key, void* buffer, uint16_t bufferSize) const
+{
+	IndexEntry* entry = find(key);
+	EntryHeader header;
+	if(entry == nullptr || !readEntry(entry->location, header) || header.type == eCVT_Deleted) {
+		return -1;
+	}
+	uint16_t len = std::min(header.valueLength, bufferSize);
+	if(len != 0 && buffer != nullptr) {
+		flashmem_read(buffer, locationAddress(entry->location) + sizeof(header) + header.keyLength, len);
+	}
+	return header.valueLength;
+}
+
+int32_t ConfigStore::getInt(const String& key, int32_t defaultValue) const
+{
+	int32_t value;
+	return readValue(key, eCVT_Int, &value, sizeof(value)) ? value : defaultValue;
+}
+
+float ConfigStore::getFloat(const String& key, float defaultValue) const
+{
+	float value;
+	return readValue(key, eCVT_Float, &value, sizeof(value)) ? value : defaultValue;
+}
+
+bool ConfigStore::getBool(const String& key, bool defaultValue) const
+{
+	uint8_t value;
+	return readValue(key, eCVT_Bool, &value, sizeof(value)) ? value != 0 : defaultValue;
+}
+
+String ConfigStore::getString(const String& key, const String& defaultValue) const
+{
+	switch(getType(key)) {
+	case eCVT_None:
+		return defaultValue;
+	case eCVT_Int:
+		return String(getInt(key));
+	case eCVT_Float:
+		return String(getFloat(key));
+	case eCVT_Bool:
+		return getBool(key) ? "true" : "false";
+	default:;
+	}
+
+	int length = getBinary(key, nullptr, 0);
+	String value;
+	if(length < 0 || !value.setLength(length)) {
+		return defaultValue;
+	}
+	getBinary(key, value.begin(), length);
+	return value;
+}
+
+unsigned ConfigStore::count() const
+{
+	unsigned n = 0;
+	for(uint16_t i = 0; isOpen() && i < indexSize; ++i) {
+		EntryHeader header;
+		if(index[i].location != 0xFFFF && readEntry(index[i].location, header) && header.type != eCVT_Deleted) {
+			++n;
+		}
+	}
+	return n;
+}
+
+String ConfigStore::keyAt(unsigned n) const
+{
+	for(uint16_t i = 0; isOpen() && i < indexSize; ++i) {
+		EntryHeader header;
+		String key;
+		if(index[i].location != 0xFFFF && readEntry(index[i].location, header, &key) &&
+		   header.type != eCVT_Deleted && n-- == 0) {
+			return key;
+		}
+	}
+	return nullptr;
+}
+
+bool ConfigStore::compact()
+{
+	if(!isOpen() || sectorsInUse == 0 || sectorsInUse >= sectorCount) {
+		return false;
+	}
+	return compactTail();
+}
+
+void ConfigStore::initCommand(const String& name)
+{
+#if ENABLE_CMD_EXECUTOR
+	commandHandler.registerCommand(CommandDelegate(name, F("Settings: list, get, set, del, compact"), F("Config"),
+												   commandFunctionDelegate(&ConfigStore::processCommand, this)));
+#endif
+}
+
+void ConfigStore::processCommand(String commandLine, CommandOutput* commandOutput)
+{
+	Vector<String> commandToken;
+	int numToken = splitString(commandLine, ' ', commandToken);
+
+	if(numToken == 1) {
+		commandOutput->print(_F("Config Commands available : \r\n"));
+		commandOutput->print(_F("list                : Show all settings\r\n"));
+		commandOutput->print(_F("get <key>           : Show a setting\r\n"));
+		commandOutput->print(_F("set <key> <value>   : Change a setting, keeping its type\r\n"));
+		commandOutput->print(_F("del <key>           : Delete a setting\r\n"));
+		commandOutput->print(_F("compact             : Reclaim space from old values\r\n"));
+		return;
+	}
+
+	const String& cmd = commandToken[1];
+	if(!isOpen()) {
+		commandOutput->print(_F("Store not open\r\n"));
+	} else if(cmd == _F("list")) {
+		unsigned n = count();
+		for(unsigned i = 0; i < n; ++i) {
+			String key = keyAt(i);
+			String value;
+			if(getType(key) == eCVT_Binary) {
+				uint8_t buf[32];
+				int len = getBinary(key, buf, sizeof(buf));
+				value = makeHexString(buf, std::min(len, int(sizeof(buf))), ' ');
+			} else {
+				value = getString(key);
+			}
+			commandOutput->printf(_F("%s = %s\r\n"), key.c_str(), value.c_str());
+		}
+		commandOutput->printf(_F("%u keys, %u sectors in use of %u\r\n"), n, sectorsInUse, sectorCount);
+	} else if(numToken < 3) {
+		if(cmd == _F("compact")) {
+			commandOutput->print(compact() ? F("Compacted\r\n") : F("Nothing to compact\r\n"));
+		} else {
+			commandOutput->print(_F("Key required\r\n"));
+		}
+	} else if(cmd == _F("get")) {
+		if(contains(commandToken[2])) {
+			commandOutput->printf(_F("%s\r\n"), getString(commandToken[2]).c_str());
+		} else {
+			commandOutput->print(_F("Not found\r\n"));
+		}
+	} else if(cmd == _F("set")) {
+		const String& key = commandToken[2];
+		String value;
+		for(int i = 3; i < numToken; ++i) {
+			if(i > 3) {
+				value += ' ';
+			}
+			value += commandToken[i];
+		}
+		bool ok;
+		switch(getType(key)) {
+		case eCVT_Int:
+			ok = setInt(key, value.toInt());
+			break;
+		case eCVT_Float:
+			ok = setFloat(key, value.toFloat());
+			break;
+		case eCVT_Bool:
+			ok = setBool(key, value == "1" || value.equalsIgnoreCase(F("true")) || value.equalsIgnoreCase(F("on")));
+			break;
+		default:
+			ok = setString(key, value);
+		}
+		commandOutput->print(ok ? F("OK\r\n") : F("Failed\r\n"));
+	} else if(cmd == _F("del")) {
+		commandOutput->print(remove(commandToken[2]) ? F("Deleted\r\n") : F("Not found\r\n"));
+	} else {
+		commandOutput->print(_F("Unknown command\r\n"));
+	}
+}
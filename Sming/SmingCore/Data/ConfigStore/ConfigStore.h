@@ -0,0 +1,226 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * ConfigStore.h
+ *
+ * Typed key/value settings kept in a flash area of its own, as an alternative
+ * to JSON files in SPIFFS: reading one setting is a hash lookup and a flash
+ * read, without parsing a file or allocating a document.
+ *
+ * Each update appends a record, with a CRC, after the ones already written.
+ * The old value stands until the new record is complete, so a reset part way
+ * through an update loses the update but nothing else. Deleting a key writes
+ * a tombstone. When the area fills up, the live entries in the oldest sector
+ * are copied forward and the sector is erased; one sector is always kept
+ * spare for this. A RAM index, built when the store is opened, maps a hash of
+ * each key to its newest record.
+ *
+ * 	ConfigStore config;
+ * 	...
+ * 	config.open(0x3F0000, 4);
+ * 	String ssid = config.getString("ssid");
+ * 	config.setInt("interval", 60);
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_CONFIG_STORE_H_
+#define _SMING_CORE_DATA_CONFIG_STORE_H_
+
+#include "flashmem.h"
+#include "WString.h"
+
+/** @brief Most keys a store can hold, including recently deleted ones */
+#ifndef CONFIG_STORE_MAX_KEYS
+#define CONFIG_STORE_MAX_KEYS 64
+#endif
+
+/** @brief Longest key */
+#ifndef CONFIG_STORE_MAX_KEY_LENGTH
+#define CONFIG_STORE_MAX_KEY_LENGTH 32
+#endif
+
+class CommandOutput;
+
+/** @brief Type of a stored value */
+enum ConfigValueType {
+	eCVT_None,   ///< No such key
+	eCVT_String, ///< Text
+	eCVT_Int,	///< int32_t
+	eCVT_Float,  ///< float
+	eCVT_Bool,   ///< bool
+	eCVT_Binary, ///< Anything else
+};
+
+class ConfigStore
+{
+public:
+	~ConfigStore()
+	{
+		close();
+	}
+
+	/** @brief Open the store, recovering its contents
+	 *  @param flashAddress Start of the area, which must be sector aligned
+	 *  @param sectorCount 2 to 64
+	 *  @retval bool false if the area is unusable
+	 *  @note An area which doesn't hold a store is treated as empty, and overwritten
+	 */
+	bool open(uint32_t flashAddress, uint16_t sectorCount);
+
+	void close();
+
+	bool isOpen() const
+	{
+		return index != nullptr;
+	}
+
+	bool setString(const String& key, const String& value)
+	{
+		return set(key, eCVT_String, value.c_str(), value.length());
+	}
+
+	bool setInt(const String& key, int32_t value)
+	{
+		return set(key, eCVT_Int, &value, sizeof(value));
+	}
+
+	bool setFloat(const String& key, float value)
+	{
+		return set(key, eCVT_Float, &value, sizeof(value));
+	}
+
+	bool setBool(const String& key, bool value)
+	{
+		uint8_t b = value;
+		return set(key, eCVT_Bool, &b, sizeof(b));
+	}
+
+	bool setBinary(const String& key, const void* data, uint16_t length)
+	{
+		return set(key, eCVT_Binary, data, length);
+	}
+
+	/** @brief Get a value as text, whatever its type
+	 *  @note Binary values are returned as they are
+	 */
+	String getString(const String& key, const String& defaultValue = nullptr) const;
+
+	int32_t getInt(const String& key, int32_t defaultValue = 0) const;
+
+	float getFloat(const String& key, float defaultValue = 0) const;
+
+	bool getBool(const String& key, bool defaultValue = false) const;
+
+	/** @brief Get a value of any type
+	 *  @param key
+	 *  @param buffer
+	 *  @param bufferSize Longer values are truncated
+	 *  @retval int Length of the value, -1 if there's no such key
+	 */
+	int getBinary(const String& key, void* buffer, uint16_t bufferSize) const;
+
+	ConfigValueType getType(const String& key) const;
+
+	bool contains(const String& key) const
+	{
+		return getType(key) != eCVT_None;
+	}
+
+	bool remove(const String& key);
+
+	/** @brief Number of keys with values */
+	unsigned count() const;
+
+	/** @brief Get a key by position, for listing the contents
+	 *  @param n 0 to count() - 1
+	 */
+	String keyAt(unsigned n) const;
+
+	/** @brief Reclaim the space taken by old values now, rather than when it's needed
+	 *  @note Each call compacts one sector
+	 */
+	bool compact();
+
+	/** @brief Register the "config" command with the command handler
+	 *  @param name Command name, for more than one store
+	 */
+	void initCommand(const String& name = "config");
+
+private:
+	struct SectorHeader {
+		uint32_t magic;
+		uint32_t sequence;
+		uint32_t check;
+	};
+
+	struct EntryHeader {
+		uint8_t type; ///< ConfigValueType, eCVT_Deleted or 0xFF where the next entry goes
+		uint8_t keyLength;
+		uint16_t valueLength;
+		uint16_t crc; ///< Of the rest of the header, key and value
+		uint16_t reserved;
+	};
+
+	/** @brief Where an entry is, in the RAM index */
+	struct IndexEntry {
+		uint16_t hash;
+		uint16_t location; ///< Sector index and offset / 4, 0xFFFF if the slot is free
+	};
+
+	static const uint8_t eCVT_Deleted = 0x7F;
+	static const uint16_t indexSize = CONFIG_STORE_MAX_KEYS * 2;
+
+	uint32_t sectorAddress(uint16_t sector) const
+	{
+		return flashAddress + sector * INTERNAL_FLASH_SECTOR_SIZE;
+	}
+
+	static uint16_t makeLocation(uint16_t sector, uint16_t offset)
+	{
+		return (sector << 10) | (offset >> 2);
+	}
+
+	uint32_t locationAddress(uint16_t location) const
+	{
+		return sectorAddress(location >> 10) + ((location & 0x3FF) << 2);
+	}
+
+	static uint16_t entrySize(const EntryHeader& header)
+	{
+		return (sizeof(header) + header.keyLength + header.valueLength + 3) & ~3;
+	}
+
+	bool set(const String& key, uint8_t type, const void* value, uint16_t length);
+	IndexEntry* find(const String& key) const;
+	bool readEntry(uint16_t location, EntryHeader& header, String* key = nullptr) const;
+	bool readValue(const String& key, uint8_t type, void* buffer, uint16_t size) const;
+	bool readHeader(uint16_t sector, SectorHeader& header) const;
+	bool buildIndex();
+	bool addToIndex(uint16_t location, const EntryHeader& header, const String& key);
+	bool ensureSpace(uint16_t size);
+	bool startSector();
+	bool compactTail();
+	bool writeEntry(uint8_t type, const String& key, const void* value, uint16_t length);
+	uint32_t liveBytes() const;
+	void processCommand(String commandLine, CommandOutput* commandOutput);
+
+private:
+	uint32_t flashAddress = 0;
+	uint16_t sectorCount = 0;
+	uint16_t headSector = 0;
+	uint32_t headSequence = 0; ///< 0 if the store is empty
+	uint16_t sectorsInUse = 0; ///< Run of sectors ending with the head
+	uint16_t writeOffset = 0;  ///< Where the next entry goes in the head sector
+	bool headOpen = false;	 ///< Head can take more entries
+	IndexEntry* index = nullptr;
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_CONFIG_STORE_H_ */
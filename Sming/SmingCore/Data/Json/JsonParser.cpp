@@ -0,0 +1,544 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * JsonParser.cpp
+ *
+ ****/
+
+#include "JsonParser.h"
+
+static inline bool isSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static inline bool isDigit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+static int hexValue(char c)
+{
+	if(isDigit(c)) {
+		return c - '0';
+	}
+	c |= 0x20;
+	if(c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+static bool isValidNumber(const char* s)
+{
+	if(*s == '-') {
+		++s;
+	}
+	if(*s == '0') {
+		++s;
+	} else if(isDigit(*s)) {
+		while(isDigit(*s)) {
+			++s;
+		}
+	} else {
+		return false;
+	}
+	if(*s == '.') {
+		++s;
+		if(!isDigit(*s)) {
+			return false;
+		}
+		while(isDigit(*s)) {
+			++s;
+		}
+	}
+	if(*s == 'e' || *s == 'E') {
+		++s;
+		if(*s == '+' || *s == '-') {
+			++s;
+		}
+		if(!isDigit(*s)) {
+			return false;
+		}
+		while(isDigit(*s)) {
+			++s;
+		}
+	}
+	return *s == '\0';
+}
+
+bool JsonParser::on(const String& pattern, JsonEventDelegate handler)
+{
+	if(handlerCount == JSON_PARSER_MAX_HANDLERS) {
+		return false;
+	}
+	handlers[handlerCount].pattern = pattern;
+	handlers[handlerCount].delegate = handler;
+	++handlerCount;
+	return true;
+}
+
+void JsonParser::reset()
+{
+	state = eJS_Value;
+	error = eJPE_None;
+	offset = 0;
+	depth = 0;
+	path[0] = '$';
+	path[1] = '\0';
+	pathLength = 1;
+	tokenLength = 0;
+	inKey = false;
+	literal = nullptr;
+	literalPos = 0;
+	hexDigits = 0;
+	unicode = 0;
+	highSurrogate = 0;
+}
+
+bool JsonParser::matchPath(const char* pattern, const char* path)
+{
+	while(*pattern != '\0') {
+		if(pattern[0] == '[' && pattern[1] == '*' && pattern[2] == ']') {
+			if(*path != '[') {
+				return false;
+			}
+			path = strchr(path, ']');
+			if(path == nullptr) {
+				return false;
+			}
+			++path;
+			pattern += 3;
+		} else if(pattern[0] == '.' && pattern[1] == '*') {
+			if(*path != '.') {
+				return false;
+			}
+			do {
+				++path;
+			} while(*path != '\0' && *path != '.' && *path != '[');
+			pattern += 2;
+		} else if(*pattern++ != *path++) {
+			return false;
+		}
+	}
+	return *path == '\0';
+}
+
+bool JsonParser::fail(JsonParserError err)
+{
+	error = err;
+	state = eJS_Error;
+	return false;
+}
+
+bool JsonParser::emit(JsonEventType type, const char* value, unsigned length, bool partial)
+{
+	JsonEvent event;
+	event.type = type;
+	event.path = path;
+	event.key = nullptr;
+	event.index = 0;
+	event.depth = depth;
+	event.value = value;
+	event.length = length;
+	event.partial = partial;
+
+	// Start events are sent before the new level is added, end events after it's gone
+	if(depth != 0) {
+		const Level& parent = levels[depth - 1];
+		if(parent.isArray) {
+			event.index = parent.index;
+		} else {
+			event.key = &path[parent.pathLength + 1];
+		}
+	}
+
+	for(unsigned i = 0; i < handlerCount; ++i) {
+		if(matchPath(handlers[i].pattern.c_str(), path) && !handlers[i].delegate(*this, event)) {
+			return fail(eJPE_Stopped);
+		}
+	}
+	if(eventHandler && !eventHandler(*this, event)) {
+		return fail(eJPE_Stopped);
+	}
+	return true;
+}
+
+bool JsonParser::appendPath(const char* text, unsigned length)
+{
+	if(pathLength + length > JSON_PARSER_MAX_PATH) {
+		return fail(eJPE_PathTooLong);
+	}
+	memcpy(&path[pathLength], text, length);
+	pathLength += length;
+	path[pathLength] = '\0';
+	return true;
+}
+
+bool JsonParser::beginValue()
+{
+	if(depth == 0 || !levels[depth - 1].isArray) {
+		// Member name is already in the path
+		return true;
+	}
+
+	char buf[16];
+	int len = m_snprintf(buf, sizeof(buf), "[%u]", levels[depth - 1].index);
+	return appendPath(buf, len);
+}
+
+bool JsonParser::endValue()
+{
+	if(depth == 0) {
+		state = eJS_Done;
+		return true;
+	}
+
+	Level& parent = levels[depth - 1];
+	pathLength = parent.pathLength;
+	path[pathLength] = '\0';
+	if(parent.isArray) {
+		++parent.index;
+	}
+	state = eJS_CommaOrEnd;
+	return true;
+}
+
+bool JsonParser::beginContainer(bool isArray)
+{
+	if(depth == JSON_PARSER_MAX_DEPTH) {
+		return fail(eJPE_TooDeep);
+	}
+	if(!emit(isArray ? eJET_ArrayStart : eJET_ObjectStart)) {
+		return false;
+	}
+
+	Level& level = levels[depth++];
+	level.pathLength = pathLength;
+	level.isArray = isArray;
+	level.index = 0;
+	state = isArray ? eJS_ValueOrArrayEnd : eJS_KeyOrObjectEnd;
+	return true;
+}
+
+bool JsonParser::endContainer()
+{
+	bool isArray = levels[--depth].isArray;
+	return emit(isArray ? eJET_ArrayEnd : eJET_ObjectEnd) && endValue();
+}
+
+bool JsonParser::putChar(char c)
+{
+	if(highSurrogate != 0) {
+		// Unpaired, so not a valid character
+		highSurrogate = 0;
+		if(!putCodePoint(0xFFFD)) {
+			return false;
+		}
+	}
+
+	if(inKey) {
+		return appendPath(&c, 1);
+	}
+
+	if(tokenLength == JSON_PARSER_MAX_TOKEN) {
+		if(!emit(eJET_String, token, tokenLength, true)) {
+			return false;
+		}
+		tokenLength = 0;
+	}
+	token[tokenLength++] = c;
+	token[tokenLength] = '\0';
+	return true;
+}
+
+bool JsonParser::putCodePoint(uint32_t code)
+{
+	char buf[4];
+	unsigned len;
+	if(code < 0x80) {
+		buf[0] = code;
+		len = 1;
+	} else if(code < 0x800) {
+		buf[0] = 0xC0 | (code >> 6);
+		buf[1] = 0x80 | (code & 0x3F);
+		len = 2;
+	} else if(code < 0x10000) {
+		buf[0] = 0xE0 | (code >> 12);
+		buf[1] = 0x80 | ((code >> 6) & 0x3F);
+		buf[2] = 0x80 | (code & 0x3F);
+		len = 3;
+	} else {
+		buf[0] = 0xF0 | (code >> 18);
+		buf[1] = 0x80 | ((code >> 12) & 0x3F);
+		buf[2] = 0x80 | ((code >> 6) & 0x3F);
+		buf[3] = 0x80 | (code & 0x3F);
+		len = 4;
+	}
+
+	for(unsigned i = 0; i < len; ++i) {
+		if(!putChar(buf[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool JsonParser::endString()
+{
+	if(highSurrogate != 0) {
+		highSurrogate = 0;
+		if(!putCodePoint(0xFFFD)) {
+			return false;
+		}
+	}
+
+	if(inKey) {
+		inKey = false;
+		state = eJS_Colon;
+		return true;
+	}
+
+	return emit(eJET_String, token, tokenLength) && endValue();
+}
+
+bool JsonParser::endNumber()
+{
+	if(!isValidNumber(token)) {
+		return fail(eJPE_Syntax);
+	}
+	return emit(eJET_Number, token, tokenLength) && endValue();
+}
+
+bool JsonParser::step(char c)
+{
+	switch(state) {
+	case eJS_Number:
+		if(isDigit(c) || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+			if(tokenLength == JSON_PARSER_MAX_TOKEN) {
+				return fail(eJPE_NumberTooLong);
+			}
+			token[tokenLength++] = c;
+			token[tokenLength] = '\0';
+			return true;
+		}
+		// Whatever ends the number comes next
+		if(!endNumber()) {
+			return false;
+		}
+		return step(c);
+
+	case eJS_String:
+		if(c == '"') {
+			return endString();
+		}
+		if(c == '\\') {
+			state = eJS_Escape;
+			return true;
+		}
+		if(uint8_t(c) < 0x20) {
+			return fail(eJPE_Syntax);
+		}
+		return putChar(c);
+
+	case eJS_Escape: {
+		state = eJS_String;
+		switch(c) {
+		case '"':
+		case '\\':
+		case '/':
+			return putChar(c);
+		case 'b':
+			return putChar('\b');
+		case 'f':
+			return putChar('\f');
+		case 'n':
+			return putChar('\n');
+		case 'r':
+			return putChar('\r');
+		case 't':
+			return putChar('\t');
+		case 'u':
+			state = eJS_Unicode;
+			hexDigits = 0;
+			unicode = 0;
+			return true;
+		default:
+			return fail(eJPE_Syntax);
+		}
+	}
+
+	case eJS_Unicode: {
+		int digit = hexValue(c);
+		if(digit < 0) {
+			return fail(eJPE_Syntax);
+		}
+		unicode = (unicode << 4) | digit;
+		if(++hexDigits < 4) {
+			return true;
+		}
+
+		state = eJS_String;
+		if(unicode >= 0xDC00 && unicode <= 0xDFFF && highSurrogate != 0) {
+			uint32_t code = 0x10000 + ((uint32_t(highSurrogate - 0xD800) << 10) | (unicode - 0xDC00));
+			highSurrogate = 0;
+			return putCodePoint(code);
+		}
+		if(unicode >= 0xD800 && unicode <= 0xDBFF) {
+			// Wait for the other half; putChar() deals with it never arriving
+			if(highSurrogate != 0) {
+				highSurrogate = 0;
+				if(!putCodePoint(0xFFFD)) {
+					return false;
+				}
+			}
+			highSurrogate = unicode;
+			return true;
+		}
+		return putCodePoint((unicode >= 0xDC00 && unicode <= 0xDFFF) ? 0xFFFD : unicode);
+	}
+
+	case eJS_Literal:
+		if(c != literal[literalPos]) {
+			return fail(eJPE_Syntax);
+		}
+		if(literal[++literalPos] == '\0') {
+			JsonEventType type = (literal[0] == 'n') ? eJET_Null : eJET_Bool;
+			return emit(type, literal, literalPos) && endValue();
+		}
+		return true;
+
+	case eJS_Done:
+		return isSpace(c) || fail(eJPE_Syntax);
+
+	case eJS_Error:
+		return false;
+
+	default:
+		break;
+	}
+
+	// The remaining states skip white space between tokens
+	if(isSpace(c)) {
+		return true;
+	}
+
+	switch(state) {
+	case eJS_ValueOrArrayEnd:
+		if(c == ']') {
+			return endContainer();
+		}
+	// fall-through
+
+	case eJS_Value:
+		if(!beginValue()) {
+			return false;
+		}
+		switch(c) {
+		case '{':
+			return beginContainer(false);
+		case '[':
+			return beginContainer(true);
+		case '"':
+			inKey = false;
+			tokenLength = 0;
+			token[0] = '\0';
+			state = eJS_String;
+			return true;
+		case 't':
+			literal = "true";
+			break;
+		case 'f':
+			literal = "false";
+			break;
+		case 'n':
+			literal = "null";
+			break;
+		default:
+			if(c == '-' || isDigit(c)) {
+				token[0] = c;
+				token[1] = '\0';
+				tokenLength = 1;
+				state = eJS_Number;
+				return true;
+			}
+			return fail(eJPE_Syntax);
+		}
+		literalPos = 1;
+		state = eJS_Literal;
+		return true;
+
+	case eJS_KeyOrObjectEnd:
+		if(c == '}') {
+			return endContainer();
+		}
+	// fall-through
+
+	case eJS_Key:
+		if(c != '"') {
+			return fail(eJPE_Syntax);
+		}
+		inKey = true;
+		state = eJS_String;
+		return appendPath(".", 1);
+
+	case eJS_Colon:
+		if(c != ':') {
+			return fail(eJPE_Syntax);
+		}
+		state = eJS_Value;
+		return true;
+
+	case eJS_CommaOrEnd: {
+		bool isArray = levels[depth - 1].isArray;
+		if(c == ',') {
+			state = isArray ? eJS_Value : eJS_Key;
+			return true;
+		}
+		if(c == (isArray ? ']' : '}')) {
+			return endContainer();
+		}
+		return fail(eJPE_Syntax);
+	}
+
+	default:
+		return fail(eJPE_Syntax);
+	}
+}
+
+bool JsonParser::parse(const char* data, int length)
+{
+	if(length == JSON_PARSE_START) {
+		reset();
+		return true;
+	}
+
+	if(state == eJS_Error) {
+		return false;
+	}
+
+	if(length == JSON_PARSE_END) {
+		// A number at the root only ends with the input
+		if(state == eJS_Number && depth == 0 && !endNumber()) {
+			return false;
+		}
+		return state == eJS_Done || fail(eJPE_Incomplete);
+	}
+
+	for(int i = 0; i < length; ++i) {
+		if(!step(data[i])) {
+			if(error == eJPE_Stopped) {
+				debug_i("JsonParser: stopped at %u", offset);
+			} else {
+				debug_w("JsonParser: error %u at %u, '%s'", error, offset, path);
+			}
+			return false;
+		}
+		++offset;
+	}
+	return true;
+}
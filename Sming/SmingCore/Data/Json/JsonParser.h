@@ -0,0 +1,249 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * JsonParser.h
+ *
+ * Reads JSON a piece at a time, as it arrives, and reports each value as an
+ * event instead of building a document. Memory use is fixed by the limits
+ * below, whatever the size of the input.
+ *
+ * Every event carries the path of its value, such as "$.data.items[3].value".
+ * Handlers can be attached to a path pattern, where "[*]" stands for any
+ * array index and ".*" for any member name:
+ *
+ * 	JsonParser parser;
+ * 	parser.on("$.data.items[*].value", [](JsonParser& parser, const JsonEvent& event) {
+ * 		total += event.toInt();
+ * 		return true;
+ * 	});
+ *
+ * The start and end of the input are marked with the same special lengths
+ * as used by HTTP body parsers and MQTT payload parsers, so the parser can
+ * be fed from either directly, or from an HttpRequest::onBody() callback:
+ *
+ * 	mqtt.setPayloadParser([](MqttPayloadParserState& state, mqtt_message_t* message, const char* buffer, int length) {
+ * 		return parser.parse(buffer, length) ? 0 : -1;
+ * 	});
+ *
+ * Long strings are passed on in parts, each marked as partial except the last.
+ * Member names containing '.' or '[' can't be told apart in paths.
+ *
+ ****/
+
+/** @addtogroup json
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_JSON_PARSER_H_
+#define _SMING_CORE_DATA_JSON_PARSER_H_
+
+#include "WString.h"
+#include "Delegate.h"
+
+/** @brief Deepest nesting of objects and arrays */
+#ifndef JSON_PARSER_MAX_DEPTH
+#define JSON_PARSER_MAX_DEPTH 16
+#endif
+
+/** @brief Longest path, including member names and array indices */
+#ifndef JSON_PARSER_MAX_PATH
+#define JSON_PARSER_MAX_PATH 128
+#endif
+
+/** @brief Longest number, and the size of the parts long strings are passed on in */
+#ifndef JSON_PARSER_MAX_TOKEN
+#define JSON_PARSER_MAX_TOKEN 64
+#endif
+
+/** @brief Most path handlers */
+#ifndef JSON_PARSER_MAX_HANDLERS
+#define JSON_PARSER_MAX_HANDLERS 4
+#endif
+
+/** @brief special length values passed to JsonParser::parse(), as for PARSE_DATASTART and PARSE_DATAEND */
+#define JSON_PARSE_START -1
+#define JSON_PARSE_END -2
+
+enum JsonEventType {
+	eJET_ObjectStart,
+	eJET_ObjectEnd,
+	eJET_ArrayStart,
+	eJET_ArrayEnd,
+	eJET_String,
+	eJET_Number,
+	eJET_Bool,
+	eJET_Null,
+};
+
+enum JsonParserError {
+	eJPE_None,
+	eJPE_Syntax,		///< Not valid JSON
+	eJPE_TooDeep,		///< More than JSON_PARSER_MAX_DEPTH levels
+	eJPE_PathTooLong,   ///< Path longer than JSON_PARSER_MAX_PATH
+	eJPE_NumberTooLong, ///< Number longer than JSON_PARSER_MAX_TOKEN
+	eJPE_Incomplete,	///< Input ended part way through
+	eJPE_Stopped,		///< A handler returned false
+};
+
+struct JsonEvent {
+	JsonEventType type;
+	const char* path;  ///< Of the value, or of the object or array for start and end events
+	const char* key;   ///< Member name, nullptr for array elements and the root
+	unsigned index;	///< Position of an array element
+	unsigned depth;	///< 0 for the root
+	const char* value; ///< Text of a string, number or literal, nullptr for objects and arrays
+	unsigned length;   ///< Of value
+	bool partial;	  ///< More of this string follows in the next event
+
+	int toInt() const
+	{
+		return (type == eJET_Number) ? atoi(value) : 0;
+	}
+
+	float toFloat() const
+	{
+		return (type == eJET_Number) ? atof(value) : 0;
+	}
+
+	bool toBool() const
+	{
+		return type == eJET_Bool && value[0] == 't';
+	}
+
+	String toString() const
+	{
+		return (value == nullptr) ? String() : String(value, length);
+	}
+};
+
+class JsonParser;
+
+/** @brief Called for each event
+ *  @retval bool false to stop parsing
+ */
+typedef Delegate<bool(JsonParser& parser, const JsonEvent& event)> JsonEventDelegate;
+
+class JsonParser
+{
+public:
+	JsonParser()
+	{
+		reset();
+	}
+
+	/** @brief Call a handler for events whose path matches a pattern
+	 *  @param pattern Path, with "[*]" to match any index and ".*" any member name
+	 *  @retval bool false if there are already JSON_PARSER_MAX_HANDLERS
+	 */
+	bool on(const String& pattern, JsonEventDelegate handler);
+
+	/** @brief Call a handler for every event */
+	void onEvent(JsonEventDelegate handler)
+	{
+		eventHandler = handler;
+	}
+
+	/** @brief Process the next part of the input
+	 *  @param data
+	 *  @param length JSON_PARSE_START to begin a new document, JSON_PARSE_END when it's finished
+	 *  @retval bool false if there was an error, the rest of the document is then ignored
+	 */
+	bool parse(const char* data, int length);
+
+	/** @brief Get ready for a new document, handlers are kept */
+	void reset();
+
+	/** @brief Whether a complete document has been read */
+	bool isComplete() const
+	{
+		return state == eJS_Done;
+	}
+
+	JsonParserError getError() const
+	{
+		return error;
+	}
+
+	/** @brief Position in the input of the first error */
+	size_t getErrorOffset() const
+	{
+		return offset;
+	}
+
+	/** @brief Path of the value being read */
+	const char* getPath() const
+	{
+		return path;
+	}
+
+	/** @brief Match a path against a pattern as for on() */
+	static bool matchPath(const char* pattern, const char* path);
+
+private:
+	enum State {
+		eJS_Value,
+		eJS_ValueOrArrayEnd,
+		eJS_KeyOrObjectEnd,
+		eJS_Key,
+		eJS_Colon,
+		eJS_CommaOrEnd,
+		eJS_String,
+		eJS_Escape,
+		eJS_Unicode,
+		eJS_Number,
+		eJS_Literal,
+		eJS_Done,
+		eJS_Error,
+	};
+
+	struct Level {
+		uint16_t pathLength; ///< Path of the object or array
+		bool isArray;
+		unsigned index; ///< Of the next array element
+	};
+
+	struct Handler {
+		String pattern;
+		JsonEventDelegate delegate;
+	};
+
+	bool step(char c);
+	bool fail(JsonParserError err);
+	bool emit(JsonEventType type, const char* value = nullptr, unsigned length = 0, bool partial = false);
+	bool appendPath(const char* text, unsigned length);
+	bool beginValue();
+	bool endValue();
+	bool beginContainer(bool isArray);
+	bool endContainer();
+	bool putChar(char c);
+	bool putCodePoint(uint32_t code);
+	bool endString();
+	bool endNumber();
+
+private:
+	Handler handlers[JSON_PARSER_MAX_HANDLERS];
+	unsigned handlerCount = 0;
+	JsonEventDelegate eventHandler;
+
+	State state;
+	JsonParserError error;
+	size_t offset; ///< Bytes read
+	Level levels[JSON_PARSER_MAX_DEPTH];
+	unsigned depth;
+	char path[JSON_PARSER_MAX_PATH + 1];
+	unsigned pathLength;
+	char token[JSON_PARSER_MAX_TOKEN + 1]; ///< Number or string value
+	unsigned tokenLength;
+	bool inKey;			///< Reading a member name, which goes straight into the path
+	const char* literal; ///< true, false or null being matched
+	uint8_t literalPos;
+	uint8_t hexDigits; ///< Of a \u escape
+	uint16_t unicode;
+	uint16_t highSurrogate; ///< First half of a pair, waiting for the second
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_JSON_PARSER_H_ */
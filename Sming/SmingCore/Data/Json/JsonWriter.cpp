@@ -0,0 +1,217 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * JsonWriter.cpp
+ *
+ ****/
+
+#include "JsonWriter.h"
+#include <math.h>
+
+bool JsonWriter::writeName(const char* name)
+{
+	if(skipped != 0) {
+		return false;
+	}
+
+	if(depth != 0) {
+		uint32_t bit = BIT(depth - 1);
+		if(started & bit) {
+			out.write(',');
+		}
+		started |= bit;
+	}
+
+	// Array elements have no name, and nor does the root
+	if(name != nullptr && depth != 0 && !(arrays & BIT(depth - 1))) {
+		writeString(name, strlen(name));
+		out.write(':');
+	}
+	return true;
+}
+
+void JsonWriter::open(const char* name, bool isArray)
+{
+	if(skipped != 0 || depth == maxDepth) {
+		// Counted so the matching close() doesn't close the parent
+		if(!truncated) {
+			debug_e("JsonWriter: too deep");
+			truncated = true;
+		}
+		++skipped;
+		return;
+	}
+
+	writeName(name);
+	out.write(isArray ? '[' : '{');
+
+	uint32_t bit = BIT(depth);
+	if(isArray) {
+		arrays |= bit;
+	} else {
+		arrays &= ~bit;
+	}
+	started &= ~bit;
+	++depth;
+}
+
+void JsonWriter::close()
+{
+	if(skipped != 0) {
+		--skipped;
+		return;
+	}
+	if(depth == 0) {
+		return;
+	}
+	--depth;
+	out.write((arrays & BIT(depth)) ? ']' : '}');
+}
+
+void JsonWriter::end()
+{
+	skipped = 0;
+	while(depth != 0) {
+		close();
+	}
+}
+
+void JsonWriter::writeString(const char* str, size_t length)
+{
+	out.write('"');
+
+	// Write runs of plain characters in one go
+	size_t run = 0;
+	for(size_t i = 0; i < length; ++i) {
+		uint8_t c = str[i];
+		if(c >= 0x20 && c != '"' && c != '\\') {
+			continue;
+		}
+
+		out.write(&str[run], i - run);
+		run = i + 1;
+
+		char esc[7] = {'\\'};
+		switch(c) {
+		case '"':
+		case '\\':
+			esc[1] = c;
+			break;
+		case '\b':
+			esc[1] = 'b';
+			break;
+		case '\f':
+			esc[1] = 'f';
+			break;
+		case '\n':
+			esc[1] = 'n';
+			break;
+		case '\r':
+			esc[1] = 'r';
+			break;
+		case '\t':
+			esc[1] = 't';
+			break;
+		default:
+			m_snprintf(esc, sizeof(esc), "\\u%04x", c);
+		}
+		out.write(esc);
+	}
+	out.write(&str[run], length - run);
+
+	out.write('"');
+}
+
+void JsonWriter::addString(const char* name, const char* value, size_t length)
+{
+	if(writeName(name)) {
+		writeString(value, length);
+	}
+}
+
+void JsonWriter::add(const char* name, const char* value)
+{
+	if(value == nullptr) {
+		addNull(name);
+	} else {
+		addString(name, value, strlen(value));
+	}
+}
+
+void JsonWriter::add(const char* name, int value)
+{
+	if(writeName(name)) {
+		out.print(value);
+	}
+}
+
+void JsonWriter::add(const char* name, unsigned value)
+{
+	if(writeName(name)) {
+		out.print(value);
+	}
+}
+
+void JsonWriter::add(const char* name, long value)
+{
+	if(writeName(name)) {
+		out.print(value);
+	}
+}
+
+void JsonWriter::add(const char* name, unsigned long value)
+{
+	if(writeName(name)) {
+		out.print(value);
+	}
+}
+
+void JsonWriter::add(const char* name, bool value)
+{
+	if(writeName(name)) {
+		out.write(value ? "true" : "false");
+	}
+}
+
+void JsonWriter::add(const char* name, double value, unsigned char digits)
+{
+	if(isnan(value) || isinf(value)) {
+		addNull(name);
+		return;
+	}
+
+	if(!writeName(name)) {
+		return;
+	}
+
+	// Print only copes with the range of an unsigned long, so scale anything bigger
+	int exponent = 0;
+	if(fabs(value) > 4294967040.0) {
+		while(fabs(value) >= 10.0) {
+			value /= 10.0;
+			++exponent;
+		}
+	}
+	out.print(value, digits);
+	if(exponent != 0) {
+		out.write('e');
+		out.print(exponent);
+	}
+}
+
+void JsonWriter::addNull(const char* name)
+{
+	if(writeName(name)) {
+		out.write("null");
+	}
+}
+
+void JsonWriter::addRaw(const char* name, const char* json)
+{
+	if(writeName(name)) {
+		out.write(json);
+	}
+}
@@ -0,0 +1,142 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * JsonWriter.h
+ *
+ * Writes JSON text straight to a Print as values are added, without building
+ * a document first. It only keeps track of which objects and arrays are open,
+ * to put the commas and closing brackets in the right places.
+ *
+ * Members of an object are added with a name, elements of an array without
+ * one (or with nullptr as the name):
+ *
+ * 	JsonWriter json(Serial);
+ * 	json.beginObject();
+ * 	json.add("uptime", millis());
+ * 	json.beginArray("pins");
+ * 	json.add(4);
+ * 	json.add(5);
+ * 	json.end();
+ *
+ * produces {"uptime":1234,"pins":[4,5]}
+ *
+ ****/
+
+/** @defgroup   json JSON
+ *  @brief      Producing and consuming JSON without a document in RAM
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_JSON_WRITER_H_
+#define _SMING_CORE_DATA_JSON_WRITER_H_
+
+#include "Print.h"
+#include "WString.h"
+
+class JsonWriter
+{
+public:
+	/** @brief Deepest nesting of objects and arrays */
+	static const unsigned maxDepth = 32;
+
+	JsonWriter(Print& out) : out(out)
+	{
+	}
+
+	/** @brief Start an object
+	 *  @param name Member name, nullptr for the root or an array element
+	 */
+	void beginObject(const char* name = nullptr)
+	{
+		open(name, false);
+	}
+
+	/** @brief Start an array
+	 *  @param name Member name, nullptr for the root or an array element
+	 */
+	void beginArray(const char* name = nullptr)
+	{
+		open(name, true);
+	}
+
+	/** @brief Close the innermost object */
+	void endObject()
+	{
+		close();
+	}
+
+	/** @brief Close the innermost array */
+	void endArray()
+	{
+		close();
+	}
+
+	/** @brief Close all objects and arrays still open */
+	void end();
+
+	/** @brief Number of objects and arrays open */
+	unsigned getDepth() const
+	{
+		return depth + skipped;
+	}
+
+	/** @brief Whether anything was left out for being nested deeper than maxDepth
+	 *  @note Objects and arrays past maxDepth are dropped along with their contents,
+	 *  so the output stays well formed
+	 */
+	bool isTruncated() const
+	{
+		return truncated;
+	}
+
+	void add(const char* name, const char* value);
+	void add(const char* name, const String& value)
+	{
+		addString(name, value.c_str(), value.length());
+	}
+	void add(const char* name, int value);
+	void add(const char* name, unsigned value);
+	void add(const char* name, long value);
+	void add(const char* name, unsigned long value);
+	void add(const char* name, bool value);
+
+	/** @brief Add a number
+	 *  @param digits Decimal places
+	 *  @note NaN and infinity can't be represented in JSON, they're written as null
+	 */
+	void add(const char* name, double value, unsigned char digits = 2);
+
+	void addNull(const char* name = nullptr);
+
+	/** @brief Add text which is already JSON, such as a value saved from earlier */
+	void addRaw(const char* name, const char* json);
+
+	/** @brief Add an array element */
+	template <typename T> void add(const T& value)
+	{
+		add(nullptr, value);
+	}
+
+	/** @brief Write a string with JSON escapes, quotes included */
+	void writeString(const char* str, size_t length);
+
+private:
+	void open(const char* name, bool isArray);
+	void close();
+	bool writeName(const char* name);
+	void addString(const char* name, const char* value, size_t length);
+
+private:
+	Print& out;
+	unsigned depth = 0;
+	uint32_t arrays = 0;  ///< Bit set for each level which is an array
+	uint32_t started = 0; ///< Bit set for each level which has something in it, so needs a comma before the next
+	unsigned skipped = 0; ///< Levels open beyond maxDepth, whose contents are dropped
+	bool truncated = false;
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_JSON_WRITER_H_ */
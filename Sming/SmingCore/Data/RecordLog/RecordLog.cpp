@@ -0,0 +1,382 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * RecordLog.cpp
+ *
+ ****/
+
+#include "RecordLog.h"
+#include <algorithm>
+
+#define RECORD_LOG_MAGIC 0x474F4C52 // "RLOG"
+
+static uint16_t alignRecord(uint16_t size)
+{
+	return (size + 3) & ~3;
+}
+
+bool RecordLog::open(uint32_t flashAddress, uint16_t sectorCount)
+{
+	close();
+	if(flashAddress % INTERNAL_FLASH_SECTOR_SIZE != 0 || sectorCount < 3 ||
+	   flashAddress + uint32_t(sectorCount) * INTERNAL_FLASH_SECTOR_SIZE > flashmem_get_size_bytes()) {
+		debug_e("RecordLog: bad area");
+		return false;
+	}
+
+	this->flashAddress = flashAddress;
+	this->sectorCount = sectorCount;
+	headIndex = sectorCount - 1;
+	headSequence = 0;
+	sectorsInUse = 0;
+	headOpen = false;
+	nextErased = false;
+	bufferLength = 0;
+	lastTime = 0;
+
+	SectorHeader header;
+	for(uint16_t i = 0; i < sectorCount; ++i) {
+		if(readHeader(i, header) && header.sequence > headSequence) {
+			headIndex = i;
+			headSequence = header.sequence;
+		}
+	}
+	if(headSequence == 0) {
+		debug_i("RecordLog: empty");
+		return true;
+	}
+
+	// Sectors are used in turn, so the log runs back from the newest one
+	sectorsInUse = 1;
+	while(sectorsInUse < sectorCount && sectorsInUse < headSequence) {
+		uint16_t index = (headIndex + sectorCount - sectorsInUse) % sectorCount;
+		if(!readHeader(index, header) || header.sequence != headSequence - sectorsInUse) {
+			break;
+		}
+		++sectorsInUse;
+	}
+
+	// Find the end of the newest sector
+	bufferStart = INTERNAL_FLASH_SECTOR_SIZE;
+	readHeader(headIndex, header);
+	lastTime = header.firstTime;
+	RecordLogCursor cursor;
+	cursor.sequence = headSequence;
+	cursor.offset = sizeof(SectorHeader);
+	RecordHeader record;
+	while(readRecord(cursor, record)) {
+		lastTime = record.time;
+		cursor.offset += alignRecord(sizeof(record) + record.length);
+	}
+	writeOffset = cursor.offset;
+	bufferStart = writeOffset;
+
+	// Anything but erased flash here means a write was cut short, so leave the sector alone
+	headOpen = true;
+	if(writeOffset + sizeof(record) <= INTERNAL_FLASH_SECTOR_SIZE) {
+		flashmem_read(&record, sectorAddress(headIndex) + writeOffset, sizeof(record));
+		const uint32_t* words = reinterpret_cast<const uint32_t*>(&record);
+		if(words[0] != 0xFFFFFFFF || words[1] != 0xFFFFFFFF) {
+			debug_w("RecordLog: torn record at sector %u offset %u", headIndex, writeOffset);
+			headOpen = false;
+		}
+	}
+
+	debug_i("RecordLog: %u sectors in use, head %u", sectorsInUse, headIndex);
+	return true;
+}
+
+void RecordLog::close()
+{
+	if(isOpen()) {
+		flush();
+	}
+	eraseTimer.stop();
+	sectorCount = 0;
+}
+
+bool RecordLog::readHeader(uint16_t index, SectorHeader& header) const
+{
+	if(flashmem_read(&header, sectorAddress(index), sizeof(header)) != sizeof(header)) {
+		return false;
+	}
+	return header.magic == RECORD_LOG_MAGIC && header.sequence != 0 && header.sequence != 0xFFFFFFFF &&
+		   header.check == ~(header.magic ^ header.sequence ^ header.firstTime);
+}
+
+bool RecordLog::readBytes(uint32_t sequence, uint16_t offset, void* data, uint16_t length) const
+{
+	auto dst = static_cast<uint8_t*>(data);
+	uint16_t index = sectorIndex(sequence);
+
+	// The end of the head sector may still be in RAM
+	if(sequence == headSequence && offset + length > bufferStart) {
+		uint16_t flashLength = offset < bufferStart ? bufferStart - offset : 0;
+		uint16_t bufferOffset = offset + flashLength - bufferStart;
+		if(bufferOffset + length - flashLength > bufferLength) {
+			return false;
+		}
+		memcpy(dst + flashLength, reinterpret_cast<const uint8_t*>(buffer) + bufferOffset, length - flashLength);
+		length = flashLength;
+	}
+
+	return length == 0 || flashmem_read(dst, sectorAddress(index) + offset, length) == length;
+}
+
+bool RecordLog::readRecord(const RecordLogCursor& cursor, RecordHeader& header) const
+{
+	if(cursor.sequence == headSequence && cursor.offset >= writeOffset && headOpen) {
+		return false;
+	}
+	if(cursor.offset + sizeof(header) > INTERNAL_FLASH_SECTOR_SIZE ||
+	   !readBytes(cursor.sequence, cursor.offset, &header, sizeof(header))) {
+		return false;
+	}
+	if(header.length == 0 || header.length > getMaxRecordSize() ||
+	   cursor.offset + sizeof(header) + header.length > INTERNAL_FLASH_SECTOR_SIZE) {
+		return false;
+	}
+
+	uint8_t data[getMaxRecordSize()];
+	return readBytes(cursor.sequence, cursor.offset + sizeof(header), data, header.length) &&
+		   header.crc == crc(header, data);
+}
+
+uint16_t RecordLog::crc(const RecordHeader& header, const void* data)
+{
+	// CRC-16/CCITT over the length, time and data
+	uint16_t crc = 0xFFFF;
+	auto update = [&crc](const void* buf, unsigned len) {
+		auto p = static_cast<const uint8_t*>(buf);
+		while(len--) {
+			crc ^= uint16_t(*p++) << 8;
+			for(unsigned i = 0; i < 8; ++i) {
+				crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+			}
+		}
+	};
+	update(&header.length, sizeof(header.length));
+	update(&header.time, sizeof(header.time));
+	update(data, header.length);
+	return crc;
+}
+
+bool RecordLog::append(const void* data, uint16_t length, uint32_t time)
+{
+	if(!isOpen() || data == nullptr || length == 0 || length > getMaxRecordSize()) {
+		return false;
+	}
+
+	uint16_t size = alignRecord(sizeof(RecordHeader) + length);
+	if(!headOpen || writeOffset + size > INTERNAL_FLASH_SECTOR_SIZE) {
+		if(!startSector(time)) {
+			return false;
+		}
+	}
+
+	RecordHeader header;
+	header.length = length;
+	header.time = time;
+	header.crc = crc(header, data);
+
+	// Padding is left erased
+	auto buf = reinterpret_cast<uint8_t*>(buffer) + bufferLength;
+	memcpy(buf, &header, sizeof(header));
+	memcpy(buf + sizeof(header), data, length);
+	memset(buf + sizeof(header) + length, 0xFF, size - sizeof(header) - length);
+	bufferLength += size;
+	writeOffset += size;
+	lastTime = time;
+
+	return writePages(false);
+}
+
+bool RecordLog::flush()
+{
+	return !isOpen() || writePages(true);
+}
+
+bool RecordLog::writePages(bool all)
+{
+	// Full pages only, unless asked for everything
+	uint16_t end = bufferStart + bufferLength;
+	uint16_t pageEnd = end & ~(RECORD_LOG_PAGE_SIZE - 1);
+	uint16_t length = all ? bufferLength : (pageEnd > bufferStart ? pageEnd - bufferStart : 0);
+	if(length == 0) {
+		return true;
+	}
+
+	bool ok = flashmem_write(buffer, sectorAddress(headIndex) + bufferStart, length) == length;
+	bufferLength -= length;
+	bufferStart += length;
+	memmove(buffer, reinterpret_cast<uint8_t*>(buffer) + length, bufferLength);
+	if(!ok) {
+		debug_e("RecordLog: write failed at sector %u offset %u", headIndex, bufferStart - length);
+		headOpen = false;
+		bufferLength = 0;
+		return false;
+	}
+
+	// Get the next sector ready well before it's needed, so an append doesn't have to wait
+	if(!nextErased && bufferStart > INTERNAL_FLASH_SECTOR_SIZE / 2) {
+		scheduleErase();
+	}
+	return true;
+}
+
+void RecordLog::scheduleErase()
+{
+	if(!eraseTimer.isStarted()) {
+		eraseTimer.initializeMs(10, TimerDelegateStdFunction([this]() { eraseNext(); })).startOnce();
+	}
+}
+
+bool RecordLog::eraseNext()
+{
+	if(nextErased || !isOpen()) {
+		return true;
+	}
+
+	uint16_t next = (headIndex + 1) % sectorCount;
+	if(sectorsInUse == sectorCount) {
+		// Oldest sector goes
+		--sectorsInUse;
+	}
+	if(!flashmem_erase_sector(flashmem_get_sector_of_address(sectorAddress(next)))) {
+		debug_e("RecordLog: erase failed, sector %u", next);
+		return false;
+	}
+	nextErased = true;
+	return true;
+}
+
+bool RecordLog::startSector(uint32_t time)
+{
+	if(!writePages(true)) {
+		return false;
+	}
+	eraseTimer.stop();
+	if(!eraseNext()) {
+		return false;
+	}
+
+	headIndex = (headIndex + 1) % sectorCount;
+	++headSequence;
+	if(sectorsInUse < sectorCount) {
+		++sectorsInUse;
+	}
+	nextErased = false;
+
+	SectorHeader header;
+	header.magic = RECORD_LOG_MAGIC;
+	header.sequence = headSequence;
+	header.firstTime = time;
+	header.check = ~(header.magic ^ header.sequence ^ header.firstTime);
+	memcpy(buffer, &header, sizeof(header));
+	bufferStart = 0;
+	bufferLength = sizeof(header);
+	writeOffset = sizeof(header);
+	headOpen = true;
+	return true;
+}
+
+bool RecordLog::clear()
+{
+	if(!isOpen()) {
+		return false;
+	}
+
+	eraseTimer.stop();
+	bool ok = true;
+	for(uint16_t i = 0; i < sectorCount; ++i) {
+		SectorHeader header;
+		if(readHeader(i, header) || header.magic != 0xFFFFFFFF) {
+			ok &= flashmem_erase_sector(flashmem_get_sector_of_address(sectorAddress(i)));
+		}
+	}
+
+	// Sequence numbers carry on, so a sector left over from a failed erase can't be mistaken for the head
+	headIndex = sectorCount - 1;
+	sectorsInUse = 0;
+	headOpen = false;
+	nextErased = true;
+	bufferLength = 0;
+	return ok;
+}
+
+bool RecordLog::seek(RecordLogCursor& cursor, uint32_t time)
+{
+	if(!isOpen() || sectorsInUse == 0) {
+		return false;
+	}
+
+	// Find the last sector starting at or before the time
+	uint32_t low = tailSequence();
+	uint32_t high = headSequence;
+	while(low < high) {
+		uint32_t mid = low + (high - low + 1) / 2;
+		SectorHeader header;
+		// The head sector's header may not have been written yet
+		if(!readBytes(mid, 0, &header, sizeof(header))) {
+			return false;
+		}
+		if(header.firstTime <= time) {
+			low = mid;
+		} else {
+			high = mid - 1;
+		}
+	}
+
+	cursor.sequence = low;
+	cursor.offset = sizeof(SectorHeader);
+	RecordLogCursor next = cursor;
+	uint32_t recordTime;
+	while(read(next, recordTime, nullptr, 0) > 0) {
+		if(recordTime >= time) {
+			return true;
+		}
+		cursor = next;
+	}
+	return false;
+}
+
+int RecordLog::read(RecordLogCursor& cursor, uint32_t& time, void* buffer, uint16_t bufferSize)
+{
+	if(!isOpen() || sectorsInUse == 0) {
+		return 0;
+	}
+
+	for(;;) {
+		if(cursor.sequence < tailSequence()) {
+			cursor.sequence = tailSequence();
+			cursor.offset = sizeof(SectorHeader);
+		}
+		if(cursor.sequence > headSequence) {
+			return 0;
+		}
+		if(cursor.offset < sizeof(SectorHeader)) {
+			cursor.offset = sizeof(SectorHeader);
+		}
+
+		RecordHeader header;
+		if(readRecord(cursor, header)) {
+			uint16_t length = std::min(header.length, bufferSize);
+			if(length != 0 && !readBytes(cursor.sequence, cursor.offset + sizeof(header), buffer, length)) {
+				return 0;
+			}
+			time = header.time;
+			cursor.offset += alignRecord(sizeof(header) + header.length);
+			return header.length;
+		}
+
+		// End of the sector, or a torn record
+		if(cursor.sequence == headSequence) {
+			return 0;
+		}
+		++cursor.sequence;
+		cursor.offset = sizeof(SectorHeader);
+	}
+}
@@ -0,0 +1,181 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * RecordLog.h
+ *
+ * Ring buffer of timestamped records in a flash area of its own, for logging
+ * sensor readings and the like without going through SPIFFS.
+ *
+ * Records are collected in RAM and written a flash page at a time. Sectors are
+ * used in turn, so wear is spread evenly, and once the area is full the oldest
+ * sector is erased to make room. Each sector header holds a sequence number
+ * and the time of its first record: the newest sector is found by sequence
+ * number when the log is opened, and reads by time start with a binary search
+ * of the headers. Every record has a CRC, so one torn by a reset is ignored
+ * and writing carries on in the next sector.
+ *
+ * Timestamps can be in any unit, but must not go backwards.
+ *
+ * 	RecordLog readings;
+ * 	...
+ * 	readings.open(0x300000, 64);
+ * 	readings.append(&reading, sizeof(reading), RTC.getRtcSeconds());
+ * 	...
+ * 	RecordLogCursor cursor;
+ * 	readings.seek(cursor, RTC.getRtcSeconds() - 600);
+ * 	uint32_t time;
+ * 	while(readings.read(cursor, time, &reading, sizeof(reading)) > 0) {
+ * 		...
+ * 	}
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_RECORD_LOG_H_
+#define _SMING_CORE_DATA_RECORD_LOG_H_
+
+#include "flashmem.h"
+#include "../../Timer.h"
+
+/** @brief Records are batched up in RAM and written to flash this many bytes at a time */
+#ifndef RECORD_LOG_PAGE_SIZE
+#define RECORD_LOG_PAGE_SIZE 256
+#endif
+
+/** @brief Position of a record in the log */
+struct RecordLogCursor {
+	uint32_t sequence = 0; ///< Sector sequence number, 0 for the oldest sector
+	uint16_t offset = 0;   ///< From the start of the sector
+};
+
+class RecordLog
+{
+public:
+	~RecordLog()
+	{
+		close();
+	}
+
+	/** @brief Open the log, recovering its contents
+	 *  @param flashAddress Start of the area, which must be sector aligned
+	 *  @param sectorCount At least 3
+	 *  @retval bool false if the area is unusable
+	 *  @note An area which doesn't hold a log is treated as empty, and overwritten
+	 */
+	bool open(uint32_t flashAddress, uint16_t sectorCount);
+
+	/** @brief Write out anything buffered and stop using the area */
+	void close();
+
+	bool isOpen() const
+	{
+		return sectorCount != 0;
+	}
+
+	/** @brief Add a record
+	 *  @param data
+	 *  @param length 1 to getMaxRecordSize() bytes
+	 *  @param time
+	 *  @retval bool false on error
+	 *  @note The record is held in RAM until a page's worth has been collected, call flush()
+	 *  if it has to survive a reset straight away
+	 */
+	bool append(const void* data, uint16_t length, uint32_t time);
+
+	/** @brief Write buffered records to flash
+	 *  @retval bool false on error
+	 */
+	bool flush();
+
+	/** @brief Erase all records */
+	bool clear();
+
+	static constexpr uint16_t getMaxRecordSize()
+	{
+		return RECORD_LOG_PAGE_SIZE - sizeof(RecordHeader);
+	}
+
+	/** @brief Get the time of the last record appended */
+	uint32_t getLastTime() const
+	{
+		return lastTime;
+	}
+
+	/** @brief Position a cursor at the first record at or after the given time
+	 *  @param cursor
+	 *  @param time 0 for the oldest record
+	 *  @retval bool false if there is no such record
+	 */
+	bool seek(RecordLogCursor& cursor, uint32_t time = 0);
+
+	/** @brief Read a record and move the cursor on to the next one
+	 *  @param cursor Records which have been overwritten are skipped
+	 *  @param time Timestamp of the record
+	 *  @param buffer
+	 *  @param bufferSize Longer records are truncated
+	 *  @retval int Length of the record, 0 if there are no more
+	 */
+	int read(RecordLogCursor& cursor, uint32_t& time, void* buffer, uint16_t bufferSize);
+
+private:
+	struct SectorHeader {
+		uint32_t magic;
+		uint32_t sequence;
+		uint32_t firstTime;
+		uint32_t check;
+	};
+
+	struct RecordHeader {
+		uint16_t length; ///< 0xFFFF where the next record goes
+		uint16_t crc;	///< Of the length, time and data
+		uint32_t time;
+	};
+
+	uint32_t sectorAddress(uint16_t index) const
+	{
+		return flashAddress + index * INTERNAL_FLASH_SECTOR_SIZE;
+	}
+
+	uint16_t sectorIndex(uint32_t sequence) const
+	{
+		return (headIndex + sectorCount - (headSequence - sequence) % sectorCount) % sectorCount;
+	}
+
+	uint32_t tailSequence() const
+	{
+		return headSequence - sectorsInUse + 1;
+	}
+
+	bool readHeader(uint16_t index, SectorHeader& header) const;
+	bool readBytes(uint32_t sequence, uint16_t offset, void* data, uint16_t length) const;
+	bool readRecord(const RecordLogCursor& cursor, RecordHeader& header) const;
+	bool startSector(uint32_t time);
+	bool eraseNext();
+	bool writePages(bool all);
+	void scheduleErase();
+	static uint16_t crc(const RecordHeader& header, const void* data);
+
+private:
+	uint32_t flashAddress = 0;
+	uint16_t sectorCount = 0;
+	uint16_t headIndex = 0;		 ///< Sector records are being added to
+	uint32_t headSequence = 0;   ///< 0 if the log is empty
+	uint16_t sectorsInUse = 0;   ///< Run of sectors ending with the head
+	uint16_t writeOffset = 0;	///< Where the next record goes in the head sector
+	uint16_t bufferStart = 0;	///< Head sector offset of the first buffered byte
+	uint16_t bufferLength = 0;
+	uint32_t lastTime = 0;
+	bool headOpen = false;   ///< Head can take more records
+	bool nextErased = false; ///< Sector after the head is ready for use
+	Timer eraseTimer;
+	uint32_t buffer[RECORD_LOG_PAGE_SIZE * 2 / sizeof(uint32_t)];
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_RECORD_LOG_H_ */
@@ -0,0 +1,39 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#include "AssetStream.h"
+#include <algorithm>
+
+uint16_t AssetStream::readMemoryBlock(char* data, int bufSize)
+{
+	if(data == nullptr || bufSize <= 0) {
+		return 0;
+	}
+
+	// Reads don't move the position, the caller seeks past what it used
+	return fileSystem.read(info, pos, data, std::min(bufSize, 0xFFFF));
+}
+
+bool AssetStream::seek(int len)
+{
+	if(len < 0 ? uint32_t(-len) > pos : uint32_t(len) > info.size - pos) {
+		return false;
+	}
+	pos += len;
+	return true;
+}
+
+String AssetStream::id() const
+{
+	if(!found) {
+		return nullptr;
+	}
+
+	char buf[9];
+	m_snprintf(buf, sizeof(buf), _F("%08x"), info.etag);
+	return String(buf);
+}
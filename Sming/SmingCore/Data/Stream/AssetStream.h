@@ -0,0 +1,86 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ ****/
+
+#ifndef _SMING_CORE_DATA_ASSET_STREAM_H_
+#define _SMING_CORE_DATA_ASSET_STREAM_H_
+
+#include "ReadWriteStream.h"
+#include "../AssetFS/AssetFileSystem.h"
+
+/**
+  * @brief      Read-only stream on a file in an asset image
+  * @ingroup    stream data
+  *
+  *  @{
+ */
+
+class AssetStream : public ReadWriteStream
+{
+public:
+	/** @brief Open a file
+	 *  @param fileName Name without a leading '/'
+	 *  @param fileSystem
+	 *  @note Check isValid() to see if the file was found
+	 */
+	AssetStream(const String& fileName, const AssetFileSystem& fileSystem = assetFS) : fileSystem(fileSystem)
+	{
+		found = fileSystem.find(fileName, info);
+	}
+
+	virtual StreamType getStreamType() const
+	{
+		return found ? eSST_File : eSST_Invalid;
+	}
+
+	virtual uint16_t readMemoryBlock(char* data, int bufSize);
+
+	virtual bool seek(int len);
+
+	virtual bool isFinished()
+	{
+		return pos >= info.size;
+	}
+
+	int available()
+	{
+		return info.size - pos;
+	}
+
+	/** @brief The ETag computed when the image was built */
+	virtual String id() const;
+
+	virtual String getName() const
+	{
+		return found ? fileSystem.getName(info) : nullptr;
+	}
+
+	String getMimeType() const
+	{
+		return found ? fileSystem.getMimeType(info) : nullptr;
+	}
+
+	// Read-only, but HttpResponse holds a ReadWriteStream
+	virtual size_t write(const uint8_t* buffer, size_t size)
+	{
+		return 0;
+	}
+
+	/** @brief Data is gzip-compressed and should be sent with "Content-Encoding: gzip" */
+	bool isCompressed() const
+	{
+		return info.isCompressed();
+	}
+
+private:
+	const AssetFileSystem& fileSystem;
+	AssetInfo info;
+	uint32_t pos = 0;
+	bool found;
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_ASSET_STREAM_H_ */
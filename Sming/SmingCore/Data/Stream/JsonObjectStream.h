@@ -13,6 +13,7 @@
 
 /** @brief JsonObject stream class
  * 	@ingroup    stream data
+ *  @note The whole document is built in RAM before any of it is sent, use JsonWriterStream for big ones
  *  @{
  *
  */
@@ -0,0 +1,76 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * JsonWriterStream.cpp
+ *
+ ****/
+
+#include "JsonWriterStream.h"
+#include <algorithm>
+
+// Buffer grows in steps of at least this much
+#define JSON_WRITER_STREAM_MIN_GROWTH 128
+
+size_t JsonWriterStream::write(const uint8_t* data, size_t size)
+{
+	if(length + size > capacity) {
+		size_t newCapacity = std::max(length + size, capacity + JSON_WRITER_STREAM_MIN_GROWTH);
+		auto newBuffer = static_cast<char*>(realloc(buffer, newCapacity));
+		if(newBuffer == nullptr) {
+			debug_e("JsonWriterStream: out of memory");
+			return 0;
+		}
+		buffer = newBuffer;
+		capacity = newCapacity;
+	}
+
+	memcpy(buffer + length, data, size);
+	length += size;
+	return size;
+}
+
+uint16_t JsonWriterStream::readMemoryBlock(char* data, int bufSize)
+{
+	if(bufSize <= 0) {
+		return 0;
+	}
+
+	// Only ask for more when there isn't enough to fill the caller's buffer
+	while(!done && length - readPos < size_t(bufSize)) {
+		if(readPos != 0) {
+			length -= readPos;
+			memmove(buffer, buffer + readPos, length);
+			readPos = 0;
+		}
+		if(!generator || !generator(writer, index++)) {
+			writer.end();
+			done = true;
+		}
+	}
+
+	size_t count = std::min(size_t(bufSize), length - readPos);
+	memcpy(data, buffer + readPos, count);
+	return count;
+}
+
+bool JsonWriterStream::seek(int len)
+{
+	if(len < 0 || size_t(len) > length - readPos) {
+		return false;
+	}
+
+	readPos += len;
+	if(readPos == length) {
+		readPos = 0;
+		length = 0;
+		if(done) {
+			free(buffer);
+			buffer = nullptr;
+			capacity = 0;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,107 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * JsonWriterStream.h
+ *
+ * JSON produced on demand as the stream is read, instead of being built up
+ * in a document first as JsonObjectStream does. The generator is called
+ * whenever more output is wanted, with a count of the calls made so far,
+ * and adds a few values each time; it returns false once there are no more.
+ * Anything left open is then closed. Only the output not yet sent is kept,
+ * so a response of any size needs about one TCP packet of RAM.
+ *
+ * 	bool writeLog(JsonWriter& json, unsigned index)
+ * 	{
+ * 		if(index == 0) {
+ * 			json.beginObject();
+ * 			json.add("device", deviceName);
+ * 			json.beginArray("readings");
+ * 		}
+ * 		if(index >= readingCount) {
+ * 			return false;
+ * 		}
+ * 		json.add(readings[index]);
+ * 		return true;
+ * 	}
+ * 	...
+ * 	response.sendDataStream(new JsonWriterStream(writeLog), MIME_JSON);
+ *
+ ****/
+
+#ifndef _SMING_CORE_DATA_JSON_WRITER_STREAM_H_
+#define _SMING_CORE_DATA_JSON_WRITER_STREAM_H_
+
+#include "ReadWriteStream.h"
+#include "Delegate.h"
+#include "../Json/JsonWriter.h"
+
+/** @addtogroup stream
+ *  @{
+ */
+
+/** @brief Produces the next part of a JSON document
+ *  @param json Writer to add values to
+ *  @param index 0 for the first call, 1 for the next and so on
+ *  @retval bool false when the document is complete
+ */
+typedef Delegate<bool(JsonWriter& json, unsigned index)> JsonWriterDelegate;
+
+class JsonWriterStream : public ReadWriteStream
+{
+public:
+	JsonWriterStream(JsonWriterDelegate generator) : generator(generator)
+	{
+	}
+
+	virtual ~JsonWriterStream()
+	{
+		free(buffer);
+	}
+
+	//Use base class documentation
+	virtual StreamType getStreamType() const
+	{
+		return eSST_JsonObject;
+	}
+
+	/** @brief Add text to the output, used by the JsonWriter
+	 *  @retval size_t size, or 0 if out of memory
+	 */
+	virtual size_t write(const uint8_t* data, size_t size);
+
+	//Use base class documentation
+	virtual uint16_t readMemoryBlock(char* data, int bufSize);
+
+	//Use base class documentation
+	virtual bool seek(int len);
+
+	//Use base class documentation
+	virtual bool isFinished()
+	{
+		return done && readPos == length;
+	}
+
+	/** @brief Get the writer, for adding values outside the generator
+	 *  @note Anything added before the stream is read comes first in the output
+	 */
+	JsonWriter& getWriter()
+	{
+		return writer;
+	}
+
+private:
+	JsonWriterDelegate generator;
+	JsonWriter writer{*this};
+	char* buffer = nullptr; ///< Output waiting to be read
+	size_t capacity = 0;
+	size_t length = 0;
+	size_t readPos = 0;
+	unsigned index = 0; ///< Generator calls made
+	bool done = false;
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_JSON_WRITER_STREAM_H_ */
@@ -0,0 +1,167 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * AssetFsDriver.cpp
+ *
+ ****/
+
+#include "AssetFsDriver.h"
+
+bool AssetFsDriver::find(const char* name, AssetInfo& info) const
+{
+	if(*name == '/') {
+		++name;
+	}
+
+	unsigned length = strlen(name);
+	if(length > 3 && strcmp(name + length - 3, ".gz") == 0) {
+		String plain(name, length - 3);
+		return fs.find(plain, info) && info.isCompressed();
+	}
+	return fs.find(name, info);
+}
+
+String AssetFsDriver::getName(const AssetInfo& info) const
+{
+	String name = fs.getName(info);
+	if(info.isCompressed()) {
+		name += ".gz";
+	}
+	return name;
+}
+
+void AssetFsDriver::fillStat(const AssetInfo& info, spiffs_stat& stat) const
+{
+	memset(&stat, 0, sizeof(stat));
+	stat.obj_id = info.etag;
+	stat.size = info.size;
+	stat.type = SPIFFS_TYPE_FILE;
+	strncpy(reinterpret_cast<char*>(stat.name), getName(info).c_str(), SPIFFS_OBJ_NAME_LEN - 1);
+}
+
+AssetFsDriver::Handle* AssetFsDriver::getHandle(file_t file)
+{
+	if(file < 0 || file >= ASSETFS_DRIVER_MAX_OPEN || !handles[file].used) {
+		return nullptr;
+	}
+	return &handles[file];
+}
+
+file_t AssetFsDriver::open(const char* name, FileOpenFlags flags)
+{
+	if(flags & (eFO_WriteOnly | eFO_Truncate | eFO_Append)) {
+		return SPIFFS_ERR_RO_NOT_IMPL;
+	}
+
+	file_t file = 0;
+	while(handles[file].used) {
+		if(++file == ASSETFS_DRIVER_MAX_OPEN) {
+			return SPIFFS_ERR_OUT_OF_FILE_DESCS;
+		}
+	}
+
+	Handle& handle = handles[file];
+	if(!find(name, handle.info)) {
+		return SPIFFS_ERR_NOT_FOUND;
+	}
+	handle.pos = 0;
+	handle.used = true;
+	return file;
+}
+
+void AssetFsDriver::close(file_t file)
+{
+	Handle* handle = getHandle(file);
+	if(handle != nullptr) {
+		handle->used = false;
+	}
+}
+
+int AssetFsDriver::read(file_t file, void* data, size_t size)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	size_t count = fs.read(handle->info, handle->pos, data, size);
+	handle->pos += count;
+	return count;
+}
+
+int AssetFsDriver::write(file_t file, const void* data, size_t size)
+{
+	return SPIFFS_ERR_RO_NOT_IMPL;
+}
+
+int AssetFsDriver::seek(file_t file, int offset, SeekOriginFlags origin)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+
+	int pos = offset;
+	if(origin == eSO_CurrentPos) {
+		pos += handle->pos;
+	} else if(origin == eSO_FileEnd) {
+		pos += handle->info.size;
+	}
+	if(pos < 0 || uint32_t(pos) > handle->info.size) {
+		return SPIFFS_ERR_SEEK_BOUNDS;
+	}
+	handle->pos = pos;
+	return pos;
+}
+
+int32_t AssetFsDriver::tell(file_t file)
+{
+	Handle* handle = getHandle(file);
+	return handle ? int32_t(handle->pos) : SPIFFS_ERR_BAD_DESCRIPTOR;
+}
+
+bool AssetFsDriver::eof(file_t file)
+{
+	Handle* handle = getHandle(file);
+	return handle == nullptr || handle->pos >= handle->info.size;
+}
+
+int AssetFsDriver::stat(const char* name, spiffs_stat& stat)
+{
+	AssetInfo info;
+	if(!find(name, info)) {
+		return SPIFFS_ERR_NOT_FOUND;
+	}
+	fillStat(info, stat);
+	return SPIFFS_OK;
+}
+
+int AssetFsDriver::fstat(file_t file, spiffs_stat& stat)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	fillStat(handle->info, stat);
+	return SPIFFS_OK;
+}
+
+int AssetFsDriver::remove(const char* name)
+{
+	return SPIFFS_ERR_RO_NOT_IMPL;
+}
+
+int AssetFsDriver::rename(const char* oldName, const char* newName)
+{
+	return SPIFFS_ERR_RO_NOT_IMPL;
+}
+
+void AssetFsDriver::list(Vector<String>& names)
+{
+	AssetInfo info;
+	for(uint32_t i = 0; fs.getInfo(i, info); ++i) {
+		names.add(getName(info));
+	}
+}
@@ -0,0 +1,72 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * AssetFsDriver.h
+ *
+ * Read-only access to an asset image through the file API. A compressed
+ * asset is found by its original name with ".gz" added, as it was before
+ * packing, so HttpResponse::sendFile() recognises it and sets the encoding.
+ *
+ * 	AssetFsDriver assetDriver(assetFS);
+ * 	...
+ * 	fileMount("assets", &assetDriver);
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_VFS_ASSETFS_DRIVER_H_
+#define _SMING_CORE_DATA_VFS_ASSETFS_DRIVER_H_
+
+#include "FileSystemDriver.h"
+#include "../AssetFS/AssetFileSystem.h"
+
+/** @brief Most files which can be open at once */
+#ifndef ASSETFS_DRIVER_MAX_OPEN
+#define ASSETFS_DRIVER_MAX_OPEN 4
+#endif
+
+class AssetFsDriver : public FileSystemDriver
+{
+public:
+	AssetFsDriver(const AssetFileSystem& fs) : fs(fs)
+	{
+	}
+
+	virtual file_t open(const char* name, FileOpenFlags flags);
+	virtual void close(file_t file);
+	virtual int read(file_t file, void* data, size_t size);
+	virtual int write(file_t file, const void* data, size_t size);
+	virtual int seek(file_t file, int offset, SeekOriginFlags origin);
+	virtual int32_t tell(file_t file);
+	virtual bool eof(file_t file);
+	virtual int stat(const char* name, spiffs_stat& stat);
+	virtual int fstat(file_t file, spiffs_stat& stat);
+	virtual int remove(const char* name);
+	virtual int rename(const char* oldName, const char* newName);
+	virtual void list(Vector<String>& names);
+
+private:
+	struct Handle {
+		AssetInfo info;
+		uint32_t pos;
+		bool used;
+	};
+
+	bool find(const char* name, AssetInfo& info) const;
+	Handle* getHandle(file_t file);
+	String getName(const AssetInfo& info) const;
+	void fillStat(const AssetInfo& info, spiffs_stat& stat) const;
+
+private:
+	const AssetFileSystem& fs;
+	Handle handles[ASSETFS_DRIVER_MAX_OPEN] = {};
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_VFS_ASSETFS_DRIVER_H_ */
@@ -0,0 +1,245 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * FatFsDriver.cpp
+ *
+ ****/
+
+#include "FatFsDriver.h"
+
+FatFsDriver::~FatFsDriver()
+{
+	for(unsigned i = 0; i < FATFS_DRIVER_MAX_OPEN; ++i) {
+		close(i);
+	}
+}
+
+int FatFsDriver::mapError(FRESULT res)
+{
+	switch(res) {
+	case FR_OK:
+		return SPIFFS_OK;
+	case FR_NO_FILE:
+	case FR_NO_PATH:
+	case FR_INVALID_NAME:
+		return SPIFFS_ERR_NOT_FOUND;
+	case FR_DENIED:
+		return SPIFFS_ERR_FULL;
+	case FR_EXIST:
+		return SPIFFS_ERR_CONFLICTING_NAME;
+	case FR_WRITE_PROTECTED:
+		return SPIFFS_ERR_RO_NOT_IMPL;
+	case FR_NOT_ENABLED:
+	case FR_NO_FILESYSTEM:
+	case FR_NOT_READY:
+		return SPIFFS_ERR_NOT_MOUNTED;
+	case FR_INVALID_OBJECT:
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	case FR_TOO_MANY_OPEN_FILES:
+		return SPIFFS_ERR_OUT_OF_FILE_DESCS;
+	default:
+		return SPIFFS_ERR_INTERNAL;
+	}
+}
+
+FatFsDriver::Handle* FatFsDriver::getHandle(file_t file)
+{
+	if(file < 0 || file >= FATFS_DRIVER_MAX_OPEN || handles[file].fil == nullptr) {
+		return nullptr;
+	}
+	return &handles[file];
+}
+
+file_t FatFsDriver::open(const char* name, FileOpenFlags flags)
+{
+	file_t file = 0;
+	while(handles[file].fil != nullptr) {
+		if(++file == FATFS_DRIVER_MAX_OPEN) {
+			return SPIFFS_ERR_OUT_OF_FILE_DESCS;
+		}
+	}
+
+	BYTE mode = 0;
+	if(flags & eFO_ReadOnly) {
+		mode |= FA_READ;
+	}
+	if(flags & eFO_WriteOnly) {
+		mode |= FA_WRITE;
+	}
+	if((flags & eFO_CreateNewAlways) == eFO_CreateNewAlways) {
+		mode |= FA_CREATE_ALWAYS;
+	} else if(flags & eFO_CreateIfNotExist) {
+		mode |= FA_OPEN_ALWAYS;
+	}
+
+	auto fil = new FIL;
+	if(fil == nullptr) {
+		return SPIFFS_ERR_OUT_OF_FILE_DESCS;
+	}
+	FRESULT res = f_open(fil, name, mode);
+	if(res == FR_OK && (flags & eFO_Truncate) && !(mode & FA_CREATE_ALWAYS)) {
+		res = f_truncate(fil);
+	}
+	if(res != FR_OK) {
+		if(res != FR_NO_FILE) {
+			debugf("f_open '%s' failed: %d", name, res);
+		}
+		delete fil;
+		return mapError(res);
+	}
+
+	Handle& handle = handles[file];
+	handle.fil = fil;
+	handle.name = name;
+	handle.append = flags & eFO_Append;
+	return file;
+}
+
+void FatFsDriver::close(file_t file)
+{
+	Handle* handle = getHandle(file);
+	if(handle != nullptr) {
+		f_close(handle->fil);
+		delete handle->fil;
+		handle->fil = nullptr;
+		handle->name = nullptr;
+	}
+}
+
+int FatFsDriver::read(file_t file, void* data, size_t size)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	UINT count;
+	FRESULT res = f_read(handle->fil, data, size, &count);
+	return res == FR_OK ? int(count) : mapError(res);
+}
+
+int FatFsDriver::write(file_t file, const void* data, size_t size)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	if(handle->append) {
+		FRESULT res = f_lseek(handle->fil, f_size(handle->fil));
+		if(res != FR_OK) {
+			return mapError(res);
+		}
+	}
+	UINT count;
+	FRESULT res = f_write(handle->fil, data, size, &count);
+	if(res != FR_OK) {
+		return mapError(res);
+	}
+	// FatFs reports a full volume as a short write
+	return (count == 0 && size != 0) ? SPIFFS_ERR_FULL : int(count);
+}
+
+int FatFsDriver::seek(file_t file, int offset, SeekOriginFlags origin)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+
+	int pos = offset;
+	if(origin == eSO_CurrentPos) {
+		pos += f_tell(handle->fil);
+	} else if(origin == eSO_FileEnd) {
+		pos += f_size(handle->fil);
+	}
+	// FatFs would extend the file, SPIFFS doesn't
+	if(pos < 0 || DWORD(pos) > f_size(handle->fil)) {
+		return SPIFFS_ERR_SEEK_BOUNDS;
+	}
+	FRESULT res = f_lseek(handle->fil, pos);
+	return res == FR_OK ? pos : mapError(res);
+}
+
+int32_t FatFsDriver::tell(file_t file)
+{
+	Handle* handle = getHandle(file);
+	return handle ? int32_t(f_tell(handle->fil)) : SPIFFS_ERR_BAD_DESCRIPTOR;
+}
+
+bool FatFsDriver::eof(file_t file)
+{
+	Handle* handle = getHandle(file);
+	return handle == nullptr || f_eof(handle->fil);
+}
+
+int FatFsDriver::flush(file_t file)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	return mapError(f_sync(handle->fil));
+}
+
+int FatFsDriver::stat(const char* name, spiffs_stat& stat)
+{
+	FILINFO info;
+	FRESULT res = f_stat(name, &info);
+	if(res != FR_OK) {
+		return mapError(res);
+	}
+	if(info.fattrib & AM_DIR) {
+		return SPIFFS_ERR_NOT_A_FILE;
+	}
+
+	memset(&stat, 0, sizeof(stat));
+	// Time of last change, to the nearest two seconds, stands in for the object ID
+	stat.obj_id = info.ftime ^ info.fdate;
+	stat.size = info.fsize;
+	stat.type = SPIFFS_TYPE_FILE;
+	strncpy(reinterpret_cast<char*>(stat.name), name, SPIFFS_OBJ_NAME_LEN - 1);
+	return SPIFFS_OK;
+}
+
+int FatFsDriver::fstat(file_t file, spiffs_stat& stat)
+{
+	Handle* handle = getHandle(file);
+	if(handle == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+
+	memset(&stat, 0, sizeof(stat));
+	stat.obj_id = handle->fil->sclust;
+	stat.size = f_size(handle->fil);
+	stat.type = SPIFFS_TYPE_FILE;
+	strncpy(reinterpret_cast<char*>(stat.name), handle->name.c_str(), SPIFFS_OBJ_NAME_LEN - 1);
+	return SPIFFS_OK;
+}
+
+int FatFsDriver::remove(const char* name)
+{
+	return mapError(f_unlink(name));
+}
+
+int FatFsDriver::rename(const char* oldName, const char* newName)
+{
+	return mapError(f_rename(oldName, newName));
+}
+
+void FatFsDriver::list(Vector<String>& names)
+{
+	DIR dir;
+	FILINFO info;
+
+	if(f_opendir(&dir, "/") != FR_OK) {
+		return;
+	}
+	while(f_readdir(&dir, &info) == FR_OK && info.fname[0] != '\0') {
+		if(!(info.fattrib & (AM_DIR | AM_HID | AM_SYS))) {
+			names.add(info.fname);
+		}
+	}
+	f_closedir(&dir);
+}
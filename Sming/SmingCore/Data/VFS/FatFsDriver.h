@@ -0,0 +1,70 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * FatFsDriver.h
+ *
+ * A FatFs volume, usually an SD card set up with SDCard_begin(), which must
+ * be mounted with f_mount() before any files are opened.
+ *
+ * 	FatFsDriver sdFs;
+ * 	...
+ * 	SDCard_begin(PIN_CARD_SS);
+ * 	fileMount("sd", &sdFs);
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_VFS_FATFS_DRIVER_H_
+#define _SMING_CORE_DATA_VFS_FATFS_DRIVER_H_
+
+#include "FileSystemDriver.h"
+#include "../../../Services/FATFS/ff.h"
+
+/** @brief Most files which can be open at once, each takes a FIL on the heap */
+#ifndef FATFS_DRIVER_MAX_OPEN
+#define FATFS_DRIVER_MAX_OPEN 4
+#endif
+
+class FatFsDriver : public FileSystemDriver
+{
+public:
+	~FatFsDriver();
+
+	virtual file_t open(const char* name, FileOpenFlags flags);
+	virtual void close(file_t file);
+	virtual int read(file_t file, void* data, size_t size);
+	virtual int write(file_t file, const void* data, size_t size);
+	virtual int seek(file_t file, int offset, SeekOriginFlags origin);
+	virtual int32_t tell(file_t file);
+	virtual bool eof(file_t file);
+	virtual int flush(file_t file);
+	virtual int stat(const char* name, spiffs_stat& stat);
+	virtual int fstat(file_t file, spiffs_stat& stat);
+	virtual int remove(const char* name);
+	virtual int rename(const char* oldName, const char* newName);
+	virtual void list(Vector<String>& names);
+
+	/** @brief Translate a FatFs result into a SPIFFS error code */
+	static int mapError(FRESULT res);
+
+private:
+	struct Handle {
+		FIL* fil;
+		String name; ///< FIL doesn't keep it, and fstat() needs it
+		bool append;
+	};
+
+	Handle* getHandle(file_t file);
+
+private:
+	Handle handles[FATFS_DRIVER_MAX_OPEN] = {};
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_VFS_FATFS_DRIVER_H_ */
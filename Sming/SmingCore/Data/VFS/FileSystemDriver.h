@@ -0,0 +1,78 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * FileSystemDriver.h
+ *
+ * Interface a file system implements to be mounted with fileMount(), after
+ * which the fileXxx() functions, FileStream, HttpResponse::sendFile() and the
+ * FTP server reach it by names starting with its mount point.
+ *
+ * Drivers see names with the mount point removed. Handles are the driver's
+ * own, from 0 to FS_DRIVER_MAX_HANDLE, and errors are negative SPIFFS error
+ * codes so callers see the same codes whichever file system they're using.
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_VFS_FILE_SYSTEM_DRIVER_H_
+#define _SMING_CORE_DATA_VFS_FILE_SYSTEM_DRIVER_H_
+
+#include "../../FileSystem.h"
+#include "WString.h"
+
+/** @brief Highest handle a driver may return */
+#define FS_DRIVER_MAX_HANDLE 0x0FFF
+
+class FileSystemDriver
+{
+public:
+	virtual ~FileSystemDriver()
+	{
+	}
+
+	/** @retval file_t Handle, or negative error code */
+	virtual file_t open(const char* name, FileOpenFlags flags) = 0;
+
+	virtual void close(file_t file) = 0;
+
+	/** @retval int Bytes read, or negative error code */
+	virtual int read(file_t file, void* data, size_t size) = 0;
+
+	/** @retval int Bytes written, or negative error code */
+	virtual int write(file_t file, const void* data, size_t size) = 0;
+
+	/** @retval int New position, or negative error code */
+	virtual int seek(file_t file, int offset, SeekOriginFlags origin) = 0;
+
+	virtual int32_t tell(file_t file) = 0;
+
+	virtual bool eof(file_t file) = 0;
+
+	virtual int flush(file_t file)
+	{
+		return SPIFFS_OK;
+	}
+
+	/** @brief Get the name and size of a file
+	 *  @note Drivers fill in obj_id with something which changes when the file does, for ETags
+	 */
+	virtual int stat(const char* name, spiffs_stat& stat) = 0;
+
+	virtual int fstat(file_t file, spiffs_stat& stat) = 0;
+
+	virtual int remove(const char* name) = 0;
+
+	virtual int rename(const char* oldName, const char* newName) = 0;
+
+	/** @brief Add the names of all files to a list */
+	virtual void list(Vector<String>& names) = 0;
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_VFS_FILE_SYSTEM_DRIVER_H_ */
@@ -0,0 +1,273 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * RamFsDriver.cpp
+ *
+ ****/
+
+#include "RamFsDriver.h"
+#include <algorithm>
+
+// Files grow in steps of at least this much, so appending a line at a time doesn't reallocate every time
+#define RAMFS_MIN_GROWTH 64
+
+RamFsDriver::RamFsDriver()
+{
+	for(auto& file : files) {
+		file.data = nullptr;
+		file.size = 0;
+		file.capacity = 0;
+		file.version = 0;
+	}
+	for(auto& handle : handles) {
+		handle.file = -1;
+	}
+}
+
+RamFsDriver::~RamFsDriver()
+{
+	for(auto& file : files) {
+		free(file.data);
+	}
+}
+
+int RamFsDriver::find(const char* name) const
+{
+	for(unsigned i = 0; i < RAMFS_MAX_FILES; ++i) {
+		if(files[i].name.length() != 0 && files[i].name == name) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+RamFsDriver::File* RamFsDriver::getFile(file_t file, Handle*& handle)
+{
+	if(file < 0 || file >= RAMFS_MAX_OPEN || handles[file].file < 0) {
+		return nullptr;
+	}
+	handle = &handles[file];
+	return &files[handle->file];
+}
+
+void RamFsDriver::truncate(File& file)
+{
+	usedSize -= file.capacity;
+	free(file.data);
+	file.data = nullptr;
+	file.size = 0;
+	file.capacity = 0;
+	++file.version;
+}
+
+file_t RamFsDriver::open(const char* name, FileOpenFlags flags)
+{
+	if(*name == '\0') {
+		return SPIFFS_ERR_NOT_FOUND;
+	}
+	if(strlen(name) >= SPIFFS_OBJ_NAME_LEN) {
+		return SPIFFS_ERR_NAME_TOO_LONG;
+	}
+
+	file_t file = 0;
+	while(handles[file].file >= 0) {
+		if(++file == RAMFS_MAX_OPEN) {
+			return SPIFFS_ERR_OUT_OF_FILE_DESCS;
+		}
+	}
+
+	int index = find(name);
+	if(index < 0) {
+		if(!(flags & eFO_CreateIfNotExist)) {
+			return SPIFFS_ERR_NOT_FOUND;
+		}
+		for(index = 0; files[index].name.length() != 0; ++index) {
+			if(index == RAMFS_MAX_FILES - 1) {
+				return SPIFFS_ERR_FULL;
+			}
+		}
+		files[index].name = name;
+		++files[index].version;
+	} else if(flags & eFO_Truncate) {
+		truncate(files[index]);
+	}
+
+	handles[file].file = index;
+	handles[file].flags = flags;
+	handles[file].pos = 0;
+	return file;
+}
+
+void RamFsDriver::close(file_t file)
+{
+	if(file >= 0 && file < RAMFS_MAX_OPEN) {
+		handles[file].file = -1;
+	}
+}
+
+int RamFsDriver::read(file_t file, void* data, size_t size)
+{
+	Handle* handle;
+	File* f = getFile(file, handle);
+	if(f == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	if(!(handle->flags & eFO_ReadOnly)) {
+		return SPIFFS_ERR_NOT_READABLE;
+	}
+
+	size = std::min(size, size_t(f->size - handle->pos));
+	memcpy(data, f->data + handle->pos, size);
+	handle->pos += size;
+	return size;
+}
+
+int RamFsDriver::write(file_t file, const void* data, size_t size)
+{
+	Handle* handle;
+	File* f = getFile(file, handle);
+	if(f == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	if(!(handle->flags & eFO_WriteOnly)) {
+		return SPIFFS_ERR_NOT_WRITABLE;
+	}
+	if(handle->flags & eFO_Append) {
+		handle->pos = f->size;
+	}
+
+	uint32_t needed = handle->pos + size;
+	if(needed > f->capacity) {
+		// Take what's left if a full step won't fit, and write as much as that allows
+		size_t available = RAMFS_MAX_SIZE - usedSize + f->capacity;
+		size_t capacity = std::max(needed, f->capacity + RAMFS_MIN_GROWTH);
+		capacity = std::min(capacity, available);
+		if(capacity <= handle->pos) {
+			return SPIFFS_ERR_FULL;
+		}
+		auto newData = static_cast<char*>(realloc(f->data, capacity));
+		if(newData == nullptr) {
+			return SPIFFS_ERR_FULL;
+		}
+		usedSize += capacity - f->capacity;
+		f->data = newData;
+		f->capacity = capacity;
+		size = std::min(size, size_t(capacity - handle->pos));
+	}
+
+	memcpy(f->data + handle->pos, data, size);
+	handle->pos += size;
+	f->size = std::max(f->size, handle->pos);
+	++f->version;
+	return size;
+}
+
+int RamFsDriver::seek(file_t file, int offset, SeekOriginFlags origin)
+{
+	Handle* handle;
+	File* f = getFile(file, handle);
+	if(f == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+
+	int pos = offset;
+	if(origin == eSO_CurrentPos) {
+		pos += handle->pos;
+	} else if(origin == eSO_FileEnd) {
+		pos += f->size;
+	}
+	if(pos < 0 || uint32_t(pos) > f->size) {
+		return SPIFFS_ERR_SEEK_BOUNDS;
+	}
+	handle->pos = pos;
+	return pos;
+}
+
+int32_t RamFsDriver::tell(file_t file)
+{
+	Handle* handle;
+	return getFile(file, handle) ? int32_t(handle->pos) : SPIFFS_ERR_BAD_DESCRIPTOR;
+}
+
+bool RamFsDriver::eof(file_t file)
+{
+	Handle* handle;
+	File* f = getFile(file, handle);
+	return f == nullptr || handle->pos >= f->size;
+}
+
+void RamFsDriver::fillStat(const File& file, int index, spiffs_stat& stat)
+{
+	memset(&stat, 0, sizeof(stat));
+	stat.obj_id = file.version * RAMFS_MAX_FILES + index + 1;
+	stat.size = file.size;
+	stat.type = SPIFFS_TYPE_FILE;
+	strncpy(reinterpret_cast<char*>(stat.name), file.name.c_str(), SPIFFS_OBJ_NAME_LEN - 1);
+}
+
+int RamFsDriver::stat(const char* name, spiffs_stat& stat)
+{
+	int index = find(name);
+	if(index < 0) {
+		return SPIFFS_ERR_NOT_FOUND;
+	}
+	fillStat(files[index], index, stat);
+	return SPIFFS_OK;
+}
+
+int RamFsDriver::fstat(file_t file, spiffs_stat& stat)
+{
+	Handle* handle;
+	File* f = getFile(file, handle);
+	if(f == nullptr) {
+		return SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	fillStat(*f, handle->file, stat);
+	return SPIFFS_OK;
+}
+
+int RamFsDriver::remove(const char* name)
+{
+	int index = find(name);
+	if(index < 0) {
+		return SPIFFS_ERR_NOT_FOUND;
+	}
+
+	// As with SPIFFS, handles still open on the file stop working
+	for(auto& handle : handles) {
+		if(handle.file == index) {
+			handle.file = -1;
+		}
+	}
+	truncate(files[index]);
+	files[index].name = nullptr;
+	return SPIFFS_OK;
+}
+
+int RamFsDriver::rename(const char* oldName, const char* newName)
+{
+	int index = find(oldName);
+	if(index < 0) {
+		return SPIFFS_ERR_NOT_FOUND;
+	}
+	if(*newName == '\0' || strlen(newName) >= SPIFFS_OBJ_NAME_LEN) {
+		return SPIFFS_ERR_NAME_TOO_LONG;
+	}
+	if(find(newName) >= 0) {
+		return SPIFFS_ERR_CONFLICTING_NAME;
+	}
+	files[index].name = newName;
+	return SPIFFS_OK;
+}
+
+void RamFsDriver::list(Vector<String>& names)
+{
+	for(auto& file : files) {
+		if(file.name.length() != 0) {
+			names.add(file.name);
+		}
+	}
+}
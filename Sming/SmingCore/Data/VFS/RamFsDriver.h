@@ -0,0 +1,96 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * RamFsDriver.h
+ *
+ * Files held on the heap, for scratch data which doesn't need to survive a
+ * restart and shouldn't wear the flash. Total size is capped so the file
+ * system can't starve the network stack of memory.
+ *
+ * 	RamFsDriver ramFs;
+ * 	...
+ * 	fileMount("ram", &ramFs);
+ * 	fileSetContent("/ram/status.json", json);
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_VFS_RAMFS_DRIVER_H_
+#define _SMING_CORE_DATA_VFS_RAMFS_DRIVER_H_
+
+#include "FileSystemDriver.h"
+
+/** @brief Most files a RAM file system can hold */
+#ifndef RAMFS_MAX_FILES
+#define RAMFS_MAX_FILES 8
+#endif
+
+/** @brief Most files which can be open at once */
+#ifndef RAMFS_MAX_OPEN
+#define RAMFS_MAX_OPEN 4
+#endif
+
+/** @brief Heap the file contents may take, in bytes */
+#ifndef RAMFS_MAX_SIZE
+#define RAMFS_MAX_SIZE 8192
+#endif
+
+class RamFsDriver : public FileSystemDriver
+{
+public:
+	RamFsDriver();
+	~RamFsDriver();
+
+	virtual file_t open(const char* name, FileOpenFlags flags);
+	virtual void close(file_t file);
+	virtual int read(file_t file, void* data, size_t size);
+	virtual int write(file_t file, const void* data, size_t size);
+	virtual int seek(file_t file, int offset, SeekOriginFlags origin);
+	virtual int32_t tell(file_t file);
+	virtual bool eof(file_t file);
+	virtual int stat(const char* name, spiffs_stat& stat);
+	virtual int fstat(file_t file, spiffs_stat& stat);
+	virtual int remove(const char* name);
+	virtual int rename(const char* oldName, const char* newName);
+	virtual void list(Vector<String>& names);
+
+	/** @brief Heap taken by file contents */
+	size_t getUsedSize() const
+	{
+		return usedSize;
+	}
+
+private:
+	struct File {
+		String name; ///< Empty if the slot is free
+		char* data;
+		uint32_t size;
+		uint32_t capacity;
+		uint16_t version; ///< Changes on every write, for ETags
+	};
+
+	struct Handle {
+		int8_t file; ///< -1 if the handle is free
+		uint8_t flags;
+		uint32_t pos;
+	};
+
+	int find(const char* name) const;
+	File* getFile(file_t file, Handle*& handle);
+	void truncate(File& file);
+	static void fillStat(const File& file, int index, spiffs_stat& stat);
+
+private:
+	File files[RAMFS_MAX_FILES];
+	Handle handles[RAMFS_MAX_OPEN];
+	size_t usedSize = 0;
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_VFS_RAMFS_DRIVER_H_ */
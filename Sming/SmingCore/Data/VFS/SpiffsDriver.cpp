@@ -0,0 +1,111 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SpiffsDriver.cpp
+ *
+ ****/
+
+#include "SpiffsDriver.h"
+
+file_t SpiffsDriver::open(const char* name, FileOpenFlags flags)
+{
+	// Special fix to prevent known spifFS bug: manual delete file
+	if((flags & eFO_CreateNewAlways) == eFO_CreateNewAlways) {
+		spiffs_stat st;
+		if(SPIFFS_stat(&_filesystemStorageHandle, name, &st) >= 0) {
+			SPIFFS_remove(&_filesystemStorageHandle, name);
+		}
+		flags = (FileOpenFlags)((int)flags & ~eFO_Truncate);
+	}
+
+	file_t res = SPIFFS_open(&_filesystemStorageHandle, name, (spiffs_flags)flags, 0);
+	if(res < 0)
+		debugf("open errno %d\n", SPIFFS_errno(&_filesystemStorageHandle));
+
+	return res;
+}
+
+void SpiffsDriver::close(file_t file)
+{
+	uint32_t start = system_get_time();
+	SPIFFS_close(&_filesystemStorageHandle, file);
+	spiffs_record_write(system_get_time() - start);
+}
+
+int SpiffsDriver::read(file_t file, void* data, size_t size)
+{
+	int res = SPIFFS_read(&_filesystemStorageHandle, file, data, size);
+	if(res < 0) {
+		debugf("read errno %d\n", SPIFFS_errno(&_filesystemStorageHandle));
+	}
+	return res;
+}
+
+int SpiffsDriver::write(file_t file, const void* data, size_t size)
+{
+	uint32_t start = system_get_time();
+	int res = SPIFFS_write(&_filesystemStorageHandle, file, (void*)data, size);
+	spiffs_record_write(system_get_time() - start);
+	if(res < 0) {
+		debugf("write errno %d\n", SPIFFS_errno(&_filesystemStorageHandle));
+	}
+	return res;
+}
+
+int SpiffsDriver::seek(file_t file, int offset, SeekOriginFlags origin)
+{
+	return SPIFFS_lseek(&_filesystemStorageHandle, file, offset, origin);
+}
+
+int32_t SpiffsDriver::tell(file_t file)
+{
+	return SPIFFS_tell(&_filesystemStorageHandle, file);
+}
+
+bool SpiffsDriver::eof(file_t file)
+{
+	return SPIFFS_eof(&_filesystemStorageHandle, file);
+}
+
+int SpiffsDriver::flush(file_t file)
+{
+	uint32_t start = system_get_time();
+	int res = SPIFFS_fflush(&_filesystemStorageHandle, file);
+	spiffs_record_write(system_get_time() - start);
+	return res;
+}
+
+int SpiffsDriver::stat(const char* name, spiffs_stat& stat)
+{
+	return SPIFFS_stat(&_filesystemStorageHandle, name, &stat);
+}
+
+int SpiffsDriver::fstat(file_t file, spiffs_stat& stat)
+{
+	return SPIFFS_fstat(&_filesystemStorageHandle, file, &stat);
+}
+
+int SpiffsDriver::remove(const char* name)
+{
+	return SPIFFS_remove(&_filesystemStorageHandle, name);
+}
+
+int SpiffsDriver::rename(const char* oldName, const char* newName)
+{
+	return SPIFFS_rename(&_filesystemStorageHandle, oldName, newName);
+}
+
+void SpiffsDriver::list(Vector<String>& names)
+{
+	spiffs_DIR d;
+	spiffs_dirent info;
+
+	SPIFFS_opendir(&_filesystemStorageHandle, "/", &d);
+	while(SPIFFS_readdir(&d, &info)) {
+		names.add(String((char*)info.name));
+	}
+	SPIFFS_closedir(&d);
+}
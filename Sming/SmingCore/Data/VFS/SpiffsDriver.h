@@ -0,0 +1,42 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SpiffsDriver.h
+ *
+ * The SPIFFS file system on the internal flash, which is always mounted as
+ * "flash" and also takes every name not starting with a mount point.
+ *
+ ****/
+
+/** @addtogroup filesystem
+ *  @{
+ */
+
+#ifndef _SMING_CORE_DATA_VFS_SPIFFS_DRIVER_H_
+#define _SMING_CORE_DATA_VFS_SPIFFS_DRIVER_H_
+
+#include "FileSystemDriver.h"
+
+class SpiffsDriver : public FileSystemDriver
+{
+public:
+	virtual file_t open(const char* name, FileOpenFlags flags);
+	virtual void close(file_t file);
+	virtual int read(file_t file, void* data, size_t size);
+	virtual int write(file_t file, const void* data, size_t size);
+	virtual int seek(file_t file, int offset, SeekOriginFlags origin);
+	virtual int32_t tell(file_t file);
+	virtual bool eof(file_t file);
+	virtual int flush(file_t file);
+	virtual int stat(const char* name, spiffs_stat& stat);
+	virtual int fstat(file_t file, spiffs_stat& stat);
+	virtual int remove(const char* name);
+	virtual int rename(const char* oldName, const char* newName);
+	virtual void list(Vector<String>& names);
+};
+
+/** @} */
+#endif /* _SMING_CORE_DATA_VFS_SPIFFS_DRIVER_H_ */
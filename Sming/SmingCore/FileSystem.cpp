@@ -6,106 +6,266 @@
  ****/
 
 #include "FileSystem.h"
+#include "Data/VFS/SpiffsDriver.h"
 #include "../Wiring/WString.h"
+#include "Platform/System.h"
+#include "Timer.h"
 
-file_t fileOpen(const String& name, FileOpenFlags flags)
+static Timer gcTimer;
+static uint32_t gcTimeSlice;
+static bool gcQueued;
+
+#define FS_HANDLE_SHIFT 12
+
+static_assert(FS_MAX_MOUNTS <= 8, "Mount index must fit in the top bits of a file_t");
+
+struct FileSystemMount {
+	String point;
+	FileSystemDriver* driver;
+	FileSystemStats stats;
+	uint8_t openFiles;
+};
+
+static SpiffsDriver spiffsDriver;
+static FileSystemMount mounts[FS_MAX_MOUNTS] = {{"flash", &spiffsDriver}};
+static int lastError;
+
+/*
+ * Handles from other file systems carry the mount index in their top bits.
+ * SPIFFS handles are passed through as they are, so code which hands them
+ * straight to SPIFFS carries on working.
+ */
+static file_t makeHandle(unsigned mount, file_t file)
 {
-	int res;
+	return (file < 0 || mount == 0) ? file : file_t((mount << FS_HANDLE_SHIFT) | file);
+}
 
-	// Special fix to prevent known spifFS bug: manual delete file
-	if((flags & eFO_CreateNewAlways) == eFO_CreateNewAlways) {
-		if(fileExist(name))
-			fileDelete(name);
-		flags = (FileOpenFlags)((int)flags & ~eFO_Truncate);
+static FileSystemMount* getMount(file_t file, file_t& driverFile)
+{
+	if(file < 0) {
+		return nullptr;
+	}
+	unsigned index = unsigned(file) >> FS_HANDLE_SHIFT;
+	if(index >= FS_MAX_MOUNTS || mounts[index].driver == nullptr) {
+		return nullptr;
 	}
+	driverFile = index ? (file & FS_DRIVER_MAX_HANDLE) : file;
+	return &mounts[index];
+}
 
-	res = SPIFFS_open(&_filesystemStorageHandle, name.c_str(), (spiffs_flags)flags, 0);
-	if(res < 0)
-		debugf("open errno %d\n", SPIFFS_errno(&_filesystemStorageHandle));
+/*
+ * Find the file system a name is on, and the name it has there.
+ * Anything without a mount point prefix goes to SPIFFS unchanged.
+ */
+static FileSystemMount& findMount(const String& name, const char*& path)
+{
+	const char* s = name.c_str();
+	if(*s == '/') {
+		++s;
+	}
+	for(auto& mount : mounts) {
+		unsigned len = mount.point.length();
+		if(mount.driver != nullptr && len != 0 && strncmp(s, mount.point.c_str(), len) == 0 && s[len] == '/') {
+			path = s + len + 1;
+			return mount;
+		}
+	}
+	path = name.c_str();
+	return mounts[0];
+}
 
-	return res;
+static FileSystemMount* findMountPoint(const String& mountPoint)
+{
+	for(auto& mount : mounts) {
+		if(mount.driver != nullptr && mount.point == mountPoint) {
+			return &mount;
+		}
+	}
+	return nullptr;
 }
 
-void fileClose(file_t file)
+// Note how long an operation took, and whether it failed
+static uint32_t record(FileSystemMount& mount, uint32_t start, int res)
 {
-	SPIFFS_close(&_filesystemStorageHandle, file);
+	uint32_t elapsed = system_get_time() - start;
+	unsigned bucket = 0;
+	for(uint32_t limit = 16; bucket < FS_LATENCY_BUCKETS - 1 && elapsed >= limit; limit <<= 2) {
+		++bucket;
+	}
+	++mount.stats.latency[bucket];
+	if(res < 0) {
+		++mount.stats.errors;
+		lastError = res;
+	}
+	return elapsed;
 }
 
-size_t fileWrite(file_t file, const void* data, size_t size)
+file_t fileOpen(const String& name, FileOpenFlags flags)
 {
-	int res = SPIFFS_write(&_filesystemStorageHandle, file, (void*)data, size);
+	const char* path;
+	FileSystemMount& mount = findMount(name, path);
+	uint32_t start = system_get_time();
+	file_t res = mount.driver->open(path, flags);
+	record(mount, start, res);
+	++mount.stats.opens;
 	if(res < 0) {
-		debugf("write errno %d\n", SPIFFS_errno(&_filesystemStorageHandle));
 		return res;
 	}
+	if(res > FS_DRIVER_MAX_HANDLE) {
+		// Driver bug, the handle can't be encoded
+		mount.driver->close(res);
+		return lastError = SPIFFS_ERR_OUT_OF_FILE_DESCS;
+	}
+	++mount.openFiles;
+	return makeHandle(&mount - mounts, res);
+}
+
+void fileClose(file_t file)
+{
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	if(mount == nullptr) {
+		return;
+	}
+	uint32_t start = system_get_time();
+	mount->driver->close(f);
+	mount->stats.writeTime += record(*mount, start, 0);
+	++mount->stats.writes;
+	if(mount->openFiles != 0) {
+		--mount->openFiles;
+	}
+}
+
+size_t fileWrite(file_t file, const void* data, size_t size)
+{
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	if(mount == nullptr) {
+		return lastError = SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	uint32_t start = system_get_time();
+	int res = mount->driver->write(f, data, size);
+	mount->stats.writeTime += record(*mount, start, res);
+	++mount->stats.writes;
+	if(res > 0) {
+		mount->stats.writeBytes += res;
+	}
 	return res;
 }
 
 size_t fileRead(file_t file, void* data, size_t size)
 {
-	int res = SPIFFS_read(&_filesystemStorageHandle, file, data, size);
-	if(res < 0) {
-		debugf("read errno %d\n", SPIFFS_errno(&_filesystemStorageHandle));
-		return res;
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	if(mount == nullptr) {
+		return lastError = SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	uint32_t start = system_get_time();
+	int res = mount->driver->read(f, data, size);
+	mount->stats.readTime += record(*mount, start, res);
+	++mount->stats.reads;
+	if(res > 0) {
+		mount->stats.readBytes += res;
 	}
 	return res;
 }
 
 int fileSeek(file_t file, int offset, SeekOriginFlags origin)
 {
-	return SPIFFS_lseek(&_filesystemStorageHandle, file, offset, origin);
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	if(mount == nullptr) {
+		return lastError = SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	uint32_t start = system_get_time();
+	int res = mount->driver->seek(f, offset, origin);
+	record(*mount, start, res);
+	return res;
 }
 
 bool fileIsEOF(file_t file)
 {
-	return SPIFFS_eof(&_filesystemStorageHandle, file);
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	return mount == nullptr || mount->driver->eof(f);
 }
 
 int32_t fileTell(file_t file)
 {
-	return SPIFFS_tell(&_filesystemStorageHandle, file);
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	return mount ? mount->driver->tell(f) : SPIFFS_ERR_BAD_DESCRIPTOR;
 }
 
 int fileFlush(file_t file)
 {
-	return SPIFFS_fflush(&_filesystemStorageHandle, file);
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	if(mount == nullptr) {
+		return lastError = SPIFFS_ERR_BAD_DESCRIPTOR;
+	}
+	uint32_t start = system_get_time();
+	int res = mount->driver->flush(f);
+	mount->stats.writeTime += record(*mount, start, res);
+	++mount->stats.writes;
+	return res;
 }
 
 int fileStats(const String& name, spiffs_stat* stat)
 {
-	return SPIFFS_stat(&_filesystemStorageHandle, name.c_str(), stat);
+	const char* path;
+	FileSystemMount& mount = findMount(name, path);
+	return mount.driver->stat(path, *stat);
 }
 
 int fileStats(file_t file, spiffs_stat* stat)
 {
-	return SPIFFS_fstat(&_filesystemStorageHandle, file, stat);
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	return mount ? mount->driver->fstat(f, *stat) : SPIFFS_ERR_BAD_DESCRIPTOR;
 }
 
 void fileDelete(const String& name)
 {
-	SPIFFS_remove(&_filesystemStorageHandle, name.c_str());
+	const char* path;
+	FileSystemMount& mount = findMount(name, path);
+	uint32_t start = system_get_time();
+	record(mount, start, mount.driver->remove(path));
 }
 
 void fileDelete(file_t file)
 {
-	SPIFFS_fremove(&_filesystemStorageHandle, file);
+	file_t f;
+	FileSystemMount* mount = getMount(file, f);
+	if(mount == &mounts[0]) {
+		SPIFFS_fremove(&_filesystemStorageHandle, f);
+	} else if(mount != nullptr) {
+		// Other file systems delete by name
+		spiffs_stat stat;
+		if(mount->driver->fstat(f, stat) >= 0) {
+			mount->driver->close(f);
+			--mount->openFiles;
+			mount->driver->remove(reinterpret_cast<const char*>(stat.name));
+		}
+	}
 }
 
 bool fileExist(const String& name)
 {
 	spiffs_stat stat = {0};
-	if(fileStats(name.c_str(), &stat) < 0)
+	if(fileStats(name, &stat) < 0)
 		return false;
 	return stat.name[0] != '\0';
 }
 
 int fileLastError(file_t fd)
 {
-	return SPIFFS_errno(&_filesystemStorageHandle);
+	return lastError;
 }
 
 void fileClearLastError(file_t fd)
 {
+	lastError = SPIFFS_OK;
 	SPIFFS_clearerr(&_filesystemStorageHandle);
 }
 
@@ -133,25 +293,114 @@ uint32_t fileGetSize(const String& fileName)
 
 void fileRename(const String& oldName, const String& newName)
 {
-	SPIFFS_rename(&_filesystemStorageHandle, oldName.c_str(), newName.c_str());
+	const char* oldPath;
+	const char* newPath;
+	FileSystemMount& mount = findMount(oldName, oldPath);
+	if(&findMount(newName, newPath) != &mount) {
+		debugf("can't rename across file systems");
+		lastError = SPIFFS_ERR_NOT_FOUND;
+		return;
+	}
+	uint32_t start = system_get_time();
+	record(mount, start, mount.driver->rename(oldPath, newPath));
 }
 
 Vector<String> fileList()
 {
 	Vector<String> result;
-	spiffs_DIR d;
-	spiffs_dirent info;
+	spiffsDriver.list(result);
+	return result;
+}
 
-	SPIFFS_opendir(&_filesystemStorageHandle, "/", &d);
-	while(true) {
-		if(!SPIFFS_readdir(&d, &info))
-			break;
-		result.add(String((char*)info.name));
+Vector<String> fileList(const String& mountPoint)
+{
+	Vector<String> result;
+	FileSystemMount* mount = findMountPoint(mountPoint);
+	if(mount != nullptr) {
+		Vector<String> names;
+		mount->driver->list(names);
+		for(unsigned i = 0; i < names.count(); ++i) {
+			result.add(mountPoint + '/' + names[i]);
+		}
 	}
-	SPIFFS_closedir(&d);
 	return result;
 }
 
+bool fileMount(const String& mountPoint, FileSystemDriver* driver)
+{
+	if(driver == nullptr || mountPoint.length() == 0 || mountPoint.indexOf('/') >= 0 ||
+	   findMountPoint(mountPoint) != nullptr) {
+		return false;
+	}
+	for(auto& mount : mounts) {
+		if(mount.driver == nullptr) {
+			mount.point = mountPoint;
+			mount.driver = driver;
+			memset(&mount.stats, 0, sizeof(mount.stats));
+			mount.openFiles = 0;
+			debug_i("mounted '%s'", mountPoint.c_str());
+			return true;
+		}
+	}
+	debug_e("no room to mount '%s'", mountPoint.c_str());
+	return false;
+}
+
+bool fileUnmount(const String& mountPoint)
+{
+	FileSystemMount* mount = findMountPoint(mountPoint);
+	if(mount == nullptr || mount == &mounts[0]) {
+		return false;
+	}
+	// Handles encode the mount index, so it can't be reused while any are open
+	if(mount->openFiles != 0) {
+		debug_w("'%s' has %u files open", mountPoint.c_str(), mount->openFiles);
+		return false;
+	}
+	mount->driver = nullptr;
+	mount->point = nullptr;
+	return true;
+}
+
+unsigned fileGetMountCount()
+{
+	unsigned count = 0;
+	for(auto& mount : mounts) {
+		if(mount.driver != nullptr) {
+			++count;
+		}
+	}
+	return count;
+}
+
+String fileGetMountPoint(unsigned index)
+{
+	for(auto& mount : mounts) {
+		if(mount.driver != nullptr && index-- == 0) {
+			return mount.point;
+		}
+	}
+	return nullptr;
+}
+
+bool fileGetMountStats(const String& mountPoint, FileSystemStats& stats)
+{
+	FileSystemMount* mount = findMountPoint(mountPoint);
+	if(mount == nullptr) {
+		return false;
+	}
+	stats = mount->stats;
+	return true;
+}
+
+void fileResetMountStats(const String& mountPoint)
+{
+	FileSystemMount* mount = findMountPoint(mountPoint);
+	if(mount != nullptr) {
+		memset(&mount->stats, 0, sizeof(mount->stats));
+	}
+}
+
 String fileGetContent(const String& fileName)
 {
 	file_t file = fileOpen(fileName.c_str(), eFO_ReadOnly);
@@ -192,3 +441,40 @@ int fileGetContent(const String& fileName, char* buffer, int bufSize)
 	fileClose(file);
 	return size;
 }
+
+static void gcStep(uint32_t param)
+{
+	// Keep going while there's work, yielding between slices so other tasks get a look in
+	if(gcTimer.isStarted() && spiffs_gc_step(gcTimeSlice) > 0) {
+		gcQueued = System.queueCallback(gcStep, 0, eTP_Low);
+	} else {
+		gcQueued = false;
+	}
+}
+
+void fileStartBackgroundGc(uint32_t intervalMs, uint32_t timeSliceUs)
+{
+	gcTimeSlice = timeSliceUs;
+	gcTimer.initializeMs(intervalMs, TimerDelegateStdFunction([]() {
+		if(!gcQueued) {
+			gcQueued = System.queueCallback(gcStep, 0, eTP_Low);
+		}
+	}));
+	gcTimer.start();
+}
+
+void fileStopBackgroundGc()
+{
+	// A queued step sees the timer has stopped and does nothing
+	gcTimer.stop();
+}
+
+void fileGetSystemStats(spiffs_sming_stats& stats)
+{
+	spiffs_get_stats(&stats);
+}
+
+void fileResetStats()
+{
+	spiffs_reset_stats();
+}
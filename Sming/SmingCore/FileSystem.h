@@ -7,6 +7,11 @@
 
 /**	@defgroup filesystem File system
  *	@brief	Access file system
+ *
+ *	Files are on SPIFFS unless their name starts with the mount point of another
+ *	file system, as in "/sd/log.csv" or "ram/status.json" (the leading '/' is
+ *	optional). SPIFFS itself is mounted as "flash", so "/flash/index.html" and
+ *	"index.html" are the same file. See fileMount().
  *  @{
  */
 
@@ -16,7 +21,43 @@
 #include "../Services/SpifFS/spiffs_sming.h"
 #include "../Wiring/WVector.h"
 
+/** @brief How often background garbage collection checks for work, in milliseconds */
+#ifndef FS_GC_INTERVAL
+#define FS_GC_INTERVAL 2000
+#endif
+
+/** @brief Time background garbage collection may use before yielding, in microseconds */
+#ifndef FS_GC_TIME_SLICE
+#define FS_GC_TIME_SLICE 20000
+#endif
+
+/** @brief Most file systems which can be mounted at once, including SPIFFS */
+#ifndef FS_MAX_MOUNTS
+#define FS_MAX_MOUNTS 5
+#endif
+
+/** @brief Number of buckets in the latency histograms */
+#define FS_LATENCY_BUCKETS 8
+
 class String;
+class FileSystemDriver;
+
+/** @brief I/O counters for a mounted file system
+ *  @note Times are in microseconds
+ */
+struct FileSystemStats {
+	uint32_t opens;
+	uint32_t reads;
+	uint32_t writes; ///< Including flushes and closes, which is when buffered data goes out
+	uint32_t readBytes;
+	uint32_t writeBytes;
+	uint32_t errors;
+	uint32_t readTime;
+	uint32_t writeTime;
+	/** @brief Operations by time taken: under 16us, under 64us and so on, up
+	 *  by four times each bucket, the last one counting 65ms and over */
+	uint32_t latency[FS_LATENCY_BUCKETS];
+};
 
 /// File open flags
 enum FileOpenFlags {
@@ -141,9 +182,16 @@ void fileRename(const String& oldName, const String& newName);
 /** @brief  Get list of files on file system
  *  @retval Vector<String> Vector of strings.
             Each string element contains the name of a file on the file system
+ *  @note   Only SPIFFS files are listed
  */
 Vector<String> fileList();
 
+/** @brief  Get list of files on a mounted file system
+ *  @param  mountPoint
+ *  @retval Vector<String> Names start with the mount point, so they can be passed to fileOpen()
+ */
+Vector<String> fileList(const String& mountPoint);
+
 /** @brief  Read content of a file
  *  @param  fileName Name of file to read from
  *  @retval String String variable in to which to read the file content
@@ -196,5 +244,59 @@ void fileDelete(file_t file);
  */
 bool fileExist(const String& name);
 
+/** @brief  Mount a file system
+ *  @param  mountPoint Name of the first part of the path, such as "sd"
+ *  @param  driver Must stay valid until unmounted
+ *  @retval bool false if the mount point is in use or there are too many mounts
+ */
+bool fileMount(const String& mountPoint, FileSystemDriver* driver);
+
+/** @brief  Unmount a file system
+ *  @param  mountPoint
+ *  @retval bool false if it isn't mounted, or still has files open
+ *  @note   SPIFFS can't be unmounted this way
+ */
+bool fileUnmount(const String& mountPoint);
+
+/** @brief  Get the number of mounted file systems, including SPIFFS */
+unsigned fileGetMountCount();
+
+/** @brief  Get a mount point by position, for listing
+ *  @param  index 0 to fileGetMountCount() - 1, SPIFFS is always first
+ */
+String fileGetMountPoint(unsigned index);
+
+/** @brief  Get I/O counters and latencies for a mounted file system
+ *  @param  mountPoint
+ *  @param  stats
+ *  @retval bool false if nothing is mounted there
+ *  @note   Counters run from mounting, or the last call to fileResetMountStats()
+ */
+bool fileGetMountStats(const String& mountPoint, FileSystemStats& stats);
+
+/** @brief  Reset the counters of a mounted file system */
+void fileResetMountStats(const String& mountPoint);
+
+/** @brief  Reclaim space in the background, so writes don't stall while SPIFFS collects garbage
+ *  @param  intervalMs How often to check for garbage
+ *  @param  timeSliceUs Time to spend collecting before yielding to other tasks
+ *  @note   Collection runs as a low priority task, a block at a time, and continues until
+ *          there's nothing left worth reclaiming. Erasing a block takes tens of milliseconds,
+ *          so a slice can overrun by that much.
+ */
+void fileStartBackgroundGc(uint32_t intervalMs = FS_GC_INTERVAL, uint32_t timeSliceUs = FS_GC_TIME_SLICE);
+
+/** @brief  Stop background garbage collection */
+void fileStopBackgroundGc();
+
+/** @brief  Get storage statistics: space, block wear, erase, write and garbage collection times
+ *  @param  stats
+ *  @note   Counters and timings run from mount, or the last call to fileResetStats()
+ */
+void fileGetSystemStats(spiffs_sming_stats& stats);
+
+/** @brief  Reset storage counters and timings */
+void fileResetStats();
+
 /** @} */
 #endif /* _SMING_CORE_FILESYSTEM_H_ */
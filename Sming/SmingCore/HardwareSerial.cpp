@@ -123,37 +123,40 @@ void HardwareSerial::callbackHandler(uint32_t status)
 #else
 	if(HWSDelegate) {
 #endif
+		/*
+		 * Data is held in the receive ring until read, so only one callback need be queued at a time.
+		 * This stops high data rates flooding the task queue. If queueing fails it is retried on the
+		 * next receive interrupt.
+		 */
+		if(!rxCallbackQueued) {
+			rxCallbackQueued = System.queueCallback(staticReceiveCallback, reinterpret_cast<uint32_t>(this));
+		}
+	}
+}
 
-		// Pack parameters for callback into a single word
-		union __packed SerialParam {
-			struct {
-				uint16_t charCount;
-				uint8_t receivedChar;
-				uint8_t uartNr;
-			};
-			uint32_t param;
-		};
-
-		SerialParam serialParam = {{.charCount = static_cast<uint16_t>(uart_rx_available(uart)),
-									.receivedChar = (uint8_t)uart_peek_last_char(uart),
-									.uartNr = static_cast<uint8_t>(uartNr)}};
-
-		System.queueCallback(
-			[](uint32_t param) {
-				SerialParam serialParam = {.param = param};
-				auto uart = uart_get_uart(serialParam.uartNr);
-				auto serial = reinterpret_cast<HardwareSerial*>(uart_get_callback_param(uart));
-				if(serial->HWSDelegate) {
-					serial->HWSDelegate(*serial, serialParam.receivedChar, serialParam.charCount);
-				}
+void HardwareSerial::staticReceiveCallback(uint32_t param)
+{
+	auto serial = reinterpret_cast<HardwareSerial*>(param);
+	// Clear first so data arriving during the callback queues another
+	serial->rxCallbackQueued = false;
+
+	auto charCount = static_cast<uint16_t>(uart_rx_available(serial->uart));
+	auto receivedChar = static_cast<char>(uart_peek_last_char(serial->uart));
+
+	if(serial->HWSDelegate) {
+		serial->HWSDelegate(*serial, receivedChar, charCount);
+	}
 #if ENABLE_CMD_EXECUTOR
-				if(serial->commandExecutor) {
-					serial->commandExecutor->executorReceive(serialParam.receivedChar);
-				}
-#endif
-			},
-			serialParam.param);
+	// Callbacks are coalesced, so pass on everything waiting; with a delegate, whatever it left unread
+	char buffer[32];
+	while(serial->commandExecutor) {
+		size_t count = serial->readMemoryBlock(buffer, sizeof(buffer));
+		if(count == 0) {
+			break;
+		}
+		serial->commandExecutor->executorReceive(buffer, count);
 	}
+#endif
 }
 
 bool HardwareSerial::updateUartCallback()
@@ -397,6 +397,16 @@ public:
 		return uart_rx_find(uart, c);
 	}
 
+	/** @brief Get the number of times received data was held in the hardware FIFO because the
+	 *  receive buffer was full
+	 *  @retval uint32_t
+	 *  @note Data is lost if the FIFO then overflows before it is read
+	 */
+	uint32_t getRxOverflows()
+	{
+		return uart_get_rx_overflows(uart);
+	}
+
 	/**
 	 * @brief Returns a pointer to the internal uart object. Use with care.
 	 * @retval pointer to uart_t
@@ -417,6 +427,7 @@ private:
 	uart_options_t options = _BV(UART_OPT_TXWAIT);
 	size_t txSize = DEFAULT_TX_BUFFER_SIZE;
 	size_t rxSize = DEFAULT_RX_BUFFER_SIZE;
+	volatile bool rxCallbackQueued = false; ///< Receive callback waiting in task queue
 
 	/**
 	 * @brief  Interrupt handler for UART0 receive events
@@ -425,6 +436,12 @@ private:
 	 */
 	void IRAM_ATTR callbackHandler(uint32_t status);
 
+	/**
+	 * @brief Task callback to invoke receive handlers
+	 * @param param The HardwareSerial object
+	 */
+	static void staticReceiveCallback(uint32_t param);
+
 	/**
 	 * @brief Called whenever one of the user callbacks change
 	 * @retval true if uart callback is active
@@ -9,11 +9,33 @@
 #include "Digital.h"
 #include "WiringFrameworkIncludes.h"
 #include "System.h"
+#include "SpscRing.h"
 
 static InterruptCallback gpioInterruptsList[16] = {0};
 static InterruptDelegate delegateFunctionList[16];
 static bool gpioInterruptsInitialied = false;
 
+// Pins with delegate interrupts waiting to be dispatched
+static SpscRing<uint8_t, INTERRUPT_DELEGATE_QUEUE_SIZE> pendingInterrupts;
+static volatile bool dispatchQueued = false;
+
+/** @brief  Invoke delegates for all pending interrupts, in order
+ *  @note   A single task call handles any number of events so the system task queue is not flooded
+ */
+static void dispatchInterruptDelegates(uint32_t)
+{
+	// Clear first so an interrupt arriving during dispatch queues another call
+	dispatchQueued = false;
+
+	uint8_t pin;
+	while(pendingInterrupts.pop(pin)) {
+		auto& delegate = delegateFunctionList[pin];
+		if(delegate) {
+			delegate();
+		}
+	}
+}
+
 /** @brief  Interrupt handler
  *  @param  intr_mask Interrupt mask
  *  @param  arg pointer to array of arguments
@@ -37,13 +59,11 @@ static void IRAM_ATTR interruptHandler(uint32 intr_mask, void* arg)
 			if(gpioInterruptsList[i]) {
 				gpioInterruptsList[i]();
 			} else if(delegateFunctionList[i]) {
-				System.queueCallback(
-					[](uint32_t interruptNumber) {
-						auto& delegate = delegateFunctionList[interruptNumber];
-						if(delegate)
-							delegate();
-					},
-					i);
+				pendingInterrupts.push(i);
+				// If queueing fails it is retried on the next interrupt
+				if(!dispatchQueued) {
+					dispatchQueued = System.queueCallback(dispatchInterruptDelegates);
+				}
 			}
 
 			processed = true;
@@ -139,6 +159,11 @@ GPIO_INT_TYPE ConvertArduinoInterruptMode(uint8_t mode)
 	}
 }
 
+uint32_t getInterruptDelegateOverflows()
+{
+	return pendingInterrupts.getOverflowCount();
+}
+
 void noInterrupts()
 {
 	//ETS_INTR_LOCK();
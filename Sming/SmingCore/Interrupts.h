@@ -17,6 +17,13 @@
 
 #define ESP_MAX_INTERRUPTS 16
 
+/** @brief Number of delegate interrupt events which may be pending, must be a power of two
+ *  @note Events are queued by the ISR and dispatched in order from a single task
+ */
+#ifndef INTERRUPT_DELEGATE_QUEUE_SIZE
+#define INTERRUPT_DELEGATE_QUEUE_SIZE 32
+#endif
+
 typedef void (*InterruptCallback)(void);
 typedef Delegate<void()> InterruptDelegate;
 
@@ -88,6 +95,11 @@ void interruptMode(uint8_t pin, GPIO_INT_TYPE type);
  */
 GPIO_INT_TYPE ConvertArduinoInterruptMode(uint8_t mode);
 
+/** @brief  Get number of delegate interrupt events lost because the queue was full
+ *  @retval uint32_t
+ */
+uint32_t getInterruptDelegateOverflows();
+
 /** @brief  Disable interrupts
  */
 void noInterrupts();
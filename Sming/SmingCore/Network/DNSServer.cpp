@@ -15,122 +15,369 @@
 #include "UdpConnection.h"
 #include "NetUtils.h"
 #include "WString.h"
+#include <algorithm>
+
+#define DNS_HEADER_SIZE 12
+#define DNS_MAX_NAME_SIZE 255
+
+// Flag bits in the third and fourth header bytes
+#define DNS_FLAG_QR 0x80
+#define DNS_FLAG_AA 0x04
+#define DNS_FLAG_TC 0x02
+#define DNS_FLAG_RD 0x01
+#define DNS_OPCODE_SHIFT 3
+#define DNS_OPCODE_MASK 0x0F
+
+// Answer layout: type, class, TTL, data length, data
+#define DNS_ANSWER_TTL_OFFSET 4
+#define DNS_ANSWER_FIXED_SIZE 10
+
+static inline uint8_t toLower(uint8_t c)
+{
+	return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline void setUint16(uint8_t* buffer, uint16_t value)
+{
+	buffer[0] = value >> 8;
+	buffer[1] = value;
+}
+
+static inline uint16_t getUint16(const uint8_t* buffer)
+{
+	return (buffer[0] << 8) | buffer[1];
+}
 
 bool DNSServer::start(uint16_t port, const String& domainName, const IPAddress& resolvedIP)
 {
-	this->port = port;
-	buffer = nullptr;
-	this->domainName = domainName;
-	this->resolvedIP = resolvedIP;
-	downcaseAndRemoveWwwPrefix(this->domainName);
-	return listen(this->port) == 1;
+	clearRecords();
+
+	if(domainName == "*") {
+		addA(domainName, resolvedIP);
+	} else {
+		String name = domainName;
+		name.toLowerCase();
+		if(name.startsWith("www.")) {
+			name.remove(0, 4);
+		}
+		addA(name, resolvedIP);
+		String wwwName = "www.";
+		wwwName += name;
+		addA(wwwName, resolvedIP);
+	}
+
+	return start(port);
+}
+
+bool DNSServer::start(uint16_t port)
+{
+	return listen(port);
 }
 
 void DNSServer::stop()
 {
 	close();
-	delete[] buffer;
-	buffer = nullptr;
 }
 
-void DNSServer::downcaseAndRemoveWwwPrefix(String& domainName)
+void DNSServer::setTTL(uint32_t ttl)
 {
-	domainName.toLowerCase();
-	domainName.replace(F("www."), String::empty);
+	this->ttl = ttl;
+	for(auto record = records; record != nullptr; record = record->next) {
+		uint8_t* p = &record->answer[DNS_ANSWER_TTL_OFFSET];
+		setUint16(p, ttl >> 16);
+		setUint16(p + 2, ttl);
+	}
 }
 
-bool DNSServer::requestIncludesOnlyOneQuestion()
+int DNSServer::encodeName(const String& name, uint8_t* buffer, unsigned bufferSize, bool& wildcard)
 {
-	return ntohs(dnsHeader->QDCount) == 1 && dnsHeader->ANCount == 0 && dnsHeader->NSCount == 0 &&
-		   dnsHeader->ARCount == 0;
+	const char* s = name.c_str();
+	unsigned length = name.length();
+
+	wildcard = false;
+	if(length == 1 && s[0] == '*') {
+		wildcard = true;
+		length = 0;
+	} else if(length > 2 && s[0] == '*' && s[1] == '.') {
+		wildcard = true;
+		s += 2;
+		length -= 2;
+	}
+
+	if(length != 0 && s[length - 1] == '.') {
+		--length;
+	}
+
+	unsigned pos = 0;
+	while(length != 0) {
+		auto dot = static_cast<const char*>(memchr(s, '.', length));
+		unsigned labelLength = (dot == nullptr) ? length : dot - s;
+		if(labelLength == 0 || labelLength > 63 || pos + labelLength + 2 > bufferSize) {
+			return -1;
+		}
+
+		buffer[pos++] = labelLength;
+		for(unsigned i = 0; i < labelLength; ++i) {
+			buffer[pos++] = toLower(s[i]);
+		}
+
+		s += labelLength;
+		length -= labelLength;
+		if(dot != nullptr) {
+			++s;
+			--length;
+		}
+	}
+
+	if(pos >= bufferSize) {
+		return -1;
+	}
+	buffer[pos++] = 0;
+	return pos;
 }
 
-void DNSServer::onReceive(pbuf* buf, IPAddress remoteIP, uint16_t remotePort)
+int DNSServer::parseName(const uint8_t* data, unsigned length)
 {
-	delete[] buffer;
-	buffer = new char[buf->tot_len];
-	if(buffer == nullptr) {
-		return;
+	// Questions never use compression so anything other than plain labels is malformed
+	unsigned pos = 0;
+	while(pos < length && pos < DNS_MAX_NAME_SIZE) {
+		uint8_t labelLength = data[pos];
+		if(labelLength == 0) {
+			return pos + 1;
+		}
+		if(labelLength > 63) {
+			return -1;
+		}
+		pos += labelLength + 1;
 	}
+	return -1;
+}
+
+bool DNSServer::matchName(const Record& record, const uint8_t* qname, unsigned qnameLength) const
+{
+	auto equals = [](const uint8_t* query, const uint8_t* name, unsigned length) {
+		for(unsigned i = 0; i < length; ++i) {
+			if(toLower(query[i]) != name[i]) {
+				return false;
+			}
+		}
+		return true;
+	};
 
-	pbuf_copy_partial(buf, buffer, buf->tot_len, 0);
-	debug_d("DNS REQ for %s from %s:%d", getDomainNameWithoutWwwPrefix().c_str(), remoteIP.toString().c_str(),
-			remotePort);
-	dnsHeader = reinterpret_cast<DNSHeader*>(buffer);
-	if(dnsHeader->QR == DNS_QR_QUERY && dnsHeader->OPCode == DNS_OPCODE_QUERY && requestIncludesOnlyOneQuestion() &&
-	   (domainName == "*" || getDomainNameWithoutWwwPrefix() == domainName)) {
-		char response[buf->tot_len + 16];
-		int idx = buf->tot_len;
-		dnsHeader->QR = DNS_QR_RESPONSE;
-		dnsHeader->ANCount = dnsHeader->QDCount;
-		memcpy(response, buffer, idx);
-		//Set a pointer to the domain name in the question section
-		response[idx] = 0xC0;
-		response[idx + 1] = 0x0C;
-
-		//Type: "Host Address"
-		response[idx + 2] = 0x00;
-		response[idx + 3] = 0x01;
-
-		//Set the response class to IN
-		response[idx + 4] = 0x00;
-		response[idx + 5] = 0x01;
-
-		//TTL
-		auto ttln = htonl(ttl);
-		response[idx + 6] = ttln >> 24;
-		response[idx + 7] = ttln >> 16;
-		response[idx + 8] = ttln >> 8;
-		response[idx + 9] = ttln;
-
-		//RDATA length
-		response[idx + 10] = 0x00;
-		response[idx + 11] = 0x04; //4 byte IP address
-
-		//The IP address
-		response[idx + 12] = ip4_addr1(&resolvedIP);
-		response[idx + 13] = ip4_addr2(&resolvedIP);
-		response[idx + 14] = ip4_addr3(&resolvedIP);
-		response[idx + 15] = ip4_addr4(&resolvedIP);
-
-		sendTo(remoteIP, remotePort, response, idx + 16);
-	} else if(dnsHeader->QR == DNS_QR_QUERY) {
-		dnsHeader->QR = DNS_QR_RESPONSE;
-		dnsHeader->RCode = char(errorReplyCode);
-		dnsHeader->QDCount = 0;
-		sendTo(remoteIP, remotePort, buffer, sizeof(DNSHeader));
-	}
-
-	delete[] buffer;
-	buffer = nullptr;
+	if(!record.wildcard) {
+		return qnameLength == record.nameLength && equals(qname, record.name, qnameLength);
+	}
 
-	UdpConnection::onReceive(buf, remoteIP, remotePort);
+	// Try the name following each label, a wildcard requires at least one label in front
+	for(unsigned offset = 0; qname[offset] != 0; offset += qname[offset] + 1) {
+		unsigned suffixLength = qnameLength - offset - qname[offset] - 1;
+		if(suffixLength < record.nameLength) {
+			break;
+		}
+		if(suffixLength == record.nameLength) {
+			return equals(&qname[qnameLength - suffixLength], record.name, suffixLength);
+		}
+	}
+
+	return false;
+}
+
+bool DNSServer::addRecord(const String& name, uint16_t type, const uint8_t* data, uint16_t dataLength)
+{
+	uint8_t wireName[DNS_MAX_NAME_SIZE];
+	bool wildcard;
+	int nameLength = encodeName(name, wireName, sizeof(wireName), wildcard);
+	if(nameLength < 0 || DNS_HEADER_SIZE + 2 + DNS_ANSWER_FIXED_SIZE + dataLength > DNS_SERVER_MAX_RESPONSE) {
+		debug_e("DNS: invalid record for '%s'", name.c_str());
+		return false;
+	}
+
+	auto record = new Record{nullptr};
+	if(record == nullptr) {
+		return false;
+	}
+	record->name = new uint8_t[nameLength];
+	record->answerLength = DNS_ANSWER_FIXED_SIZE + dataLength;
+	record->answer = new uint8_t[record->answerLength];
+	if(record->name == nullptr || record->answer == nullptr) {
+		delete[] record->name;
+		delete[] record->answer;
+		delete record;
+		return false;
+	}
+
+	memcpy(record->name, wireName, nameLength);
+	record->nameLength = nameLength;
+	record->wildcard = wildcard;
+	record->type = type;
+
+	uint8_t* answer = record->answer;
+	setUint16(&answer[0], type);
+	setUint16(&answer[2], DNS_CLASS_IN);
+	setUint16(&answer[DNS_ANSWER_TTL_OFFSET], ttl >> 16);
+	setUint16(&answer[DNS_ANSWER_TTL_OFFSET + 2], ttl);
+	setUint16(&answer[8], dataLength);
+	memcpy(&answer[DNS_ANSWER_FIXED_SIZE], data, dataLength);
+
+	// Keep records in the order added, which is the order they are answered in
+	Record** tail = &records;
+	while(*tail != nullptr) {
+		tail = &(*tail)->next;
+	}
+	*tail = record;
+
+	return true;
+}
+
+bool DNSServer::addA(const String& name, IPAddress ip)
+{
+	const uint8_t data[] = {ip[0], ip[1], ip[2], ip[3]};
+	return addRecord(name, DNS_TYPE_A, data, sizeof(data));
+}
+
+bool DNSServer::addPtr(const String& name, const String& target)
+{
+	uint8_t data[DNS_MAX_NAME_SIZE];
+	bool wildcard;
+	int length = encodeName(target, data, sizeof(data), wildcard);
+	if(length < 0 || wildcard) {
+		return false;
+	}
+	return addRecord(name, DNS_TYPE_PTR, data, length);
+}
+
+bool DNSServer::addPtr(IPAddress ip, const String& target)
+{
+	String name;
+	for(int i = 3; i >= 0; --i) {
+		name += ip[i];
+		name += '.';
+	}
+	name += _F("in-addr.arpa");
+	return addPtr(name, target);
 }
 
-String DNSServer::getDomainNameWithoutWwwPrefix()
+bool DNSServer::addTxt(const String& name, const String& text)
 {
-	String parsedDomainName;
-	if(buffer == nullptr) {
-		return parsedDomainName;
+	// Each character-string is preceded by its length
+	unsigned textLength = text.length();
+	unsigned dataLength = textLength + (textLength + 254) / 255;
+	if(dataLength == 0) {
+		dataLength = 1;
 	}
-	char* start = buffer + 12;
-	if(*start == 0) {
-		return parsedDomainName;
+	if(dataLength > DNS_SERVER_MAX_RESPONSE) {
+		return false;
+	}
+
+	uint8_t* data = new uint8_t[dataLength];
+	if(data == nullptr) {
+		return false;
 	}
 
 	unsigned pos = 0;
-	while(true) {
-		unsigned labelLength = *(start + pos);
-		for(unsigned i = 0; i < labelLength; i++) {
-			pos++;
-			parsedDomainName += start[pos];
+	unsigned offset = 0;
+	do {
+		unsigned chunk = std::min(textLength - offset, 255U);
+		data[pos++] = chunk;
+		memcpy(&data[pos], text.c_str() + offset, chunk);
+		pos += chunk;
+		offset += chunk;
+	} while(offset < textLength);
+
+	bool ok = addRecord(name, DNS_TYPE_TXT, data, dataLength);
+	delete[] data;
+	return ok;
+}
+
+void DNSServer::clearRecords()
+{
+	while(records != nullptr) {
+		Record* record = records;
+		records = record->next;
+		delete[] record->name;
+		delete[] record->answer;
+		delete record;
+	}
+}
+
+void DNSServer::onReceive(pbuf* buf, IPAddress remoteIP, uint16_t remotePort)
+{
+	++stats.queries;
+
+	// The reply starts with the request header and question, so build it in place
+	uint8_t response[DNS_SERVER_MAX_RESPONSE];
+	unsigned length = pbuf_copy_partial(buf, response, std::min(unsigned(buf->tot_len), sizeof(response)), 0);
+	if(length < DNS_HEADER_SIZE || (response[2] & DNS_FLAG_QR)) {
+		// Never reply to responses, that could start a loop between servers
+		++stats.dropped;
+		return;
+	}
+
+	uint8_t opcode = (response[2] >> DNS_OPCODE_SHIFT) & DNS_OPCODE_MASK;
+	DNSReplyCode rcode = DNSReplyCode::NoError;
+	unsigned pos = DNS_HEADER_SIZE;
+	uint16_t answerCount = 0;
+	bool truncated = false;
+
+	int qnameLength = parseName(&response[DNS_HEADER_SIZE], length - DNS_HEADER_SIZE);
+	if(opcode != DNS_OPCODE_QUERY) {
+		rcode = DNSReplyCode::NotImplemented;
+	} else if(getUint16(&response[4]) != 1 || qnameLength < 0 ||
+			  DNS_HEADER_SIZE + unsigned(qnameLength) + 4 > length) {
+		rcode = DNSReplyCode::FormError;
+	} else {
+		const uint8_t* qname = &response[DNS_HEADER_SIZE];
+		pos += qnameLength;
+		uint16_t qtype = getUint16(&response[pos]);
+		uint16_t qclass = getUint16(&response[pos + 2]);
+		pos += 4;
+
+		bool known = false;
+		if(qclass == DNS_CLASS_IN || qclass == DNS_CLASS_ANY) {
+			for(auto record = records; record != nullptr; record = record->next) {
+				if(!matchName(*record, qname, qnameLength)) {
+					continue;
+				}
+				known = true;
+				if(qtype != DNS_TYPE_ANY && qtype != record->type) {
+					continue;
+				}
+				if(pos + 2 + record->answerLength > sizeof(response)) {
+					truncated = true;
+					break;
+				}
+				// The name is a pointer to the question
+				response[pos++] = 0xC0;
+				response[pos++] = DNS_HEADER_SIZE;
+				memcpy(&response[pos], record->answer, record->answerLength);
+				pos += record->answerLength;
+				++answerCount;
+			}
 		}
-		pos++;
-		if(start[pos] == 0) {
-			downcaseAndRemoveWwwPrefix(parsedDomainName);
-			return parsedDomainName;
-		} else {
-			parsedDomainName += '.';
+
+		if(!known) {
+			rcode = errorReplyCode;
 		}
 	}
+
+	// Keep ID, opcode and RD. Anything after the question, such as EDNS options, is dropped.
+	response[2] = DNS_FLAG_QR | DNS_FLAG_AA | (response[2] & ((DNS_OPCODE_MASK << DNS_OPCODE_SHIFT) | DNS_FLAG_RD)) |
+				  (truncated ? DNS_FLAG_TC : 0);
+	response[3] = uint8_t(rcode);
+	setUint16(&response[4], (pos > DNS_HEADER_SIZE) ? 1 : 0);
+	setUint16(&response[6], answerCount);
+	setUint16(&response[8], 0);
+	setUint16(&response[10], 0);
+
+	if(answerCount != 0) {
+		++stats.answered;
+	} else if(rcode == DNSReplyCode::NoError) {
+		++stats.noData;
+	} else {
+		++stats.errors;
+	}
+
+	sendTo(remoteIP, remotePort, reinterpret_cast<const char*>(response), pos);
+
+	UdpConnection::onReceive(buf, remoteIP, remotePort);
 }
@@ -9,6 +9,15 @@
  * https://github.com/israellot/esp-ginx/tree/master/app/dns
  * https://github.com/esp8266/Arduino/tree/master/libraries/DNSServer
  * Created on March 4, 2016
+ *
+ * Small authoritative responder. Names are held in wire format and matched
+ * case-insensitively against the question as received, and each record's
+ * answer is built when it is added, so a reply is just the question followed
+ * by copies of the matching answers. Nothing is allocated per request.
+ *
+ * A name of "*" matches every query, "*.example.com" any name below example.com.
+ * AAAA queries for known names get an empty answer so clients fall back to IPv4
+ * without waiting.
  */
 
 /** @defgroup   dnsserver DNS server
@@ -26,6 +35,20 @@
 #define DNS_QR_RESPONSE 1
 #define DNS_OPCODE_QUERY 0
 
+#define DNS_TYPE_A 1
+#define DNS_TYPE_PTR 12
+#define DNS_TYPE_TXT 16
+#define DNS_TYPE_AAAA 28
+#define DNS_TYPE_ANY 255
+
+#define DNS_CLASS_IN 1
+#define DNS_CLASS_ANY 255
+
+/** @brief Largest reply sent, replies which don't fit are truncated */
+#ifndef DNS_SERVER_MAX_RESPONSE
+#define DNS_SERVER_MAX_RESPONSE 512
+#endif
+
 enum class DNSReplyCode {
 	NoError = 0,
 	FormError = 1,
@@ -54,6 +77,14 @@ struct DNSHeader {
 	uint16_t ARCount; // number of resource entries
 };
 
+typedef struct {
+	uint32_t queries = 0;  ///< Requests received
+	uint32_t answered = 0; ///< Replies with at least one answer
+	uint32_t noData = 0;   ///< Known name but no record of the requested type
+	uint32_t errors = 0;   ///< Replies with an error code, including unknown names
+	uint32_t dropped = 0;  ///< Malformed requests and responses, which get no reply
+} DNSServerStats;
+
 class DNSServer : public UdpConnection
 {
 public:
@@ -63,6 +94,7 @@ public:
 
 	virtual ~DNSServer()
 	{
+		clearRecords();
 	}
 
 	void setErrorReplyCode(DNSReplyCode replyCode)
@@ -70,30 +102,71 @@ public:
 		errorReplyCode = replyCode;
 	}
 
-	void setTTL(uint32_t ttl)
-	{
-		this->ttl = ttl;
-	}
+	/** @brief Set the TTL of all records, including those already added */
+	void setTTL(uint32_t ttl);
 
-	// Returns true if successful, false if there are no sockets available
+	/**
+	 * @brief Answer A queries for one name
+	 * @param port
+	 * @param domainName Name to answer for, also answered with a "www." prefix. Use "*" to answer all queries.
+	 * @param resolvedIP
+	 * @retval bool true if successful, false if there are no sockets available
+	 * @note Replaces any records added previously
+	 */
 	bool start(uint16_t port, const String& domainName, const IPAddress& resolvedIP);
 
+	/**
+	 * @brief Start serving the records added with addA() etc.
+	 * @retval bool true if successful, false if there are no sockets available
+	 */
+	bool start(uint16_t port = 53);
+
 	// stops the DNS server
 	void stop();
 
+	/** @brief Add an address record. A name may have several. */
+	bool addA(const String& name, IPAddress ip);
+
+	/** @brief Add a pointer record, e.g. "1.4.168.192.in-addr.arpa" -> "device.local" */
+	bool addPtr(const String& name, const String& target);
+
+	/** @brief Add a reverse lookup record for an address */
+	bool addPtr(IPAddress ip, const String& target);
+
+	/** @brief Add a text record. Text longer than 255 characters is split into several strings. */
+	bool addTxt(const String& name, const String& text);
+
+	void clearRecords();
+
+	const DNSServerStats& getStats() const
+	{
+		return stats;
+	}
+
+protected:
+	virtual void onReceive(pbuf* buf, IPAddress remoteIP, uint16_t remotePort);
+
+private:
+	struct Record {
+		Record* next;
+		uint8_t* name;	 ///< Lower case wire format, without the "*" label of a wildcard
+		uint8_t* answer;   ///< Type, class, TTL, data length and data
+		uint16_t type;
+		uint8_t nameLength;
+		uint16_t answerLength;
+		bool wildcard;
+	};
+
+	bool addRecord(const String& name, uint16_t type, const uint8_t* data, uint16_t dataLength);
+	bool matchName(const Record& record, const uint8_t* qname, unsigned qnameLength) const;
+	static int encodeName(const String& name, uint8_t* buffer, unsigned bufferSize, bool& wildcard);
+	static int parseName(const uint8_t* data, unsigned length);
+
 private:
-	uint16_t port = 0;
-	String domainName;
-	ip_addr resolvedIP;
-	char* buffer = nullptr;
-	DNSHeader* dnsHeader = nullptr;
+	Record* records = nullptr;
 	uint32_t ttl = 60;
 	DNSReplyCode errorReplyCode = DNSReplyCode::NonExistentDomain;
-
-	virtual void onReceive(pbuf* buf, IPAddress remoteIP, uint16_t remotePort);
-	static void downcaseAndRemoveWwwPrefix(String& domainName);
-	String getDomainNameWithoutWwwPrefix();
-	bool requestIncludesOnlyOneQuestion();
+	DNSServerStats stats;
 };
 
 /** @} */
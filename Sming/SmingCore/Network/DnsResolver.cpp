@@ -0,0 +1,287 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * DnsResolver.cpp
+ *
+ ****/
+
+#include "DnsResolver.h"
+#include "../Clock.h"
+
+DnsResolver dnsResolver;
+
+DnsResolver::~DnsResolver()
+{
+	for(auto& entry : entries) {
+		while(entry.waiters != nullptr) {
+			Waiter* waiter = entry.waiters;
+			entry.waiters = waiter->next;
+			delete waiter;
+		}
+	}
+}
+
+DnsResolver::Entry* DnsResolver::find(const String& name)
+{
+	for(auto& entry : entries) {
+		if(entry.name.length() == name.length() && entry.name.equalsIgnoreCase(name)) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+DnsResolver::Entry* DnsResolver::allocate(const String& name)
+{
+	// Use a free entry or replace the least recently used one, but never one that is in use
+	Entry* entry = nullptr;
+	for(auto& e : entries) {
+		if(e.pending || e.waiters != nullptr) {
+			continue;
+		}
+		if(e.name.length() == 0) {
+			entry = &e;
+			break;
+		}
+		if(entry == nullptr || int32_t(e.lastUsed - entry->lastUsed) < 0) {
+			entry = &e;
+		}
+	}
+
+	if(entry != nullptr) {
+		*entry = Entry();
+		entry->name = name;
+	}
+	return entry;
+}
+
+bool DnsResolver::getAddress(Entry& entry, IPAddress& ip)
+{
+	if(!entry.valid) {
+		return false;
+	}
+
+	uint32_t now = millis();
+	uint32_t age = now - entry.updated;
+	if(age >= (DNS_RESOLVER_TTL + DNS_RESOLVER_STALE_TIME) * 1000U) {
+		entry.valid = false;
+		return false;
+	}
+
+	bool refresh;
+	if(age < DNS_RESOLVER_TTL * 1000U) {
+		++stats.hits;
+		refresh = (age >= (DNS_RESOLVER_TTL - DNS_RESOLVER_PREFETCH_TIME) * 1000U);
+	} else {
+		++stats.staleHits;
+		refresh = true;
+	}
+
+	// While the server is unreachable, retry no more often than the negative TTL
+	if(refresh && !entry.pending && !entry.isFailureCached(now)) {
+		query(entry);
+	}
+
+	ip = entry.ip;
+	return true;
+}
+
+err_t DnsResolver::resolve(const String& name, IPAddress& ip, DnsResolverDelegate callback, void* owner)
+{
+	if(name.length() == 0) {
+		return ERR_ARG;
+	}
+
+	ip_addr_t addr;
+	if(ipaddr_aton(name.c_str(), &addr)) {
+		ip = addr;
+		return ERR_OK;
+	}
+
+	Entry* entry = find(name);
+	if(entry != nullptr) {
+		entry->lastUsed = millis();
+
+		if(getAddress(*entry, ip)) {
+			return ERR_OK;
+		}
+
+		if(!entry->pending && entry->isFailureCached(millis())) {
+			++stats.negativeHits;
+			return ERR_VAL;
+		}
+	} else {
+		entry = allocate(name);
+		if(entry == nullptr) {
+			debug_w("DNS: no free cache entry for %s", name.c_str());
+			return ERR_MEM;
+		}
+		entry->lastUsed = millis();
+	}
+
+	++stats.misses;
+	if(entry->pending) {
+		++stats.coalesced;
+	} else {
+		err_t err = query(*entry);
+		if(err != ERR_INPROGRESS) {
+			// Answered from the lwIP table or failed to start, either way there are no waiters to call
+			if(err == ERR_OK) {
+				ip = entry->ip;
+			}
+			return err;
+		}
+	}
+
+	auto waiter = new Waiter{entry->waiters, callback, owner};
+	if(waiter == nullptr) {
+		return ERR_MEM;
+	}
+	entry->waiters = waiter;
+	++waiterCount;
+	return ERR_INPROGRESS;
+}
+
+bool DnsResolver::lookup(const String& name, IPAddress& ip)
+{
+	Entry* entry = find(name);
+	if(entry == nullptr || !entry->valid) {
+		return false;
+	}
+
+	if(millis() - entry->updated >= (DNS_RESOLVER_TTL + DNS_RESOLVER_STALE_TIME) * 1000U) {
+		return false;
+	}
+
+	ip = entry->ip;
+	return true;
+}
+
+void DnsResolver::prefetch(const String& name)
+{
+	ip_addr_t addr;
+	if(name.length() == 0 || ipaddr_aton(name.c_str(), &addr)) {
+		return;
+	}
+
+	Entry* entry = find(name);
+	if(entry == nullptr) {
+		entry = allocate(name);
+		if(entry == nullptr) {
+			return;
+		}
+		entry->lastUsed = millis();
+	}
+
+	if(!entry->pending) {
+		query(*entry);
+	}
+}
+
+err_t DnsResolver::query(Entry& entry)
+{
+	debug_d("DNS: query %s", entry.name.c_str());
+	++stats.queries;
+	entry.pending = true;
+
+	ip_addr_t addr;
+	err_t err = dns_gethostbyname(entry.name.c_str(), &addr, staticDnsFound, this);
+	if(err == ERR_OK) {
+		complete(entry, &addr);
+	} else if(err != ERR_INPROGRESS) {
+		// Local problem such as no network or a full lwIP table, so don't cache the failure
+		debug_w("DNS: query for %s failed to start (%d)", entry.name.c_str(), err);
+		entry.pending = false;
+		++stats.failures;
+	}
+
+	return err;
+}
+
+void DnsResolver::staticDnsFound(const char* name, LWIP_IP_ADDR_T* ipaddr, void* arg)
+{
+	auto resolver = static_cast<DnsResolver*>(arg);
+	Entry* entry = resolver->find(name);
+	if(entry == nullptr || !entry->pending) {
+		return;
+	}
+
+	resolver->complete(*entry, ipaddr);
+}
+
+void DnsResolver::complete(Entry& entry, const ip_addr_t* addr)
+{
+	entry.pending = false;
+	entry.checked = millis();
+
+	if(addr != nullptr) {
+		debug_d("DNS: %s = %s", entry.name.c_str(), IPAddress(*addr).toString().c_str());
+		entry.ip = *addr;
+		entry.updated = entry.checked;
+		entry.valid = true;
+		entry.failed = false;
+	} else {
+		// Any previous answer is kept, a stale address is better than none
+		debug_d("DNS: %s not found", entry.name.c_str());
+		++stats.failures;
+		entry.failed = true;
+	}
+
+	if(entry.waiters == nullptr) {
+		return;
+	}
+
+	// Callbacks may resolve or cancel, so take one waiter at a time. The entry cannot
+	// be reused while it has waiters.
+	String name = entry.name;
+	IPAddress ip = entry.valid ? entry.ip : INADDR_NONE;
+	while(entry.waiters != nullptr) {
+		Waiter* waiter = entry.waiters;
+		entry.waiters = waiter->next;
+		--waiterCount;
+		if(waiter->callback) {
+			waiter->callback(name, ip);
+		}
+		delete waiter;
+	}
+}
+
+void DnsResolver::cancel(void* owner)
+{
+	if(owner == nullptr || waiterCount == 0) {
+		return;
+	}
+
+	for(auto& entry : entries) {
+		Waiter** pwaiter = &entry.waiters;
+		while(*pwaiter != nullptr) {
+			Waiter* waiter = *pwaiter;
+			if(waiter->owner == owner) {
+				*pwaiter = waiter->next;
+				--waiterCount;
+				delete waiter;
+			} else {
+				pwaiter = &waiter->next;
+			}
+		}
+	}
+}
+
+void DnsResolver::flush()
+{
+	for(auto& entry : entries) {
+		entry.valid = false;
+		entry.failed = false;
+		if(!entry.pending && entry.waiters == nullptr) {
+			entry.name = nullptr;
+		}
+	}
+}
+
+void DnsResolver::setServer(IPAddress server, uint8_t index)
+{
+	dns_setserver(index, server);
+}
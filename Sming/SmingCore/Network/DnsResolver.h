@@ -0,0 +1,162 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * DnsResolver.h
+ *
+ * Caching front end to the lwIP resolver, shared by all network clients.
+ *
+ * - Answers are cached for DNS_RESOLVER_TTL seconds, failures for
+ *   DNS_RESOLVER_NEGATIVE_TTL so an unreachable name is not queried on every
+ *   reconnect attempt.
+ * - An expired answer is still returned for up to DNS_RESOLVER_STALE_TIME while
+ *   a fresh query runs in the background, and is kept if that query fails. After
+ *   a Wi-Fi drop clients reconnect straight away instead of waiting on DNS.
+ * - A name used within DNS_RESOLVER_PREFETCH_TIME of expiry is refreshed early.
+ * - Requests for a name already being queried wait on that query rather than
+ *   starting another. Different names are queried in parallel, up to the size
+ *   of the lwIP DNS table.
+ *
+ * lwIP does not pass record TTLs to its callers, so a fixed TTL is used.
+ *
+ ****/
+
+/** @defgroup   dns DNS resolver
+ *  @brief      Cached host name resolution
+ *  @ingroup    networking
+ *  @{
+ */
+
+#ifndef _SMING_CORE_NETWORK_DNS_RESOLVER_H_
+#define _SMING_CORE_NETWORK_DNS_RESOLVER_H_
+
+#include "../Wiring/WiringFrameworkDependencies.h"
+#include "../Wiring/WString.h"
+#include "IPAddress.h"
+#include "../Delegate.h"
+
+/** @brief Number of names cached, including those being queried */
+#ifndef DNS_RESOLVER_CACHE_SIZE
+#define DNS_RESOLVER_CACHE_SIZE 8
+#endif
+
+/** @brief Seconds an answer is considered fresh */
+#ifndef DNS_RESOLVER_TTL
+#define DNS_RESOLVER_TTL 300
+#endif
+
+/** @brief Seconds a failed lookup is remembered */
+#ifndef DNS_RESOLVER_NEGATIVE_TTL
+#define DNS_RESOLVER_NEGATIVE_TTL 10
+#endif
+
+/** @brief Seconds after expiry an answer may still be used while it is refreshed */
+#ifndef DNS_RESOLVER_STALE_TIME
+#define DNS_RESOLVER_STALE_TIME 3600
+#endif
+
+/** @brief Seconds before expiry at which a used answer is refreshed */
+#ifndef DNS_RESOLVER_PREFETCH_TIME
+#define DNS_RESOLVER_PREFETCH_TIME 30
+#endif
+
+/** @brief Lookup result, `ip` is INADDR_NONE on failure */
+typedef Delegate<void(const String& name, IPAddress ip)> DnsResolverDelegate;
+
+typedef struct {
+	uint32_t hits = 0;		   ///< Answered from cache
+	uint32_t staleHits = 0;	///< Answered with an expired address while it was refreshed
+	uint32_t negativeHits = 0; ///< Failed from cache
+	uint32_t misses = 0;	   ///< Had to wait for a query
+	uint32_t coalesced = 0;	///< Misses which joined a query already in progress
+	uint32_t queries = 0;	  ///< Queries started, including refreshes
+	uint32_t failures = 0;	 ///< Queries which failed
+} DnsResolverStats;
+
+class DnsResolver
+{
+public:
+	~DnsResolver();
+
+	/** @brief Resolve a host name
+	 *  @param name Host name or dotted IP address
+	 *  @param ip Receives the address if it is available immediately
+	 *  @param callback Invoked with the result if it is not
+	 *  @param owner Identifies the request for cancel(), typically the caller's `this`
+	 *  @retval err_t ERR_OK if `ip` is valid, ERR_INPROGRESS if `callback` will be invoked,
+	 *  ERR_VAL if the name recently failed to resolve, or another error if no query could be started
+	 */
+	err_t resolve(const String& name, IPAddress& ip, DnsResolverDelegate callback, void* owner = nullptr);
+
+	/** @brief Get a cached address without querying
+	 *  @retval bool false if there is no usable address
+	 */
+	bool lookup(const String& name, IPAddress& ip);
+
+	/** @brief Refresh a name in the background, e.g. ahead of a reconnect */
+	void prefetch(const String& name);
+
+	/** @brief Drop all callbacks registered by an owner */
+	void cancel(void* owner);
+
+	/** @brief Discard cached answers and failures. Queries in progress complete normally. */
+	void flush();
+
+	/** @brief Set a DNS server, e.g. to point the resolver at a local server for testing */
+	static void setServer(IPAddress server, uint8_t index = 0);
+
+	const DnsResolverStats& getStats() const
+	{
+		return stats;
+	}
+
+	void resetStats()
+	{
+		stats = DnsResolverStats();
+	}
+
+private:
+	struct Waiter {
+		Waiter* next;
+		DnsResolverDelegate callback;
+		void* owner;
+	};
+
+	struct Entry {
+		String name;
+		IPAddress ip;
+		uint32_t updated = 0;  ///< millis() when `ip` was received
+		uint32_t checked = 0;  ///< millis() when the last query completed
+		uint32_t lastUsed = 0; ///< millis() when last requested, for replacement
+		Waiter* waiters = nullptr;
+		bool valid = false;   ///< `ip` holds an answer, which may have expired
+		bool failed = false;  ///< The last query failed
+		bool pending = false; ///< A query is in progress
+
+		/** @brief Determine if a failure is recent enough that the name should not be queried again */
+		bool isFailureCached(uint32_t now) const
+		{
+			return failed && now - checked < DNS_RESOLVER_NEGATIVE_TTL * 1000U;
+		}
+	};
+
+	Entry* find(const String& name);
+	Entry* allocate(const String& name);
+	bool getAddress(Entry& entry, IPAddress& ip);
+	err_t query(Entry& entry);
+	void complete(Entry& entry, const ip_addr_t* addr);
+	static void staticDnsFound(const char* name, LWIP_IP_ADDR_T* ipaddr, void* arg);
+
+private:
+	Entry entries[DNS_RESOLVER_CACHE_SIZE];
+	unsigned waiterCount = 0;
+	DnsResolverStats stats;
+};
+
+/** @brief Global resolver used by TcpConnection and NtpClient */
+extern DnsResolver dnsResolver;
+
+/** @} */
+#endif /* _SMING_CORE_NETWORK_DNS_RESOLVER_H_ */
@@ -11,6 +11,7 @@
 #include "HttpResponse.h"
 #include "FTPServerConnection.h"
 #include "TcpClient.h"
+#include "../FileSystem.h"
 #include "../Wiring/WString.h"
 
 FTPServer::FTPServer()
@@ -43,10 +44,39 @@ bool FTPServer::checkUser(String login, const String& pass)
 	return users[login] == pass;
 }
 
+const String& FTPServer::getFileListing()
+{
+	if(fileListingValid && millis() - fileListingTime < FTP_LIST_CACHE_TIME * 1000)
+		return fileListing;
+
+	// Each size is a separate file system lookup, so this is worth keeping
+	Vector<String> list = fileList();
+	// Other file systems show up as files named with their mount point
+	for(unsigned i = 1; i < fileGetMountCount(); ++i) {
+		Vector<String> names = fileList(fileGetMountPoint(i));
+		for(unsigned j = 0; j < names.count(); ++j) {
+			list.add(names[j]);
+		}
+	}
+	debug_d("build file list: %d", list.count());
+	fileListing = "";
+	for(int i = 0; i < list.count(); i++) {
+		fileListing += _F("01-01-15  01:00AM               ");
+		fileListing += fileGetSize(list[i]);
+		fileListing += ' ';
+		fileListing += list[i];
+		fileListing += "\r\n";
+	}
+	fileListingTime = millis();
+	fileListingValid = true;
+	return fileListing;
+}
+
 bool FTPServer::onCommand(String cmd, String data, FTPServerConnection& connection)
 {
 	if(cmd == "FSFORMAT") {
 		spiffs_format();
+		invalidateFileListing();
 		connection.response(200, "File system successfully formated");
 		return true;
 	}
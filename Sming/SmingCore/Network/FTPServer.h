@@ -19,6 +19,11 @@
 #include "../../Wiring/WVector.h"
 #include "../../Wiring/WString.h"
 
+/** @brief Seconds a directory listing is reused for, bounds how long changes made by the application stay unseen */
+#ifndef FTP_LIST_CACHE_TIME
+#define FTP_LIST_CACHE_TIME 10
+#endif
+
 class FTPServerConnection;
 
 class FTPServer : public TcpServer
@@ -32,12 +37,26 @@ public:
 	void addUser(String login, String pass);
 	bool checkUser(String login, const String& pass);
 
+	/** @brief Get the listing sent for LIST, rebuilt when it's older than FTP_LIST_CACHE_TIME
+	 *  @note Uploads and deletions through the server rebuild it on next use
+	 */
+	const String& getFileListing();
+
+	/** @brief Rebuild the listing on next use, call after changing files */
+	void invalidateFileListing()
+	{
+		fileListingValid = false;
+	}
+
 protected:
 	virtual TcpConnection* createClient(tcp_pcb* clientTcp);
 	virtual bool onCommand(String cmd, String data, FTPServerConnection& connection);
 
 private:
 	HashMap<String, String> users;
+	String fileListing;
+	uint32_t fileListingTime = 0; ///< millis() when fileListing was built
+	bool fileListingValid = false;
 };
 
 /** @} */
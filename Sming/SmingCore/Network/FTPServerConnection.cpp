@@ -2,85 +2,242 @@
 #include "FTPServer.h"
 #include "NetUtils.h"
 #include "TcpConnection.h"
+#include "PbufSpan.h"
 #include "../FileSystem.h"
+#include <algorithm>
 
 class FTPDataStream : public TcpConnection
 {
 public:
-	FTPDataStream(FTPServerConnection* connection)
-		: TcpConnection(true), parent(connection), completed(false), sent(0), written(0)
+	FTPDataStream(FTPServerConnection* connection) : TcpConnection(true), parent(connection), completed(false)
 	{
 	}
+	virtual ~FTPDataStream()
+	{
+		// Closed by timeout or error before the transfer finished
+		finish(426, F("Transfer aborted"));
+	}
+
+	/** @brief Take over a passive mode connection accepted by the control connection
+	 *  @note May free the stream, if the transfer finishes straight away
+	 */
+	void attach(tcp_pcb* pcb)
+	{
+		initialize(pcb);
+		onConnected(ERR_OK);
+		freeIfClosed();
+	}
+
+	/** @brief Abandon the transfer as the control connection is going away, frees the stream */
+	void detach()
+	{
+		parent = NULL;
+		// Data lwIP has queued may point into this object, so don't wait for it to be sent
+		abortConnection();
+		delete this;
+	}
+
+	/** @brief Called when the control connection's last reply has been sent
+	 *  @note May free the stream
+	 */
+	void resume()
+	{
+		if(tcp == NULL)
+			return; // Passive connection not accepted yet
+		if(canSend)
+			onReadyToSendData(eTCE_Poll);
+		freeIfClosed();
+	}
+
 	virtual err_t onConnected(err_t err)
 	{
 		//response(125, "Connected");
 		setTimeOut(300); // Update timeout
 		return TcpConnection::onConnected(err);
 	}
-	virtual err_t onSent(uint16_t len)
-	{
-		sent += len;
-		if(written < sent || !completed)
-			return TcpConnection::onSent(len);
-		finishTransfer();
-		return TcpConnection::onSent(len);
-	}
-	void finishTransfer()
+	/** @brief Report the result and close, leaving the stream to be freed by the caller */
+	void finishTransfer(int code = 226, const String& text = F("Transfer Complete."))
 	{
+		finish(code, text);
+		autoSelfDestruct = false;
 		close();
-		parent->dataTransferFinished(this);
+		autoSelfDestruct = true;
 	}
 	void response(int code, String text = "")
 	{
-		parent->response(code, text);
-	}
-	int write(const char* data, int len, uint8_t apiflags = 0)
-	{
-		written += len;
-		return TcpConnection::write(data, len, apiflags);
+		if(parent != NULL)
+			parent->response(code, text);
 	}
 	virtual void onReadyToSendData(TcpConnectionEvent sourceEvent)
 	{
-		if(!parent->isCanTransfer())
+		if(parent == NULL || !parent->isCanTransfer())
 			return;
-		if(completed && written == 0)
-			finishTransfer();
 		transferData(sourceEvent);
 	}
 	virtual void transferData(TcpConnectionEvent sourceEvent)
 	{
 	}
 
+protected:
+	/** @brief Tell the control connection the transfer is over, once */
+	void finish(int code, const String& text)
+	{
+		FTPServerConnection* connection = parent;
+		parent = NULL;
+		if(connection != NULL)
+			connection->dataTransferFinished(this, code, text);
+	}
+
+	void invalidateFileListing()
+	{
+		if(parent != NULL)
+			parent->server->invalidateFileListing();
+	}
+
+	/** @brief Drop the connection at once, so lwIP lets go of any data it was given
+	 *  @note Not from within this connection's own lwIP callbacks, unless they then return ERR_ABRT
+	 */
+	void abortConnection()
+	{
+		if(tcp != NULL) {
+			tcp_pcb* pcb = tcp;
+			tcp_arg(pcb, NULL);
+			tcp = NULL;
+			tcp_abort(pcb);
+		}
+	}
+
+private:
+	// lwIP callbacks free closed connections on return, other entry points have to do it themselves
+	void freeIfClosed()
+	{
+		if(tcp == NULL)
+			delete this;
+	}
+
 protected:
 	FTPServerConnection* parent;
 	bool completed;
-	int written;
-	int sent;
 };
 
-class FTPDataFileList : public FTPDataStream
+/*
+ * Sends from memory owned by the stream without copying it into lwIP, so a block
+ * stays untouched until it has been acknowledged. Completion waits for the last
+ * acknowledgement, as closing would free memory lwIP still refers to.
+ */
+class FTPDataSender : public FTPDataStream
+{
+public:
+	FTPDataSender(FTPServerConnection* connection) : FTPDataStream(connection)
+	{
+	}
+
+	~FTPDataSender()
+	{
+		// TcpConnection's destructor only closes gracefully
+		if(unacknowledged != 0)
+			abortConnection();
+	}
+
+	/*
+	 * A graceful close leaves lwIP free to retransmit data after the stream has been freed,
+	 * so while any is unacknowledged the connection is aborted instead. That covers the idle
+	 * timeout and closes from the control connection.
+	 */
+	virtual void close()
+	{
+		if(unacknowledged != 0)
+			abortConnection();
+		FTPDataStream::close();
+	}
+
+	virtual err_t onReceive(pbuf* buf)
+	{
+		// The client gave up part way through
+		if(buf == NULL && unacknowledged != 0) {
+			abortConnection();
+			close(); // Frees the stream
+			return ERR_ABRT;
+		}
+		return FTPDataStream::onReceive(buf);
+	}
+
+	virtual err_t onSent(uint16_t len)
+	{
+		unacknowledged -= std::min(unacknowledged, unsigned(len));
+		onAcknowledged(len);
+		if(completed) {
+			if(unacknowledged == 0)
+				finishTransfer();
+			return ERR_OK;
+		}
+		return TcpConnection::onSent(len);
+	}
+
+protected:
+	/** @brief Queue data, which must stay valid until acknowledged
+	 *  @retval bool false if the send buffer is full
+	 */
+	bool send(const char* data, uint16_t len)
+	{
+		if(getAvailableWriteSize() < len || TcpConnection::write(data, len, 0) < 0)
+			return false;
+		unacknowledged += len;
+		return true;
+	}
+
+	/** @brief Mark the end of the data, finishing now if nothing is in flight */
+	void complete()
+	{
+		completed = true;
+		if(unacknowledged == 0)
+			finishTransfer();
+		else
+			flush();
+	}
+
+	/** @brief Acknowledgements arrive in the order data was sent */
+	virtual void onAcknowledged(uint16_t len)
+	{
+	}
+
+protected:
+	unsigned unacknowledged = 0;
+};
+
+class FTPDataFileList : public FTPDataSender
 {
 public:
-	FTPDataFileList(FTPServerConnection* connection) : FTPDataStream(connection)
+	FTPDataFileList(FTPServerConnection* connection, const String& listing)
+		: FTPDataSender(connection), listing(listing)
 	{
 	}
 	virtual void transferData(TcpConnectionEvent sourceEvent)
 	{
 		if(completed)
 			return;
-		Vector<String> list = fileList();
-		debug_d("send file list: %d", list.count());
-		for(int i = 0; i < list.count(); i++)
-			writeString("01-01-15  01:00AM               " + String(fileGetSize(list[i])) + " " + list[i] + "\r\n");
-		completed = true;
-		finishTransfer();
+		// Our copy of the listing is immune to the cache being rebuilt during the transfer
+		unsigned remaining = listing.length() - offset;
+		uint16_t len = std::min(remaining, unsigned(getAvailableWriteSize()));
+		if(len != 0 && send(listing.c_str() + offset, len))
+			offset += len;
+		if(offset == listing.length())
+			complete();
 	}
+
+private:
+	String listing;
+	unsigned offset = 0;
 };
 
-class FTPDataRetrieve : public FTPDataStream
+/*
+ * Two blocks alternate: while one waits to be acknowledged the next is read
+ * from flash and queued, so reading and transmitting overlap.
+ */
+class FTPDataRetrieve : public FTPDataSender
 {
 public:
-	FTPDataRetrieve(FTPServerConnection* connection, const String& fileName) : FTPDataStream(connection)
+	FTPDataRetrieve(FTPServerConnection* connection, const String& fileName) : FTPDataSender(connection)
 	{
 		file = fileOpen(fileName, eFO_ReadOnly);
 	}
@@ -90,19 +247,56 @@ public:
 	}
 	virtual void transferData(TcpConnectionEvent sourceEvent)
 	{
-		if(completed)
-			return;
-		char buf[1024];
-		int len = fileRead(file, buf, 1024);
-		write(buf, len, TCP_WRITE_FLAG_COPY);
-		if(fileIsEOF(file)) {
-			completed = true;
-			finishTransfer();
+		while(!completed) {
+			Block& block = blocks[fillIndex];
+			if(block.length != 0)
+				break; // Both blocks in flight
+
+			uint16_t len = std::min(uint16_t(FTP_RETRIEVE_BLOCK_SIZE), getAvailableWriteSize());
+			if(len < FTP_RETRIEVE_MIN_BLOCK)
+				break;
+
+			int count = fileRead(file, block.data, len);
+			if(count <= 0) {
+				complete();
+				break;
+			}
+
+			if(!send(block.data, count)) {
+				// Can't happen as the space was checked, but don't lose the data
+				fileSeek(file, -count, eSO_CurrentPos);
+				break;
+			}
+			block.length = count;
+			fillIndex ^= 1;
+		}
+	}
+
+protected:
+	virtual void onAcknowledged(uint16_t len)
+	{
+		while(len != 0) {
+			Block& block = blocks[ackIndex];
+			if(block.length == 0)
+				break;
+			uint16_t n = std::min(len, block.length);
+			block.length -= n;
+			len -= n;
+			if(block.length == 0)
+				ackIndex ^= 1;
 		}
 	}
 
 private:
+	struct Block {
+		uint16_t length; ///< Bytes not yet acknowledged
+		char data[FTP_RETRIEVE_BLOCK_SIZE];
+	};
+
 	file_t file;
+	Block blocks[2] = {};
+	uint8_t fillIndex = 0;
+	uint8_t ackIndex = 0;
 };
 
 class FTPDataStore : public FTPDataStream
@@ -111,10 +305,13 @@ public:
 	FTPDataStore(FTPServerConnection* connection, const String& fileName) : FTPDataStream(connection)
 	{
 		file = fileOpen(fileName, eFO_WriteOnly | eFO_CreateNewAlways);
+		// The client is paced by the receive window, which only reopens as data is written
+		setReceiveBudget(FTP_STORE_RECEIVE_BUDGET);
 	}
 	~FTPDataStore()
 	{
-		fileClose(file);
+		if(file >= 0)
+			fileClose(file);
 	}
 	virtual err_t onReceive(pbuf* buf)
 	{
@@ -123,14 +320,24 @@ public:
 
 		if(buf == NULL) {
 			completed = true;
-			response(226, "Transfer completed");
+			// Make sure everything is on flash before reporting success
+			fileClose(file);
+			file = -1;
+			invalidateFileListing();
+			if(failed) {
+				finish(552, F("Write failed"));
+			} else {
+				finish(226, F("Transfer completed"));
+			}
 			return TcpConnection::onReceive(buf);
 		}
 
-		pbuf* cur = buf;
-		while(cur != NULL && cur->len > 0) {
-			fileWrite(file, (uint8_t*)cur->payload, cur->len);
-			cur = cur->next;
+		// After a failed write the rest of the upload is discarded
+		for(auto span : PbufSpans(buf)) {
+			if(failed || fileWrite(file, span.data, span.length) != span.length) {
+				failed = true;
+				break;
+			}
 		}
 
 		return TcpConnection::onReceive(buf);
@@ -138,6 +345,7 @@ public:
 
 private:
 	file_t file;
+	bool failed = false;
 };
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -152,6 +360,12 @@ FTPServerConnection::FTPServerConnection(FTPServer* parentServer, tcp_pcb* clien
 
 FTPServerConnection::~FTPServerConnection()
 {
+	closePassive();
+	if(dataConnection != NULL) {
+		FTPDataStream* connection = dataConnection;
+		dataConnection = NULL;
+		connection->detach();
+	}
 }
 
 err_t FTPServerConnection::onReceive(pbuf* buf)
@@ -196,9 +410,126 @@ void FTPServerConnection::cmdPort(const String& data)
 	int p2 = ps2.toInt();
 	port = (p1 << 8) | p2;
 	debug_d("connection to: %s, %d", ip.toString().c_str(), port);
+	closePassive();
 	response(200);
 }
 
+void FTPServerConnection::cmdPassive(bool extended)
+{
+	closePassive();
+
+	tcp_pcb* pcb = (tcp == NULL) ? NULL : tcp_new();
+	if(pcb == NULL) {
+		response(425, F("Can't open data connection"));
+		return;
+	}
+
+	// Port 0 picks a free ephemeral port
+	tcp_pcb* listener = NULL;
+	if(tcp_bind(pcb, IP_ADDR_ANY, 0) == ERR_OK)
+		listener = tcp_listen(pcb);
+	if(listener == NULL) {
+		tcp_close(pcb);
+		response(425, F("Can't open data connection"));
+		return;
+	}
+
+	tcp_arg(listener, this);
+	tcp_accept(listener, staticOnPassiveAccept);
+	passiveListener = listener;
+	passive = true;
+
+	uint16_t dataPort = listener->local_port;
+	debug_d("passive data port: %d", dataPort);
+	String text;
+	if(extended) {
+		text = F("Entering Extended Passive Mode (|||");
+		text += dataPort;
+		text += F("|)");
+		response(229, text);
+	} else {
+		// Clients connect to the address they reached us on
+		IPAddress localIp(tcp->local_ip);
+		text = F("Entering Passive Mode (");
+		for(int i = 0; i < 4; i++) {
+			text += localIp[i];
+			text += ',';
+		}
+		text += dataPort >> 8;
+		text += ',';
+		text += dataPort & 0xFF;
+		text += ')';
+		response(227, text);
+	}
+}
+
+err_t FTPServerConnection::staticOnPassiveAccept(void* arg, tcp_pcb* pcb, err_t err)
+{
+	FTPServerConnection* con = (FTPServerConnection*)arg;
+	if(con == NULL || err != ERR_OK || pcb == NULL)
+		return ERR_VAL;
+	return con->onPassiveAccept(pcb);
+}
+
+err_t FTPServerConnection::onPassiveAccept(tcp_pcb* pcb)
+{
+	tcp_accepted(passiveListener);
+
+	// Only the client may connect, so nobody else can steal or inject a transfer,
+	// and only once for each PASV
+	bool wanted = passive && passiveClient == NULL;
+	if(!wanted || tcp == NULL || uint32_t(IPAddress(pcb->remote_ip)) != uint32_t(getRemoteIp())) {
+		debug_w("FTP: refused passive connection from %s", IPAddress(pcb->remote_ip).toString().c_str());
+		tcp_abort(pcb);
+		return ERR_ABRT;
+	}
+
+	if(dataConnection != NULL) {
+		passive = false;
+		dataConnection->attach(pcb);
+		return ERR_OK;
+	}
+
+	// Clients usually connect before sending the command, hold the connection until then
+	passiveClient = pcb;
+	tcp_arg(pcb, this);
+	tcp_recv(pcb, staticOnHeldReceive);
+	tcp_err(pcb, staticOnHeldError);
+	return ERR_OK;
+}
+
+err_t FTPServerConnection::staticOnHeldReceive(void* arg, tcp_pcb* pcb, pbuf* p, err_t err)
+{
+	// Refused data is offered again later, by then the transfer should have taken over the connection
+	return (p == NULL) ? ERR_OK : ERR_MEM;
+}
+
+void FTPServerConnection::staticOnHeldError(void* arg, err_t err)
+{
+	FTPServerConnection* con = (FTPServerConnection*)arg;
+	if(con != NULL)
+		con->passiveClient = NULL; // Already freed by lwIP
+}
+
+void FTPServerConnection::closePassive()
+{
+	passive = false;
+
+	if(passiveClient != NULL) {
+		tcp_arg(passiveClient, NULL);
+		tcp_err(passiveClient, NULL);
+		tcp_abort(passiveClient);
+		passiveClient = NULL;
+	}
+
+	if(passiveListener != NULL) {
+		tcp_arg(passiveListener, NULL);
+		tcp_accept(passiveListener, NULL);
+		tcp_close(passiveListener);
+		passiveListener = NULL;
+	}
+}
+
 void FTPServerConnection::onCommand(String cmd, String data)
 {
 	cmd.toUpperCase();
@@ -234,6 +565,10 @@ void FTPServerConnection::onCommand(String cmd, String data)
 			response(257, F("\"/\""));
 		} else if(cmd == _F("PORT")) {
 			cmdPort(data);
+		} else if(cmd == _F("PASV")) {
+			cmdPassive(false);
+		} else if(cmd == _F("EPSV")) {
+			cmdPassive(true);
 		} else if(cmd == _F("CWD")) {
 			if(data == "/")
 				response(250);
@@ -250,6 +585,7 @@ void FTPServerConnection::onCommand(String cmd, String data)
 			String name = makeFileName(data, false);
 			if(fileExist(name)) {
 				fileDelete(name);
+				server->invalidateFileListing();
 				response(250);
 			} else
 				response(550);
@@ -270,13 +606,17 @@ void FTPServerConnection::onCommand(String cmd, String data)
 				response(550);
 		}*/
 		else if(cmd == _F("RETR")) {
-			createDataConnection(new FTPDataRetrieve(this, makeFileName(data, false)));
+			if(!isTransferBusy())
+				createDataConnection(new FTPDataRetrieve(this, makeFileName(data, false)));
 		} else if(cmd == _F("STOR")) {
-			createDataConnection(new FTPDataStore(this, makeFileName(data, true)));
+			// Checked first, as opening the file for the transfer truncates it
+			if(!isTransferBusy()) {
+				createDataConnection(new FTPDataStore(this, makeFileName(data, true)));
+				server->invalidateFileListing();
+			}
 		} else if(cmd == _F("LIST")) {
-			createDataConnection(new FTPDataFileList(this));
-		} else if(cmd == _F("PASV")) {
-			response(500, F("Passive mode not supported"));
+			if(!isTransferBusy())
+				createDataConnection(new FTPDataFileList(this, server->getFileListing()));
 		} else if(cmd == _F("NOOP")) {
 			response(200);
 		} else if(!server->onCommand(cmd, data, *this))
@@ -292,6 +632,10 @@ err_t FTPServerConnection::onSent(uint16_t len)
 {
 	canTransfer = true;
 
+	// A transfer held back until our reply went out can start now
+	if(dataConnection != NULL)
+		dataConnection->resume();
+
 	return ERR_OK;
 }
 
@@ -310,20 +654,49 @@ String FTPServerConnection::makeFileName(String name, bool shortIt)
 	return name;
 }
 
-void FTPServerConnection::createDataConnection(TcpConnection* connection)
+bool FTPServerConnection::isTransferBusy()
+{
+	if(dataConnection == NULL)
+		return false;
+	response(425, F("Transfer in progress"));
+	return true;
+}
+
+void FTPServerConnection::createDataConnection(FTPDataStream* connection)
 {
+	if(dataConnection != NULL) {
+		// Callers check isTransferBusy() first, this one mustn't report to us as it goes
+		connection->detach();
+		response(425, F("Transfer in progress"));
+		return;
+	}
+
 	dataConnection = connection;
-	dataConnection->connect(ip, port);
-	response(150, F("Connecting"));
+	if(!passive) {
+		response(150, F("Connecting"));
+		connection->connect(ip, port);
+		return;
+	}
+
+	response(150, F("Opening data connection"));
+	if(passiveClient != NULL) {
+		// Each PASV is good for one transfer
+		tcp_pcb* pcb = passiveClient;
+		passiveClient = NULL;
+		passive = false;
+		connection->attach(pcb);
+	}
+	// Otherwise the transfer starts when the client connects
 }
 
-void FTPServerConnection::dataTransferFinished(TcpConnection* connection)
+void FTPServerConnection::dataTransferFinished(FTPDataStream* connection, int code, const String& text)
 {
 	if(connection != dataConnection)
 		SYSTEM_ERROR("FTP Wrong state: connection != dataConnection");
 
+	// The passive listener may be in use by lwIP right now, it's closed by the next PASV or PORT
 	dataConnection = NULL;
-	response(226, F("Transfer Complete."));
+	response(code, text);
 }
 
 int FTPServerConnection::getSplitterPos(String data, char splitter, uint8_t number)
@@ -7,7 +7,21 @@
 
 #define MAX_FTP_CMD 255
 
+/** @brief Bytes of an upload written to flash before other tasks get to run */
+#ifndef FTP_STORE_RECEIVE_BUDGET
+#define FTP_STORE_RECEIVE_BUDGET 2920
+#endif
+
+/** @brief Size of each of the two blocks a download alternates between, at most TCP_SND_BUF / 2 */
+#ifndef FTP_RETRIEVE_BLOCK_SIZE
+#define FTP_RETRIEVE_BLOCK_SIZE TCP_MSS
+#endif
+
+/** @brief Smallest block read for a download, if less send buffer is free it waits for acknowledgements */
+#define FTP_RETRIEVE_MIN_BLOCK 256
+
 class FTPServer;
+class FTPDataStream;
 
 enum FTPConnectionState { eFCS_Ready, eFCS_Authorization, eFCS_Active };
 
@@ -24,7 +38,8 @@ public:
 	virtual err_t onSent(uint16_t len);
 	virtual void onReadyToSendData(TcpConnectionEvent sourceEvent);
 
-	void dataTransferFinished(TcpConnection* connection);
+	/** @brief Called by the data connection when the transfer is over, sends the final reply */
+	void dataTransferFinished(FTPDataStream* connection, int code, const String& text);
 
 protected:
 	virtual void onCommand(String cmd, String data);
@@ -33,12 +48,27 @@ protected:
 	String makeFileName(String name, bool shortIt);
 
 	void cmdPort(const String& data);
-	void createDataConnection(TcpConnection* connection);
+	/** @brief Open a listening socket for the next transfer and tell the client where it is
+	 *  @param extended true for EPSV, which only reports the port
+	 */
+	void cmdPassive(bool extended);
+	/** @brief Refuse a transfer command while another transfer is running
+	 *  @retval bool true if busy, the reply has been sent
+	 */
+	bool isTransferBusy();
+	void createDataConnection(FTPDataStream* connection);
 	bool isCanTransfer()
 	{
 		return canTransfer;
 	}
 
+private:
+	err_t onPassiveAccept(tcp_pcb* pcb);
+	void closePassive();
+	static err_t staticOnPassiveAccept(void* arg, tcp_pcb* pcb, err_t err);
+	static err_t staticOnHeldReceive(void* arg, tcp_pcb* pcb, pbuf* p, err_t err);
+	static void staticOnHeldError(void* arg, err_t err);
+
 private:
 	FTPServer* server;
 	FTPConnectionState state;
@@ -47,7 +77,10 @@ private:
 
 	IPAddress ip;
 	int port;
-	TcpConnection* dataConnection;
+	FTPDataStream* dataConnection;
+	tcp_pcb* passiveListener = nullptr;
+	tcp_pcb* passiveClient = nullptr; ///< Accepted before the transfer command arrived
+	bool passive = false;			  ///< A connection to passiveListener is expected for the next transfer
 	bool canTransfer;
 };
 
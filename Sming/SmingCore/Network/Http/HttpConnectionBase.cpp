@@ -238,6 +238,15 @@ void HttpConnectionBase::onHttpError(http_errno error)
 bool HttpConnectionBase::onTcpReceive(TcpClient& client, char* data, int size)
 {
 	int parsedBytes = http_parser_execute(&parser, &parserSettings, data, size);
+	if(isParserPaused()) {
+		// Keep the rest for resumeParser()
+		if(!unparsed.concat(data + parsedBytes, size - parsedBytes)) {
+			debug_e("HTTP: unable to keep %d bytes while paused", size - parsedBytes);
+			return false;
+		}
+		return true;
+	}
+
 	if(HTTP_PARSER_ERRNO(&parser) != HPE_OK) {
 		// we ran into trouble - abort the connection
 		onHttpError(HTTP_PARSER_ERRNO(&parser));
@@ -253,6 +262,30 @@ bool HttpConnectionBase::onTcpReceive(TcpClient& client, char* data, int size)
 	return true;
 }
 
+void HttpConnectionBase::pauseParser()
+{
+	http_parser_pause(&parser, 1);
+	pauseReceive();
+}
+
+bool HttpConnectionBase::resumeParser()
+{
+	if(!isParserPaused()) {
+		return true;
+	}
+
+	http_parser_pause(&parser, 0);
+	resumeReceive();
+
+	if(unparsed.length() == 0) {
+		return true;
+	}
+
+	// The parser may be paused again part way through, leaving the rest in unparsed
+	String data = std::move(unparsed);
+	return onTcpReceive(*this, data.begin(), data.length());
+}
+
 void HttpConnectionBase::onError(err_t err)
 {
 	cleanup();
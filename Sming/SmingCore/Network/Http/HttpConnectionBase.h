@@ -42,6 +42,23 @@ public:
 protected:
 	void resetHeaders();
 
+	/**
+	 * @brief Stop parsing once the current callback returns, e.g. until a response has been sent
+	 * @note Receiving is paused too. Anything left over is kept for resumeParser().
+	 */
+	void pauseParser();
+
+	/**
+	 * @brief Continue parsing, starting with anything kept while paused
+	 * @retval bool false if that data could not be parsed and the connection should be closed
+	 */
+	bool resumeParser();
+
+	bool isParserPaused() const
+	{
+		return HTTP_PARSER_ERRNO(&parser) == HPE_PAUSED;
+	}
+
 	/**
 	 * @brief Initializes the http parser for a specific type of HTTP message
 	 * @param http_parser_type
@@ -146,6 +163,7 @@ protected:
 	String lastData = "";
 	String currentField = "";
 	HttpHeaders incomingHeaders;
+	String unparsed; ///< Received while the parser was paused
 	HttpConnectionState state = eHCS_Ready;
 };
 
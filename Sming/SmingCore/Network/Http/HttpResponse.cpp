@@ -15,6 +15,7 @@
 #include "Data/Stream/MemoryDataStream.h"
 #include "Data/Stream/JsonObjectStream.h"
 #include "Data/Stream/FileStream.h"
+#include "Data/Stream/AssetStream.h"
 
 HttpResponse::~HttpResponse()
 {
@@ -117,6 +118,32 @@ bool HttpResponse::sendFile(String fileName, bool allowGzipFileCheck /* = true*/
 	return true;
 }
 
+bool HttpResponse::sendAsset(const String& fileName)
+{
+	if(stream != nullptr) {
+		SYSTEM_ERROR("Stream already created");
+		delete stream;
+		stream = nullptr;
+	}
+
+	auto asset = new AssetStream(fileName);
+	if(!asset->isValid()) {
+		delete asset;
+		code = HTTP_STATUS_NOT_FOUND;
+		return false;
+	}
+
+	if(asset->isCompressed()) {
+		headers[HTTP_HEADER_CONTENT_ENCODING] = _F("gzip");
+	}
+	if(!headers.contains(HTTP_HEADER_CONTENT_TYPE)) {
+		setContentType(asset->getMimeType());
+	}
+
+	stream = asset;
+	return true;
+}
+
 bool HttpResponse::sendTemplate(TemplateStream* newTemplateInstance)
 {
 	if(stream != nullptr) {
@@ -174,6 +201,11 @@ bool HttpResponse::sendDataStream(ReadWriteStream* newDataStream, const String&
 	}
 	stream = newDataStream;
 
+	// Generated content, such as a JsonWriterStream, only knows its length once it's all been sent
+	if(stream != nullptr && !headers.contains(HTTP_HEADER_TRANSFER_ENCODING) && stream->available() < 0) {
+		headers[HTTP_HEADER_TRANSFER_ENCODING] = _F("chunked");
+	}
+
 	return true;
 }
 
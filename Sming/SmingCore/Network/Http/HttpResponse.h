@@ -65,6 +65,13 @@ public:
 	// Send file by name
 	bool sendFile(String fileName, bool allowGzipFileCheck = true);
 
+	/** @brief Send a file from the asset image mounted on assetFS
+	 *  @param fileName Name without a leading '/'
+	 *  @retval bool false if there's no such file, the response code is then 404
+	 *  @note Content type, compression and ETag come from the image, nothing is looked up in SPIFFS
+	 */
+	bool sendAsset(const String& fileName);
+
 	// @deprecated
 
 	// Parse and send template file
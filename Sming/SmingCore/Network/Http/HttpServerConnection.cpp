@@ -16,6 +16,7 @@
 #include "TcpServer.h"
 #include "WebConstants.h"
 #include "../../Data/Stream/ChunkedStream.h"
+#include "../../Coroutine/Coroutine.h"
 
 HttpServerConnection::HttpServerConnection(tcp_pcb* clientTcp) : HttpConnectionBase(clientTcp, HTTP_REQUEST)
 {
@@ -23,6 +24,7 @@ HttpServerConnection::HttpServerConnection(tcp_pcb* clientTcp) : HttpConnectionB
 
 HttpServerConnection::~HttpServerConnection()
 {
+	cancelDeferredResponse();
 	if(this->resource) {
 		this->resource->shutdown(*this);
 	}
@@ -38,8 +40,18 @@ void HttpServerConnection::setBodyParsers(BodyParsers* bodyParsers)
 	this->bodyParsers = bodyParsers;
 }
 
+void HttpServerConnection::setHeaderTimeout(uint16_t seconds)
+{
+	headerTimeout = seconds;
+	if(state == eHCS_Ready) {
+		setDeadline(seconds);
+	}
+}
+
 int HttpServerConnection::onMessageBegin(http_parser* parser)
 {
+	setDeadline(headerTimeout);
+
 	// Reset Response ...
 	response.code = 200;
 	response.headers.clear();
@@ -81,6 +93,7 @@ int HttpServerConnection::onMessageComplete(http_parser* parser)
 {
 	// we are finished with this request
 	int hasError = 0;
+	setReceiveBudget(0);
 	if(HTTP_PARSER_ERRNO(parser) != HPE_OK) {
 		sendError(httpGetErrorName(HTTP_PARSER_ERRNO(parser)));
 		return 0;
@@ -94,6 +107,14 @@ int HttpServerConnection::onMessageComplete(http_parser* parser)
 		hasError = resource->onRequestComplete(*this, request, response);
 	}
 
+	if(responseDeferred) {
+		// Pipelined requests would overwrite this one, so they wait for send()
+		deferredTimeOut = timeOut;
+		setTimeOut(USHRT_MAX);
+		pauseParser();
+		return hasError;
+	}
+
 	send();
 
 	if(request.responseStream != nullptr) {
@@ -107,6 +128,8 @@ int HttpServerConnection::onMessageComplete(http_parser* parser)
 int HttpServerConnection::onHeadersComplete(const HttpHeaders& headers)
 {
 	debug_d("The headers are complete");
+	setDeadline(0);
+	setReceiveBudget(bodyReceiveBudget);
 
 	/* Callbacks should return non-zero to indicate an error. The parser will
 	 * then halt execution.
@@ -335,8 +358,44 @@ bool HttpServerConnection::sendResponseBody(HttpResponse* response)
 
 void HttpServerConnection::send()
 {
+	bool wasDeferred = responseDeferred;
+	responseDeferred = false;
+	deferredCoroutine = nullptr;
+	if(wasDeferred) {
+		setTimeOut(deferredTimeOut);
+	}
+
 	state = eHCS_StartSending;
 	onReadyToSendData(eTCE_Received);
+
+	if(!wasDeferred) {
+		return;
+	}
+
+	if(request.responseStream != nullptr) {
+		delete request.responseStream;
+		request.responseStream = nullptr;
+	}
+
+	if(!resumeParser()) {
+		close();
+	}
+}
+
+void HttpServerConnection::cancelDeferredResponse()
+{
+	if(deferredCoroutine != nullptr) {
+		Coroutine* coroutine = deferredCoroutine;
+		deferredCoroutine = nullptr;
+		coroutine->cancel();
+	}
+	responseDeferred = false;
+}
+
+void HttpServerConnection::onError(err_t err)
+{
+	cancelDeferredResponse();
+	HttpConnectionBase::onError(err);
 }
 
 void HttpServerConnection::sendError(const String& message, enum http_status code)
@@ -34,6 +34,7 @@
 #endif
 
 class HttpServerConnection;
+class Coroutine;
 
 typedef Delegate<void(HttpServerConnection& connection)> HttpServerConnectionDelegate;
 
@@ -48,10 +49,52 @@ public:
 	void setResourceTree(ResourceTree* resourceTree);
 	void setBodyParsers(BodyParsers* bodyParsers);
 
+	/**
+	 * @brief Limit the time a client may take to send each request's headers
+	 * @param seconds 0 for no limit
+	 * @note Timed from acceptance for the first request, then from the first byte of
+	 * each subsequent one. Between requests only the idle timeout applies.
+	 */
+	void setHeaderTimeout(uint16_t seconds);
+
+	/**
+	 * @brief Set how much request body is handled before other tasks get to run
+	 * @param bytes 0 for no limit
+	 * @note The client is held off by the TCP window meanwhile, so an upload written to flash
+	 * proceeds at flash speed. A body handler which needs longer can call pauseReceive() and
+	 * resumeReceive() once it has caught up.
+	 */
+	void setBodyReceiveBudget(uint16_t bytes)
+	{
+		bodyReceiveBudget = bytes;
+	}
+
 	void send();
 
 	using TcpClient::send;
 
+	/** @brief Call from a request handler to respond later rather than on return
+	 *  @param coroutine Cancelled if the connection closes first, so it must call send() before it is destroyed
+	 *  @note The response is sent when send() is next called, e.g. from a coroutine. Until then
+	 *  the connection has no idle timeout, can't be evicted and reads no further requests.
+	 */
+	void deferResponse(Coroutine* coroutine = nullptr)
+	{
+		responseDeferred = true;
+		deferredCoroutine = coroutine;
+	}
+
+	bool isResponseDeferred() const
+	{
+		return responseDeferred;
+	}
+
+	/** @brief Determine if the connection is between requests, i.e. not sending or awaiting a response */
+	bool isWaitingForRequest() const
+	{
+		return state == eHCS_Ready && !responseDeferred;
+	}
+
 	void setUpgradeCallback(HttpServerProtocolUpgradeCallback callback)
 	{
 		upgradeCallback = callback;
@@ -101,9 +144,11 @@ protected:
 
 	// TCP methods
 	virtual void onReadyToSendData(TcpConnectionEvent sourceEvent);
+	virtual void onError(err_t err);
 	virtual void sendError(const String& message = nullptr, enum http_status code = HTTP_STATUS_BAD_REQUEST);
 
 private:
+	void cancelDeferredResponse();
 	void sendResponseHeaders(HttpResponse* response);
 	bool sendResponseBody(HttpResponse* response);
 
@@ -123,6 +168,11 @@ private:
 	HttpServerProtocolUpgradeCallback upgradeCallback = nullptr;
 
 	BodyParsers* bodyParsers = nullptr;
+	bool responseDeferred = false;
+	Coroutine* deferredCoroutine = nullptr;
+	uint16_t deferredTimeOut = 0; ///< Idle timeout to restore once the response is sent
+	uint16_t headerTimeout = 0;
+	uint16_t bodyReceiveBudget = 0;
 	HttpBodyParserDelegate bodyParser = 0;
 };
 
@@ -48,15 +48,11 @@ bool HttpClient::send(HttpRequest* request)
 #ifdef ENABLE_SSL
 	// Based on the URL decide if we should reuse the SSL and TCP pool
 	if(useSsl) {
-		if(!sslSessionIdPool.contains(cacheKey)) {
-			sslSessionIdPool[cacheKey] = (SSLSessionId*)malloc(sizeof(SSLSessionId));
-			sslSessionIdPool[cacheKey]->value = NULL;
-			sslSessionIdPool[cacheKey]->length = 0;
-		}
 		httpConnectionPool[cacheKey]->addSslOptions(request->getSslOptions());
 		httpConnectionPool[cacheKey]->pinCertificate(request->sslFingerprint);
 		httpConnectionPool[cacheKey]->setSslKeyCert(request->sslKeyCertPair);
-		httpConnectionPool[cacheKey]->sslSessionId = sslSessionIdPool[cacheKey];
+		// The session cache keeps the master secret, which resumption needs as well as the session ID
+		httpConnectionPool[cacheKey]->setSslSessionCache(true);
 	}
 #endif
 
@@ -91,6 +91,7 @@ protected:
 	static HashMap<String, RequestQueue*> queue;
 
 #ifdef ENABLE_SSL
+	/** @deprecated Sessions are now held in sslClientSessionCache */
 	static HashMap<String, SSLSessionId*> sslSessionIdPool;
 #endif
 };
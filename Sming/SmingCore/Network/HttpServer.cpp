@@ -38,6 +38,7 @@ void HttpServer::configure(const HttpServerSettings& settings)
 	}
 
 	setKeepAlive(settings.keepAliveSeconds);
+	setMaxConnections(settings.maxActiveConnections);
 #ifdef ENABLE_SSL
 	sslSessionCacheSize = settings.sslSessionCacheSize;
 #endif
@@ -62,10 +63,43 @@ TcpConnection* HttpServer::createClient(tcp_pcb* clientTcp)
 	HttpServerConnection* con = new HttpServerConnection(clientTcp);
 	con->setResourceTree(&resourceTree);
 	con->setBodyParsers(&bodyParsers);
+	con->setHeaderTimeout(settings.headerTimeoutSeconds);
+	con->setBodyReceiveBudget(settings.bodyReceiveBudget);
 
 	return con;
 }
 
+bool HttpServer::isIdle(TcpConnection& connection)
+{
+	// Keep-alive connection waiting for its next request, with no recent traffic
+	auto con = static_cast<HttpServerConnection*>(&connection);
+	return con->isWaitingForRequest() && getIdleTime(connection) >= 1000;
+}
+
+err_t HttpServer::onReject(tcp_pcb* clientTcp)
+{
+#ifdef ENABLE_SSL
+	if(useSsl) {
+		return TcpServer::onReject(clientTcp);
+	}
+#endif
+
+	static const char response[] PROGMEM = "HTTP/1.1 503 Service Unavailable\r\n"
+										   "Connection: close\r\n"
+										   "Content-Length: 0\r\n"
+										   "Retry-After: 1\r\n\r\n";
+	char buffer[sizeof(response)];
+	memcpy_P(buffer, response, sizeof(response));
+
+	tcp_arg(clientTcp, nullptr);
+	if(tcp_write(clientTcp, buffer, sizeof(response) - 1, TCP_WRITE_FLAG_COPY) != ERR_OK ||
+	   tcp_close(clientTcp) != ERR_OK) {
+		return TcpServer::onReject(clientTcp);
+	}
+
+	return ERR_OK;
+}
+
 void HttpServer::addPath(String path, const HttpPathDelegate& callback)
 {
 	if(path.length() > 1 && path.endsWith("/")) {
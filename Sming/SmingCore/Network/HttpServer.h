@@ -30,8 +30,10 @@
 #include "Http/HttpBodyParser.h"
 
 typedef struct {
-	int maxActiveConnections = 10;  // << the maximum number of concurrent requests..
+	int maxActiveConnections = 10;  // << the maximum number of concurrent connections, 0 for no limit
 	int keepAliveSeconds = 0;		// << the default seconds to keep the connection alive before closing it
+	int headerTimeoutSeconds = 10;  // << seconds a client has to send the request headers, 0 for no limit
+	int bodyReceiveBudget = 2920;   // << bytes of request body handled before yielding to other tasks, 0 for no limit
 	int minHeapSize = -1;			// << defines the min heap size that is required to accept connection.
 									//  -1 - means use server default
 	bool useDefaultBodyParsers = 1; // << if the default body parsers,  as form-url-encoded, should be used
@@ -81,10 +83,12 @@ public:
 protected:
 	virtual TcpConnection* createClient(tcp_pcb* clientTcp);
 
-protected:
-#ifdef ENABLE_SSL
-	int minHeapSize = 16384;
-#endif
+	virtual bool isIdle(TcpConnection& connection);
+
+	/**
+	 * @brief Reply with '503 Service Unavailable' and close, without allocating a connection
+	 */
+	virtual err_t onReject(tcp_pcb* clientTcp);
 
 private:
 	HttpServerSettings settings;
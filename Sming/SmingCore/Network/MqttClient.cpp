@@ -32,6 +32,11 @@ mqtt_parser_callbacks_t MqttClient::callbacks;
 MqttClient::MqttClient(bool withDefaultPayloadParser /* = true */, bool autoDestruct /* = false*/)
 	: TcpClient(autoDestruct)
 {
+#ifdef ENABLE_SSL
+	// Reconnects resume the previous session rather than repeating the full handshake
+	setSslSessionCache(true);
+#endif
+
 	// TODO:...
 	//	if(!bitSet(flags, MQTT_CLIENT_CALLBACKS)) {
 	callbacks.on_message_begin = staticOnMessageBegin;
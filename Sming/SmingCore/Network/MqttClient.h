@@ -159,6 +159,7 @@ public:
 	using TcpClient::getSsl;
 	using TcpClient::pinCertificate;
 	using TcpClient::setSslKeyCert;
+	using TcpClient::setSslSessionCache;
 #endif
 
 	// deprecated methods below
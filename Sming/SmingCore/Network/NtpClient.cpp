@@ -51,25 +51,18 @@ void NtpClient::requestTime()
 		return;
 	}
 
-	ip_addr_t resolvedIp;
-	int result = dns_gethostbyname(server.c_str(), &resolvedIp,
-								   [](const char* name, LWIP_IP_ADDR_T* ip, void* arg) {
-									   // We do a new request since the last one was never done.
-									   if(ip)
-										   reinterpret_cast<NtpClient*>(arg)->internalRequestTime(*ip);
-								   },
-								   this);
+	// A retry replaces any lookup still outstanding
+	dnsResolver.cancel(this);
 
-	debug_d("dns_gethostbyname() returned %d", result);
+	IPAddress resolvedIp;
+	err_t result =
+		dnsResolver.resolve(server, resolvedIp, DnsResolverDelegate(&NtpClient::onDnsResolved, this), this);
+
+	debug_d("dnsResolver.resolve() returned %d", result);
 
 	switch(result) {
 	case ERR_OK:
-		// Documentation says this will be the result if the string is already
-		// an ip address in dotted decimal form or if the host is found in dns cache.
-		// however I'm not sure if the dns cache is working since this never seems to
-		// be called for a host lookup other than an ip address.
-		// Doesn't really matter since the loockup will be fast anyways, the host
-		// is most likely found in the dns cache of the next node the query is sent to.
+		// IP address, or host found in the resolver cache
 		internalRequestTime(resolvedIp);
 		break;
 	case ERR_INPROGRESS:
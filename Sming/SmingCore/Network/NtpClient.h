@@ -16,6 +16,7 @@
 #define _SMING_CORE_NETWORK_NTPCLIENT_H_
 
 #include "UdpConnection.h"
+#include "DnsResolver.h"
 #include "Platform/System.h"
 #include "Timer.h"
 #include "DateTime.h"
@@ -60,6 +61,7 @@ public:
 
 	virtual ~NtpClient()
 	{
+		dnsResolver.cancel(this);
 	}
 
 	/** @brief  Request time from NTP server
@@ -106,6 +108,13 @@ protected:
      */
 	void internalRequestTime(IPAddress serverIp);
 
+	void onDnsResolved(const String& name, IPAddress ip)
+	{
+		if(!ip.isNull()) {
+			internalRequestTime(ip);
+		}
+	}
+
 	/** @brief Start the timer running
 	 *  @param time to run in milliseconds
 	 */
@@ -0,0 +1,102 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * PbufSpan.h
+ *
+ * Iterates over the segments of a pbuf chain so received data can be parsed
+ * where lwIP put it, without gathering it into a contiguous buffer first:
+ *
+ * 	for(auto span : PbufSpans(buf)) {
+ * 		parse(span.data, span.length);
+ * 	}
+ *
+ ****/
+
+/** @addtogroup networking
+ *  @{
+ */
+
+#ifndef _SMING_CORE_NETWORK_PBUF_SPAN_H_
+#define _SMING_CORE_NETWORK_PBUF_SPAN_H_
+
+#include "../Wiring/WiringFrameworkDependencies.h"
+
+/** @brief A contiguous piece of received data */
+struct PbufSpan {
+	char* data;
+	uint16_t length;
+};
+
+/** @brief Range over the non-empty segments of a pbuf chain, starting at an offset */
+class PbufSpans
+{
+public:
+	class Iterator
+	{
+	public:
+		Iterator(pbuf* buf, uint16_t offset) : buf(buf), offset(offset)
+		{
+			skip();
+		}
+
+		PbufSpan operator*() const
+		{
+			return PbufSpan{static_cast<char*>(buf->payload) + offset, uint16_t(buf->len - offset)};
+		}
+
+		Iterator& operator++()
+		{
+			buf = buf->next;
+			offset = 0;
+			skip();
+			return *this;
+		}
+
+		bool operator!=(const Iterator& other) const
+		{
+			return buf != other.buf;
+		}
+
+	private:
+		// Move past segments which are empty or lie entirely before the offset
+		void skip()
+		{
+			while(buf != nullptr && offset >= buf->len) {
+				offset -= buf->len;
+				buf = buf->next;
+			}
+		}
+
+	private:
+		pbuf* buf;
+		uint16_t offset;
+	};
+
+	/**
+	 * @param buf Chain to iterate, may be NULL
+	 * @param offset Number of bytes at the start of the chain to skip
+	 */
+	PbufSpans(pbuf* buf, uint16_t offset = 0) : buf(buf), offset(offset)
+	{
+	}
+
+	Iterator begin() const
+	{
+		return Iterator(buf, offset);
+	}
+
+	Iterator end() const
+	{
+		return Iterator(nullptr, 0);
+	}
+
+private:
+	pbuf* buf;
+	uint16_t offset;
+};
+
+/** @} */
+#endif /* _SMING_CORE_NETWORK_PBUF_SPAN_H_ */
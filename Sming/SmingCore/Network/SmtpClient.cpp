@@ -17,6 +17,7 @@
  */
 
 #include "SmtpClient.h"
+#include "PbufSpan.h"
 #include "../Services/WebHelpers/base64.h"
 #include "Data/Stream/QuotedPrintableOutputStream.h"
 #include "Data/Stream/Base64OutputStream.h"
@@ -350,11 +351,9 @@ err_t SmtpClient::onReceive(pbuf* buf)
 		return TcpClient::onReceive(buf);
 	}
 
-	pbuf* cur = buf;
 	int parsedBytes = 0;
-	while(cur != nullptr && cur->len > 0) {
-		parsedBytes += smtpParse((char*)cur->payload, cur->len);
-		cur = cur->next;
+	for(auto span : PbufSpans(buf)) {
+		parsedBytes += smtpParse(span.data, span.length);
 	}
 
 	if(parsedBytes != buf->tot_len) {
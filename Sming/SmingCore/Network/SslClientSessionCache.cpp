@@ -0,0 +1,257 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SslClientSessionCache.cpp
+ *
+ ****/
+
+#include "SslClientSessionCache.h"
+
+#ifdef ENABLE_SSL
+
+#include "../FileSystem.h"
+#include <time.h>
+
+#define SSL_SESSION_CACHE_MAGIC 0x53534c43 // "SSLC"
+
+SslClientSessionCache sslClientSessionCache;
+
+static uint32_t fnv1a(uint32_t hash, const void* data, size_t length)
+{
+	auto bytes = static_cast<const uint8_t*>(data);
+	for(size_t i = 0; i < length; ++i) {
+		hash = (hash ^ bytes[i]) * 16777619U;
+	}
+	return hash;
+}
+
+uint32_t SslClientSessionCache::makeKey(const String& host, uint16_t port)
+{
+	uint32_t key = fnv1a(2166136261U, host.c_str(), host.length());
+	key = fnv1a(key, &port, sizeof(port));
+	// 0 marks an unused entry
+	return (key != 0) ? key : 1;
+}
+
+bool SslClientSessionCache::allocate()
+{
+	if(entries == nullptr) {
+		entries = new Entry[SSL_CLIENT_SESSION_CACHE_SIZE];
+		if(entries == nullptr) {
+			return false;
+		}
+		memset(entries, 0, sizeof(Entry) * SSL_CLIENT_SESSION_CACHE_SIZE);
+	}
+	return true;
+}
+
+SslClientSessionCache::Entry* SslClientSessionCache::find(uint32_t key)
+{
+	if(entries == nullptr) {
+		return nullptr;
+	}
+
+	for(unsigned i = 0; i < SSL_CLIENT_SESSION_CACHE_SIZE; ++i) {
+		if(entries[i].key == key) {
+			return &entries[i];
+		}
+	}
+	return nullptr;
+}
+
+uint8_t SslClientSessionCache::restore(uint32_t key, SSLCTX* context, const uint8_t*& sessionId)
+{
+	++stats.lookups;
+
+	Entry* entry = find(key);
+	if(entry == nullptr || context == nullptr || context->num_sessions == 0) {
+		return 0;
+	}
+
+	// axTLS only resumes if the session's master secret is in the context's cache
+	SSL_SESSION*& session = context->ssl_sessions[0];
+	if(session == nullptr) {
+		session = (SSL_SESSION*)calloc(1, sizeof(SSL_SESSION));
+		if(session == nullptr) {
+			return 0;
+		}
+	}
+	memcpy(session->session_id, entry->id, SSL_SESSION_ID_SIZE);
+	memcpy(session->master_secret, entry->masterSecret, SSL_SECRET_SIZE);
+	session->conn_time = time(nullptr);
+
+	entry->lastUsed = ++sequence;
+	++stats.hits;
+	sessionId = entry->id;
+	return entry->idLength;
+}
+
+void SslClientSessionCache::store(uint32_t key, SSL* ssl)
+{
+	if(ssl == nullptr || ssl->session == nullptr || ssl->sess_id_size == 0) {
+		return;
+	}
+
+	if(ssl->flag & SSL_SESSION_RESUME) {
+		++stats.resumed;
+	}
+
+	if(!allocate()) {
+		return;
+	}
+
+	Entry* entry = find(key);
+	if(entry == nullptr) {
+		// Use a free entry or replace the least recently used one
+		entry = &entries[0];
+		for(unsigned i = 0; i < SSL_CLIENT_SESSION_CACHE_SIZE && entry->key != 0; ++i) {
+			Entry& e = entries[i];
+			if(e.key == 0 || e.lastUsed < entry->lastUsed) {
+				entry = &e;
+			}
+		}
+	}
+
+	entry->key = key;
+	entry->lastUsed = ++sequence;
+	entry->idLength = ssl->sess_id_size;
+	memset(entry->id, 0, SSL_SESSION_ID_SIZE);
+	memcpy(entry->id, ssl->session_id, ssl->sess_id_size);
+	memcpy(entry->masterSecret, ssl->session->master_secret, SSL_SECRET_SIZE);
+}
+
+void SslClientSessionCache::remove(uint32_t key)
+{
+	Entry* entry = find(key);
+	if(entry != nullptr) {
+		memset(entry, 0, sizeof(Entry));
+	}
+}
+
+void SslClientSessionCache::clear()
+{
+	delete[] entries;
+	entries = nullptr;
+	sequence = 0;
+}
+
+unsigned SslClientSessionCache::pack()
+{
+	if(entries == nullptr) {
+		return 0;
+	}
+
+	unsigned count = 0;
+	for(unsigned i = 0; i < SSL_CLIENT_SESSION_CACHE_SIZE; ++i) {
+		if(entries[i].key == 0) {
+			continue;
+		}
+		if(i != count) {
+			entries[count] = entries[i];
+			memset(&entries[i], 0, sizeof(Entry));
+		}
+		++count;
+	}
+	return count;
+}
+
+uint32_t SslClientSessionCache::checksum(unsigned count) const
+{
+	return fnv1a(2166136261U, entries, sizeof(Entry) * count);
+}
+
+bool SslClientSessionCache::load(const Header& header)
+{
+	if(header.magic != SSL_SESSION_CACHE_MAGIC || header.count > SSL_CLIENT_SESSION_CACHE_SIZE ||
+	   header.checksum != checksum(header.count)) {
+		clear();
+		return false;
+	}
+
+	sequence = 0;
+	for(unsigned i = 0; i < header.count; ++i) {
+		if(entries[i].lastUsed > sequence) {
+			sequence = entries[i].lastUsed;
+		}
+	}
+	return true;
+}
+
+bool SslClientSessionCache::saveToRtc(uint32_t rtcBlock)
+{
+	Header header;
+	header.magic = SSL_SESSION_CACHE_MAGIC;
+	header.count = pack();
+	header.checksum = checksum(header.count);
+
+	if(!system_rtc_mem_write(rtcBlock, &header, sizeof(header))) {
+		return false;
+	}
+
+	return header.count == 0 ||
+		   system_rtc_mem_write(rtcBlock + sizeof(header) / 4, entries, sizeof(Entry) * header.count);
+}
+
+bool SslClientSessionCache::loadFromRtc(uint32_t rtcBlock)
+{
+	Header header;
+	if(!system_rtc_mem_read(rtcBlock, &header, sizeof(header))) {
+		return false;
+	}
+
+	if(header.magic != SSL_SESSION_CACHE_MAGIC || header.count > SSL_CLIENT_SESSION_CACHE_SIZE || !allocate()) {
+		return false;
+	}
+
+	memset(entries, 0, sizeof(Entry) * SSL_CLIENT_SESSION_CACHE_SIZE);
+	if(header.count != 0 &&
+	   !system_rtc_mem_read(rtcBlock + sizeof(header) / 4, entries, sizeof(Entry) * header.count)) {
+		clear();
+		return false;
+	}
+
+	return load(header);
+}
+
+bool SslClientSessionCache::saveToFile(const String& fileName)
+{
+	Header header;
+	header.magic = SSL_SESSION_CACHE_MAGIC;
+	header.count = pack();
+	header.checksum = checksum(header.count);
+
+	file_t file = fileOpen(fileName, eFO_CreateNewAlways | eFO_WriteOnly);
+	if(file < 0) {
+		return false;
+	}
+
+	size_t dataSize = sizeof(Entry) * header.count;
+	bool ok = fileWrite(file, &header, sizeof(header)) == sizeof(header) &&
+			  (dataSize == 0 || fileWrite(file, entries, dataSize) == dataSize);
+	fileClose(file);
+	return ok;
+}
+
+bool SslClientSessionCache::loadFromFile(const String& fileName)
+{
+	file_t file = fileOpen(fileName, eFO_ReadOnly);
+	if(file < 0) {
+		return false;
+	}
+
+	Header header;
+	bool ok = fileRead(file, &header, sizeof(header)) == sizeof(header) && header.magic == SSL_SESSION_CACHE_MAGIC &&
+			  header.count <= SSL_CLIENT_SESSION_CACHE_SIZE && allocate();
+	if(ok) {
+		memset(entries, 0, sizeof(Entry) * SSL_CLIENT_SESSION_CACHE_SIZE);
+		size_t dataSize = sizeof(Entry) * header.count;
+		ok = fileRead(file, entries, dataSize) == dataSize && load(header);
+	}
+	fileClose(file);
+	return ok;
+}
+
+#endif /* ENABLE_SSL */
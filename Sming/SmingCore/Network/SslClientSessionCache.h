@@ -0,0 +1,129 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SslClientSessionCache.h
+ *
+ * Process-wide cache of client SSL sessions, keyed by server. Each entry holds
+ * the session ID and master secret, which axTLS needs to resume a session but
+ * loses when a connection's context is freed. Any TcpConnection can opt in with
+ * setSslSessionCache(true).
+ *
+ * The cache may be saved to RTC memory or to a file so that sessions survive
+ * deep sleep. Entries contain secret key material so only persist to storage
+ * which is adequately protected.
+ *
+ ****/
+
+/** @addtogroup tcp
+ *  @{
+ */
+
+#ifndef _SMING_CORE_SSL_CLIENT_SESSION_CACHE_H_
+#define _SMING_CORE_SSL_CLIENT_SESSION_CACHE_H_
+
+#ifdef ENABLE_SSL
+
+#include "TcpConnection.h"
+#include "../Wiring/WString.h"
+
+/** @brief Number of servers for which sessions are cached */
+#ifndef SSL_CLIENT_SESSION_CACHE_SIZE
+#define SSL_CLIENT_SESSION_CACHE_SIZE 4
+#endif
+
+typedef struct {
+	uint32_t lookups = 0;
+	uint32_t hits = 0;	///< Lookups which found a cached session
+	uint32_t resumed = 0; ///< Handshakes where the server accepted the cached session
+} SslClientSessionStats;
+
+class SslClientSessionCache
+{
+public:
+	~SslClientSessionCache()
+	{
+		delete[] entries;
+	}
+
+	/** @brief Get the cache key for a server */
+	static uint32_t makeKey(const String& host, uint16_t port);
+
+	/** @brief Get the cache key for a server by address */
+	static uint32_t makeKey(IPAddress addr, uint16_t port)
+	{
+		return makeKey(addr.toString(), port);
+	}
+
+	/** @brief Prepare a new client context to resume a cached session
+	 *  @param key Server key from makeKey()
+	 *  @param context Context the session will be created from, must have a session cache
+	 *  @param sessionId On success, receives the ID to pass to ssl_client_new()
+	 *  @retval uint8_t Length of session ID, 0 if there is no cached session
+	 */
+	uint8_t restore(uint32_t key, SSLCTX* context, const uint8_t*& sessionId);
+
+	/** @brief Save the session from a completed handshake
+	 *  @param key
+	 *  @param ssl
+	 */
+	void store(uint32_t key, SSL* ssl);
+
+	/** @brief Remove a server's session, e.g. after a failed resumption */
+	void remove(uint32_t key);
+
+	void clear();
+
+	/** @brief Save sessions to RTC user memory
+	 *  @param rtcBlock First 4-byte block to use, at least 64. Requires 12 bytes
+	 *  plus 92 bytes per cached session.
+	 */
+	bool saveToRtc(uint32_t rtcBlock);
+
+	bool loadFromRtc(uint32_t rtcBlock);
+
+	bool saveToFile(const String& fileName);
+
+	bool loadFromFile(const String& fileName);
+
+	const SslClientSessionStats& getStats() const
+	{
+		return stats;
+	}
+
+private:
+	struct Entry {
+		uint32_t key;
+		uint32_t lastUsed; ///< Cache sequence number, for LRU replacement
+		uint8_t idLength;
+		uint8_t id[SSL_SESSION_ID_SIZE];
+		uint8_t masterSecret[SSL_SECRET_SIZE];
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t count;
+		uint32_t checksum;
+	};
+
+	Entry* find(uint32_t key);
+	bool allocate();
+	unsigned pack();
+	uint32_t checksum(unsigned count) const;
+	bool load(const Header& header);
+
+private:
+	Entry* entries = nullptr; ///< Allocated on first use
+	uint32_t sequence = 0;
+	SslClientSessionStats stats;
+};
+
+/** @brief Global client session cache */
+extern SslClientSessionCache sslClientSessionCache;
+
+#endif /* ENABLE_SSL */
+
+/** @} */
+#endif /* _SMING_CORE_SSL_CLIENT_SESSION_CACHE_H_ */
@@ -0,0 +1,123 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SslServerContext.cpp
+ *
+ ****/
+
+#include "SslServerContext.h"
+
+#ifdef ENABLE_SSL
+
+SslServerContext* SslServerContext::head = nullptr;
+
+uint32_t SslServerContext::hash(const uint8_t* data, int length)
+{
+	// FNV-1a
+	uint32_t h = 2166136261U;
+	for(int i = 0; i < length; ++i) {
+		h = (h ^ data[i]) * 16777619U;
+	}
+	return h;
+}
+
+SslServerContext* SslServerContext::acquire(const SSLKeyCertPair& keyCert, uint32_t options, int sessionCacheSize)
+{
+	if(!(keyCert.keyLength && keyCert.certificateLength)) {
+		debug_e("SSL: server certificate and key are not provided!");
+		return nullptr;
+	}
+
+	uint32_t keyHash = hash(keyCert.key, keyCert.keyLength);
+	uint32_t certHash = hash(keyCert.certificate, keyCert.certificateLength);
+
+	for(auto ctx = head; ctx != nullptr; ctx = ctx->next) {
+		if(ctx->keyHash == keyHash && ctx->certHash == certHash) {
+			ctx->addRef();
+			debug_d("SSL: sharing server context (%u refs)", ctx->stats.references);
+			return ctx;
+		}
+	}
+
+	SSLCTX* context = ssl_ctx_new(options, sessionCacheSize);
+	if(context == nullptr) {
+		return nullptr;
+	}
+
+	if(ssl_obj_memory_load(context, SSL_OBJ_RSA_KEY, keyCert.key, keyCert.keyLength, keyCert.keyPassword) != SSL_OK) {
+		debug_e("SSL: Unable to load server private key");
+		ssl_ctx_free(context);
+		return nullptr;
+	}
+
+	if(ssl_obj_memory_load(context, SSL_OBJ_X509_CERT, keyCert.certificate, keyCert.certificateLength, NULL) !=
+	   SSL_OK) {
+		debug_e("SSL: Unable to load server certificate");
+		ssl_ctx_free(context);
+		return nullptr;
+	}
+
+	auto ctx = new SslServerContext(context, keyHash, certHash);
+	if(ctx == nullptr) {
+		ssl_ctx_free(context);
+		return nullptr;
+	}
+
+	ctx->stats.sessionCacheSize = sessionCacheSize;
+	ctx->stats.references = 1;
+	ctx->next = head;
+	head = ctx;
+	return ctx;
+}
+
+SslServerContext::~SslServerContext()
+{
+	for(SslServerContext** pctx = &head; *pctx != nullptr; pctx = &(*pctx)->next) {
+		if(*pctx == this) {
+			*pctx = next;
+			break;
+		}
+	}
+
+	ssl_ctx_free(context);
+}
+
+void SslServerContext::release()
+{
+	if(--stats.references == 0) {
+		debug_d("SSL: freeing server context");
+		delete this;
+	}
+}
+
+SSL* SslServerContext::createSession(int clientfd)
+{
+	SSL* ssl = ssl_server_new(context, clientfd);
+	if(ssl != nullptr) {
+		addRef();
+	}
+	return ssl;
+}
+
+void SslServerContext::handshakeComplete(SSL* ssl)
+{
+	++stats.handshakes;
+	if(ssl->flag & SSL_SESSION_RESUME) {
+		++stats.resumed;
+	}
+	debug_d("SSL: server handshakes %u, resumed %u%%", stats.handshakes, getHitRate());
+}
+
+void SslServerContext::sessionClosed(SSL* ssl, bool connected)
+{
+	if(!connected) {
+		++stats.failures;
+	}
+	ssl_free(ssl);
+	release();
+}
+
+#endif /* ENABLE_SSL */
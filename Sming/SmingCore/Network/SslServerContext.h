@@ -0,0 +1,114 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SslServerContext.h
+ *
+ * Shared, reference-counted SSL context for servers. Parsing the key and
+ * certificate is done once per key/certificate pair, however many servers use
+ * it, and the context's session cache lets returning clients resume without a
+ * full RSA handshake.
+ *
+ ****/
+
+/** @addtogroup tcp
+ *  @{
+ */
+
+#ifndef _SMING_CORE_SSL_SERVER_CONTEXT_H_
+#define _SMING_CORE_SSL_SERVER_CONTEXT_H_
+
+#ifdef ENABLE_SSL
+
+#include "TcpConnection.h"
+
+typedef struct {
+	uint32_t handshakes = 0; ///< Completed handshakes
+	uint32_t resumed = 0;	///< Handshakes which resumed a cached session
+	uint32_t failures = 0;   ///< Connections closed before the handshake completed
+	uint16_t sessionCacheSize = 0;
+	uint16_t references = 0; ///< Servers and connections using the context
+} SslServerStats;
+
+class SslServerContext
+{
+public:
+	/** @brief Get a context for a key/certificate pair, creating it if necessary
+	 *  @param keyCert
+	 *  @param options SSL options for a new context
+	 *  @param sessionCacheSize Sessions to cache in a new context, 0 disables resumption
+	 *  @retval SslServerContext* nullptr on failure. Call release() when finished with it.
+	 *  @note An existing context is shared regardless of `options` and `sessionCacheSize`
+	 */
+	static SslServerContext* acquire(const SSLKeyCertPair& keyCert, uint32_t options, int sessionCacheSize);
+
+	/** @brief Take an additional reference */
+	void addRef()
+	{
+		++stats.references;
+	}
+
+	/** @brief Drop a reference, the context is destroyed when none remain */
+	void release();
+
+	/** @brief Create an SSL session for an accepted connection
+	 *  @note Each successful call takes a reference, dropped by sessionClosed()
+	 */
+	SSL* createSession(int clientfd);
+
+	/** @brief Record completion of a handshake */
+	void handshakeComplete(SSL* ssl);
+
+	/** @brief Free a session created by createSession()
+	 *  @param ssl
+	 *  @param connected true if the handshake completed
+	 */
+	void sessionClosed(SSL* ssl, bool connected);
+
+	const SslServerStats& getStats() const
+	{
+		return stats;
+	}
+
+	/** @brief Percentage of handshakes which resumed a cached session */
+	unsigned getHitRate() const
+	{
+		return stats.handshakes ? (stats.resumed * 100) / stats.handshakes : 0;
+	}
+
+	/** @brief Visit all live contexts, e.g. for reporting */
+	static SslServerContext* getFirst()
+	{
+		return head;
+	}
+
+	SslServerContext* getNext() const
+	{
+		return next;
+	}
+
+private:
+	SslServerContext(SSLCTX* context, uint32_t keyHash, uint32_t certHash)
+		: context(context), keyHash(keyHash), certHash(certHash)
+	{
+	}
+
+	~SslServerContext();
+
+	static uint32_t hash(const uint8_t* data, int length);
+
+private:
+	static SslServerContext* head;
+	SslServerContext* next = nullptr;
+	SSLCTX* context;
+	uint32_t keyHash;
+	uint32_t certHash;
+	SslServerStats stats;
+};
+
+#endif /* ENABLE_SSL */
+
+/** @} */
+#endif /* _SMING_CORE_SSL_SERVER_CONTEXT_H_ */
@@ -7,13 +7,14 @@
 
 #include "TcpClient.h"
 #include "Data/Stream/MemoryDataStream.h"
+#include "PbufSpan.h"
 
 TcpClient::TcpClient(tcp_pcb* clientTcp, TcpClientDataDelegate clientReceive, TcpClientCompleteDelegate onCompleted)
 	: TcpConnection(clientTcp, true), state(eTCS_Connected)
 {
 	completed = onCompleted;
 	receive = clientReceive;
-	timeOut = TCP_CLIENT_TIMEOUT;
+	setTimeOut(TCP_CLIENT_TIMEOUT);
 }
 
 TcpClient::TcpClient(bool autoDestruct) : TcpConnection(autoDestruct), state(eTCS_Ready)
@@ -117,17 +118,15 @@ err_t TcpClient::onReceive(pbuf* buf)
 	}
 
 	if(receive) {
-		pbuf* cur = buf;
-		while(cur != NULL && cur->len > 0) {
-			bool success = receive(*this, (char*)cur->payload, cur->len);
+		// Parsers are fed each segment where it lies, nothing is copied
+		for(auto span : PbufSpans(buf)) {
+			bool success = receive(*this, span.data, span.length);
 			if(!success) {
 				debug_d("TcpClient::onReceive: Aborted from receive callback");
 
 				TcpConnection::onReceive(NULL);
 				return ERR_ABRT; // abort the connection
 			}
-
-			cur = cur->next;
 		}
 	}
 
@@ -10,18 +10,34 @@
 #include "../Data/Stream/DataSourceStream.h"
 #include "../../SmingCore/Platform/WDT.h"
 #include "NetUtils.h"
+#include "DnsResolver.h"
+#include "SslServerContext.h"
+#include "SslClientSessionCache.h"
 #include "../Wiring/WString.h"
 #include "../Wiring/IPAddress.h"
 
 #include <algorithm>
 
+#ifdef ENABLE_SSL
+// Descriptor table of the axTLS lwIP glue, used to read records in place
+extern "C" AxlTcpDataArray axlFdArray;
+#endif
+
 TcpConnection::TcpConnection(bool autoDestruct) : autoSelfDestruct(autoDestruct), sleep(0), canSend(true)
 {
+	idleTimer.callback = staticOnIdleTimer;
+	idleTimer.arg = this;
+	resumeTimer.callback = staticOnResumeReceive;
+	resumeTimer.arg = this;
 }
 
 TcpConnection::TcpConnection(tcp_pcb* connection, bool autoDestruct)
 	: autoSelfDestruct(autoDestruct), sleep(0), canSend(true)
 {
+	idleTimer.callback = staticOnIdleTimer;
+	idleTimer.arg = this;
+	resumeTimer.callback = staticOnResumeReceive;
+	resumeTimer.arg = this;
 	initialize(connection);
 }
 
@@ -45,8 +61,6 @@ bool TcpConnection::connect(const String& server, int port, bool useSsl /* = fal
 	if(tcp == NULL)
 		initialize(tcp_new());
 
-	ip_addr_t addr;
-
 	this->useSsl = useSsl;
 #ifdef ENABLE_SSL
 	this->sslOptions |= sslOptions;
@@ -59,22 +73,19 @@ bool TcpConnection::connect(const String& server, int port, bool useSsl /* = fal
 		sslExtension = ssl_ext_new();
 		ssl_ext_set_host_name(sslExtension, server.c_str());
 		ssl_ext_set_max_fragment_size(sslExtension, 4); // 4K max size
+		sslSessionKey = SslClientSessionCache::makeKey(server, port);
 	}
 #endif
 
 	debug_d("connect to: %s", server.c_str());
 	canSend = false; // Wait for connection
-	DnsLookup* look = new DnsLookup{this, port};
-	err_t dnslook = dns_gethostbyname(server.c_str(), &addr, staticDnsResponse, look);
+	dnsPort = port;
+	dnsResolver.cancel(this);
+	IPAddress addr;
+	err_t dnslook = dnsResolver.resolve(server, addr, DnsResolverDelegate(&TcpConnection::onDnsResolved, this), this);
 	if(dnslook != ERR_OK) {
-		if(dnslook == ERR_INPROGRESS)
-			return true;
-		else {
-			delete look;
-			return false;
-		}
+		return dnslook == ERR_INPROGRESS;
 	}
-	delete look;
 
 	return internalTcpConnect(addr, port);
 }
@@ -87,6 +98,9 @@ bool TcpConnection::connect(IPAddress addr, uint16_t port, bool useSsl /* = fals
 	this->useSsl = useSsl;
 #ifdef ENABLE_SSL
 	this->sslOptions |= sslOptions;
+	if(useSsl) {
+		sslSessionKey = SslClientSessionCache::makeKey(addr, port);
+	}
 #endif
 
 	return internalTcpConnect(addr, port);
@@ -96,6 +110,61 @@ void TcpConnection::setTimeOut(uint16_t waitTimeOut)
 {
 	debug_d("timeout updating: %d -> %d", timeOut, waitTimeOut);
 	timeOut = waitTimeOut;
+	armIdleTimer();
+}
+
+void TcpConnection::setDeadline(uint16_t seconds)
+{
+	hasDeadline = (seconds != 0);
+	deadline = millis() + seconds * 1000U;
+	armIdleTimer();
+}
+
+int32_t TcpConnection::getTimeRemaining() const
+{
+	uint32_t now = millis();
+	int32_t remaining = INT32_MAX;
+	if(hasTimeOut()) {
+		remaining = int32_t(lastActivity + timeOut * 1000U - now);
+	}
+	if(hasDeadline) {
+		remaining = std::min(remaining, int32_t(deadline - now));
+	}
+	return remaining;
+}
+
+void TcpConnection::armIdleTimer()
+{
+	if(tcp == NULL || (!hasTimeOut() && !hasDeadline)) {
+		timerScheduler.disarm(idleTimer);
+		return;
+	}
+
+	// Never close from here, the caller may still be using the connection
+	int32_t remaining = getTimeRemaining();
+	timerScheduler.arm(idleTimer, (remaining > 0) ? remaining : 1, false);
+}
+
+/*
+ * Activity only updates lastActivity. The timer is left at its original expiry
+ * and, if the connection turns out to have been active since, re-armed for the
+ * remainder. A busy connection costs one re-arm per timeout period rather than
+ * one per segment.
+ */
+void TcpConnection::staticOnIdleTimer(void* arg)
+{
+	auto con = static_cast<TcpConnection*>(arg);
+	if(con->tcp == NULL) {
+		return;
+	}
+
+	if(con->getTimeRemaining() > 0) {
+		con->armIdleTimer();
+		return;
+	}
+
+	debug_d("TCP connection closed by timeout: idle %u ms (from %d s)", con->getIdleTime(), con->timeOut);
+	con->close();
 }
 
 err_t TcpConnection::onReceive(pbuf* buf)
@@ -124,13 +193,6 @@ err_t TcpConnection::onSent(uint16_t len)
 
 err_t TcpConnection::onPoll()
 {
-	if(sleep >= timeOut && timeOut != USHRT_MAX) {
-		debug_d("TCP connection closed by timeout: %d (from %d)", sleep, timeOut);
-
-		close();
-		return ERR_TIMEOUT;
-	}
-
 	if(tcp != NULL && getAvailableWriteSize() > 0) //(tcp->state >= SYN_SENT && tcp->state <= ESTABLISHED))
 		onReadyToSendData(eTCE_Poll);
 
@@ -283,6 +345,10 @@ int TcpConnection::write(IDataSourceStream* stream)
 
 void TcpConnection::close()
 {
+	timerScheduler.disarm(idleTimer);
+	dnsResolver.cancel(this);
+	discardReceived();
+
 #ifdef ENABLE_SSL
 	closeSsl();
 #endif
@@ -304,8 +370,10 @@ void TcpConnection::close()
 
 void TcpConnection::initialize(tcp_pcb* pcb)
 {
+	discardReceived();
 	tcp = pcb;
 	sleep = 0;
+	lastActivity = millis();
 	canSend = true;
 #ifdef ENABLE_SSL
 	axl_init(10);
@@ -317,6 +385,7 @@ void TcpConnection::initialize(tcp_pcb* pcb)
 	tcp_recv(tcp, staticOnReceive);
 	tcp_err(tcp, staticOnError);
 	tcp_poll(tcp, staticOnPoll, 4);
+	armIdleTimer();
 
 #ifdef NETWORK_DEBUG
 	debug_d("+TCP connection");
@@ -418,19 +487,26 @@ err_t TcpConnection::staticOnConnected(void* arg, tcp_pcb* tcp, err_t err)
 				}
 			}
 
-			debug_d("SSL: Session Id Length: %d", (con->sslSessionId != NULL ? con->sslSessionId->length : 0));
-			if(con->sslSessionId != NULL && con->sslSessionId->length > 0) {
+			const uint8_t* sessionId = nullptr;
+			uint8_t sessionIdLength = 0;
+			if(con->useSslSessionCache) {
+				sessionIdLength = sslClientSessionCache.restore(con->sslSessionKey, con->sslContext, sessionId);
+			} else if(con->sslSessionId != NULL && con->sslSessionId->length > 0) {
+				sessionId = con->sslSessionId->value;
+				sessionIdLength = con->sslSessionId->length;
+			}
+
+			debug_d("SSL: Session Id Length: %d", sessionIdLength);
+			if(sessionIdLength > 0) {
 				debug_d("-----BEGIN SSL SESSION PARAMETERS-----");
-				for(int i = 0; i < con->sslSessionId->length; i++) {
-					m_printf("%02x", con->sslSessionId->value[i]);
+				for(int i = 0; i < sessionIdLength; i++) {
+					m_printf("%02x", sessionId[i]);
 				}
 
 				debug_d("\n-----END SSL SESSION PARAMETERS-----");
 			}
 
-			con->ssl =
-				ssl_client_new(con->sslContext, clientfd, (con->sslSessionId != NULL ? con->sslSessionId->value : NULL),
-							   (con->sslSessionId != NULL ? con->sslSessionId->length : 0), con->sslExtension);
+			con->ssl = ssl_client_new(con->sslContext, clientfd, sessionId, sessionIdLength, con->sslExtension);
 			if(ssl_handshake_status(con->ssl) != SSL_OK) {
 				debug_d("SSL: handshake is in progress...");
 				return SSL_OK;
@@ -440,13 +516,7 @@ err_t TcpConnection::staticOnConnected(void* arg, tcp_pcb* tcp, err_t err)
 			debug_d("SSL: Switching back 80 MHz");
 			System.setCpuFrequency(eCF_80MHz);
 #endif
-			if(con->sslSessionId) {
-				if(con->sslSessionId->value == NULL) {
-					con->sslSessionId->value = new uint8_t[SSL_SESSION_ID_SIZE];
-				}
-				memcpy((void*)con->sslSessionId->value, (void*)con->ssl->session_id, con->ssl->sess_id_size);
-				con->sslSessionId->length = con->ssl->sess_id_size;
-			}
+			con->sslHandshakeComplete();
 		}
 	}
 #endif
@@ -471,8 +541,10 @@ err_t TcpConnection::staticOnReceive(void* arg, tcp_pcb* tcp, pbuf* p, err_t err
 		}
 		closeTcpConnection(tcp);
 		return ERR_OK;
-	} else
+	} else {
 		con->sleep = 0;
+		con->lastActivity = millis();
+	}
 
 	if(err != ERR_OK /*&& err != ERR_CLSD && err != ERR_RST*/) {
 		debug_d("Received ERROR %d", err);
@@ -489,100 +561,303 @@ err_t TcpConnection::staticOnReceive(void* arg, tcp_pcb* tcp, pbuf* p, err_t err
 		return err == ERR_ABRT ? ERR_ABRT : ERR_OK;
 	}
 
-	//if (tcp != NULL && tcp->state == ESTABLISHED) // If active
-	/* We have taken the data. */
-	if(p != NULL) {
-		tcp_recved(tcp, p->tot_len);
-	} else {
+	// Keep data in order behind anything already held
+	if(con->receivePaused || con->heldReceive != NULL) {
+		if(p == NULL) {
+			con->heldClose = true;
+		} else if(con->heldReceive == NULL) {
+			con->heldReceive = p;
+		} else {
+			pbuf_cat(con->heldReceive, p);
+		}
+		return ERR_OK;
+	}
+
+	if(p == NULL) {
 		debug_d("TcpConnection::staticOnReceive: pbuf is NULL");
+		err_t res = con->onReceive(NULL);
+		if(res == ERR_ABRT) {
+			// Receiver has aborted the connection, both it and the pcb may be gone
+			return res;
+		}
+		con->close();
+		closeTcpConnection(tcp);
+		con->checkSelfFree();
+		return res;
+	}
+
+	err_t res = con->processReceived(p);
+	if(res != ERR_ABRT) {
+		con->checkSelfFree();
 	}
+	//debug_d("<staticOnReceive");
+	return res;
+}
+
+err_t TcpConnection::processReceived(pbuf* p)
+{
+	/*
+	 * The receive window is only reopened once the data has been consumed, so it reflects how fast
+	 * the application processes data rather than how fast lwIP hands it over.
+	 */
+	tcp_pcb* pcb = tcp;
+	uint16_t length = p->tot_len;
+	err_t res = ERR_OK;
+	receiving = length;
 
 #ifdef ENABLE_SSL
-	if(con->ssl && p != NULL) {
+	if(ssl != nullptr) {
 		WDT.alive(); /* SSL handshake needs time. In theory we have max 8 seconds before the hardware watchdog resets the device */
-		struct pbuf* pout;
 
-		int read_bytes = axl_ssl_read(con->ssl, tcp, p, &pout);
+		int read_bytes = sslReceive(p, res);
+		pbuf_free(p);
 
-		// free the SSL pbuf and put the decrypted data in the brand new pout pbuf
-		if(p != NULL) {
-			pbuf_free(p);
+		if(res == ERR_ABRT) {
+			// Closed during the handshake or by the receiver
+			return res;
 		}
 
 		if(read_bytes < SSL_OK) {
 			debug_d("SSL: Got error: %d", read_bytes);
 			if(read_bytes == SSL_CLOSE_NOTIFY) {
+				receiving = 0;
+				acknowledgeReceived(length);
 				return ERR_OK;
 			}
 
-			con->close();
-			closeTcpConnection(tcp);
-			return read_bytes;
+			close();
+			tcp_abort(pcb);
+			return ERR_ABRT;
 		}
 
-		if(read_bytes == 0) {
-			if(!con->sslConnected && ssl_handshake_status(con->ssl) == SSL_OK) {
-				con->sslConnected = true;
-				debug_d("SSL: Handshake done (%d ms).", millis());
-#ifndef SSL_SLOW_CONNECT
-				debug_d("SSL: Switching back to 80 MHz");
-				System.setCpuFrequency(eCF_80MHz); // Preserve some CPU cycles
+		if(read_bytes == 0 && ssl != nullptr && !sslConnected && ssl_handshake_status(ssl) == SSL_OK) {
+			res = sslHandshakeDone();
+			if(res == ERR_ABRT) {
+				return res;
+			}
+		}
+	} else
 #endif
-				if(con->onSslConnected(con->ssl) != ERR_OK) {
-					con->close();
-					closeTcpConnection(tcp);
+	{
+		res = onReceive(p);
+		pbuf_free(p);
+		if(res == ERR_ABRT) {
+			return res;
+		}
+	}
 
-					return ERR_ABRT;
-				}
+	if(tcp != pcb) {
+		// Closed by the receiver, close() has acknowledged the data
+		return res;
+	}
+	receiving = 0;
 
-				if(con->sslSessionId) {
-					if(con->sslSessionId->value == NULL) {
-						con->sslSessionId->value = new uint8_t[SSL_SESSION_ID_SIZE];
-					}
-					memcpy((void*)con->sslSessionId->value, (void*)con->ssl->session_id, con->ssl->sess_id_size);
-					con->sslSessionId->length = con->ssl->sess_id_size;
-				}
+	if(receiveBudget != 0) {
+		receivedSinceResume += length;
+		if(receivedSinceResume >= receiveBudget && !receivePaused) {
+			receivePaused = true;
+			timerScheduler.arm(resumeTimer, 1, false);
+		}
+	}
 
-				err_t res = con->onConnected(err);
-				con->checkSelfFree();
+	acknowledgeReceived(length);
+	return res;
+}
 
-				return res;
-			}
+void TcpConnection::acknowledgeReceived(uint16_t length)
+{
+	if(receivePaused) {
+		unacknowledged += length;
+	} else {
+		tcp_recved(tcp, length);
+	}
+}
 
-			// No data yet
-			return ERR_OK;
+void TcpConnection::reopenWindow(uint32_t length)
+{
+	while(length != 0) {
+		uint16_t chunk = std::min(length, uint32_t(0xFFFF));
+		tcp_recved(tcp, chunk);
+		length -= chunk;
+	}
+}
+
+void TcpConnection::discardReceived()
+{
+	/*
+	 * lwIP resets the connection rather than closing it if the receive window isn't fully open,
+	 * discarding any reply still queued, so give back anything not yet acknowledged.
+	 */
+	if(tcp != NULL) {
+		uint32_t length = receiving + unacknowledged;
+		if(heldReceive != NULL) {
+			length += heldReceive->tot_len;
 		}
+		reopenWindow(length);
+	}
+	receiving = 0;
+
+	timerScheduler.disarm(resumeTimer);
+	if(heldReceive != NULL) {
+		pbuf_free(heldReceive);
+		heldReceive = NULL;
+	}
+	heldClose = false;
+	receivePaused = false;
+	unacknowledged = 0;
+	receivedSinceResume = 0;
+}
 
-		// we got some decrypted bytes...
-		debug_d("SSL: Decrypted data len %d", read_bytes);
+void TcpConnection::pauseReceive()
+{
+	receivePaused = true;
+	timerScheduler.disarm(resumeTimer);
+}
 
-		// put the decrypted data in a brand new pbuf
-		p = pout;
+void TcpConnection::resumeReceive()
+{
+	// Delivery is deferred so callers never see onReceive() re-entered
+	if(receivePaused) {
+		timerScheduler.arm(resumeTimer, 1, false);
 	}
-#endif
+}
 
-	err_t res = con->onReceive(p);
+void TcpConnection::staticOnResumeReceive(void* arg)
+{
+	static_cast<TcpConnection*>(arg)->deliverHeldReceive();
+}
 
-	if(p != NULL)
-		pbuf_free(p);
-	else {
-		con->close();
-		closeTcpConnection(tcp);
+void TcpConnection::deliverHeldReceive()
+{
+	receivePaused = false;
+	receivedSinceResume = 0;
+	if(tcp == NULL) {
+		return;
 	}
 
-	con->checkSelfFree();
-	//debug_d("<staticOnReceive");
-	return res;
+	reopenWindow(unacknowledged);
+	unacknowledged = 0;
+
+	// Stay alive until everything held has been handled
+	bool autoDestruct = autoSelfDestruct;
+	autoSelfDestruct = false;
+
+	if(heldReceive != NULL) {
+		pbuf* p = heldReceive;
+		heldReceive = NULL;
+		if(processReceived(p) == ERR_ABRT) {
+			close();
+		}
+	}
+
+	if(heldClose && heldReceive == NULL && !receivePaused && tcp != NULL) {
+		heldClose = false;
+		tcp_pcb* pcb = tcp;
+		bool aborted = (onReceive(NULL) == ERR_ABRT);
+		close();
+		if(!aborted) {
+			closeTcpConnection(pcb);
+		}
+	}
+
+	autoSelfDestruct = autoDestruct;
+	checkSelfFree();
 }
 
+#ifdef ENABLE_SSL
+int TcpConnection::sslReceive(pbuf* encrypted, err_t& result)
+{
+	/*
+	 * This does the job of axl_ssl_read(), which gathers all decrypted records into a heap buffer
+	 * and copies that into a new pbuf. Instead each record is passed on as soon as it is decrypted,
+	 * wrapped in place by a reference pbuf.
+	 */
+	int clientfd = ax_fd_getfd(&axlFdArray, tcp);
+	AxlTcpData* data = (clientfd < 0) ? nullptr : ax_fd_get(&axlFdArray, clientfd);
+	if(data == nullptr) {
+		return ERR_AXL_INVALID_CLIENTFD;
+	}
+
+	data->tcp_pbuf = encrypted;
+	data->pbuf_offset = 0;
+
+	int total = 0;
+	while(ssl != nullptr && encrypted->tot_len > data->pbuf_offset) {
+		WDT.alive();
+		uint8_t* decrypted;
+		int length = ssl_read(ssl, &decrypted);
+		if(length < SSL_OK) {
+			// Report the error unless some data got through, which must be handled first
+			return (total == 0) ? length : total;
+		}
+		if(length == 0) {
+			continue;
+		}
+
+		// Application data can arrive in the same segment as the end of the handshake
+		if(!sslConnected) {
+			result = sslHandshakeDone();
+			if(result != ERR_OK) {
+				break;
+			}
+		}
+
+		debug_d("SSL: Decrypted data len %d", length);
+		total += length;
+
+		pbuf* ref = pbuf_alloc(PBUF_RAW, length, PBUF_REF);
+		if(ref == nullptr) {
+			result = ERR_MEM;
+			break;
+		}
+		ref->payload = decrypted;
+		result = onReceive(ref);
+		pbuf_free(ref);
+
+		// The connection may have been closed by the receiver
+		if(result != ERR_OK || tcp == nullptr) {
+			break;
+		}
+	}
+
+	return total;
+}
+
+err_t TcpConnection::sslHandshakeDone()
+{
+	sslConnected = true;
+	debug_d("SSL: Handshake done (%d ms).", millis());
+#ifndef SSL_SLOW_CONNECT
+	debug_d("SSL: Switching back to 80 MHz");
+	System.setCpuFrequency(eCF_80MHz); // Preserve some CPU cycles
+#endif
+	if(sslServerContext != nullptr) {
+		sslServerContext->handshakeComplete(ssl);
+	}
+
+	if(onSslConnected(ssl) != ERR_OK) {
+		tcp_pcb* pcb = tcp;
+		close();
+		tcp_abort(pcb);
+		return ERR_ABRT;
+	}
+
+	sslHandshakeComplete();
+
+	return onConnected(ERR_OK);
+}
+#endif
+
 err_t TcpConnection::staticOnSent(void* arg, tcp_pcb* tcp, uint16_t len)
 {
 	TcpConnection* con = (TcpConnection*)arg;
 
 	if(con == NULL)
 		return ERR_OK;
-	else
+	else {
 		con->sleep = 0;
+		con->lastActivity = millis();
+	}
 
 	err_t res = con->onSent(len);
 	con->checkSelfFree();
@@ -621,28 +896,21 @@ void TcpConnection::staticOnError(void* arg, err_t err)
 	//debug_d("<staticOnError");
 }
 
-void TcpConnection::staticDnsResponse(const char* name, LWIP_IP_ADDR_T* ipaddr, void* arg)
+void TcpConnection::onDnsResolved(const String& name, IPAddress ip)
 {
-	DnsLookup* dlook = (DnsLookup*)arg;
-	if(dlook == NULL)
-		return;
+	if(!ip.isNull()) {
+		debug_d("DNS record found: %s = %d.%d.%d.%d", name.c_str(), ip[0], ip[1], ip[2], ip[3]);
 
-	if(ipaddr != NULL) {
-		IPAddress ip = *ipaddr;
-		debug_d("DNS record found: %s = %d.%d.%d.%d", name, ip[0], ip[1], ip[2], ip[3]);
-
-		dlook->con->internalTcpConnect(ip, dlook->port);
+		internalTcpConnect(ip, dnsPort);
 	} else {
 #ifdef NETWORK_DEBUG
-		debug_d("DNS record _not_ found: %s", name);
+		debug_d("DNS record _not_ found: %s", name.c_str());
 #endif
 
-		closeTcpConnection(dlook->con->tcp);
-		dlook->con->tcp = NULL;
-		dlook->con->close();
+		closeTcpConnection(tcp);
+		tcp = NULL;
+		close();
 	}
-
-	delete dlook;
 }
 
 void TcpConnection::setDestroyedDelegate(TcpConnectionDestroyedDelegate destroyedDelegate)
@@ -725,15 +993,45 @@ SSL* TcpConnection::getSsl()
 	return ssl;
 }
 
+void TcpConnection::sslHandshakeComplete()
+{
+	if(sslServerContext != nullptr) {
+		return;
+	}
+
+	if(useSslSessionCache) {
+		sslClientSessionCache.store(sslSessionKey, ssl);
+	}
+
+	if(sslSessionId) {
+		if(sslSessionId->value == NULL) {
+			sslSessionId->value = new uint8_t[SSL_SESSION_ID_SIZE];
+		}
+		memcpy((void*)sslSessionId->value, (void*)ssl->session_id, ssl->sess_id_size);
+		sslSessionId->length = ssl->sess_id_size;
+	}
+}
+
 void TcpConnection::closeSsl()
 {
 	if(ssl == nullptr) {
 		return;
 	}
 
+	if(!sslConnected && useSslSessionCache) {
+		// Don't keep offering a session which may have caused the failure
+		sslClientSessionCache.remove(sslSessionKey);
+	}
+
 	debug_d("SSL: closing ...");
-	ssl_ctx_free(sslContext);
-	sslContext = nullptr;
+	if(sslServerContext != nullptr) {
+		// Session belongs to a shared server context
+		sslServerContext->sessionClosed(ssl, sslConnected);
+		sslServerContext = nullptr;
+	} else {
+		ssl_ctx_free(sslContext);
+		sslContext = nullptr;
+	}
 	sslExtension = nullptr;
 	ssl = nullptr;
 	sslConnected = false;
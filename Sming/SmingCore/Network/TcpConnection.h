@@ -15,12 +15,13 @@
 
 #ifdef ENABLE_SSL
 #include "../../axtls-8266/compat/lwipr_compat.h"
-#include "../Clock.h"
 #endif
 
 #include "../Wiring/WiringFrameworkDependencies.h"
 #include "IPAddress.h"
 #include "../Delegate.h"
+#include "../TimerScheduler.h"
+#include "../Clock.h"
 
 #define NETWORK_DEBUG
 
@@ -68,6 +69,9 @@ typedef struct {
 struct pbuf;
 class String;
 class IDataSourceStream;
+#ifdef ENABLE_SSL
+class SslServerContext;
+#endif
 class IPAddress;
 class TcpServer;
 class TcpConnection;
@@ -101,7 +105,51 @@ public:
 	}
 	void flush();
 
+	/**
+	 * @brief Set the idle timeout
+	 * @param waitTimeOut Seconds without data sent or received before the connection is closed,
+	 * 0 or USHRT_MAX for no timeout
+	 */
 	void setTimeOut(uint16_t waitTimeOut);
+
+	/**
+	 * @brief Close the connection after a fixed time, regardless of activity
+	 * @param seconds Time from now, 0 to cancel
+	 * @note Use to bound how long a peer may take over a request. A client sending
+	 * headers a byte at a time never trips the idle timeout.
+	 */
+	void setDeadline(uint16_t seconds);
+
+	/**
+	 * @brief Stop passing received data to onReceive()
+	 * @note Data arriving while paused is held. Neither it nor data delivered since the pause
+	 * is acknowledged to lwIP, so the receive window closes and throttles the sender. Held data
+	 * therefore never exceeds TCP_WND.
+	 */
+	void pauseReceive();
+
+	/**
+	 * @brief Resume receiving. Held data is delivered from the timer queue shortly afterwards.
+	 * @note Safe to call from within receive callbacks
+	 */
+	void resumeReceive();
+
+	bool isReceivePaused() const
+	{
+		return receivePaused;
+	}
+
+	/**
+	 * @brief Limit how much received data is handled before other tasks get to run
+	 * @param bytes Once this much has been delivered receiving pauses, then resumes from the
+	 * timer queue. The window reopens only as data is handled, so a sender is paced by a slow
+	 * consumer such as a flash write instead of filling RAM. 0 for no limit.
+	 */
+	void setReceiveBudget(uint16_t bytes)
+	{
+		receiveBudget = bytes;
+	}
+
 	IPAddress getRemoteIp()
 	{
 		return (tcp == NULL) ? INADDR_NONE : IPAddress(tcp->remote_ip);
@@ -120,6 +168,16 @@ public:
 #ifdef ENABLE_SSL
 	void addSslOptions(uint32_t sslOptions);
 
+	/**
+	 * @brief Resume SSL sessions via the global client session cache
+	 * @param enable
+	 * @note Call before connect(). Sessions are cached per server name (or address) and port.
+	 */
+	void setSslSessionCache(bool enable)
+	{
+		useSslSessionCache = enable;
+	}
+
 	// start deprecated
 	/**
 	 * @brief Sets client private key, certificate and password from memory
@@ -233,12 +291,32 @@ protected:
 	static err_t staticOnSent(void* arg, tcp_pcb* tcp, uint16_t len);
 	static err_t staticOnPoll(void* arg, tcp_pcb* tcp);
 	static void staticOnError(void* arg, err_t err);
-	static void staticDnsResponse(const char* name, LWIP_IP_ADDR_T* ipaddr, void* arg);
 
 	static void closeTcpConnection(tcp_pcb* tpcb);
 	void initialize(tcp_pcb* pcb);
 
+	/** @brief Get milliseconds since data was last sent or received */
+	uint32_t getIdleTime() const
+	{
+		return millis() - lastActivity;
+	}
+
 private:
+	void onDnsResolved(const String& name, IPAddress ip);
+	static void staticOnIdleTimer(void* arg);
+	err_t processReceived(pbuf* p);
+	void acknowledgeReceived(uint16_t length);
+	void reopenWindow(uint32_t length);
+	void discardReceived();
+	static void staticOnResumeReceive(void* arg);
+	void deliverHeldReceive();
+	int32_t getTimeRemaining() const;
+	void armIdleTimer();
+	bool hasTimeOut() const
+	{
+		return timeOut != 0 && timeOut != USHRT_MAX;
+	}
+
 	inline void checkSelfFree()
 	{
 		if(tcp == NULL && autoSelfDestruct)
@@ -249,6 +327,10 @@ protected:
 	tcp_pcb* tcp = NULL;
 	uint16_t sleep;
 	uint16_t timeOut = USHRT_MAX; // << By default a TCP connection does not have a time out
+	uint32_t lastActivity = 0;   // << millis() when data was last sent or received
+	uint32_t deadline = 0;	   // << millis() at which the connection is closed, if hasDeadline
+	bool hasDeadline = false;
+	uint16_t dnsPort = 0; // << Port to connect to once the host name is resolved
 	bool canSend;
 	bool autoSelfDestruct;
 #ifdef ENABLE_SSL
@@ -260,14 +342,39 @@ protected:
 	SSLKeyCertPair sslKeyCert;
 	bool freeKeyCert = false;
 	SSLSessionId* sslSessionId = NULL;
+	SslServerContext* sslServerContext = nullptr; ///< Shared context for server-side SSL
+	uint32_t sslSessionKey = 0;					  ///< Identifies server in client session cache
+	bool useSslSessionCache = false;
 #endif
 	bool useSsl = false;
 
 private:
 	TcpConnectionDestroyedDelegate destroyedDelegate = 0;
+	TimerScheduler::Entry idleTimer; ///< Expires at the earlier of the idle timeout and the deadline
+	TimerScheduler::Entry resumeTimer; ///< Delivers held data after resumeReceive()
+	pbuf* heldReceive = nullptr;	   ///< Data received while paused, not yet delivered
+	uint32_t unacknowledged = 0;	   ///< Bytes delivered while paused, window update pending
+	uint16_t receiving = 0;			   ///< Bytes being delivered, acknowledged once onReceive() returns
+	uint16_t receiveBudget = 0;
+	uint32_t receivedSinceResume = 0;
+	bool receivePaused = false;
+	bool heldClose = false; ///< Remote closed while data was held
 
 #ifdef ENABLE_SSL
 	void closeSsl();
+	void sslHandshakeComplete();
+
+	/** @brief Decrypt a received segment, passing each record to onReceive() as it is decrypted
+	 *  @param encrypted
+	 *  @param result Set to the last onReceive() result, or ERR_ABRT if the connection was closed
+	 *  @retval int Number of bytes decrypted, 0 if there were none yet or an SSL error code
+	 */
+	int sslReceive(pbuf* encrypted, err_t& result);
+
+	/** @brief Called once the handshake has completed
+	 *  @retval err_t ERR_ABRT if the connection has been closed
+	 */
+	err_t sslHandshakeDone();
 #endif
 };
 
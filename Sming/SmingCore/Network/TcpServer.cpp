@@ -7,6 +7,7 @@
 
 #include "TcpServer.h"
 #include "TcpClient.h"
+#include "SslServerContext.h"
 
 #include "../../SmingCore/Digital.h"
 #include "../../SmingCore/Timer.h"
@@ -41,6 +42,12 @@ TcpServer::TcpServer(TcpClientDataDelegate clientReceiveDataHandler)
 
 TcpServer::~TcpServer()
 {
+#ifdef ENABLE_SSL
+	if(sslServerContext != nullptr) {
+		sslServerContext->release();
+		sslServerContext = nullptr;
+	}
+#endif
 	debug_i("Server is destroyed.");
 }
 
@@ -92,22 +99,13 @@ bool TcpServer::listen(int port, bool useSsl /*= false */)
 		sslOptions |= SSL_DISPLAY_STATES | SSL_DISPLAY_BYTES | SSL_DISPLAY_CERTS;
 #endif
 
-		sslContext = ssl_ctx_new(sslOptions, sslSessionCacheSize);
-
-		if(!(sslKeyCert.keyLength && sslKeyCert.certificateLength)) {
-			debug_e("SSL: server certificate and key are not provided!");
-			return false;
-		}
-
-		if(ssl_obj_memory_load(sslContext, SSL_OBJ_RSA_KEY, sslKeyCert.key, sslKeyCert.keyLength,
-							   sslKeyCert.keyPassword) != SSL_OK) {
-			debug_e("SSL: Unable to load server private key");
-			return false;
+		if(sslServerContext != nullptr) {
+			sslServerContext->release();
 		}
 
-		if(ssl_obj_memory_load(sslContext, SSL_OBJ_X509_CERT, sslKeyCert.certificate, sslKeyCert.certificateLength,
-							   NULL) != SSL_OK) {
-			debug_e("SSL: Unable to load server certificate");
+		// Connections take their own references so the context outlives a server that shuts down
+		sslServerContext = SslServerContext::acquire(sslKeyCert, sslOptions, sslSessionCacheSize);
+		if(sslServerContext == nullptr) {
 			return false;
 		}
 
@@ -118,17 +116,61 @@ bool TcpServer::listen(int port, bool useSsl /*= false */)
 
 	tcp = tcp_listen(tcp);
 	tcp_accept(tcp, staticAccept);
+	// The timeout applies to accepted connections, not the listener
+	timerScheduler.disarm(idleTimer);
 
 	//stateTimer.initializeMs(3500, list_mem).start();
 	return true;
 }
 
+bool TcpServer::canAdmit()
+{
+	if(maxConnections != 0 && connections.count() >= maxConnections) {
+		return false;
+	}
+
+	return system_get_free_heap_size() >= minHeapSize;
+}
+
+bool TcpServer::evictIdleConnection()
+{
+	// Choose the connection which has been idle longest
+	TcpConnection* oldest = nullptr;
+	for(unsigned i = 0; i < connections.count(); i++) {
+		TcpConnection* connection = connections[i];
+		if(connection == nullptr || !isIdle(*connection)) {
+			continue;
+		}
+		if(oldest == nullptr || connection->getIdleTime() > oldest->getIdleTime()) {
+			oldest = connection;
+		}
+	}
+
+	if(oldest == nullptr) {
+		return false;
+	}
+
+	debug_d("Evicting idle connection: %s", oldest->getRemoteIp().toString().c_str());
+	++stats.evicted;
+	// Connection is removed from the list and destroyed
+	oldest->close();
+	return true;
+}
+
+err_t TcpServer::onReject(tcp_pcb* clientTcp)
+{
+	tcp_abort(clientTcp);
+	return ERR_ABRT;
+}
+
 err_t TcpServer::onAccept(tcp_pcb* clientTcp, err_t err)
 {
 	// Anti DDoS :-)
-	if(system_get_free_heap_size() < minHeapSize) {
-		debug_w("\r\n\r\nCONNECTION DROPPED\r\n\t(%d)\r\n\r\n", system_get_free_heap_size());
-		return ERR_MEM;
+	if(err == ERR_OK && !canAdmit() && !(evictIdleConnection() && canAdmit())) {
+		debug_w("\r\n\r\nCONNECTION DROPPED\r\n\t(%d, %d)\r\n\r\n", system_get_free_heap_size(),
+				connections.count());
+		++stats.rejected;
+		return onReject(clientTcp);
 	}
 
 #ifdef NETWORK_DEBUG
@@ -152,11 +194,17 @@ err_t TcpServer::onAccept(tcp_pcb* clientTcp, err_t err)
 		if(clientfd == -1) {
 			delete client;
 			debug_e("SSL: Unable to initiate tcp ");
-			return ERR_ABRT;
+			return onReject(clientTcp);
 		}
 
 		debug_d("SSL: handshake start (%d ms)", millis());
-		client->ssl = ssl_server_new(sslContext, clientfd);
+		client->ssl = sslServerContext->createSession(clientfd);
+		if(client->ssl == nullptr) {
+			delete client;
+			debug_e("SSL: Unable to create session");
+			return onReject(clientTcp);
+		}
+		client->sslServerContext = sslServerContext;
 		client->useSsl = true;
 	}
 #endif
@@ -164,6 +212,7 @@ err_t TcpServer::onAccept(tcp_pcb* clientTcp, err_t err)
 	client->setDestroyedDelegate(TcpConnectionDestroyedDelegate(&TcpServer::onClientDestroy, this));
 
 	connections.add(client);
+	++stats.accepted;
 	debug_d("Opening connection. Total connections: %d", connections.count());
 
 	onClient((TcpClient*)client);
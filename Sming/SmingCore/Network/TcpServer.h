@@ -23,6 +23,12 @@ typedef Delegate<void(TcpClient* client)> TcpClientConnectDelegate;
 // By default a TCP server will wait for a new remote client connection to get established for 20 seconds
 #define TCP_SERVER_TIMEOUT 20
 
+typedef struct {
+	uint32_t accepted = 0; ///< Connections accepted
+	uint32_t rejected = 0; ///< Connections refused by admission control
+	uint32_t evicted = 0;  ///< Idle connections closed to make room for new ones
+} TcpServerStats;
+
 class TcpServer : public TcpConnection
 {
 public:
@@ -35,8 +41,35 @@ public:
 
 public:
 	virtual bool listen(int port, bool useSsl = false);
+
+	/**
+	 * @brief Set the idle timeout for accepted connections
+	 * @param seconds USHRT_MAX for no timeout
+	 */
 	void setKeepAlive(uint16_t seconds);
 
+	/**
+	 * @brief Limit the number of concurrent connections
+	 * @param count 0 for no limit
+	 */
+	void setMaxConnections(uint16_t count)
+	{
+		maxConnections = count;
+	}
+
+	/**
+	 * @brief Set the free heap below which new connections are refused
+	 */
+	void setMinHeapSize(int size)
+	{
+		minHeapSize = size;
+	}
+
+	const TcpServerStats& getStats() const
+	{
+		return stats;
+	}
+
 	void shutdown();
 
 #ifdef ENABLE_SSL
@@ -53,6 +86,15 @@ public:
 	 * @brief Adds SSL support and specifies the server certificate and private key.
 	 */
 	using TcpConnection::setSslKeyCert;
+
+	/**
+	 * @brief Get the shared SSL context, for session cache statistics
+	 * @retval SslServerContext* nullptr if not listening with SSL
+	 */
+	SslServerContext* getSslServerContext()
+	{
+		return sslServerContext;
+	}
 #endif
 
 protected:
@@ -65,14 +107,42 @@ protected:
 	virtual void onClientComplete(TcpClient& client, bool succesfull);
 	virtual void onClientDestroy(TcpConnection& connection);
 
+	/**
+	 * @brief Determine whether a connection may be closed to admit a new one
+	 * @note By default connections are never evicted
+	 */
+	virtual bool isIdle(TcpConnection& connection)
+	{
+		return false;
+	}
+
+	/**
+	 * @brief Refuse a connection which failed admission control
+	 * @retval err_t Value to return from the accept callback
+	 * @note The default resets the connection
+	 */
+	virtual err_t onReject(tcp_pcb* clientTcp);
+
 	static err_t staticAccept(void* arg, tcp_pcb* new_tcp, err_t err);
 
+	/** @brief Get milliseconds since a connection last sent or received data */
+	uint32_t getIdleTime(TcpConnection& connection)
+	{
+		return connection.getIdleTime();
+	}
+
+private:
+	bool canAdmit();
+	bool evictIdleConnection();
+
 public:
 	static int16_t totalConnections;
 	uint16_t activeClients = 0;
 
 protected:
 	int minHeapSize = 3000;
+	uint16_t maxConnections = 0;
+	TcpServerStats stats;
 
 #ifdef ENABLE_SSL
 	int sslSessionCacheSize = 50;
@@ -25,6 +25,9 @@ bool UdpConnection::initialize(udp_pcb* pcb)
 
 void UdpConnection::close()
 {
+	if(udp == nullptr) {
+		return;
+	}
 	udp_recv(udp, nullptr, nullptr);
 	udp_remove(udp);
 	udp = nullptr;
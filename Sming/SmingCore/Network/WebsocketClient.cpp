@@ -58,6 +58,9 @@ bool WebsocketClient::connect(const String& url, uint32_t sslOptions /* = 0 */)
 		return false;
 	}
 
+#ifdef ENABLE_SSL
+	httpConnection->setSslSessionCache(true);
+#endif
 	httpConnection->connect(uri.Host, uri.Port, useSsl, sslOptions);
 
 	state = eWSCS_Ready;
@@ -10,24 +10,155 @@
 SystemClass System;
 
 SystemState SystemClass::state = eSS_None;
-os_event_t SystemClass::taskQueue[TASK_QUEUE_LENGTH];
-volatile uint8_t SystemClass::taskCount;
+os_event_t SystemClass::taskQueue[2];
+volatile bool SystemClass::taskPending;
 volatile uint8_t SystemClass::maxTaskCount;
 
-/** @brief OS calls this function which invokes user-defined callback
- *  @note callback function pointer is placed in event->sig, with parameter
- *  in event->par.
+/*
+ * Tasks are queued from interrupt handlers, so the queues are guarded by raising the interrupt
+ * level and then restoring it. ets_intr_lock()/ets_intr_unlock() don't nest: unlocking would
+ * re-enable interrupts part way through a handler.
+ */
+#ifndef __STRINGIFY
+#define __STRINGIFY(a) #a
+#endif
+
+#ifndef xt_rsil
+#define xt_rsil(level)                                                                                                 \
+	(__extension__({                                                                                                   \
+		uint32_t state;                                                                                                \
+		__asm__ __volatile__("rsil %0," __STRINGIFY(level) : "=a"(state));                                             \
+		state;                                                                                                         \
+	}))
+#endif
+
+#ifndef xt_wsr_ps
+#define xt_wsr_ps(state) __asm__ __volatile__("wsr %0,ps; isync" ::"a"(state) : "memory")
+#endif
+
+namespace
+{
+/** @brief Queued task, either a callback with parameter or a delegate */
+struct Task {
+	TaskCallback callback = nullptr;
+	uint32_t param = 0;
+	TaskDelegate delegate;
+	uint32_t queueTime = 0;
+};
+
+/** @brief Fixed-size ring of tasks for one priority level
+ *  @note Callers must disable interrupts
+ */
+class TaskRing
+{
+public:
+	TaskRing(Task* tasks, uint8_t capacity) : tasks(tasks)
+	{
+		stats.capacity = capacity;
+		stats.limit = capacity;
+	}
+
+	Task* IRAM_ATTR push()
+	{
+		if(stats.count >= stats.limit) {
+			++stats.overflows;
+			return nullptr;
+		}
+		unsigned index = head + stats.count;
+		if(index >= stats.capacity) {
+			index -= stats.capacity;
+		}
+		Task* task = &tasks[index];
+		if(++stats.count > stats.maxCount) {
+			stats.maxCount = stats.count;
+		}
+		task->queueTime = system_get_time();
+		return task;
+	}
+
+	bool pop(Task& task)
+	{
+		if(stats.count == 0) {
+			return false;
+		}
+		task = std::move(tasks[head]);
+		tasks[head].delegate = nullptr;
+		if(++head == stats.capacity) {
+			head = 0;
+		}
+		--stats.count;
+
+		uint32_t latency = system_get_time() - task.queueTime;
+		++stats.runs;
+		stats.totalLatency += latency;
+		if(latency > stats.maxLatency) {
+			stats.maxLatency = latency;
+		}
+		return true;
+	}
+
+	TaskQueueStats stats = {};
+
+private:
+	Task* tasks;
+	uint8_t head = 0;
+};
+
+Task highTasks[TASK_QUEUE_LENGTH_HIGH];
+Task normalTasks[TASK_QUEUE_LENGTH];
+Task lowTasks[TASK_QUEUE_LENGTH_LOW];
+
+TaskRing taskRings[eTP_Count] = {
+	{highTasks, TASK_QUEUE_LENGTH_HIGH},
+	{normalTasks, TASK_QUEUE_LENGTH},
+	{lowTasks, TASK_QUEUE_LENGTH_LOW},
+};
+
+unsigned IRAM_ATTR totalTaskCount()
+{
+	unsigned count = 0;
+	for(auto& ring : taskRings) {
+		count += ring.stats.count;
+	}
+	return count;
+}
+
+} // namespace
+
+/** @brief OS calls this function when tasks are pending
+ *  @note Only one task is run per OS event so that system tasks get a look-in.
+ *  The OS is re-signalled whilst tasks remain.
  */
 void SystemClass::taskHandler(os_event_t* event)
 {
-	auto callback = reinterpret_cast<TaskCallback>(event->sig);
-	if(callback) {
-		// If we get interrupt during adjustment of the counter, do it again
-		uint8_t oldCount = taskCount;
-		--taskCount;
-		if(taskCount != oldCount - 1)
-			--taskCount;
-		callback(event->par);
+	Task task;
+	bool found = false;
+
+	uint32_t ps = xt_rsil(15);
+	for(auto& ring : taskRings) {
+		if(ring.pop(task)) {
+			found = true;
+			break;
+		}
+	}
+	bool more = totalTaskCount() != 0;
+	if(!more) {
+		taskPending = false;
+	}
+	xt_wsr_ps(ps);
+
+	if(more) {
+		system_os_post(USER_TASK_PRIO_1, 0, 0);
+	}
+
+	if(!found) {
+		return;
+	}
+
+	if(task.callback) {
+		task.callback(task.param);
+	} else if(task.delegate) {
+		task.delegate();
 	}
 }
 
@@ -39,20 +170,88 @@ bool SystemClass::initialize()
 	state = eSS_Intializing;
 
 	// Initialise the global task queue
-	return system_os_task(taskHandler, USER_TASK_PRIO_1, taskQueue, TASK_QUEUE_LENGTH);
+	return system_os_task(taskHandler, USER_TASK_PRIO_1, taskQueue, ARRAY_SIZE(taskQueue));
+}
+
+bool SystemClass::queueTask(TaskPriority priority, TaskCallback callback, uint32_t param, TaskDelegate* delegate)
+{
+	uint32_t ps = xt_rsil(15);
+	Task* task = taskRings[priority].push();
+	if(task != nullptr) {
+		task->callback = callback;
+		task->param = param;
+		if(delegate != nullptr) {
+			task->delegate = std::move(*delegate);
+		}
+	}
+	bool signal = (task != nullptr) && !taskPending;
+	if(signal) {
+		taskPending = true;
+	}
+	unsigned count = totalTaskCount();
+	if(count > maxTaskCount) {
+		maxTaskCount = count;
+	}
+	xt_wsr_ps(ps);
+
+	// Only the first task needs to wake the OS, it is re-signalled until the queues are empty
+	if(signal && !system_os_post(USER_TASK_PRIO_1, 0, 0)) {
+		taskPending = false;
+	}
+
+	return task != nullptr;
+}
+
+bool SystemClass::queueCallback(TaskCallback callback, uint32_t param, TaskPriority priority)
+{
+	if(callback == nullptr || priority >= eTP_Count) {
+		return false;
+	}
+
+	return queueTask(priority, callback, param, nullptr);
 }
 
-bool SystemClass::queueCallback(TaskCallback callback, uint32_t param)
+bool SystemClass::queueCallback(const TaskDelegate& callback, TaskPriority priority)
 {
-	if(callback == nullptr) {
+	if(!callback || priority >= eTP_Count) {
 		return false;
 	}
 
-	if(++taskCount > maxTaskCount) {
-		maxTaskCount = taskCount;
+	// Copy outside the lock as it may allocate
+	TaskDelegate delegate(callback);
+	return queueTask(priority, nullptr, 0, &delegate);
+}
+
+unsigned SystemClass::getTaskCount()
+{
+	uint32_t ps = xt_rsil(15);
+	unsigned count = totalTaskCount();
+	xt_wsr_ps(ps);
+	return count;
+}
+
+void SystemClass::setTaskQueueLimit(TaskPriority priority, uint8_t limit)
+{
+	if(priority >= eTP_Count) {
+		return;
 	}
 
-	return system_os_post(USER_TASK_PRIO_1, reinterpret_cast<os_signal_t>(callback), param);
+	auto& stats = taskRings[priority].stats;
+	uint32_t ps = xt_rsil(15);
+	stats.limit = (limit < stats.capacity) ? limit : stats.capacity;
+	xt_wsr_ps(ps);
+}
+
+bool SystemClass::getTaskQueueStats(TaskPriority priority, TaskQueueStats& stats)
+{
+	if(priority >= eTP_Count) {
+		return false;
+	}
+
+	uint32_t ps = xt_rsil(15);
+	stats = taskRings[priority].stats;
+	xt_wsr_ps(ps);
+	return true;
 }
 
 void SystemClass::onReady(SystemReadyDelegate readyHandler)
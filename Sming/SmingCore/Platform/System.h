@@ -22,9 +22,10 @@
 #ifndef SMINGCORE_PLATFORM_SYSTEM_H_
 #define SMINGCORE_PLATFORM_SYSTEM_H_
 
+#include <functional>
 #include "Delegate.h"
 
-/** @brief default number of tasks in global queue
+/** @brief default number of normal priority tasks in global queue
  *  @note tasks are usually short-lived and executed very promptly. If necessary this
  *  value can be overridden in makefile or user_config.h.
  */
@@ -32,13 +33,27 @@
 #define TASK_QUEUE_LENGTH 10
 #endif
 
+/// Number of high priority tasks in global queue
+#ifndef TASK_QUEUE_LENGTH_HIGH
+#define TASK_QUEUE_LENGTH_HIGH 4
+#endif
+
+/// Number of low priority tasks in global queue
+#ifndef TASK_QUEUE_LENGTH_LOW
+#define TASK_QUEUE_LENGTH_LOW 6
+#endif
+
 /** @brief Task callback function type
  * 	@ingroup event_handlers
  * 	@note Callback code does not need to be in IRAM
- *  @todo Integrate delegation into callbacks
  */
 typedef void (*TaskCallback)(uint32_t param);
 
+/** @brief Task delegate type, may capture state
+ * 	@ingroup event_handlers
+ */
+typedef std::function<void()> TaskDelegate;
+
 /// @ingroup event_handlers
 typedef Delegate<void()> SystemReadyDelegate; ///< Handler function for system ready
 
@@ -79,8 +94,28 @@ enum SystemState {
 	eSS_Intializing, ///< System initialising
 	eSS_Ready		 ///< System ready
 };
+
+/// @brief  Task priority, higher priority tasks always run first
+enum TaskPriority {
+	eTP_High,   ///< Time-critical work, e.g. network protocol handling
+	eTP_Normal, ///< Default priority
+	eTP_Low,	///< Background work, e.g. sensor processing
+	eTP_Count
+};
 /** @} */
 
+/// @brief  Statistics for one task queue priority level
+struct TaskQueueStats {
+	uint8_t count;		   ///< Tasks currently queued
+	uint8_t maxCount;	  ///< Most tasks queued at any one time
+	uint8_t limit;		   ///< Depth at which further tasks are rejected
+	uint8_t capacity;	  ///< Number of preallocated queue entries
+	uint32_t overflows;	///< Tasks rejected because the queue was full
+	uint32_t runs;		   ///< Tasks executed
+	uint32_t maxLatency;   ///< Longest time from queueing to execution, in microseconds
+	uint64_t totalLatency; ///< Sum of queueing to execution times, in microseconds
+};
+
 class SystemClass
 {
 public:
@@ -149,39 +184,61 @@ public:
 	 * @brief Queue a deferred callback.
 	 * @param callback The function to be called
 	 * @param param Parameter passed to the callback
+	 * @param priority Queue to place the callback on
 	 * @retval bool false if callback could not be queued
 	 * @note It is important to check the return value to avoid memory leaks and other issues,
 	 * for example if memory is allocated and relies on the callback to free it again.
 	 * Note also that this method is typically called from interrupt context so must avoid things
 	 * like heap allocation, etc.
 	 */
-	static bool IRAM_ATTR queueCallback(TaskCallback callback, uint32_t param = 0);
+	static bool IRAM_ATTR queueCallback(TaskCallback callback, uint32_t param = 0,
+										TaskPriority priority = eTP_Normal);
+
+	/**
+	 * @brief Queue a deferred delegate.
+	 * @param callback The delegate to be called
+	 * @param priority Queue to place the callback on
+	 * @retval bool false if callback could not be queued
+	 * @note Copying a delegate may allocate memory so do not call from interrupt context.
+	 */
+	static bool queueCallback(const TaskDelegate& callback, TaskPriority priority = eTP_Normal);
 
 	/** @brief Get number of tasks currently on queue
-	 *  @retval unsigned
+	 *  @retval unsigned Total for all priorities
 	 */
-	static unsigned getTaskCount()
-	{
-		return taskCount;
-	}
+	static unsigned getTaskCount();
 
 	/** @brief Get maximum number of tasks seen on queue at any one time
 	 *  @retval unsigned
-	 *  @note If return value is higher than maximum task queue TASK_QUEUE_LENGTH then
-	 *  the queue has overflowed at some point and tasks have been left un-executed.
+	 *  @note Check getTaskQueueStats() to find whether any tasks have been rejected.
 	 */
 	static unsigned getMaxTaskCount()
 	{
 		return maxTaskCount;
 	}
 
+	/** @brief Limit the number of tasks which may be queued at a given priority
+	 *  @param priority
+	 *  @param limit Cannot exceed the preallocated capacity for the priority
+	 */
+	static void setTaskQueueLimit(TaskPriority priority, uint8_t limit);
+
+	/** @brief Get statistics for a task queue priority level
+	 *  @param priority
+	 *  @param stats Receives the statistics
+	 *  @retval bool false if priority is invalid
+	 */
+	static bool getTaskQueueStats(TaskPriority priority, TaskQueueStats& stats);
+
 private:
 	static void taskHandler(os_event_t* event);
+	static bool IRAM_ATTR queueTask(TaskPriority priority, TaskCallback callback, uint32_t param,
+									TaskDelegate* delegate);
 
 private:
 	static SystemState state;
-	static os_event_t taskQueue[];		  ///< OS task queue
-	static volatile uint8_t taskCount;	///< Number of tasks on queue
+	static os_event_t taskQueue[];		  ///< OS task queue, only used to signal pending tasks
+	static volatile bool taskPending;	 ///< Set when the OS has been signalled
 	static volatile uint8_t maxTaskCount; ///< Profiling to establish appropriate queue size
 };
 
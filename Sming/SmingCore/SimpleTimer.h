@@ -14,6 +14,9 @@
  * short timer requirements are handled by an SimpleTimer. Still require Timer for
  * longer periods and the additional callback flexibility.
  *
+ * Millisecond timers are multiplexed over a single OS timer by the TimerScheduler,
+ * microsecond timers keep a dedicated OS timer for precision.
+ *
 */
 
 /** @defgroup   timer SimpleTimer functions
@@ -27,6 +30,8 @@ extern "C" {
 #include "esp_systemapi.h"
 }
 
+#include "TimerScheduler.h"
+
 /*
  * According to documentation maximum value of interval for ms
  * timer after doing system_timer_reinit is 268435ms.
@@ -60,8 +65,8 @@ public:
 	__forceinline void startMs(uint32_t milliseconds, bool repeating = false)
 	{
 		stop();
-		if(osTimer.timer_func)
-			ets_timer_arm_new(&osTimer, milliseconds, repeating, true);
+		if(wheelEntry.callback)
+			timerScheduler.arm(wheelEntry, milliseconds, repeating);
 	}
 
 	/** @brief  Initialise microsecond timer
@@ -82,6 +87,7 @@ public:
 	__forceinline void stop()
 	{
 		ets_timer_disarm(&osTimer);
+		timerScheduler.disarm(wheelEntry);
 	}
 
 	/** @brief  Set timer trigger function
@@ -92,10 +98,13 @@ public:
 	{
 		stop();
 		ets_timer_setfn(&osTimer, callback, arg);
+		wheelEntry.callback = callback;
+		wheelEntry.arg = arg;
 	}
 
 private:
 	os_timer_t osTimer;
+	TimerScheduler::Entry wheelEntry;
 };
 
 #endif /* _SMING_CORE_SIMPLETIMER_H_ */
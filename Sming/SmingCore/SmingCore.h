@@ -36,6 +36,7 @@
 #include "Platform/WDT.h"
 
 #include "Network/DNSServer.h"
+#include "Network/DnsResolver.h"
 #include "Network/HttpClient.h"
 #include "Network/MqttClient.h"
 #include "Network/NtpClient.h"
@@ -52,6 +53,8 @@
 #include "Network/URL.h"
 
 #include "Data/Stream/JsonObjectStream.h"
+#include "Data/Stream/JsonWriterStream.h"
+#include "Data/Json/JsonParser.h"
 #include "Data/Stream/FileStream.h"
 #include "Data/Stream/TemplateFileStream.h"
 
@@ -0,0 +1,103 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * TimerScheduler.cpp
+ *
+ ****/
+
+#include "TimerScheduler.h"
+#include "SimpleTimer.h"
+
+TimerScheduler timerScheduler;
+
+void TimerScheduler::arm(Entry& entry, uint32_t milliseconds, bool repeating)
+{
+	ETS_INTR_LOCK();
+	if(!initialised) {
+		ets_timer_setfn(&osTimer, staticOnTimer, this);
+		initialised = true;
+	}
+	uint32_t tick = getTick();
+	wheel.arm(entry, tick, milliseconds, repeating);
+	updateOsTimer(tick);
+	ETS_INTR_UNLOCK();
+}
+
+void TimerScheduler::disarm(Entry& entry)
+{
+	// The OS timer is left alone, an early wakeup just finds nothing to do
+	ETS_INTR_LOCK();
+	wheel.disarm(entry);
+	ETS_INTR_UNLOCK();
+}
+
+void TimerScheduler::staticOnTimer(void* arg)
+{
+	static_cast<TimerScheduler*>(arg)->process();
+}
+
+void TimerScheduler::process()
+{
+	ETS_INTR_LOCK();
+	++wakeupCount;
+	osTimerArmed = false;
+	uint32_t tick = getTick();
+	for(;;) {
+		Entry* entry = wheel.expire(tick);
+		if(entry == nullptr) {
+			break;
+		}
+
+		// Callbacks may arm or disarm timers, including this one
+		TimerWheelCallback callback = entry->callback;
+		void* arg = entry->arg;
+		ETS_INTR_UNLOCK();
+		if(callback != nullptr) {
+			callback(arg);
+		}
+		ETS_INTR_LOCK();
+	}
+	updateOsTimer(getTick());
+	ETS_INTR_UNLOCK();
+}
+
+uint32_t TimerScheduler::getTick()
+{
+	// system_get_time() wraps every 71 minutes, the OS timer delay is capped well below that
+	uint32_t micros = system_get_time();
+	microsRemainder += micros - lastMicros;
+	lastMicros = micros;
+	ticks += microsRemainder / 1000;
+	microsRemainder %= 1000;
+	return ticks;
+}
+
+void TimerScheduler::updateOsTimer(uint32_t tick)
+{
+	uint32_t next;
+	if(!wheel.getNextTick(next)) {
+		if(osTimerArmed) {
+			ets_timer_disarm(&osTimer);
+			osTimerArmed = false;
+		}
+		return;
+	}
+
+	if(osTimerArmed && int32_t(osTimerTick - next) <= 0) {
+		return;
+	}
+
+	int32_t delay = int32_t(next - tick);
+	if(delay < 1) {
+		delay = 1;
+	} else if(delay > MAX_OS_TIMER_INTERVAL_US / 1000) {
+		delay = MAX_OS_TIMER_INTERVAL_US / 1000;
+	}
+
+	ets_timer_arm_new(&osTimer, delay, false, true);
+	osTimerTick = tick + delay;
+	osTimerArmed = true;
+}
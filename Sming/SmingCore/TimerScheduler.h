@@ -0,0 +1,75 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * TimerScheduler.h
+ *
+ * Drives a TimerWheel from a single OS timer with millisecond ticks. The OS
+ * timer is only armed for the next deadline so an idle system is not woken
+ * every tick.
+ *
+ ****/
+
+#ifndef _SMING_CORE_TIMER_SCHEDULER_H_
+#define _SMING_CORE_TIMER_SCHEDULER_H_
+
+#include "TimerWheel.h"
+
+extern "C" {
+#include "esp_systemapi.h"
+}
+
+class TimerScheduler
+{
+public:
+	typedef TimerWheel::Entry Entry;
+
+	/** @brief Arm a millisecond timer entry
+	 *  @param entry Entry with callback set
+	 *  @param milliseconds Interval
+	 *  @param repeating true to re-arm automatically after each expiry
+	 *  @note May be called from interrupt context
+	 */
+	void IRAM_ATTR arm(Entry& entry, uint32_t milliseconds, bool repeating);
+
+	/** @brief Disarm a timer entry
+	 *  @note May be called from interrupt context
+	 */
+	void IRAM_ATTR disarm(Entry& entry);
+
+	/** @brief Number of armed timers */
+	unsigned count() const
+	{
+		return wheel.count();
+	}
+
+	/** @brief Number of times the OS timer has fired */
+	uint32_t getWakeupCount() const
+	{
+		return wakeupCount;
+	}
+
+private:
+	static void staticOnTimer(void* arg);
+	void process();
+	uint32_t IRAM_ATTR getTick();
+	void IRAM_ATTR updateOsTimer(uint32_t tick);
+
+private:
+	TimerWheel wheel;
+	os_timer_t osTimer = {};
+	uint32_t lastMicros = 0;
+	uint32_t microsRemainder = 0;
+	uint32_t ticks = 0;
+	uint32_t osTimerTick = 0; ///< Tick the OS timer is set to fire at
+	uint32_t wakeupCount = 0;
+	bool initialised = false;
+	bool osTimerArmed = false;
+};
+
+/** @brief Global scheduler for all millisecond software timers */
+extern TimerScheduler timerScheduler;
+
+#endif /* _SMING_CORE_TIMER_SCHEDULER_H_ */
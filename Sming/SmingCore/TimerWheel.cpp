@@ -0,0 +1,189 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * TimerWheel.cpp
+ *
+ ****/
+
+#include "TimerWheel.h"
+
+static_assert(TIMER_WHEEL_SLOT_BITS >= 1 && TIMER_WHEEL_SLOT_BITS <= 5, "Slot occupancy must fit in 32 bits");
+static_assert(TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS <= 30, "Wheel span must fit in 31 bits");
+
+void TimerWheel::arm(Entry& entry, uint32_t tick, uint32_t ticks, bool repeating)
+{
+	disarm(entry);
+
+	if(entryCount == 0) {
+		// Nothing depends on the current position of an empty wheel
+		now = tick;
+	} else if(int32_t(tick - now) < 0) {
+		tick = now;
+	}
+	if(ticks == 0) {
+		ticks = 1;
+	}
+
+	uint32_t expires = tick + ticks;
+#if TIMER_WHEEL_SLACK_SHIFT
+	uint32_t slack = ticks >> TIMER_WHEEL_SLACK_SHIFT;
+	if(slack != 0) {
+		// Round up to a power-of-two boundary no larger than the permitted slack
+		uint32_t granularity = 1U << (31 - __builtin_clz(slack));
+		expires = (expires + granularity - 1) & ~(granularity - 1);
+	}
+#endif
+
+	entry.expires = expires;
+	entry.period = repeating ? ticks : 0;
+	insert(entry);
+	++entryCount;
+}
+
+void TimerWheel::disarm(Entry& entry)
+{
+	if(entry.isArmed()) {
+		unlink(entry);
+		--entryCount;
+	}
+}
+
+TimerWheel::Entry* TimerWheel::expire(uint32_t tick)
+{
+	if(int32_t(tick - now) < 0) {
+		tick = now;
+	}
+
+	for(;;) {
+		Entry* entry = slots[0][now & slotMask];
+		if(entry != nullptr) {
+			unlink(*entry);
+			if(entry->period == 0) {
+				--entryCount;
+			} else {
+				entry->expires += entry->period;
+				if(int32_t(entry->expires - tick) <= 0) {
+					// Fallen behind, so skip missed periods rather than firing a burst
+					entry->expires = tick + entry->period;
+				}
+				insert(*entry);
+			}
+			return entry;
+		}
+
+		uint32_t next;
+		if(!getNextTick(next) || (next - now) > (tick - now)) {
+			now = tick;
+			return nullptr;
+		}
+
+		now = next;
+		cascade();
+	}
+}
+
+bool TimerWheel::getNextTick(uint32_t& tick) const
+{
+	if(occupied[0] & (1U << (now & slotMask))) {
+		tick = now;
+		return true;
+	}
+
+	bool found = false;
+	uint32_t minDelta = 0;
+	for(unsigned level = 0; level < levelCount; ++level) {
+		uint32_t mask = occupied[level];
+		if(mask == 0) {
+			continue;
+		}
+
+		unsigned shift = level * slotBits;
+		unsigned index = (now >> shift) & slotMask;
+
+		// Rotate so bit 0 corresponds to the slot after the current one
+		unsigned r = (index + 1) & slotMask;
+		if(r != 0) {
+			mask = ((mask >> r) | (mask << (slotCount - r))) & allSlots;
+		}
+		uint32_t offset = __builtin_ctz(mask) + 1;
+
+		uint32_t base = (now >> shift) << shift;
+		uint32_t delta = base + (offset << shift) - now;
+		if(!found || delta < minDelta) {
+			minDelta = delta;
+			found = true;
+		}
+	}
+
+	if(found) {
+		tick = now + minDelta;
+	}
+	return found;
+}
+
+void TimerWheel::insert(Entry& entry)
+{
+	const uint32_t maxDelta = (1U << (slotBits * levelCount)) - 1;
+	uint32_t expires = entry.expires;
+	uint32_t delta = expires - now;
+
+	unsigned level = 0;
+	while(level < levelCount - 1 && delta >= (1U << (slotBits * (level + 1)))) {
+		++level;
+	}
+	if(delta > maxDelta) {
+		// Park at the furthest slot, re-inserted from there with the real expiry
+		expires = now + maxDelta;
+	}
+
+	unsigned slot = (expires >> (level * slotBits)) & slotMask;
+	Entry*& head = slots[level][slot];
+	entry.level = level;
+	entry.slot = slot;
+	entry.next = head;
+	if(head != nullptr) {
+		head->pprev = &entry.next;
+	}
+	head = &entry;
+	entry.pprev = &head;
+	occupied[level] |= 1U << slot;
+}
+
+void TimerWheel::unlink(Entry& entry)
+{
+	*entry.pprev = entry.next;
+	if(entry.next != nullptr) {
+		entry.next->pprev = entry.pprev;
+	}
+	if(slots[entry.level][entry.slot] == nullptr) {
+		occupied[entry.level] &= ~(1U << entry.slot);
+	}
+	entry.next = nullptr;
+	entry.pprev = nullptr;
+}
+
+void TimerWheel::cascade()
+{
+	for(unsigned level = levelCount - 1; level > 0; --level) {
+		unsigned shift = level * slotBits;
+		if((now & ((1U << shift) - 1)) != 0) {
+			continue;
+		}
+
+		unsigned slot = (now >> shift) & slotMask;
+		Entry* entry = slots[level][slot];
+		slots[level][slot] = nullptr;
+		occupied[level] &= ~(1U << slot);
+
+		while(entry != nullptr) {
+			Entry* next = entry->next;
+			entry->next = nullptr;
+			entry->pprev = nullptr;
+			insert(*entry);
+			entry = next;
+		}
+	}
+}
@@ -0,0 +1,135 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * TimerWheel.h
+ *
+ * Hierarchical timer wheel. Entries are intrusive so arm/disarm are O(1) and
+ * never allocate. The wheel has no clock of its own: callers pass the current
+ * tick, so it can be driven by a hardware timer or by a fake clock on the host.
+ *
+ ****/
+
+/** @defgroup   timerwheel Timer wheel
+ *  @brief      Multiplexes many software timers over one hardware timer
+ *  @ingroup    timer
+ *  @{
+ */
+
+#ifndef _SMING_CORE_TIMER_WHEEL_H_
+#define _SMING_CORE_TIMER_WHEEL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __ets__
+extern "C" {
+#include "esp_systemapi.h"
+}
+#elif !defined(IRAM_ATTR)
+#define IRAM_ATTR
+#endif
+
+/*
+ * Each level has (1 << TIMER_WHEEL_SLOT_BITS) slots, at most 32 so a level's
+ * occupancy fits in one 32-bit mask. The default 4 levels of 32 slots span
+ * 2^20 ticks, longer deadlines are parked at the top level and re-inserted.
+ */
+#ifndef TIMER_WHEEL_SLOT_BITS
+#define TIMER_WHEEL_SLOT_BITS 5
+#endif
+
+#ifndef TIMER_WHEEL_LEVELS
+#define TIMER_WHEEL_LEVELS 4
+#endif
+
+/*
+ * Timers may be deferred by up to 1 / (1 << TIMER_WHEEL_SLACK_SHIFT) of their
+ * interval so that nearby deadlines coalesce onto the same tick. 0 disables.
+ */
+#ifndef TIMER_WHEEL_SLACK_SHIFT
+#define TIMER_WHEEL_SLACK_SHIFT 6
+#endif
+
+typedef void (*TimerWheelCallback)(void* arg);
+
+class TimerWheel
+{
+public:
+	struct Entry {
+		Entry* next = nullptr;
+		Entry** pprev = nullptr; ///< Points to whichever pointer references this entry
+		uint32_t expires = 0;
+		uint32_t period = 0; ///< Non-zero for repeating entries
+		TimerWheelCallback callback = nullptr;
+		void* arg = nullptr;
+		uint8_t level = 0;
+		uint8_t slot = 0;
+
+		bool isArmed() const
+		{
+			return pprev != nullptr;
+		}
+	};
+
+	/** @brief Arm an entry
+	 *  @param entry Entry to arm, disarmed first if necessary
+	 *  @param tick The current tick, must not be behind getTick()
+	 *  @param ticks Ticks from now until expiry, at least 1
+	 *  @param repeating If true the entry is re-armed every `ticks` after it fires
+	 */
+	void IRAM_ATTR arm(Entry& entry, uint32_t tick, uint32_t ticks, bool repeating);
+
+	/** @brief Disarm an entry. Has no effect if it is not armed. */
+	void IRAM_ATTR disarm(Entry& entry);
+
+	/** @brief Advance the wheel and take the next expired entry
+	 *  @param tick The current tick
+	 *  @retval Entry* An expired entry, or nullptr if there are no more up to `tick`
+	 *  @note Repeating entries are re-armed before being returned, so call until
+	 *  nullptr is returned and invoke each entry's callback in turn.
+	 */
+	Entry* expire(uint32_t tick);
+
+	/** @brief Get the tick at which the wheel next needs servicing
+	 *  @param tick On success, receives the tick
+	 *  @retval bool false if the wheel is empty
+	 *  @note This may be an internal cascade point rather than an expiry, which
+	 *  bounds how long the clock driving the wheel must run unattended.
+	 */
+	bool getNextTick(uint32_t& tick) const;
+
+	/** @brief Get the tick up to which the wheel has been processed */
+	uint32_t getTick() const
+	{
+		return now;
+	}
+
+	/** @brief Number of armed entries */
+	unsigned count() const
+	{
+		return entryCount;
+	}
+
+private:
+	static constexpr unsigned slotBits = TIMER_WHEEL_SLOT_BITS;
+	static constexpr unsigned slotCount = 1U << slotBits;
+	static constexpr unsigned slotMask = slotCount - 1;
+	static constexpr uint32_t allSlots = uint32_t((uint64_t(1) << slotCount) - 1);
+	static constexpr unsigned levelCount = TIMER_WHEEL_LEVELS;
+
+	void IRAM_ATTR insert(Entry& entry);
+	void IRAM_ATTR unlink(Entry& entry);
+	void cascade();
+
+	Entry* slots[levelCount][slotCount] = {};
+	uint32_t occupied[levelCount] = {}; ///< Bit set for each non-empty slot
+	uint32_t now = 0;
+	unsigned entryCount = 0;
+};
+
+/** @} */
+
+#endif /* _SMING_CORE_TIMER_WHEEL_H_ */
@@ -7,6 +7,7 @@
 #include <c_types.h>
 #include "umm_malloc_cfg.h"
 #include "umm_malloc.h"
+#include "heap_pool.h"
 
 #define IRAM_ATTR __attribute__((section(".iram.text")))
 
@@ -39,7 +40,11 @@ void* IRAM_ATTR pvPortZallocIram(size_t size, const char* file, int line) __attr
 
 size_t xPortGetFreeHeapSize(void)
 {
+#if ENABLE_HEAP_POOL
+    return umm_free_heap_size() + heap_pool_free_size();
+#else
     return umm_free_heap_size();
+#endif
 }
 
 size_t IRAM_ATTR xPortWantedSizeAlign(size_t size)
@@ -50,4 +55,7 @@ size_t IRAM_ATTR xPortWantedSizeAlign(size_t size)
 void system_show_malloc(void)
 {
     umm_info(NULL, 1);
+#if ENABLE_HEAP_POOL
+    heap_pool_info();
+#endif
 }
@@ -0,0 +1,277 @@
+/* heap_pool.c - segregated-fit small object pools in front of umm_malloc
+ * This file is distributed under MIT license.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <c_types.h>
+#include "umm_malloc_cfg.h"
+#include "heap_pool.h"
+
+#if ENABLE_HEAP_POOL
+
+#define IRAM_ATTR __attribute__((section(".iram.text")))
+
+/*
+ * The application is linked with -wrap for malloc(), free(), realloc() and calloc()
+ * (see Makefile-project.mk), so every call from C, C++ new and the SDK lands in the
+ * __wrap_xxx() functions below and __real_xxx() reaches umm_malloc.
+ */
+void* __real_malloc(size_t size);
+void __real_free(void* ptr);
+void* __real_realloc(void* ptr, size_t size);
+void* __real_calloc(size_t count, size_t size);
+
+#if HEAP_POOL_TRACE
+#define HEAP_TRACE(fmt, ...) ets_printf("heap " fmt "\n", ##__VA_ARGS__)
+#else
+#define HEAP_TRACE(fmt, ...)
+#endif
+
+typedef struct heap_pool_block_t {
+    struct heap_pool_block_t* next;
+} heap_pool_block_t;
+
+typedef struct {
+    uint8_t* start;
+    uint8_t* end;
+    heap_pool_block_t* freeList;
+    heap_pool_stats_t stats;
+} heap_pool_t;
+
+#define XX(size, count) {NULL, NULL, NULL, {size, count, 0, 0, 0, 0}},
+static heap_pool_t pools[] = {HEAP_POOL_CLASSES(XX)};
+#undef XX
+
+#define POOL_COUNT (sizeof(pools) / sizeof(pools[0]))
+#define POOL_MAX_SIZE (pools[POOL_COUNT - 1].stats.blockSize)
+
+static uint8_t* poolStart;
+static uint8_t* poolEnd;
+static bool poolInitFailed;
+
+/*
+ * All classes share one contiguous region taken from the main heap on first use.
+ * Called with interrupts locked.
+ */
+static bool IRAM_ATTR heap_pool_init(void)
+{
+    if(poolStart != NULL) {
+        return true;
+    }
+    if(poolInitFailed) {
+        return false;
+    }
+
+    size_t total = 0;
+    for(unsigned i = 0; i < POOL_COUNT; ++i) {
+        total += pools[i].stats.blockSize * pools[i].stats.blockCount;
+    }
+
+    poolStart = (uint8_t*)__real_malloc(total);
+    if(poolStart == NULL) {
+        poolInitFailed = true;
+        return false;
+    }
+    poolEnd = poolStart + total;
+
+    uint8_t* p = poolStart;
+    for(unsigned i = 0; i < POOL_COUNT; ++i) {
+        heap_pool_t* pool = &pools[i];
+        pool->start = p;
+        pool->freeList = NULL;
+        // Thread blocks in reverse so the lowest addresses are handed out first
+        for(unsigned n = pool->stats.blockCount; n != 0; --n) {
+            heap_pool_block_t* block = (heap_pool_block_t*)(p + (n - 1) * pool->stats.blockSize);
+            block->next = pool->freeList;
+            pool->freeList = block;
+        }
+        p += pool->stats.blockSize * pool->stats.blockCount;
+        pool->end = p;
+    }
+
+    return true;
+}
+
+static heap_pool_t* IRAM_ATTR heap_pool_find(const void* ptr)
+{
+    if((const uint8_t*)ptr < poolStart || (const uint8_t*)ptr >= poolEnd) {
+        return NULL;
+    }
+
+    for(unsigned i = 0; i < POOL_COUNT; ++i) {
+        if((const uint8_t*)ptr < pools[i].end) {
+            return &pools[i];
+        }
+    }
+
+    return NULL;
+}
+
+void* IRAM_ATTR heap_pool_malloc(size_t size)
+{
+    if(size == 0 || size > POOL_MAX_SIZE) {
+        return __real_malloc(size);
+    }
+
+    void* ptr = NULL;
+    UMM_CRITICAL_ENTRY();
+    if(heap_pool_init()) {
+        for(unsigned i = 0; i < POOL_COUNT; ++i) {
+            heap_pool_t* pool = &pools[i];
+            if(size > pool->stats.blockSize) {
+                continue;
+            }
+            heap_pool_block_t* block = pool->freeList;
+            if(block == NULL) {
+                ++pool->stats.overflows;
+            } else {
+                pool->freeList = block->next;
+                ++pool->stats.allocs;
+                if(++pool->stats.used > pool->stats.peak) {
+                    pool->stats.peak = pool->stats.used;
+                }
+                ptr = block;
+            }
+            break;
+        }
+    }
+    UMM_CRITICAL_EXIT();
+
+    return ptr ? ptr : __real_malloc(size);
+}
+
+void IRAM_ATTR heap_pool_free(void* ptr)
+{
+    heap_pool_t* pool = heap_pool_find(ptr);
+    if(pool == NULL) {
+        __real_free(ptr);
+        return;
+    }
+
+    UMM_CRITICAL_ENTRY();
+    heap_pool_block_t* block = (heap_pool_block_t*)ptr;
+    block->next = pool->freeList;
+    pool->freeList = block;
+    --pool->stats.used;
+    UMM_CRITICAL_EXIT();
+}
+
+void* IRAM_ATTR heap_pool_realloc(void* ptr, size_t size)
+{
+    if(ptr == NULL) {
+        return heap_pool_malloc(size);
+    }
+
+    heap_pool_t* pool = heap_pool_find(ptr);
+    if(pool == NULL) {
+        return __real_realloc(ptr, size);
+    }
+
+    if(size == 0) {
+        heap_pool_free(ptr);
+        return NULL;
+    }
+
+    if(size <= pool->stats.blockSize) {
+        return ptr;
+    }
+
+    void* newPtr = heap_pool_malloc(size);
+    if(newPtr != NULL) {
+        memcpy(newPtr, ptr, pool->stats.blockSize);
+        heap_pool_free(ptr);
+    }
+    return newPtr;
+}
+
+void* IRAM_ATTR __wrap_malloc(size_t size)
+{
+    void* ptr = heap_pool_malloc(size);
+    if(ptr != NULL) {
+        HEAP_TRACE("a %x %u", (uint32_t)ptr, size);
+    }
+    return ptr;
+}
+
+void IRAM_ATTR __wrap_free(void* ptr)
+{
+    if(ptr != NULL) {
+        HEAP_TRACE("f %x", (uint32_t)ptr);
+    }
+    heap_pool_free(ptr);
+}
+
+void* IRAM_ATTR __wrap_realloc(void* ptr, size_t size)
+{
+    void* newPtr = heap_pool_realloc(ptr, size);
+    if(ptr == NULL) {
+        if(newPtr != NULL) {
+            HEAP_TRACE("a %x %u", (uint32_t)newPtr, size);
+        }
+    } else if(size == 0) {
+        HEAP_TRACE("f %x", (uint32_t)ptr);
+    } else if(newPtr != NULL) {
+        HEAP_TRACE("r %x %u %x", (uint32_t)ptr, size, (uint32_t)newPtr);
+    }
+    return newPtr;
+}
+
+void* IRAM_ATTR __wrap_calloc(size_t count, size_t size)
+{
+    size_t total = count * size;
+    void* ptr;
+    if(total > POOL_MAX_SIZE) {
+        ptr = __real_calloc(count, size);
+    } else {
+        ptr = heap_pool_malloc(total);
+        if(ptr != NULL) {
+            memset(ptr, 0, total);
+        }
+    }
+    if(ptr != NULL) {
+        HEAP_TRACE("a %x %u", (uint32_t)ptr, total);
+    }
+    return ptr;
+}
+
+unsigned heap_pool_class_count(void)
+{
+    return POOL_COUNT;
+}
+
+bool heap_pool_get_stats(unsigned index, heap_pool_stats_t* stats)
+{
+    if(index >= POOL_COUNT || stats == NULL) {
+        return false;
+    }
+
+    UMM_CRITICAL_ENTRY();
+    *stats = pools[index].stats;
+    UMM_CRITICAL_EXIT();
+    return true;
+}
+
+size_t heap_pool_free_size(void)
+{
+    size_t size = 0;
+    if(poolStart != NULL) {
+        for(unsigned i = 0; i < POOL_COUNT; ++i) {
+            const heap_pool_stats_t* stats = &pools[i].stats;
+            size += (stats->blockCount - stats->used) * stats->blockSize;
+        }
+    }
+    return size;
+}
+
+void heap_pool_info(void)
+{
+    for(unsigned i = 0; i < POOL_COUNT; ++i) {
+        heap_pool_stats_t stats;
+        heap_pool_get_stats(i, &stats);
+        ets_printf("pool[%u] size %u: used %u/%u, peak %u, allocs %u, overflows %u\n", i, stats.blockSize,
+                   stats.used, stats.blockCount, stats.peak, stats.allocs, stats.overflows);
+    }
+}
+
+#endif /* ENABLE_HEAP_POOL */
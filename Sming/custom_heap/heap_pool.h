@@ -0,0 +1,93 @@
+/* heap_pool.h - segregated-fit small object pools in front of umm_malloc
+ *
+ * Small allocations (Strings, delegates, MQTT messages, pbuf wrappers) are
+ * served from fixed size-class pools. Each pool is a single contiguous
+ * region carved from the main heap on first use, so pool blocks never
+ * fragment the umm_malloc block list. Requests larger than the biggest class,
+ * or arriving when a class is exhausted, fall back to the main heap.
+ *
+ * Pools are off by default, as they reserve their memory for good once used.
+ * Build both Sming and the application with ENABLE_CUSTOM_HEAP=1 ENABLE_HEAP_POOL=1;
+ * the application is then linked so that all malloc(), free(), realloc() and
+ * calloc() calls, including those from operator new and the SDK, go through
+ * the pools.
+ *
+ * This file is distributed under MIT license.
+ */
+
+#ifndef _HEAP_POOL_H_
+#define _HEAP_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef ENABLE_HEAP_POOL
+#define ENABLE_HEAP_POOL 0
+#endif
+
+/*
+ * Set to 1 to print every heap call on the debug UART, one per line, as
+ * "heap a <ptr> <size>", "heap r <ptr> <size> <new ptr>" and "heap f <ptr>".
+ * The captured log can be replayed with tools/heapbench. This is slow, so only
+ * for recording traces, e.g.
+ *
+ *   make ENABLE_CUSTOM_HEAP=1 ENABLE_HEAP_POOL=1 HEAP_POOL_TRACE=1
+ */
+#ifndef HEAP_POOL_TRACE
+#define HEAP_POOL_TRACE 0
+#endif
+
+/*
+ * Size classes as XX(blockSize, blockCount) entries, smallest first.
+ * Block sizes must be multiples of 4. To override, define this macro in CFLAGS
+ * when building the Sming library, e.g.
+ *
+ *   make ENABLE_CUSTOM_HEAP=1 HEAP_POOL_CLASSES="XX(16,32) XX(32,32)"
+ */
+#ifndef HEAP_POOL_CLASSES
+#define HEAP_POOL_CLASSES(XX) \
+    XX(16, 64) \
+    XX(32, 48) \
+    XX(48, 24) \
+    XX(64, 16)
+#endif
+
+typedef struct {
+    uint16_t blockSize;  ///< Size of each block in this class
+    uint16_t blockCount; ///< Number of blocks in this class
+    uint16_t used;       ///< Blocks currently allocated
+    uint16_t peak;       ///< Highest value of `used` since boot
+    uint32_t allocs;     ///< Successful allocations from this class
+    uint32_t overflows;  ///< Requests passed to the main heap because the class was full
+} heap_pool_stats_t;
+
+/** @brief Get number of configured size classes */
+unsigned heap_pool_class_count(void);
+
+/** @brief Get statistics for a size class
+ *  @param index Class index, 0 .. heap_pool_class_count() - 1
+ *  @param stats Receives the statistics
+ *  @retval bool false if index is out of range
+ */
+bool heap_pool_get_stats(unsigned index, heap_pool_stats_t* stats);
+
+/** @brief Number of bytes held by unused pool blocks */
+size_t heap_pool_free_size(void);
+
+void* heap_pool_malloc(size_t size);
+void heap_pool_free(void* ptr);
+void* heap_pool_realloc(void* ptr, size_t size);
+
+/** @brief Print pool usage via ets_printf */
+void heap_pool_info(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HEAP_POOL_H_ */
@@ -19,7 +19,8 @@
 extern char _flash_code_end[];
 
 /*
- * To ensure memory alignment a temporary buffer is used by flashmem_read and flashmem_write functions.
+ * To ensure memory alignment a temporary buffer is used by the read and write functions for any data
+ * which can't be transferred directly.
  *
  * The buffer must be an integer multiple of INTERNAL_FLASH_WRITE_UNIT_SIZE.
  */
@@ -27,7 +28,7 @@ extern char _flash_code_end[];
 
 /** @brief determines if the given value is aligned to a word (4-byte) boundary */
 #undef IS_ALIGNED
-#define IS_ALIGNED(x) (((uint32_t)(x)&0x00000003) == 0)
+#define IS_ALIGNED(x) (((uintptr_t)(x)&0x00000003) == 0)
 
 // Buffers need to be word aligned for flash access
 #define __aligned __attribute__((aligned(4)))
@@ -38,76 +39,183 @@ static inline uint32_t min(uint32_t a, uint32_t b)
 	return (a < b) ? a : b;
 }
 
-uint32_t flashmem_write(const void* from, uint32_t toaddr, uint32_t size)
+// Flash statistics, updated by the internal read/write functions
+static FlashMemStats stats;
+
+/*
+ * Tracks progress through a run of regions which follow on from each other in flash
+ */
+typedef struct {
+	const FlashIoVec* vec;
+	unsigned count;
+	unsigned index;  // Current region
+	uint32_t offset; // Position within current region
+} IoCursor;
+
+typedef enum {
+	eIoc_Measure, ///< Just advance the cursor
+	eIoc_Gather,  ///< Copy from regions into the buffer
+	eIoc_Scatter, ///< Copy from the buffer into regions
+} IoCopyMode;
+
+// Skip past exhausted regions, returns false at the end of the run
+static bool cursor_valid(IoCursor* cur)
 {
-	if(IS_ALIGNED(from) && IS_ALIGNED(toaddr) && IS_ALIGNED(size))
-		return flashmem_write_internal(from, toaddr, size);
+	while(cur->index < cur->count && cur->offset == cur->vec[cur->index].size)
+	{
+		++cur->index;
+		cur->offset = 0;
+	}
+	return cur->index < cur->count;
+}
 
-	const uint32_t blksize = INTERNAL_FLASH_WRITE_UNIT_SIZE;
+static inline uint8_t* cursor_ptr(const IoCursor* cur)
+{
+	return (uint8_t*)cur->vec[cur->index].buffer + cur->offset;
+}
+
+static inline uint32_t cursor_avail(const IoCursor* cur)
+{
+	return cur->vec[cur->index].size - cur->offset;
+}
+
+/*
+ * Number of bytes at the cursor which can go straight between flash and RAM, 0 if they should be bounced.
+ * Short spans are only worth a separate operation if nothing follows them.
+ */
+static uint32_t direct_length(const IoCursor* cur, uint32_t addr, uint32_t bufsize)
+{
 	const uint32_t blkmask = INTERNAL_FLASH_WRITE_UNIT_SIZE - 1;
+	uint32_t avail = cursor_avail(cur);
+	if(!IS_ALIGNED(addr) || !IS_ALIGNED(cursor_ptr(cur)) || avail <= blkmask)
+		return 0;
+	uint32_t len = avail & ~blkmask;
+	bool last = (cur->index + 1 == cur->count) && (len == avail);
+	return (last || len >= bufsize) ? len : 0;
+}
 
-	__aligned char tmpdata[FLASH_BUFFERS * INTERNAL_FLASH_WRITE_UNIT_SIZE];
-	const uint8_t* pfrom = (const uint8_t*)from;
-	uint32_t remain = size;
+/*
+ * Move data between the bounce buffer and the regions, starting at buffer offset 'pos' which corresponds
+ * to flash address 'base + pos'. Stops when the buffer is full or where a span should be transferred directly.
+ * Returns the buffer offset reached.
+ */
+static uint32_t bounce_copy(IoCursor* cur, uint8_t* tmpdata, uint32_t bufsize, uint32_t base, uint32_t pos, IoCopyMode mode)
+{
+	uint32_t start = pos;
+	while(pos < bufsize && cursor_valid(cur))
+	{
+		if(pos != start && direct_length(cur, base + pos, bufsize) != 0)
+			break;
+		uint32_t len = min(cursor_avail(cur), bufsize - pos);
+		if(mode == eIoc_Gather)
+			memcpy(&tmpdata[pos], cursor_ptr(cur), len);
+		else if(mode == eIoc_Scatter)
+			memcpy(cursor_ptr(cur), &tmpdata[pos], len);
+		pos += len;
+		cur->offset += len;
+	}
+	return pos;
+}
 
-	// Align the start
-	if(toaddr & blkmask)
+/*
+ * Transfer a run of regions which occupy a single contiguous area of flash.
+ * Aligned spans go directly to/from the caller's buffers, everything else through tmpdata in as few
+ * operations as possible. For writes, the partial words at either end of a bounced block are padded
+ * with 0xFF, which leaves the existing flash content unchanged so no read-modify-write is needed.
+ */
+static uint32_t transfer_run(const FlashIoVec* vec, unsigned count, bool write)
+{
+	const uint32_t blkmask = INTERNAL_FLASH_WRITE_UNIT_SIZE - 1;
+
+	__aligned uint8_t tmpdata[FLASH_BUFFERS * INTERNAL_FLASH_WRITE_UNIT_SIZE];
+	IoCursor cur = {vec, count, 0, 0};
+	uint32_t start = vec[0].addr;
+	uint32_t addr = start;
+
+	while(cursor_valid(&cur))
 	{
-		uint32_t rest = toaddr & blkmask;
-		uint32_t addr_aligned = toaddr & ~blkmask; // this is the actual aligned address
+		uint32_t len = direct_length(&cur, addr, sizeof(tmpdata));
+		if(len != 0)
+		{
+			void* ptr = cursor_ptr(&cur);
+			uint32_t done = write ? flashmem_write_internal(ptr, addr, len) : flashmem_read_internal(ptr, addr, len);
+			if(done != len)
+				break;
+			addr += len;
+			cur.offset += len;
+			continue;
+		}
 
-		// Read existing unit and overlay with new data
-		if(flashmem_read_internal(tmpdata, addr_aligned, blksize) != blksize)
-			return 0;
-		while(remain && rest < blksize)
+		uint32_t base = addr & ~blkmask;
+		uint32_t head = addr - base;
+		uint32_t pos;
+		if(write)
+		{
+			memset(tmpdata, 0xFF, head);
+			pos = bounce_copy(&cur, tmpdata, sizeof(tmpdata), base, head, eIoc_Gather);
+			len = (pos + blkmask) & ~blkmask;
+			memset(&tmpdata[pos], 0xFF, len - pos);
+			if(flashmem_write_internal(tmpdata, base, len) != len)
+				break;
+		}
+		else
 		{
-			tmpdata[rest++] = *pfrom++;
-			--remain;
+			// Find out how much to read before scattering it
+			IoCursor probe = cur;
+			pos = bounce_copy(&probe, tmpdata, sizeof(tmpdata), base, head, eIoc_Measure);
+			len = (pos + blkmask) & ~blkmask;
+			if(flashmem_read_internal(tmpdata, base, len) != len)
+				break;
+			bounce_copy(&cur, tmpdata, sizeof(tmpdata), base, head, eIoc_Scatter);
 		}
+		stats.bounce_bytes += pos - head;
+		addr = base + pos;
+	}
 
-		// Write the unit
-		uint32_t written = flashmem_write_internal(tmpdata, addr_aligned, blksize);
-		if(written != blksize)
-			return written;
+	return addr - start;
+}
 
-		if (remain == 0)
-			return size;
+// Split the list into runs of adjacent regions and transfer each one
+static uint32_t transfer_vec(const FlashIoVec* vec, unsigned count, bool write)
+{
+	uint32_t total = 0;
+	unsigned i = 0;
+	while(i < count)
+	{
+		uint32_t size = vec[i].size;
+		unsigned n = 1;
+		while(i + n < count && vec[i + n].addr == vec[i + n - 1].addr + vec[i + n - 1].size)
+		{
+			size += vec[i + n].size;
+			++n;
+		}
 
-		toaddr = addr_aligned + blksize;
+		uint32_t done = transfer_run(&vec[i], n, write);
+		total += done;
+		if(done != size)
+			break;
+		i += n;
 	}
+	return total;
+}
 
-	// The start address is now a multiple of blksize
-	// Compute how many bytes we can write as multiples of blksize
-	uint32_t rest = remain & blkmask;
-	remain &= ~blkmask;
-	// Program the blocks now
-	while(remain)
-	{
-		unsigned count = min(remain, sizeof(tmpdata));
-		memcpy(tmpdata, pfrom, count);
-		uint32_t written = flashmem_write_internal(tmpdata, toaddr, count);
-		remain -= written;
-		if(written != count)
-			return size - remain;
-		toaddr += count;
-		pfrom += count;
-	}
+uint32_t flashmem_writev(const FlashIoVec* vec, unsigned count)
+{
+	return transfer_vec(vec, count, true);
+}
 
-	// And the final part of a block if needed
-	if(rest)
-	{
-		if(flashmem_read_internal(tmpdata, toaddr, blksize) != blksize)
-			return size - remain;
-		unsigned i;
-		for(i = 0; i < rest; ++i)
-			tmpdata[i] = *pfrom++;
-		uint32_t written = flashmem_write_internal(tmpdata, toaddr, blksize);
-		remain -= written;
-		if(written != blksize)
-			return size - remain;
-	}
+uint32_t flashmem_readv(const FlashIoVec* vec, unsigned count)
+{
+	return transfer_vec(vec, count, false);
+}
 
-	return size;
+uint32_t flashmem_write(const void* from, uint32_t toaddr, uint32_t size)
+{
+	if(IS_ALIGNED(from) && IS_ALIGNED(toaddr) && IS_ALIGNED(size))
+		return flashmem_write_internal(from, toaddr, size);
+
+	FlashIoVec vec = {toaddr, (void*)from, size};
+	return transfer_run(&vec, 1, true);
 }
 
 uint32_t flashmem_read(void* to, uint32_t fromaddr, uint32_t size)
@@ -115,64 +223,24 @@ uint32_t flashmem_read(void* to, uint32_t fromaddr, uint32_t size)
 	if(IS_ALIGNED(to) && IS_ALIGNED(fromaddr) && IS_ALIGNED(size))
 		return flashmem_read_internal(to, fromaddr, size);
 
-	const uint32_t blksize = INTERNAL_FLASH_READ_UNIT_SIZE;
-	const uint32_t blkmask = INTERNAL_FLASH_READ_UNIT_SIZE - 1;
-
-	__aligned char tmpdata[FLASH_BUFFERS * INTERNAL_FLASH_READ_UNIT_SIZE];
-	uint8_t* pto = (uint8_t*)to;
-	uint32_t remain = size;
-
-	// Align the start
-	if(fromaddr & blkmask)
-	{
-		uint32_t rest = fromaddr & blkmask;
-		uint32_t addr_aligned = fromaddr & ~blkmask; // this is the actual aligned address
-		if (flashmem_read_internal(tmpdata, addr_aligned, blksize) != blksize)
-			return 0;
-		// memcpy(pto, &tmpdata[rest], std::min(blksize - rest, remain))
-		while(remain && rest < blksize)
-		{
-			*pto++ = tmpdata[rest++];
-			--remain;
-		}
-		if (remain == 0)
-			return size;
-		fromaddr = addr_aligned + blksize;
-	}
-
-	// The start address is now a multiple of blksize
-	// Compute how many bytes we can read as multiples of blksize
-	uint32_t rest = remain & blkmask;
-	remain &= ~blkmask;
-	// Read the blocks now
-	while(remain)
-	{
-		unsigned count = min(remain, sizeof(tmpdata));
-		uint32_t read = flashmem_read_internal(tmpdata, fromaddr, count);
-		memcpy(pto, tmpdata, read);
-		remain -= read;
-		if(read != count)
-			return size - remain;
-		fromaddr += count;
-		pto += count;
-	}
+	FlashIoVec vec = {fromaddr, to, size};
+	return transfer_run(&vec, 1, false);
+}
 
-	// And the final part of a block if needed
-	if(rest)
-	{
-		if(flashmem_read_internal(tmpdata, fromaddr, blksize) != blksize)
-			return size - remain;
-		unsigned i;
-		for(i = 0; i < rest; ++i)
-			*pto++ = tmpdata[i];
-	}
+void flashmem_get_stats(FlashMemStats* info)
+{
+	*info = stats;
+}
 
-	return size;
+void flashmem_reset_stats()
+{
+	memset(&stats, 0, sizeof(stats));
 }
 
 bool flashmem_erase_sector(uint32_t sector_id)
 {
 	WDT_FEED();
+	++stats.erase_ops;
 	return spi_flash_erase_sector(sector_id) == SPI_FLASH_RESULT_OK;
 }
 
@@ -251,10 +319,12 @@ uint32_t flashmem_write_internal( const void *from, uint32_t toaddr, uint32_t si
 
   WDT_FEED();
 
+  ++stats.write_ops;
   SpiFlashOpResult r = spi_flash_write(toaddr, (uint32*)from, size);
-  if(SPI_FLASH_RESULT_OK == r)
+  if(SPI_FLASH_RESULT_OK == r) {
+    stats.write_bytes += size;
     return size;
-  else{
+  } else {
 	SYSTEM_ERROR( "ERROR in flash_write: r=%d at %08X\n", ( int )r, ( unsigned )toaddr );
     return 0;
   }
@@ -266,10 +336,12 @@ uint32_t flashmem_read_internal( void *to, uint32_t fromaddr, uint32_t size )
 
   WDT_FEED();
 
+  ++stats.read_ops;
   SpiFlashOpResult r = spi_flash_read(fromaddr, (uint32*)to, size);
-  if(SPI_FLASH_RESULT_OK == r)
+  if(SPI_FLASH_RESULT_OK == r) {
+    stats.read_bytes += size;
     return size;
-  else{
+  } else {
 	SYSTEM_ERROR( "ERROR in flash_read: r=%d at %08X\n", ( int )r, ( unsigned )fromaddr );
     return 0;
   }
@@ -277,7 +349,8 @@ uint32_t flashmem_read_internal( void *to, uint32_t fromaddr, uint32_t size )
 
 uint32_t flashmem_get_first_free_block_address()
 {
-  if(_flash_code_end == NULL)
+  // An undefined weak symbol would have address 0
+  if((uintptr_t)_flash_code_end == 0)
   {
 	  debugf("_flash_code_end is null");
 	  return 0;
@@ -285,6 +358,6 @@ uint32_t flashmem_get_first_free_block_address()
 
   // Round the total used flash size to the closest flash block address
   uint32_t end;
-  flashmem_find_sector( ( uint32_t )_flash_code_end - INTERNAL_FLASH_START_ADDRESS - 1, NULL, &end);
+  flashmem_find_sector(flashmem_get_address(_flash_code_end) - 1, NULL, &end);
   return end + 1;
 }
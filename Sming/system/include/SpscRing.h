@@ -0,0 +1,272 @@
+/****
+ * Sming Framework Project - Open Source framework for high efficiency native ESP8266 development.
+ * Created 2015 by Skurydin Alexey
+ * http://github.com/SmingHub/Sming
+ * All files of the Sming Core are provided under the LGPL v3 license.
+ *
+ * SpscRing.h
+ *
+ * Lock-free ring buffer for handing data from one producer to one consumer,
+ * typically an interrupt handler and the main task. Neither side needs to
+ * disable interrupts: each index is only written by its owner, and stores are
+ * ordered so the other side never sees an index before the data it covers.
+ *
+ * Indices run freely and are masked on access, so capacity must be a power of
+ * two and every slot is usable.
+ *
+ ****/
+
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __ets__
+extern "C" {
+#include "esp_systemapi.h"
+}
+#elif !defined(__forceinline)
+#define __forceinline __attribute__((always_inline)) inline
+#endif
+
+/** @brief Ring operating on external storage
+ *  @note Producer methods must only be called from one context, consumer methods
+ *  from one other. Only methods marked __forceinline may be used from an ISR.
+ *  Items are copied with memcpy so T must be trivially copyable.
+ */
+template <typename T> class SpscRingBase
+{
+public:
+	/** @brief Total number of items the ring can hold */
+	__forceinline size_t getSize() const
+	{
+		return buffer ? mask + 1 : 0;
+	}
+
+	/** @brief Number of items waiting to be read */
+	__forceinline size_t available() const
+	{
+		return __atomic_load_n(&head, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail, __ATOMIC_ACQUIRE);
+	}
+
+	__forceinline size_t getFreeSpace() const
+	{
+		return getSize() - available();
+	}
+
+	__forceinline bool isEmpty() const
+	{
+		return available() == 0;
+	}
+
+	/** @brief Number of items rejected by the producer because the ring was full */
+	uint32_t getOverflowCount() const
+	{
+		return overflows;
+	}
+
+	/* Producer */
+
+	__forceinline bool push(const T& item)
+	{
+		uint32_t h = head;
+		if(h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) > mask || buffer == nullptr) {
+			++overflows;
+			return false;
+		}
+		buffer[h & mask] = item;
+		__atomic_store_n(&head, h + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/** @brief Add as many items as will fit
+	 *  @retval size_t Number of items added, items which did not fit are counted as overflows
+	 */
+	__forceinline size_t push(const T* items, size_t count)
+	{
+		size_t written = 0;
+		while(written < count) {
+			size_t span;
+			T* dst = getWriteSpan(span);
+			if(span == 0) {
+				break;
+			}
+			if(span > count - written) {
+				span = count - written;
+			}
+			memcpy(dst, &items[written], span * sizeof(T));
+			commitWrite(span);
+			written += span;
+		}
+		overflows += count - written;
+		return written;
+	}
+
+	/** @brief Get the contiguous free region following the write position
+	 *  @param count On return, number of items which may be written
+	 *  @retval T* Start of region
+	 *  @note Fill the region directly then call commitWrite(). At most two calls
+	 *  are needed to fill all the free space.
+	 */
+	__forceinline T* getWriteSpan(size_t& count)
+	{
+		uint32_t h = head;
+		size_t space = getSize() - (h - __atomic_load_n(&tail, __ATOMIC_ACQUIRE));
+		size_t offset = h & mask;
+		size_t toEnd = mask + 1 - offset;
+		count = (space < toEnd) ? space : toEnd;
+		return &buffer[offset];
+	}
+
+	/** @brief Publish items written into a span obtained from getWriteSpan() */
+	__forceinline void commitWrite(size_t count)
+	{
+		__atomic_store_n(&head, head + count, __ATOMIC_RELEASE);
+	}
+
+	/** @brief Get the most recently written item
+	 *  @note Producer side only
+	 */
+	__forceinline const T* peekLast() const
+	{
+		return (head == __atomic_load_n(&tail, __ATOMIC_ACQUIRE)) ? nullptr : &buffer[(head - 1) & mask];
+	}
+
+	/* Consumer */
+
+	__forceinline bool pop(T& item)
+	{
+		uint32_t t = tail;
+		if(__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t) {
+			return false;
+		}
+		item = buffer[t & mask];
+		__atomic_store_n(&tail, t + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	/** @brief Remove up to `count` items
+	 *  @retval size_t Number of items copied
+	 */
+	__forceinline size_t pop(T* items, size_t count)
+	{
+		size_t read = 0;
+		while(read < count) {
+			size_t span;
+			const T* src = getReadSpan(span);
+			if(span == 0) {
+				break;
+			}
+			if(span > count - read) {
+				span = count - read;
+			}
+			memcpy(&items[read], src, span * sizeof(T));
+			commitRead(span);
+			read += span;
+		}
+		return read;
+	}
+
+	/** @brief Get the oldest item without removing it
+	 *  @retval const T* nullptr if the ring is empty
+	 */
+	__forceinline const T* peek() const
+	{
+		uint32_t t = tail;
+		return (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == t) ? nullptr : &buffer[t & mask];
+	}
+
+	/** @brief Get the contiguous filled region at the read position
+	 *  @param count On return, number of items available in the region
+	 *  @note Call commitRead() once the items have been consumed
+	 */
+	__forceinline const T* getReadSpan(size_t& count) const
+	{
+		uint32_t t = tail;
+		size_t avail = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - t;
+		size_t offset = t & mask;
+		size_t toEnd = mask + 1 - offset;
+		count = (avail < toEnd) ? avail : toEnd;
+		return &buffer[offset];
+	}
+
+	/** @brief Release items obtained from getReadSpan() */
+	__forceinline void commitRead(size_t count)
+	{
+		__atomic_store_n(&tail, tail + count, __ATOMIC_RELEASE);
+	}
+
+	/** @brief Find the first occurrence of an item
+	 *  @retval int Offset from read position, -1 if not found
+	 */
+	int find(const T& item) const
+	{
+		uint32_t t = tail;
+		size_t avail = __atomic_load_n(&head, __ATOMIC_ACQUIRE) - t;
+		for(size_t i = 0; i < avail; ++i) {
+			if(buffer[(t + i) & mask] == item) {
+				return i;
+			}
+		}
+		return -1;
+	}
+
+	/** @brief Discard all items
+	 *  @note Consumer side only
+	 */
+	void clear()
+	{
+		__atomic_store_n(&tail, __atomic_load_n(&head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+	}
+
+protected:
+	/** @brief Set the storage used by the ring
+	 *  @param storage
+	 *  @param size Number of items, must be a power of two
+	 *  @note Neither producer nor consumer may be active during this call. Any
+	 *  content is discarded.
+	 */
+	void setStorage(T* storage, size_t size)
+	{
+		buffer = storage;
+		mask = (storage != nullptr && size != 0) ? size - 1 : 0;
+		head = tail = 0;
+	}
+
+	T* getStorage()
+	{
+		return buffer;
+	}
+
+private:
+	T* buffer = nullptr;
+	uint32_t mask = 0;
+	uint32_t head = 0; ///< Written only by producer
+	uint32_t tail = 0; ///< Written only by consumer
+	uint32_t overflows = 0;
+};
+
+/** @brief Ring with storage of fixed size
+ *  @tparam T Item type
+ *  @tparam Size Capacity, must be a power of two
+ */
+template <typename T, size_t Size> class SpscRing : public SpscRingBase<T>
+{
+	static_assert(Size != 0 && (Size & (Size - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+	SpscRing()
+	{
+		this->setStorage(storage, Size);
+	}
+
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+private:
+	T storage[Size];
+};
+
+#endif // _SPSC_RING_H_
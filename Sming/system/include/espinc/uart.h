@@ -133,6 +133,7 @@ struct uart_ {
 	struct SerialBuffer* tx_buffer;  ///< Optional transmit buffer
 	uart_callback_t callback; ///< Optional User callback routine
 	void* param; ///< User-supplied callback parameter
+	uint32_t rx_overflows; ///< Times the receive buffer was full with data waiting in the FIFO
 };
 
 
@@ -300,6 +301,15 @@ int IRAM_ATTR uart_peek_last_char(uart_t* uart);
  */
 int uart_rx_find(uart_t* uart, char c);
 
+/** @brief get the number of times the receive buffer was full with data waiting in the FIFO
+ *  @param uart
+ *  @retval uint32_t
+ */
+__forceinline uint32_t uart_get_rx_overflows(uart_t* uart)
+{
+	return uart ? uart->rx_overflows : 0;
+}
+
 /** @brief determine available data which can be read
  *  @param uart
  *  @retval size_t
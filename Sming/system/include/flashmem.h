@@ -17,6 +17,7 @@ extern "C" {
 #endif
 
 #include <user_config.h>
+#include <stdint.h>
 
 // Flash memory access must be aligned and in multiples of 4-byte words
 #define INTERNAL_FLASH_WRITE_UNIT_SIZE 4
@@ -62,6 +63,28 @@ typedef struct
 	} size : 4;
 } STORE_TYPEDEF_ATTR SPIFlashInfo;
 
+/** @brief One region in a scatter/gather list for flashmem_readv() and flashmem_writev()
+ */
+typedef struct
+{
+	uint32_t addr; ///< Flash address
+	void* buffer;  ///< RAM buffer, left unchanged by flashmem_writev()
+	uint32_t size; ///< Number of bytes
+} FlashIoVec;
+
+/** @brief Flash access statistics
+ *  @note An operation is one call into the SDK, so fewer larger operations are better
+ */
+typedef struct
+{
+	uint32_t read_ops;
+	uint32_t read_bytes;
+	uint32_t write_ops;
+	uint32_t write_bytes;
+	uint32_t erase_ops;
+	uint32_t bounce_bytes; ///< Data copied through the alignment buffer
+} FlashMemStats;
+
 /** @brief obtain the flash memory address for a memory pointer
  *  @param memptr
  *  @retval uint32_t offset from start of flash memory
@@ -71,7 +94,8 @@ typedef struct
  */
 static inline uint32_t flashmem_get_address(const void* memptr)
 {
-	return (uint32_t)memptr - INTERNAL_FLASH_START_ADDRESS;
+	// Through uintptr_t, so a host build with 64-bit pointers doesn't truncate the pointer itself
+	return (uint32_t)(uintptr_t)memptr - INTERNAL_FLASH_START_ADDRESS;
 }
 
 /** @brief write a block of data to flash
@@ -92,6 +116,32 @@ uint32_t flashmem_write(const void* from, uint32_t toaddr, uint32_t size);
  */
 uint32_t flashmem_read(void* to, uint32_t fromaddr, uint32_t size);
 
+/** @brief write a list of regions to flash
+ *  @param vec regions to write
+ *  @param count number of regions
+ *  @retval uint32_t number of bytes written, stops at the first failure
+ *  @note Consecutive entries which follow on in flash are written as one block, whatever
+ *  the alignment of their buffers; for example a header, key and value can be written with
+ *  a single flash operation. Word-aligned spans are written without copying.
+ */
+uint32_t flashmem_writev(const FlashIoVec* vec, unsigned count);
+
+/** @brief read a list of regions from flash
+ *  @param vec regions to read
+ *  @param count number of regions
+ *  @retval uint32_t number of bytes read, stops at the first failure
+ *  @note Adjacent regions are merged as for flashmem_writev()
+ */
+uint32_t flashmem_readv(const FlashIoVec* vec, unsigned count);
+
+/** @brief get flash access statistics
+ *  @param stats OUT: statistics since startup or the last reset
+ */
+void flashmem_get_stats(FlashMemStats* stats);
+
+/** @brief reset flash access statistics */
+void flashmem_reset_stats();
+
 /** @brief Erase a single flash sector
  *  @param sector_id the sector to erase
  *  @retval true on success
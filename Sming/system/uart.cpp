@@ -109,14 +109,17 @@ static bool realloc_buffer(SerialBuffer*& buffer, size_t new_size)
 			return true;
 		}
 
-		return buffer->resize(new_size) == new_size;
+		uart_disable_interrupts();
+		size_t size = buffer->resize(new_size);
+		uart_restore_interrupts();
+		return size >= new_size;
 	}
 
 	if (new_size == 0)
 		return true;
 
 	auto new_buf = new SerialBuffer;
-	if(new_buf && new_buf->resize(new_size)) {
+	if(new_buf && new_buf->resize(new_size) >= new_size) {
 		buffer = new_buf;
 		return true;
 	}
@@ -178,8 +181,7 @@ size_t uart_read(uart_t* uart, void* buffer, size_t size)
 
 	// If RX buffer not in use or it's empty then read directly from hardware FIFO
 	if(uart->rx_buffer)
-		while(read < size && !uart->rx_buffer->isEmpty())
-			buf[read++] = uart->rx_buffer->readChar();
+		read = uart->rx_buffer->pop(buf, size);
 
 	while(read < size && UART_RXCOUNT(uart->uart_nr) != 0)
 		buf[read++] = USF(uart->uart_nr);
@@ -239,12 +241,21 @@ static void IRAM_ATTR handle_uart_interrupt(uint8_t uart_nr, uart_t* uart)
 	if (usis & (_BV(UIFF) | _BV(UITO))) {
 		size_t read = 0;
 
-		// Read as much data as possible from the RX FIFO into buffer
+		// Read as much data as possible from the RX FIFO into buffer, at most two spans if it wraps
 		if(uart->rx_buffer) {
-			size_t space = uart->rx_buffer->getFreeSpace();
-			while(space-- && UART_RXCOUNT(uart_nr) != 0) {
-				uart->rx_buffer->writeChar(USF(uart_nr));
-				++read;
+			size_t fifoCount = UART_RXCOUNT(uart_nr);
+			for(unsigned i = 0; i < 2 && fifoCount != 0; ++i) {
+				size_t space;
+				uint8_t* dst = uart->rx_buffer->getWriteSpan(space);
+				if(space == 0)
+					break;
+				if(space > fifoCount)
+					space = fifoCount;
+				for(size_t n = 0; n < space; ++n)
+					dst[n] = USF(uart_nr);
+				uart->rx_buffer->commitWrite(space);
+				read += space;
+				fifoCount -= space;
 			}
 		}
 
@@ -255,8 +266,11 @@ static void IRAM_ATTR handle_uart_interrupt(uint8_t uart_nr, uart_t* uart)
 		 * If the FIFO is full and we didn't read any of the data then need to mask the interrupt out or it'll recur.
 		 * The interrupt gets re-enabled by a call to uart_read() or uart_flush()
 		 */
-		if (read == 0)
+		if (read == 0) {
 			USIE(uart_nr) &= ~(_BV(UIFF) | _BV(UITO));
+			if(uart->rx_buffer)
+				++uart->rx_overflows;
+		}
 	}
 
 
@@ -1,14 +1,15 @@
 #include <user_config.h>
 #include <SmingCore/SmingCore.h>
+#include <Services/Mdns/MdnsResponder.h>
 
 /*** mDNS Demo (instruction for usage)
  * The multicast Domain Name System (mDNS) resolves host names to IP addresses
  * within small networks that do not include a local name server.
  * More info on mDNS can be found at https://en.wikipedia.org/wiki/Multicast_DNS
  * mDNS has two parts 1. Advertise 2. Listen
- * Bellow code (using ESP SDK) just does Advertise
- * Listen implementation is still on going work and will be basically porting
- * http://gkaindl.com/software/arduino-ethernet/bonjour to "Sming"
+ * Bellow code just does Advertise, using MdnsResponder. Besides the host name
+ * it registers the web server as an "_http._tcp" service, so it also shows up
+ * in DNS-SD browsers.
  *
  * In short this code will advertise other machines about its ipaddress.
  * But you can not convert other mDNS advertiser's host name to ipaddress. (this is work of Listening)
@@ -42,17 +43,21 @@
 #endif
 
 HttpServer server;
+MdnsResponder mdns;
 
-//mDNS using ESP8266 SDK functions
 void startmDNS()
 {
-	struct mdns_info* info = (struct mdns_info*)os_zalloc(sizeof(struct mdns_info));
-	info->host_name = (char*)"test"; // You can replace test with your own host name
-	info->ipAddr = WifiStation.getIP();
-	info->server_name = (char*)"Sming";
-	info->server_port = 80;
-	info->txt_data[0] = (char*)"version = now";
-	espconn_mdns_init(info);
+	static bool servicesAdded = false;
+	if(!servicesAdded) {
+		MdnsService* service = mdns.addService("Sming", "_http._tcp", 80);
+		if(service != nullptr) {
+			service->addText("version", "now");
+		}
+		servicesAdded = true;
+	}
+
+	// You can replace test with your own host name
+	mdns.begin("test", WifiStation.getIP());
 }
 
 void onIndex(HttpRequest& request, HttpResponse& response)
@@ -0,0 +1,307 @@
+/*
+ * assetfs - packs a directory into a read-only asset image
+ *
+ * The image format is described in Sming/SmingCore/Data/AssetFS/AssetFSFormat.h.
+ * A file named "x.gz" is stored as "x" flagged as compressed, and replaces an
+ * uncompressed "x" if both exist.
+ *
+ * Usage: assetfs [-a alignment] <source directory> <image file>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <AssetFSFormat.h>
+
+#define DEFAULT_ALIGN 4096 // Flash sector
+
+typedef struct {
+	char name[ASSETFS_MAX_NAME + 1];
+	char* path;
+	const char* mime;
+	uint32_t size;
+	uint32_t flags;
+} Asset;
+
+static Asset* assets = NULL;
+static unsigned assetCount = 0;
+static unsigned assetCapacity = 0;
+
+static const struct {
+	const char* extension;
+	const char* mime;
+} mimeTypes[] = {
+	{"html", "text/html"},
+	{"htm", "text/html"},
+	{"txt", "text/plain"},
+	{"js", "text/javascript"},
+	{"css", "text/css"},
+	{"xml", "text/xml"},
+	{"json", "application/json"},
+	{"jpg", "image/jpeg"},
+	{"jpeg", "image/jpeg"},
+	{"gif", "image/gif"},
+	{"png", "image/png"},
+	{"svg", "image/svg+xml"},
+	{"ico", "image/x-icon"},
+	{"woff", "font/woff"},
+	{"woff2", "font/woff2"},
+	{"gzip", "application/x-gzip"},
+	{"zip", "application/zip"},
+};
+
+static const char* getMimeType(const char* name)
+{
+	const char* extension = strrchr(name, '.');
+	if(extension != NULL) {
+		unsigned i;
+		for(i = 0; i < sizeof(mimeTypes) / sizeof(mimeTypes[0]); i++) {
+			if(strcasecmp(extension + 1, mimeTypes[i].extension) == 0) {
+				return mimeTypes[i].mime;
+			}
+		}
+	}
+	return "application/octet-stream";
+}
+
+static Asset* findAsset(const char* name)
+{
+	unsigned i;
+	for(i = 0; i < assetCount; i++) {
+		if(strcmp(assets[i].name, name) == 0) {
+			return &assets[i];
+		}
+	}
+	return NULL;
+}
+
+static int addAsset(const char* path, const char* name, uint32_t size)
+{
+	char assetName[ASSETFS_MAX_NAME + 1];
+	uint32_t flags = 0;
+	size_t length = strlen(name);
+
+	if(length > ASSETFS_MAX_NAME) {
+		fprintf(stderr, "Name too long: %s\n", name);
+		return -1;
+	}
+	strcpy(assetName, name);
+	if(length > 3 && strcmp(&assetName[length - 3], ".gz") == 0) {
+		assetName[length - 3] = '\0';
+		flags |= ASSETFS_FLAG_GZIP;
+	}
+
+	Asset* asset = findAsset(assetName);
+	if(asset != NULL) {
+		// Compressed and uncompressed versions, keep the compressed one
+		if(asset->flags & ASSETFS_FLAG_GZIP) {
+			return 0;
+		}
+		free(asset->path);
+	} else {
+		if(assetCount == assetCapacity) {
+			assetCapacity = assetCapacity ? assetCapacity * 2 : 32;
+			assets = realloc(assets, assetCapacity * sizeof(Asset));
+			if(assets == NULL) {
+				fprintf(stderr, "Out of memory\n");
+				return -1;
+			}
+		}
+		asset = &assets[assetCount++];
+		strcpy(asset->name, assetName);
+	}
+
+	asset->path = strdup(path);
+	asset->mime = getMimeType(assetName);
+	asset->size = size;
+	asset->flags = flags;
+	return 0;
+}
+
+static int scanDirectory(const char* path, const char* prefix)
+{
+	DIR* dir = opendir(path);
+	if(dir == NULL) {
+		fprintf(stderr, "Unable to open directory %s\n", path);
+		return -1;
+	}
+
+	int res = 0;
+	struct dirent* ent;
+	while(res == 0 && (ent = readdir(dir)) != NULL) {
+		if(ent->d_name[0] == '.') {
+			continue;
+		}
+
+		char fullPath[1024];
+		char name[1024];
+		snprintf(fullPath, sizeof(fullPath), "%s/%s", path, ent->d_name);
+		snprintf(name, sizeof(name), "%s%s", prefix, ent->d_name);
+
+		struct stat st;
+		if(stat(fullPath, &st) != 0) {
+			fprintf(stderr, "Unable to stat %s\n", fullPath);
+			res = -1;
+		} else if(S_ISDIR(st.st_mode)) {
+			strcat(name, "/");
+			res = scanDirectory(fullPath, name);
+		} else if(S_ISREG(st.st_mode)) {
+			res = addAsset(fullPath, name, st.st_size);
+		}
+	}
+
+	closedir(dir);
+	return res;
+}
+
+static int compareAssets(const void* a, const void* b)
+{
+	return strcmp(((const Asset*)a)->name, ((const Asset*)b)->name);
+}
+
+static uint32_t align(uint32_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+static int writeAt(FILE* image, uint32_t offset, const void* data, uint32_t length)
+{
+	if(fseek(image, offset, SEEK_SET) != 0 || fwrite(data, 1, length, image) != length) {
+		fprintf(stderr, "Unable to write image\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Copy a file into the image, returning the hash of its content
+static int copyData(FILE* image, uint32_t offset, const Asset* asset, uint32_t* etag)
+{
+	FILE* f = fopen(asset->path, "rb");
+	if(f == NULL) {
+		fprintf(stderr, "Unable to open %s\n", asset->path);
+		return -1;
+	}
+
+	uint32_t hash = 2166136261U;
+	uint32_t remaining = asset->size;
+	char buf[4096];
+	int res = fseek(image, offset, SEEK_SET);
+	while(res == 0 && remaining != 0) {
+		size_t len = remaining < sizeof(buf) ? remaining : sizeof(buf);
+		if(fread(buf, 1, len, f) != len || fwrite(buf, 1, len, image) != len) {
+			fprintf(stderr, "Unable to copy %s\n", asset->path);
+			res = -1;
+		}
+		hash = assetfs_hash_update(hash, buf, len);
+		remaining -= len;
+	}
+
+	fclose(f);
+	*etag = hash;
+	return res;
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t dataAlign = DEFAULT_ALIGN;
+	int arg = 1;
+
+	if(argc > 2 && strcmp(argv[1], "-a") == 0) {
+		dataAlign = strtoul(argv[2], NULL, 0);
+		arg += 2;
+	}
+	if(argc - arg != 2 || dataAlign < 4 || dataAlign % 4 != 0) {
+		printf("Usage: %s [-a alignment] <source directory> <image file>\n", argv[0]);
+		printf("Alignment of file data is a multiple of 4, default %u\n", DEFAULT_ALIGN);
+		return 1;
+	}
+	const char* sourceDir = argv[arg];
+	const char* imageFile = argv[arg + 1];
+
+	if(scanDirectory(sourceDir, "") != 0) {
+		return 1;
+	}
+	if(assetCount != 0) {
+		qsort(assets, assetCount, sizeof(Asset), compareAssets);
+	}
+
+	AssetFSHeader header = {0};
+	header.magic = ASSETFS_MAGIC;
+	header.version = ASSETFS_VERSION;
+	header.fileCount = assetCount;
+	header.hashSize = 1;
+	while(header.hashSize < assetCount * 2) {
+		header.hashSize *= 2;
+	}
+	header.dataAlign = dataAlign;
+
+	uint32_t tableOffset = sizeof(header);
+	uint32_t directoryOffset = tableOffset + header.hashSize * sizeof(uint32_t);
+	uint32_t stringOffset = directoryOffset + assetCount * sizeof(AssetFSEntry);
+
+	uint32_t* table = calloc(header.hashSize, sizeof(uint32_t));
+	AssetFSEntry* entries = calloc(assetCount ? assetCount : 1, sizeof(AssetFSEntry));
+	FILE* image = fopen(imageFile, "wb");
+	if(table == NULL || entries == NULL || image == NULL) {
+		fprintf(stderr, "Unable to create %s\n", imageFile);
+		return 1;
+	}
+
+	// Names and content types
+	uint32_t offset = stringOffset;
+	unsigned i;
+	for(i = 0; i < assetCount; i++) {
+		AssetFSEntry* entry = &entries[i];
+		const Asset* asset = &assets[i];
+		entry->nameLength = strlen(asset->name);
+		entry->hash = assetfs_hash(asset->name, entry->nameLength);
+		entry->nameOffset = offset;
+		if(writeAt(image, offset, asset->name, entry->nameLength + 1) != 0) {
+			return 1;
+		}
+		offset += entry->nameLength + 1;
+		entry->mimeOffset = offset;
+		if(writeAt(image, offset, asset->mime, strlen(asset->mime) + 1) != 0) {
+			return 1;
+		}
+		offset += strlen(asset->mime) + 1;
+		entry->flags = asset->flags;
+
+		uint32_t slot = entry->hash & (header.hashSize - 1);
+		while(table[slot] != 0) {
+			slot = (slot + 1) & (header.hashSize - 1);
+		}
+		table[slot] = i + 1;
+	}
+
+	// File data, each starting on the alignment boundary
+	for(i = 0; i < assetCount; i++) {
+		AssetFSEntry* entry = &entries[i];
+		offset = align(offset, dataAlign);
+		entry->dataOffset = offset;
+		entry->dataSize = assets[i].size;
+		if(copyData(image, offset, &assets[i], &entry->etag) != 0) {
+			return 1;
+		}
+		offset += entry->dataSize;
+		printf("%-40s %8u %s%s\n", assets[i].name, entry->dataSize, assets[i].mime,
+			   (entry->flags & ASSETFS_FLAG_GZIP) ? " (gzip)" : "");
+	}
+
+	// Whole words, so the image can be read from mapped flash without special cases
+	uint32_t padding = 0;
+	header.imageSize = align(offset, 4);
+	if(writeAt(image, offset, &padding, header.imageSize - offset) != 0 ||
+	   writeAt(image, 0, &header, sizeof(header)) != 0 ||
+	   writeAt(image, tableOffset, table, header.hashSize * sizeof(uint32_t)) != 0 ||
+	   writeAt(image, directoryOffset, entries, assetCount * sizeof(AssetFSEntry)) != 0) {
+		return 1;
+	}
+
+	fclose(image);
+	printf("%u files, image size %u bytes\n", assetCount, header.imageSize);
+	return 0;
+}
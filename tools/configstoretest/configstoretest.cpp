@@ -0,0 +1,382 @@
+/*
+ * configstoretest - host test for ConfigStore, built from the Sming sources
+ * (ConfigStore.cpp and the flashmem.c it writes through) against flash
+ * emulated in RAM.
+ *
+ * The emulated flash behaves as NOR flash does: erasing sets a sector to 0xFF
+ * and writing can only clear bits. It is mapped at the same address as on
+ * the device, so flashmem_get_size_bytes() reads its size from the header at
+ * the start, as it would there.
+ *
+ * A random mix of sets of every type, deletes, compactions and reopens is
+ * checked against a model of what the store should hold. Now and then the
+ * power is cut part way through: the flash write or erase in progress only
+ * gets some of the way, and nothing more reaches the flash. The store is then
+ * reopened and must hold exactly the model, except that the key being changed
+ * may have either its old or its new value.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "ConfigStore.h"
+#include "HexString.h"
+
+#define FLASH_ADDRESS INTERNAL_FLASH_START_ADDRESS
+#define FLASH_SIZE 0x400000
+#define STORE_ADDRESS 0x300000
+#define MAX_VALUE 160
+
+int debug_enabled;
+char _flash_code_end[1];
+
+static uint8_t *flash;
+static uint32_t flash_erases[FLASH_SIZE / SPI_FLASH_SEC_SIZE];
+static int cut_countdown = -1;  // Flash writes and erases until the power goes, -1 for never
+static bool power_off;
+static unsigned power_cuts;
+
+// Called by ConfigStore's "list" command, which isn't used here
+String makeHexString(const uint8_t *data, unsigned length, char separator) {
+	return String();
+}
+
+// Whether this write or erase is the one the power fails part way through
+static bool cut_now(void) {
+	if (cut_countdown < 0) {
+		return false;
+	}
+	if (cut_countdown-- != 0) {
+		return false;
+	}
+	power_off = true;
+	++power_cuts;
+	return true;
+}
+
+SpiFlashOpResult spi_flash_write(uint32_t addr, uint32 *src, uint32_t size) {
+	if (addr % 4 != 0 || size % 4 != 0 || uintptr_t(src) % 4 != 0 || addr + size > FLASH_SIZE) {
+		printf("Bad flash write: 0x%08x, %u bytes\n", addr, size);
+		abort();
+	}
+	if (power_off) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+	if (cut_now()) {
+		size = rand() % (size + 1);
+	}
+	const uint8_t *p = reinterpret_cast<const uint8_t *>(src);
+	for (uint32_t i = 0; i < size; ++i) {
+		flash[addr + i] &= p[i];
+	}
+	return power_off ? SPI_FLASH_RESULT_ERR : SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_read(uint32_t addr, uint32 *dst, uint32_t size) {
+	if (addr % 4 != 0 || size % 4 != 0 || uintptr_t(dst) % 4 != 0 || addr + size > FLASH_SIZE) {
+		printf("Bad flash read: 0x%08x, %u bytes\n", addr, size);
+		abort();
+	}
+	memcpy(dst, flash + addr, size);
+	return SPI_FLASH_RESULT_OK;
+}
+
+SpiFlashOpResult spi_flash_erase_sector(uint32_t sector) {
+	if (sector >= FLASH_SIZE / SPI_FLASH_SEC_SIZE) {
+		printf("Bad flash erase: sector %u\n", sector);
+		abort();
+	}
+	if (power_off) {
+		return SPI_FLASH_RESULT_ERR;
+	}
+	uint32_t size = SPI_FLASH_SEC_SIZE;
+	if (cut_now()) {
+		// Part erased: some of the sector is clear, the rest still holds what it did
+		size = rand() % (size + 1);
+	}
+	memset(flash + sector * SPI_FLASH_SEC_SIZE, 0xFF, size);
+	++flash_erases[sector];
+	return power_off ? SPI_FLASH_RESULT_ERR : SPI_FLASH_RESULT_OK;
+}
+
+static void flash_init(void) {
+	void *addr = reinterpret_cast<void *>(FLASH_ADDRESS);
+	flash = static_cast<uint8_t *>(mmap(addr, FLASH_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (flash != addr) {
+		printf("Can't map flash at 0x%08x\n", FLASH_ADDRESS);
+		exit(1);
+	}
+	memset(flash, 0xFF, FLASH_SIZE);
+	// As esptool writes it: 32Mbit
+	flash[3] = SPIFlashInfo::SIZE_32MBIT << 4;
+}
+
+/*
+ * What the store should hold
+ */
+
+struct Value {
+	ConfigValueType type;
+	std::string data;
+
+	bool operator==(const Value &other) const {
+		return type == other.type && data == other.data;
+	}
+};
+
+typedef std::map<std::string, Value> Model;
+
+static Model model;
+static std::vector<std::string> keys;
+static unsigned failures;
+static unsigned current_op;
+
+static bool read_value(const ConfigStore &store, const std::string &key, Value &value) {
+	value.type = store.getType(key.c_str());
+	if (value.type == eCVT_None) {
+		return false;
+	}
+	char buf[MAX_VALUE + 1];
+	int len = store.getBinary(key.c_str(), buf, sizeof(buf));
+	if (len < 0 || len > MAX_VALUE) {
+		value.data = "<bad length>";
+	} else {
+		value.data.assign(buf, len);
+	}
+	return true;
+}
+
+static void fail(const char *what, const std::string &key) {
+	++failures;
+	if (failures <= 10) {
+		printf("FAIL at operation %u: %s, key \"%s\"\n", current_op, what, key.c_str());
+	}
+}
+
+/*
+ * Check the store against the model. The pending key, if any, may have either
+ * the model's value or the new one, and the model is updated to match.
+ */
+static void check(const ConfigStore &store, const std::string *pending = nullptr, const Value *next = nullptr) {
+	for (auto &key : keys) {
+		Value value;
+		bool found = read_value(store, key, value);
+		auto it = model.find(key);
+		bool expected = (it != model.end());
+
+		if (pending != nullptr && key == *pending) {
+			bool isOld = expected ? (found && value == it->second) : !found;
+			bool isNew = next ? (found && value == *next) : !found;
+			if (!isOld && !isNew) {
+				fail("interrupted change left neither old nor new value", key);
+			}
+			if (isNew && !isOld) {
+				if (next) {
+					model[key] = *next;
+				} else {
+					model.erase(key);
+				}
+			}
+			continue;
+		}
+
+		if (found != expected) {
+			fail(found ? "deleted key present" : "key lost", key);
+		} else if (found && !(value == it->second)) {
+			fail("wrong value", key);
+		}
+	}
+
+	if (store.count() != model.size()) {
+		fail("count() doesn't match", std::to_string(store.count()));
+	}
+	for (unsigned i = 0; i < store.count(); ++i) {
+		String key = store.keyAt(i);
+		if (model.find(key) == model.end()) {
+			fail("keyAt() returned a key that isn't there", key);
+		}
+	}
+}
+
+static Value random_value(void) {
+	Value v;
+	v.type = ConfigValueType(eCVT_String + rand() % (eCVT_Binary - eCVT_String + 1));
+	switch (v.type) {
+		case eCVT_Int: {
+			int32_t i = rand() - RAND_MAX / 2;
+			v.data.assign(reinterpret_cast<char *>(&i), sizeof(i));
+			break;
+		}
+		case eCVT_Float: {
+			float f = float(rand()) / 1000;
+			v.data.assign(reinterpret_cast<char *>(&f), sizeof(f));
+			break;
+		}
+		case eCVT_Bool:
+			v.data.assign(1, char(rand() % 2));
+			break;
+		case eCVT_String:
+			for (unsigned n = rand() % (MAX_VALUE / 2); n != 0; --n) {
+				v.data += char('a' + rand() % 26);
+			}
+			break;
+		default:
+			for (unsigned n = rand() % MAX_VALUE; n != 0; --n) {
+				v.data += char(rand());
+			}
+	}
+	return v;
+}
+
+static bool store_value(ConfigStore &store, const std::string &key, const Value &v) {
+	switch (v.type) {
+		case eCVT_String:
+			return store.setString(key.c_str(), String(v.data));
+		case eCVT_Int:
+			return store.setInt(key.c_str(), *reinterpret_cast<const int32_t *>(v.data.data()));
+		case eCVT_Float:
+			return store.setFloat(key.c_str(), *reinterpret_cast<const float *>(v.data.data()));
+		case eCVT_Bool:
+			return store.setBool(key.c_str(), v.data[0] != 0);
+		default:
+			return store.setBinary(key.c_str(), v.data.data(), v.data.size());
+	}
+}
+
+static void reopen(ConfigStore &store, uint16_t sectors) {
+	store.close();
+	if (!store.open(STORE_ADDRESS, sectors)) {
+		fail("open failed", "");
+	}
+}
+
+static void usage(const char *name) {
+	printf("Usage: %s [options]\n"
+		"  -n ops        Number of operations (default 50000)\n"
+		"  -r seed       Random seed (default 1)\n"
+		"  -s sectors    Sectors in the store, 2 to 64 (default 3)\n"
+		"  -k keys       Number of different keys used, up to %u (default 32)\n"
+		"  -c percent    Operations the power is cut during (default 5)\n"
+		"  -v            Show the store's debug messages\n",
+		name, CONFIG_STORE_MAX_KEYS / 2);
+}
+
+int main(int argc, char **argv) {
+	unsigned op_count = 50000;
+	unsigned seed = 1;
+	unsigned sectors = 3;
+	unsigned key_count = 32;
+	unsigned cut_percent = 5;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:s:k:c:vh")) != -1) {
+		switch (opt) {
+			case 'n': op_count = strtoul(optarg, NULL, 0); break;
+			case 'r': seed = strtoul(optarg, NULL, 0); break;
+			case 's': sectors = strtoul(optarg, NULL, 0); break;
+			case 'k': key_count = strtoul(optarg, NULL, 0); break;
+			case 'c': cut_percent = strtoul(optarg, NULL, 0); break;
+			case 'v': debug_enabled = 1; break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (sectors < 2 || sectors > 64 || key_count == 0 || key_count > CONFIG_STORE_MAX_KEYS / 2) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	srand(seed);
+	flash_init();
+	for (unsigned i = 0; i < key_count; ++i) {
+		keys.push_back("key" + std::to_string(i * 7919 % 1000));
+	}
+
+	ConfigStore store;
+	reopen(store, sectors);
+	unsigned sets = 0, removes = 0, compacts = 0, reopens = 0, full = 0;
+
+	for (unsigned op = 0; op < op_count && failures == 0; ++op) {
+		current_op = op;
+		const std::string &key = keys[rand() % keys.size()];
+		unsigned kind = rand() % 100;
+		bool cut = unsigned(rand() % 100) < cut_percent;
+		if (cut) {
+			cut_countdown = rand() % 4;
+		}
+
+		Value next;
+		bool isSet = false;
+		if (kind < 70) {
+			next = random_value();
+			isSet = true;
+			++sets;
+			if (!store_value(store, key, next) && !power_off) {
+				// Only acceptable if the live data really doesn't fit, and then nothing changes
+				++full;
+				continue;
+			}
+		} else if (kind < 90) {
+			++removes;
+			if (!store.remove(key.c_str()) && !power_off && model.count(key) != 0) {
+				++full;
+				continue;
+			}
+		} else if (kind < 95) {
+			++compacts;
+			store.compact();
+		} else {
+			++reopens;
+			reopen(store, sectors);
+		}
+
+		cut_countdown = -1;
+		if (power_off) {
+			power_off = false;
+			reopen(store, sectors);
+			if (kind < 90) {
+				check(store, &key, isSet ? &next : nullptr);
+			} else {
+				check(store);
+			}
+			continue;
+		}
+
+		if (kind < 70) {
+			model[key] = next;
+		} else if (kind < 90) {
+			model.erase(key);
+		}
+		if (op % 16 == 0) {
+			check(store);
+		}
+	}
+
+	reopen(store, sectors);
+	check(store);
+
+	uint32_t first = STORE_ADDRESS / SPI_FLASH_SEC_SIZE;
+	uint32_t most = 0, least = UINT32_MAX;
+	for (unsigned i = 0; i < sectors; ++i) {
+		most = std::max(most, flash_erases[first + i]);
+		least = std::min(least, flash_erases[first + i]);
+	}
+	FlashMemStats stats;
+	flashmem_get_stats(&stats);
+
+	printf("%u sets, %u deletes, %u compactions, %u reopens, %u power cuts\n", sets, removes, compacts, reopens,
+		power_cuts);
+	printf("%u changes refused as full\n", full);
+	printf("Sector erases: %u to %u\n", least, most);
+	printf("Flash: %u reads (%u bytes), %u writes (%u bytes), %u bytes through the alignment buffer\n", stats.read_ops,
+		stats.read_bytes, stats.write_ops, stats.write_bytes, stats.bounce_bytes);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
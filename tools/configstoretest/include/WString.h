@@ -0,0 +1,75 @@
+/*
+ * Stand-in for Sming's String for configstoretest, with just what ConfigStore uses
+ */
+
+#ifndef _WSTRING_H_
+#define _WSTRING_H_
+
+#include <user_config.h>
+#include <string>
+#include <stdlib.h>
+#include <strings.h>
+
+class String : public std::string
+{
+public:
+	String()
+	{
+	}
+
+	String(const char* s) : std::string(s ? s : "")
+	{
+	}
+
+	String(const char* s, size_t length) : std::string(s, length)
+	{
+	}
+
+	String(const std::string& s) : std::string(s)
+	{
+	}
+
+	explicit String(int value) : std::string(std::to_string(value))
+	{
+	}
+
+	explicit String(float value) : std::string(std::to_string(value))
+	{
+	}
+
+	unsigned length() const
+	{
+		return size();
+	}
+
+	bool setLength(unsigned length)
+	{
+		resize(length);
+		return true;
+	}
+
+	char* begin()
+	{
+		return &(*this)[0];
+	}
+
+	long toInt() const
+	{
+		return atol(c_str());
+	}
+
+	float toFloat() const
+	{
+		return atof(c_str());
+	}
+
+	bool equalsIgnoreCase(const char* s) const
+	{
+		return strcasecmp(c_str(), s) == 0;
+	}
+};
+
+#define F(s) (s)
+#define _F(s) (s)
+
+#endif /* _WSTRING_H_ */
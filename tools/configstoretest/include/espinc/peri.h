@@ -0,0 +1,3 @@
+/*
+ * Stand-in for the ESP8266 register definitions, which flashmem.c doesn't need on the host
+ */
@@ -0,0 +1,50 @@
+/*
+ * Force-included into ConfigStore.cpp for configstoretest. The command
+ * handler needs the network stack, so this takes the place of
+ * CommandProcessingIncludes.h with just enough for the command code to build.
+ */
+
+#ifndef SERVICES_COMMANDPROCESSING_COMMANDPROCESSINGINCLUDES_H_
+#define SERVICES_COMMANDPROCESSING_COMMANDPROCESSINGINCLUDES_H_
+
+#include "WString.h"
+#include <vector>
+#include <stdarg.h>
+
+#define ENABLE_CMD_EXECUTOR 0
+
+template <typename T> class Vector : public std::vector<T>
+{
+};
+
+static inline int splitString(const String& text, char separator, Vector<String>& tokens)
+{
+	size_t start = 0;
+	for(;;) {
+		size_t end = text.find(separator, start);
+		tokens.push_back(String(text.substr(start, end - start)));
+		if(end == std::string::npos) {
+			return tokens.size();
+		}
+		start = end + 1;
+	}
+}
+
+class CommandOutput
+{
+public:
+	void print(const char* s)
+	{
+		fputs(s, stdout);
+	}
+
+	void printf(const char* fmt, ...)
+	{
+		va_list args;
+		va_start(args, fmt);
+		vprintf(fmt, args);
+		va_end(args);
+	}
+};
+
+#endif /* SERVICES_COMMANDPROCESSING_COMMANDPROCESSINGINCLUDES_H_ */
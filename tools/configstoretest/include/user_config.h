@@ -0,0 +1,52 @@
+/*
+ * Stand-in for the SDK and Sming headers flashmem.c and ConfigStore.cpp use,
+ * for configstoretest. The flash functions are emulated in configstoretest.cpp.
+ */
+
+#ifndef _USER_CONFIG_H_
+#define _USER_CONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef uint32_t uint32;
+
+typedef enum {
+	SPI_FLASH_RESULT_OK,
+	SPI_FLASH_RESULT_ERR,
+	SPI_FLASH_RESULT_TIMEOUT,
+} SpiFlashOpResult;
+
+#define SPI_FLASH_SEC_SIZE 4096
+
+SpiFlashOpResult spi_flash_write(uint32_t addr, uint32* src, uint32_t size);
+SpiFlashOpResult spi_flash_read(uint32_t addr, uint32* dst, uint32_t size);
+SpiFlashOpResult spi_flash_erase_sector(uint32_t sector);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define STORE_TYPEDEF_ATTR
+#define STORE_ATTR
+#define WDT_FEED()
+#define debugf(fmt, ...) printf(fmt "\n", ##__VA_ARGS__)
+
+extern int debug_enabled;
+#define debug_e(fmt, ...) (debug_enabled ? printf(fmt "\n", ##__VA_ARGS__) : 0)
+#define debug_w(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+#define debug_i(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+#define debug_d(fmt, ...)
+#define SYSTEM_ERROR(fmt, ...) (debug_enabled ? printf(fmt, ##__VA_ARGS__) : 0)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#endif /* _USER_CONFIG_H_ */
@@ -0,0 +1,498 @@
+/*
+ * coroutinetest - host test for the coroutine scheduler in
+ * SmingCore/Coroutine, built from the Sming sources.
+ *
+ * On the device, SystemCoroutineScheduler signals through the task queue and
+ * sleeps with the timer scheduler. Here the scheduler is driven by hand: a
+ * signal is just counted, and sleeps go on a TimerWheel run from a fake
+ * millisecond clock, so every step happens exactly when the test says.
+ *
+ * Covered: starting and running to completion in FIFO order, waiting and
+ * waking (including a wake while running), sleeps, cancelling in every state
+ * and from within run(), deleting a coroutine, and the memory budget.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+#include "Coroutine.h"
+
+static unsigned checks;
+static unsigned failures;
+
+#define CHECK(cond) check(cond, #cond, __LINE__)
+
+static void check(bool ok, const char *what, unsigned line) {
+	++checks;
+	if (!ok) {
+		++failures;
+		printf("FAIL at line %u: %s\n", line, what);
+	}
+}
+
+class HostScheduler : public CoroutineScheduler {
+public:
+	/** Advance the clock, waking coroutines whose sleep has ended */
+	void advance(uint32_t milliseconds) {
+		clock += milliseconds;
+		TimerWheel::Entry *entry;
+		while ((entry = wheel.expire(clock)) != nullptr) {
+			entry->callback(entry->arg);
+		}
+	}
+
+	/** Run ready coroutines until there are none, returning the number of steps */
+	unsigned runAll() {
+		unsigned steps = 0;
+		while (getReadyCount() != 0) {
+			runNext();
+			++steps;
+		}
+		return steps;
+	}
+
+	unsigned signals = 0;
+	uint32_t clock = 0xFFFFFF00; // Wraps during the test
+	TimerWheel wheel;
+
+protected:
+	void signal() override {
+		++signals;
+	}
+
+	void armTimer(TimerWheel::Entry &entry, uint32_t milliseconds) override {
+		wheel.arm(entry, clock, milliseconds, false);
+	}
+
+	void disarmTimer(TimerWheel::Entry &entry) override {
+		wheel.disarm(entry);
+	}
+};
+
+static HostScheduler hostScheduler;
+static std::string events;
+
+/** Yields a few times, logging each step */
+class Counter : public Coroutine {
+public:
+	Counter(char name, unsigned yields) : Coroutine(hostScheduler), name(name), yields(yields) {
+	}
+
+	unsigned finishCount = 0;
+	unsigned stopCount = 0;
+
+protected:
+	void run() override {
+		CR_BEGIN();
+		for (i = 0; i < yields; ++i) {
+			events += name;
+			CR_YIELD();
+		}
+		events += name;
+		CR_END();
+	}
+
+	void onFinished() override {
+		++finishCount;
+	}
+
+	void onStop() override {
+		++stopCount;
+	}
+
+private:
+	char name;
+	unsigned yields;
+	unsigned i = 0;
+};
+
+/** Waits for wake(), then for a condition, then sleeps */
+class Sleeper : public Coroutine {
+public:
+	Sleeper() : Coroutine(hostScheduler) {
+	}
+
+	~Sleeper() {
+		cancel();
+	}
+
+	bool ready = false;
+	bool wakeSelf = false;
+	uint32_t sleepTime = 100;
+	unsigned stage = 0;
+	unsigned finishCount = 0;
+	unsigned stopCount = 0;
+
+protected:
+	void run() override {
+		CR_BEGIN();
+		stage = 1;
+		if (wakeSelf) {
+			wake();
+		}
+		CR_WAIT();
+		stage = 2;
+		CR_WAIT_UNTIL(ready);
+		stage = 3;
+		CR_SLEEP(sleepTime);
+		stage = 4;
+		CR_END();
+	}
+
+	void onFinished() override {
+		++finishCount;
+	}
+
+	void onStop() override {
+		++stopCount;
+		++totalStops;
+	}
+
+public:
+	static unsigned totalStops;
+};
+
+unsigned Sleeper::totalStops;
+
+/** Allocates against its budget as it goes */
+class Allocator : public Coroutine {
+public:
+	Allocator() : Coroutine(hostScheduler) {
+	}
+
+	void *blocks[4] = {};
+
+protected:
+	void run() override {
+		CR_BEGIN();
+		blocks[0] = allocate(100);
+		blocks[1] = allocate(200);
+		CR_YIELD();
+		// Over budget
+		blocks[2] = allocate(getMemoryBudget());
+		release(blocks[0]);
+		blocks[0] = nullptr;
+		blocks[3] = allocate(50);
+		CR_YIELD();
+		CR_END();
+	}
+};
+
+/** Cancels, or deletes, itself part way through */
+class Quitter : public Coroutine {
+public:
+	Quitter(bool destroy) : Coroutine(hostScheduler), destroy(destroy) {
+	}
+
+	~Quitter() {
+		cancel();
+	}
+
+	unsigned finishCount = 0;
+	unsigned stopCount = 0;
+
+protected:
+	void run() override {
+		CR_BEGIN();
+		allocate(64);
+		CR_YIELD();
+		sleep(1000);
+		if (destroy) {
+			delete this;
+			return;
+		}
+		cancel();
+		CR_YIELD();
+		events += "unreachable";
+		CR_END();
+	}
+
+	void onFinished() override {
+		++finishCount;
+	}
+
+	void onStop() override {
+		++stopCount;
+	}
+
+private:
+	bool destroy;
+};
+
+/** Deletes itself when it finishes */
+class OneShot : public Coroutine {
+public:
+	OneShot(unsigned &deleted) : Coroutine(hostScheduler), deleted(deleted) {
+	}
+
+	~OneShot() {
+		++deleted;
+	}
+
+protected:
+	void run() override {
+		CR_BEGIN();
+		CR_YIELD();
+		CR_END();
+	}
+
+	void onFinished() override {
+		delete this;
+	}
+
+private:
+	unsigned &deleted;
+};
+
+static void test_start(void) {
+	Counter a('a', 2), b('b', 0), c('c', 1);
+	unsigned signals = hostScheduler.signals;
+
+	CHECK(a.start());
+	CHECK(!a.start());
+	CHECK(a.getState() == eCRS_Ready);
+	CHECK(hostScheduler.signals == signals + 1);
+	CHECK(b.start());
+	CHECK(c.start());
+	// Only going from empty to non-empty signals
+	CHECK(hostScheduler.signals == signals + 1);
+	CHECK(hostScheduler.getReadyCount() == 3);
+	CHECK(hostScheduler.getActiveCount() == 3);
+
+	CHECK(hostScheduler.runAll() == 6);
+	CHECK(events == "abcaca");
+	CHECK(a.getStepCount() == 3);
+	CHECK(a.getState() == eCRS_Idle);
+	CHECK(a.finishCount == 1 && b.finishCount == 1 && c.finishCount == 1);
+	CHECK(a.stopCount == 1);
+	CHECK(hostScheduler.getActiveCount() == 0);
+	CHECK(!hostScheduler.runNext());
+
+	// Restart from the beginning
+	events.clear();
+	CHECK(a.start());
+	CHECK(hostScheduler.runAll() == 3);
+	CHECK(events == "aaa");
+	CHECK(a.finishCount == 2);
+	events.clear();
+}
+
+static void test_wait(void) {
+	Sleeper s;
+	s.wake();
+	CHECK(s.getState() == eCRS_Idle);
+
+	CHECK(s.start());
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(s.stage == 1 && s.getState() == eCRS_Waiting);
+	CHECK(hostScheduler.getActiveCount() == 1);
+
+	// Queued once, however often it is woken
+	unsigned signals = hostScheduler.signals;
+	s.wake();
+	s.wake();
+	CHECK(s.getState() == eCRS_Ready);
+	CHECK(hostScheduler.getReadyCount() == 1);
+	CHECK(hostScheduler.signals == signals + 1);
+
+	// Woken, but the condition isn't met
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(s.stage == 2 && s.getState() == eCRS_Waiting);
+	s.wake();
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(s.stage == 2 && s.getState() == eCRS_Waiting);
+
+	s.ready = true;
+	s.wake();
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(s.stage == 3 && s.getState() == eCRS_Waiting);
+	CHECK(hostScheduler.wheel.count() == 1);
+
+	hostScheduler.advance(99);
+	CHECK(s.getState() == eCRS_Waiting);
+	hostScheduler.advance(1);
+	CHECK(s.getState() == eCRS_Ready);
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(s.stage == 4 && s.getState() == eCRS_Idle);
+	CHECK(s.finishCount == 1 && s.stopCount == 1);
+	CHECK(hostScheduler.wheel.count() == 0);
+
+	// A wake from within run() makes the next wait return straight away
+	s.wakeSelf = true;
+	s.ready = false;
+	CHECK(s.start());
+	CHECK(hostScheduler.runAll() == 2);
+	CHECK(s.stage == 2 && s.getState() == eCRS_Waiting);
+
+	// Woken early from a sleep, the timer goes
+	s.ready = true;
+	s.sleepTime = 5000;
+	s.wake();
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(s.stage == 3 && hostScheduler.wheel.count() == 1);
+	s.wake();
+	CHECK(hostScheduler.wheel.count() == 0);
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(s.stage == 4 && s.finishCount == 2);
+}
+
+static void test_cancel(void) {
+	// While queued
+	Counter a('a', 5);
+	CHECK(!a.isActive());
+	a.cancel();
+	CHECK(a.stopCount == 0);
+	a.start();
+	a.cancel();
+	CHECK(a.getState() == eCRS_Idle);
+	CHECK(hostScheduler.getReadyCount() == 0 && hostScheduler.getActiveCount() == 0);
+	CHECK(a.stopCount == 1 && a.finishCount == 0);
+	CHECK(events.empty());
+
+	// Part way through
+	a.start();
+	hostScheduler.runNext();
+	CHECK(a.getState() == eCRS_Ready);
+	a.cancel();
+	CHECK(hostScheduler.runAll() == 0);
+	CHECK(events == "a");
+	CHECK(a.stopCount == 2 && a.finishCount == 0);
+	events.clear();
+
+	// While sleeping
+	Sleeper s;
+	s.ready = true;
+	s.start();
+	hostScheduler.runAll();
+	s.wake();
+	hostScheduler.runAll();
+	CHECK(s.stage == 3 && hostScheduler.wheel.count() == 1);
+	s.cancel();
+	CHECK(hostScheduler.wheel.count() == 0);
+	CHECK(s.getState() == eCRS_Idle && s.stopCount == 1 && s.finishCount == 0);
+	CHECK(hostScheduler.getActiveCount() == 0);
+
+	// From within run(), whilst asleep with memory allocated
+	Quitter q(false);
+	q.start();
+	hostScheduler.runAll();
+	CHECK(q.getState() == eCRS_Idle);
+	CHECK(q.getStepCount() == 2);
+	CHECK(q.stopCount == 1 && q.finishCount == 0);
+	CHECK(q.getMemoryUsed() == 0);
+	CHECK(hostScheduler.wheel.count() == 0);
+	CHECK(hostScheduler.getActiveCount() == 0);
+	CHECK(events.empty());
+}
+
+static void test_delete(void) {
+	// A subclass which calls cancel() in its destructor gets onStop()
+	Sleeper *s = new Sleeper;
+	s->start();
+	hostScheduler.runAll();
+	unsigned stops = Sleeper::totalStops;
+	CHECK(hostScheduler.getActiveCount() == 1);
+	delete s;
+	CHECK(Sleeper::totalStops == stops + 1);
+	CHECK(hostScheduler.getActiveCount() == 0);
+
+	// One that doesn't is still taken off the queue
+	Counter *a = new Counter('a', 3);
+	Counter *b = new Counter('b', 0);
+	a->start();
+	b->start();
+	delete a;
+	CHECK(hostScheduler.getReadyCount() == 1 && hostScheduler.getActiveCount() == 1);
+	CHECK(hostScheduler.runAll() == 1);
+	CHECK(events == "b");
+	CHECK(b->finishCount == 1);
+	delete b;
+	events.clear();
+
+	// And its timer disarmed
+	Sleeper *t = new Sleeper;
+	t->ready = true;
+	t->start();
+	hostScheduler.runAll();
+	t->wake();
+	hostScheduler.runAll();
+	CHECK(hostScheduler.wheel.count() == 1);
+	delete t;
+	CHECK(hostScheduler.wheel.count() == 0);
+	hostScheduler.advance(1000);
+	CHECK(hostScheduler.getReadyCount() == 0);
+
+	// Deleting itself in onFinished() is allowed
+	unsigned deleted = 0;
+	(new OneShot(deleted))->start();
+	(new OneShot(deleted))->start();
+	hostScheduler.runAll();
+	CHECK(deleted == 2);
+	CHECK(hostScheduler.getActiveCount() == 0);
+
+	// Deleting itself in run() isn't
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid == 0) {
+		Quitter *q = new Quitter(true);
+		q->start();
+		hostScheduler.runAll();
+		_exit(0);
+	}
+	int status = 0;
+	waitpid(pid, &status, 0);
+	CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+}
+
+static void test_memory(void) {
+	Allocator a;
+	a.setMemoryBudget(512);
+	CHECK(a.getMemoryBudget() == 512);
+
+	a.start();
+	hostScheduler.runNext();
+	CHECK(a.blocks[0] != nullptr && a.blocks[1] != nullptr);
+	size_t used = a.getMemoryUsed();
+	CHECK(used > 300 && used <= 512);
+
+	hostScheduler.runNext();
+	CHECK(a.blocks[2] == nullptr);
+	CHECK(a.blocks[3] != nullptr);
+	CHECK(a.getMemoryUsed() < used);
+
+	// Freed when it finishes
+	hostScheduler.runAll();
+	CHECK(a.getState() == eCRS_Idle);
+	CHECK(a.getMemoryUsed() == 0);
+
+	// And when cancelled
+	a.start();
+	hostScheduler.runNext();
+	CHECK(a.getMemoryUsed() != 0);
+	a.cancel();
+	CHECK(a.getMemoryUsed() == 0);
+
+	// Too small for anything
+	a.setMemoryBudget(16);
+	a.start();
+	hostScheduler.runNext();
+	CHECK(a.blocks[0] == nullptr && a.blocks[1] == nullptr);
+	CHECK(a.getMemoryUsed() == 0);
+	a.cancel();
+}
+
+int main(int argc, char **argv) {
+	test_start();
+	test_wait();
+	test_cancel();
+	test_delete();
+	test_memory();
+
+	CHECK(hostScheduler.getActiveCount() == 0 && hostScheduler.getReadyCount() == 0);
+	printf("%u checks, %u failed\n", checks, failures);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
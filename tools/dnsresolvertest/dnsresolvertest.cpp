@@ -0,0 +1,406 @@
+/*
+ * dnsresolvertest - host test for DnsResolver, built from the Sming sources
+ * against a stand-in DNS server.
+ *
+ * The lwIP DNS client is replaced by a server which holds a small zone and
+ * queues each query until the test has it answer, fail or time out, so every
+ * interleaving of lookups and replies can be set up. It has the same limit on
+ * queries in flight as the lwIP table. Time is a fake millisecond clock.
+ *
+ * Covered: caching and coalescing of parallel lookups, negative caching, TTL
+ * expiry with stale-while-revalidate and prefetch, cancel(owner) including
+ * from within a callback, and errors from the DNS client.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "DnsResolver.h"
+
+#define DNS_TABLE_SIZE 4 // As in lwipopts.h
+
+int debug_enabled;
+
+static uint32_t clock_ms = 0xFFFF0000; // Wraps during the test
+
+uint32_t millis(void) {
+	return clock_ms;
+}
+
+static unsigned checks;
+static unsigned failures;
+
+#define CHECK(cond) check(cond, #cond, __LINE__)
+
+static bool check(bool ok, const char *what, unsigned line) {
+	++checks;
+	if (!ok) {
+		++failures;
+		printf("FAIL at line %u: %s\n", line, what);
+	}
+	return ok;
+}
+
+/*
+ * The stand-in server, reached through the lwIP DNS client interface
+ */
+
+struct Query {
+	std::string name;
+	dns_found_callback found;
+	void *arg;
+};
+
+static std::map<std::string, IPAddress> zone;
+static std::vector<Query> pending;
+static std::map<std::string, IPAddress> lwipTable; ///< Answers lwIP returns without a query
+static unsigned serverQueries;
+static IPAddress serverAddress;
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg) {
+	auto it = lwipTable.find(hostname);
+	if (it != lwipTable.end()) {
+		*addr = *IPAddress(it->second);
+		return ERR_OK;
+	}
+	if (pending.size() >= DNS_TABLE_SIZE) {
+		return ERR_MEM;
+	}
+	pending.push_back(Query{hostname, found, callback_arg});
+	++serverQueries;
+	return ERR_INPROGRESS;
+}
+
+void dns_setserver(uint8_t numdns, ip_addr_t *dnsserver) {
+	if (numdns == 0) {
+		serverAddress = *dnsserver;
+	}
+}
+
+/** Answer the oldest query for a name from the zone, or fail it if the name isn't there */
+static bool reply(const char *name) {
+	for (auto it = pending.begin(); it != pending.end(); ++it) {
+		if (it->name != name) {
+			continue;
+		}
+		Query query = *it;
+		pending.erase(it);
+		auto answer = zone.find(name);
+		if (answer == zone.end()) {
+			query.found(query.name.c_str(), nullptr, query.arg);
+		} else {
+			query.found(query.name.c_str(), IPAddress(answer->second), query.arg);
+		}
+		return true;
+	}
+	return false;
+}
+
+static bool is_pending(const char *name) {
+	for (auto &query : pending) {
+		if (query.name == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void advance(uint32_t seconds) {
+	clock_ms += seconds * 1000;
+}
+
+/*
+ * Callers
+ */
+
+struct Result {
+	std::string name;
+	uint32_t ip;
+	const void *owner;
+};
+
+static std::vector<Result> results;
+
+class Client {
+public:
+	DnsResolverDelegate delegate() {
+		return DnsResolverDelegate(&Client::found, this);
+	}
+
+	DnsResolver *resolver = nullptr;
+	Client *cancelOther = nullptr; ///< Cancel another client's lookups from the callback
+	const char *resolveAgain = nullptr;
+
+private:
+	void found(const String &name, IPAddress ip) {
+		results.push_back(Result{name, uint32_t(ip), this});
+		if (cancelOther != nullptr) {
+			resolver->cancel(cancelOther);
+		}
+		if (resolveAgain != nullptr) {
+			IPAddress again;
+			resolver->resolve(resolveAgain, again, delegate(), this);
+			resolveAgain = nullptr;
+		}
+	}
+};
+
+static const IPAddress hostIp(10, 0, 0, 1);
+static const IPAddress movedIp(10, 0, 0, 2);
+static const IPAddress otherIp(10, 0, 0, 3);
+
+static void reset(void) {
+	zone.clear();
+	pending.clear();
+	lwipTable.clear();
+	results.clear();
+	zone["host.example"] = hostIp;
+	zone["other.example"] = otherIp;
+}
+
+static void test_lookup(void) {
+	reset();
+	DnsResolver resolver;
+	Client a, b;
+	IPAddress ip;
+
+	CHECK(resolver.resolve("", ip, a.delegate(), &a) == ERR_ARG);
+
+	// An address needs no query
+	CHECK(resolver.resolve("192.168.1.1", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(ip == uint32_t(IPAddress(192, 168, 1, 1)));
+	CHECK(serverQueries == 0);
+
+	// Parallel lookups of a name share one query
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(resolver.resolve("HOST.example", ip, b.delegate(), &b) == ERR_INPROGRESS);
+	CHECK(resolver.resolve("other.example", ip, b.delegate(), &b) == ERR_INPROGRESS);
+	CHECK(pending.size() == 2);
+	CHECK(resolver.getStats().misses == 3 && resolver.getStats().coalesced == 1);
+	CHECK(!resolver.lookup("host.example", ip));
+
+	CHECK(reply("host.example"));
+	CHECK(results.size() == 2);
+	for (auto &r : results) {
+		CHECK(r.name == "host.example" && r.ip == uint32_t(hostIp));
+	}
+	CHECK(reply("other.example"));
+	CHECK(results.size() == 3 && results[2].owner == &b && results[2].ip == uint32_t(otherIp));
+
+	// Then answered from the cache
+	results.clear();
+	unsigned queries = serverQueries;
+	ip = IPAddress();
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(ip == uint32_t(hostIp));
+	CHECK(resolver.lookup("Host.Example", ip) && ip == uint32_t(hostIp));
+	CHECK(resolver.getStats().hits == 1);
+	CHECK(serverQueries == queries && results.empty());
+
+	// lwIP may still have the answer itself
+	lwipTable["table.example"] = otherIp;
+	CHECK(resolver.resolve("table.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(ip == uint32_t(otherIp));
+	CHECK(resolver.lookup("table.example", ip));
+
+	// flush() forgets everything
+	resolver.flush();
+	CHECK(!resolver.lookup("host.example", ip));
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(reply("host.example"));
+}
+
+static void test_negative(void) {
+	reset();
+	DnsResolver resolver;
+	Client a;
+	IPAddress ip;
+
+	CHECK(resolver.resolve("missing.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(reply("missing.example"));
+	CHECK(results.size() == 1 && results[0].ip == uint32_t(INADDR_NONE));
+	CHECK(resolver.getStats().failures == 1);
+
+	// Not asked again until the negative TTL is up
+	unsigned queries = serverQueries;
+	advance(DNS_RESOLVER_NEGATIVE_TTL - 1);
+	CHECK(resolver.resolve("missing.example", ip, a.delegate(), &a) == ERR_VAL);
+	CHECK(resolver.getStats().negativeHits == 1);
+	CHECK(serverQueries == queries);
+
+	advance(1);
+	CHECK(resolver.resolve("missing.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(serverQueries == queries + 1);
+
+	// It has appeared since
+	zone["missing.example"] = otherIp;
+	results.clear();
+	CHECK(reply("missing.example"));
+	CHECK(results.size() == 1 && results[0].ip == uint32_t(otherIp));
+	CHECK(resolver.resolve("missing.example", ip, a.delegate(), &a) == ERR_OK);
+}
+
+static void test_expiry(void) {
+	reset();
+	DnsResolver resolver;
+	Client a;
+	IPAddress ip;
+
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(reply("host.example"));
+	results.clear();
+	unsigned queries = serverQueries;
+
+	// Fresh, then refreshed in the background when used near expiry
+	advance(DNS_RESOLVER_TTL - DNS_RESOLVER_PREFETCH_TIME - 1);
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(serverQueries == queries);
+	advance(1);
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(ip == uint32_t(hostIp));
+	CHECK(serverQueries == queries + 1);
+	// Only once
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(serverQueries == queries + 1);
+
+	// The host moved, which the refresh picks up
+	zone["host.example"] = movedIp;
+	CHECK(reply("host.example"));
+	CHECK(results.empty()); // Nobody was waiting
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(ip == uint32_t(movedIp));
+
+	// Expired: the old address is used while a fresh query runs
+	advance(DNS_RESOLVER_TTL);
+	queries = serverQueries;
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(ip == uint32_t(movedIp));
+	CHECK(resolver.getStats().staleHits == 1);
+	CHECK(serverQueries == queries + 1);
+
+	// The server is unreachable, so the stale address is kept
+	zone.erase("host.example");
+	CHECK(reply("host.example"));
+	CHECK(resolver.lookup("host.example", ip) && ip == uint32_t(movedIp));
+	// And the query isn't repeated within the negative TTL
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(serverQueries == queries + 1);
+	advance(DNS_RESOLVER_NEGATIVE_TTL);
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_OK);
+	CHECK(serverQueries == queries + 2);
+	CHECK(reply("host.example"));
+
+	// Until it is too old to use at all
+	advance(DNS_RESOLVER_STALE_TIME);
+	CHECK(!resolver.lookup("host.example", ip));
+	results.clear();
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(reply("host.example"));
+	CHECK(results.size() == 1 && results[0].ip == uint32_t(INADDR_NONE));
+
+	// prefetch() refreshes ahead of time
+	zone["other.example"] = otherIp;
+	queries = serverQueries;
+	resolver.prefetch("other.example");
+	resolver.prefetch("other.example");
+	CHECK(serverQueries == queries + 1);
+	CHECK(reply("other.example"));
+	CHECK(resolver.lookup("other.example", ip) && ip == uint32_t(otherIp));
+}
+
+static void test_cancel(void) {
+	reset();
+	DnsResolver resolver;
+	Client a, b, c;
+	a.resolver = b.resolver = c.resolver = &resolver;
+	IPAddress ip;
+
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(resolver.resolve("host.example", ip, b.delegate(), &b) == ERR_INPROGRESS);
+	CHECK(resolver.resolve("other.example", ip, b.delegate(), &b) == ERR_INPROGRESS);
+	CHECK(resolver.resolve("host.example", ip, c.delegate(), &c) == ERR_INPROGRESS);
+
+	// All of an owner's lookups go
+	resolver.cancel(&b);
+	resolver.cancel(nullptr);
+	CHECK(reply("host.example"));
+	CHECK(reply("other.example"));
+	CHECK(results.size() == 2);
+	for (auto &r : results) {
+		CHECK(r.owner != &b);
+	}
+
+	// A callback may cancel lookups still to be called back, and start new ones
+	results.clear();
+	resolver.flush();
+	c.cancelOther = &a;
+	c.resolveAgain = "other.example";
+	CHECK(resolver.resolve("host.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+	CHECK(resolver.resolve("host.example", ip, c.delegate(), &c) == ERR_INPROGRESS);
+	CHECK(reply("host.example"));
+	CHECK(results.size() == 1 && results[0].owner == &c);
+	CHECK(is_pending("other.example"));
+	CHECK(reply("other.example"));
+	CHECK(results.size() == 2 && results[1].owner == &c && results[1].ip == uint32_t(otherIp));
+}
+
+static void test_limits(void) {
+	reset();
+	DnsResolver resolver;
+	Client a;
+	IPAddress ip;
+
+	// More names than lwIP can query at once: the error is passed on and not cached
+	char name[32];
+	for (unsigned i = 0; i < DNS_TABLE_SIZE; ++i) {
+		sprintf(name, "host%u.example", i);
+		CHECK(resolver.resolve(name, ip, a.delegate(), &a) == ERR_INPROGRESS);
+	}
+	CHECK(resolver.resolve("late.example", ip, a.delegate(), &a) == ERR_MEM);
+	CHECK(pending.size() == DNS_TABLE_SIZE);
+	CHECK(reply("host0.example"));
+	CHECK(resolver.resolve("late.example", ip, a.delegate(), &a) == ERR_INPROGRESS);
+
+	// Names waited on aren't replaced, so a full cache refuses new ones
+	while (!pending.empty()) {
+		reply(pending[0].name.c_str());
+	}
+	lwipTable.clear();
+	for (unsigned i = 0; i < DNS_RESOLVER_CACHE_SIZE; ++i) {
+		sprintf(name, "wait%u.example", i);
+		if (i < DNS_TABLE_SIZE) {
+			CHECK(resolver.resolve(name, ip, a.delegate(), &a) == ERR_INPROGRESS);
+		} else {
+			// lwIP is full, so these have no waiters and may be replaced
+			CHECK(resolver.resolve(name, ip, a.delegate(), &a) == ERR_MEM);
+		}
+	}
+	CHECK(resolver.resolve("new.example", ip, a.delegate(), &a) == ERR_MEM);
+	while (!pending.empty()) {
+		reply(pending[0].name.c_str());
+	}
+
+	resolver.cancel(&a);
+	DnsResolver::setServer(IPAddress(127, 0, 0, 1));
+	CHECK(serverAddress == uint32_t(IPAddress(127, 0, 0, 1)));
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		debug_enabled = 1;
+	}
+
+	test_lookup();
+	test_negative();
+	test_expiry();
+	test_cancel();
+	test_limits();
+
+	printf("%u checks, %u failed\n", checks, failures);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
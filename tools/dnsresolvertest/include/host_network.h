@@ -0,0 +1,116 @@
+/*
+ * Force-included into DnsResolver.cpp for dnsresolvertest. It takes the place
+ * of the Wiring, clock and lwIP headers DnsResolver.h pulls in, with just what
+ * the resolver uses. The lwIP DNS client is replaced by the stand-in server in
+ * dnsresolvertest.cpp.
+ */
+
+#ifndef _HOST_NETWORK_H_
+#define _HOST_NETWORK_H_
+
+#include <user_config.h>
+#include <string>
+#include <strings.h>
+#include <arpa/inet.h>
+
+// Claim the include guards of the headers replaced here
+#define WIRING_WIRINGFRAMEWORKDEPENDENCIES_H_
+#define WSTRING_H
+#define IPAddress_h
+#define _SMING_CORE_CLOCK_H_
+
+typedef int8_t err_t;
+
+#define ERR_OK 0
+#define ERR_MEM -1
+#define ERR_INPROGRESS -5
+#define ERR_VAL -6
+#define ERR_ARG -14
+
+typedef struct ip_addr {
+	uint32_t addr;
+} ip_addr_t;
+
+#define LWIP_IP_ADDR_T ip_addr_t
+
+typedef void (*dns_found_callback)(const char* name, ip_addr_t* ipaddr, void* callback_arg);
+
+err_t dns_gethostbyname(const char* hostname, ip_addr_t* addr, dns_found_callback found, void* callback_arg);
+void dns_setserver(uint8_t numdns, ip_addr_t* dnsserver);
+
+static inline int ipaddr_aton(const char* cp, ip_addr_t* addr)
+{
+	struct in_addr in;
+	if(inet_pton(AF_INET, cp, &in) != 1) {
+		return 0;
+	}
+	addr->addr = in.s_addr;
+	return 1;
+}
+
+uint32_t millis(void);
+
+class String : public std::string
+{
+public:
+	String()
+	{
+	}
+
+	String(const char* s) : std::string(s ? s : "")
+	{
+	}
+
+	unsigned length() const
+	{
+		return size();
+	}
+
+	bool equalsIgnoreCase(const String& s) const
+	{
+		return strcasecmp(c_str(), s.c_str()) == 0;
+	}
+};
+
+class IPAddress
+{
+public:
+	IPAddress()
+	{
+	}
+
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+	{
+		const uint8_t bytes[] = {a, b, c, d};
+		memcpy(&address.addr, bytes, sizeof(bytes));
+	}
+
+	IPAddress(ip_addr_t address) : address(address)
+	{
+	}
+
+	operator uint32_t() const
+	{
+		return address.addr;
+	}
+
+	operator ip_addr_t*()
+	{
+		return &address;
+	}
+
+	String toString() const
+	{
+		char buf[INET_ADDRSTRLEN];
+		return inet_ntop(AF_INET, &address, buf, sizeof(buf));
+	}
+
+private:
+	ip_addr_t address = {0};
+};
+
+// As Sming defines it, in place of the socket API's
+#undef INADDR_NONE
+#define INADDR_NONE IPAddress()
+
+#endif /* _HOST_NETWORK_H_ */
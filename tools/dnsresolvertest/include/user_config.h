@@ -0,0 +1,23 @@
+/*
+ * Stand-in for the SDK's user_config.h, for the Sming headers dnsresolvertest
+ * builds with
+ */
+
+#ifndef _USER_CONFIG_H_
+#define _USER_CONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define __forceinline __attribute__((always_inline)) inline
+
+extern int debug_enabled;
+#define debug_e(fmt, ...) (debug_enabled ? printf(fmt "\n", ##__VA_ARGS__) : 0)
+#define debug_w(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+#define debug_i(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+#define debug_d(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+
+#endif /* _USER_CONFIG_H_ */
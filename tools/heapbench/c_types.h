@@ -0,0 +1,12 @@
+/*
+ * Stand-in for the SDK's c_types.h, so custom_heap/heap_pool.c builds for heapbench
+ */
+
+#ifndef _C_TYPES_H_
+#define _C_TYPES_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#endif /* _C_TYPES_H_ */
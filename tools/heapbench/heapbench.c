@@ -0,0 +1,678 @@
+/*
+ * heapbench - host replay of heap traces against umm_malloc, on its own and
+ * with the small object pools from custom_heap/heap_pool.c in front, both
+ * built from the Sming sources.
+ *
+ * A trace has one heap call per line:
+ *
+ *   a <id> <size>            allocate
+ *   r <id> <size> [<new id>] reallocate
+ *   f <id>                   free
+ *
+ * Ids are any word, normally the address the device returned. Lines may start
+ * with "heap ", and anything else is skipped, so a serial log from a build with
+ * HEAP_POOL_TRACE=1 can be replayed as it is. Without a trace, one is made up
+ * along the lines of a networked application: mostly short lived 16 to 64 byte
+ * blocks, Strings grown a piece at a time, some packet sized buffers and a
+ * slowly changing set of long lived objects. It can be saved with -w.
+ *
+ * Each pass starts from an empty heap of the given size (the free heap the
+ * application has after boot) and ends by freeing anything the trace left
+ * allocated. The pools can't be reset, so each allocator runs in its own
+ * process. Reported:
+ *  - host time per call, only useful to compare the two
+ *  - allocations that failed
+ *  - free heap, and the largest block still free, which is the biggest
+ *    allocation that would have worked at every point in the trace
+ *  - fragmentation, 1 - largest free block / free heap, sampled as it runs
+ * Block contents are checked on free, so the run also catches allocator bugs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "umm_malloc.h"
+#include "heap_pool.h"
+
+#define MAX_HEAP (65535 * 8)    // umm_malloc counts 8 byte blocks in 16 bits
+#define MAX_ID 32
+#define HIST_STEP 10            // ns
+#define HIST_SIZE 2000
+
+char heapbench_heap[MAX_HEAP] __attribute__((aligned(8)));
+size_t heapbench_heap_size = 48 * 1024;
+
+// heap_pool.c is built as for a -wrap link, with umm_malloc underneath
+void *__real_malloc(size_t size) { return umm_malloc(size); }
+void __real_free(void *ptr) { umm_free(ptr); }
+void *__real_realloc(void *ptr, size_t size) { return umm_realloc(ptr, size); }
+void *__real_calloc(size_t count, size_t size) { return umm_calloc(count, size); }
+
+enum { OP_ALLOC, OP_REALLOC, OP_FREE, OP_COUNT };
+static const char *op_names[OP_COUNT] = {"malloc", "realloc", "free"};
+
+typedef struct {
+	uint8_t type;
+	uint32_t slot;
+	uint32_t size;
+} op_t;
+
+static op_t *ops;
+static uint32_t op_count;
+static uint32_t op_capacity;
+static uint32_t slot_count;
+
+static void add_op(uint8_t type, uint32_t slot, uint32_t size) {
+	if (op_count == op_capacity) {
+		op_capacity = op_capacity ? op_capacity * 2 : 65536;
+		ops = realloc(ops, op_capacity * sizeof(op_t));
+		if (ops == NULL) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	ops[op_count++] = (op_t){type, slot, size};
+}
+
+/*
+ * Slots stand for blocks that are allocated at the same time, so the trace's
+ * ids become small numbers the replay can index with
+ */
+static uint32_t *free_slots;
+static uint32_t free_slot_count;
+static uint32_t free_slot_capacity;
+
+static uint32_t take_slot(void) {
+	if (free_slot_count != 0) {
+		return free_slots[--free_slot_count];
+	}
+	return slot_count++;
+}
+
+static void release_slot(uint32_t slot) {
+	if (free_slot_count == free_slot_capacity) {
+		free_slot_capacity = free_slot_capacity ? free_slot_capacity * 2 : 1024;
+		free_slots = realloc(free_slots, free_slot_capacity * sizeof(uint32_t));
+	}
+	free_slots[free_slot_count++] = slot;
+}
+
+/*
+ * Trace files
+ */
+
+typedef struct {
+	char id[MAX_ID];
+	uint32_t slot;
+	uint8_t state;      // 0 empty, 1 in use, 2 deleted
+} id_entry_t;
+
+static id_entry_t *ids;
+static uint32_t id_capacity;
+static uint32_t id_used;    // in use or deleted
+
+static uint32_t hash_id(const char *id) {
+	uint32_t h = 2166136261u;
+	while (*id) {
+		h = (h ^ (uint8_t)*id++) * 16777619u;
+	}
+	return h;
+}
+
+static id_entry_t *find_id(const char *id, int insert) {
+	if (insert && (id_used + 1) * 2 > id_capacity) {
+		id_entry_t *old = ids;
+		uint32_t old_capacity = id_capacity;
+		id_capacity = id_capacity ? id_capacity * 2 : 4096;
+		ids = calloc(id_capacity, sizeof(id_entry_t));
+		id_used = 0;
+		for (uint32_t i = 0; i < old_capacity; ++i) {
+			if (old[i].state == 1) {
+				*find_id(old[i].id, 1) = old[i];
+			}
+		}
+		free(old);
+	}
+	if (id_capacity == 0) {
+		return NULL;
+	}
+
+	id_entry_t *deleted = NULL;
+	for (uint32_t i = hash_id(id) & (id_capacity - 1);; i = (i + 1) & (id_capacity - 1)) {
+		id_entry_t *e = &ids[i];
+		if (e->state == 0) {
+			if (!insert) {
+				return NULL;
+			}
+			if (deleted == NULL) {
+				++id_used;
+			}
+			return deleted ? deleted : e;
+		}
+		if (e->state == 2) {
+			if (deleted == NULL) {
+				deleted = e;
+			}
+		} else if (strcmp(e->id, id) == 0) {
+			return e;
+		}
+	}
+}
+
+static uint32_t skipped;
+
+static void read_trace(const char *filename) {
+	FILE *f = fopen(filename, "r");
+	if (f == NULL) {
+		perror(filename);
+		exit(1);
+	}
+
+	char line[256];
+	while (fgets(line, sizeof(line), f) != NULL) {
+		char *p = line;
+		if (strncmp(p, "heap ", 5) == 0) {
+			p += 5;
+		}
+		char type = 0;
+		char id[MAX_ID], new_id[MAX_ID];
+		unsigned size;
+		int n = sscanf(p, "%c %31s %u %31s", &type, id, &size, new_id);
+
+		if (type == 'a' && n >= 3) {
+			id_entry_t *e = find_id(id, 1);
+			if (e->state == 1) {
+				// Never freed as far as the trace shows, so let it go
+				add_op(OP_FREE, e->slot, 0);
+			} else {
+				strcpy(e->id, id);
+				e->state = 1;
+				e->slot = take_slot();
+			}
+			add_op(OP_ALLOC, e->slot, size);
+		} else if (type == 'f' && n >= 2) {
+			id_entry_t *e = find_id(id, 0);
+			if (e == NULL) {
+				++skipped;
+				continue;
+			}
+			add_op(OP_FREE, e->slot, 0);
+			release_slot(e->slot);
+			e->state = 2;
+		} else if (type == 'r' && n >= 3) {
+			id_entry_t *e = find_id(id, 0);
+			if (e == NULL) {
+				++skipped;
+				continue;
+			}
+			uint32_t slot = e->slot;
+			add_op(OP_REALLOC, slot, size);
+			if (n == 4 && strcmp(id, new_id) != 0) {
+				e->state = 2;
+				e = find_id(new_id, 1);
+				strcpy(e->id, new_id);
+				e->state = 1;
+				e->slot = slot;
+			}
+		}
+	}
+
+	fclose(f);
+}
+
+/*
+ * Made up trace. Each step allocates one block, maybe grows it, and frees
+ * whatever has reached the end of its life.
+ */
+
+typedef struct {
+	uint32_t expires;
+	uint32_t slot;
+	int long_lived;
+} live_t;
+
+static live_t *live;
+static uint32_t live_count;
+static uint32_t live_capacity;
+
+static void live_push(uint32_t expires, uint32_t slot, int long_lived) {
+	if (live_count == live_capacity) {
+		live_capacity = live_capacity ? live_capacity * 2 : 1024;
+		live = realloc(live, live_capacity * sizeof(live_t));
+	}
+	uint32_t i = live_count++;
+	while (i != 0 && live[(i - 1) / 2].expires > expires) {
+		live[i] = live[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	live[i] = (live_t){expires, slot, long_lived};
+}
+
+static live_t live_pop(void) {
+	live_t top = live[0];
+	live_t last = live[--live_count];
+	uint32_t i = 0;
+	for (;;) {
+		uint32_t c = i * 2 + 1;
+		if (c >= live_count) {
+			break;
+		}
+		if (c + 1 < live_count && live[c + 1].expires < live[c].expires) {
+			++c;
+		}
+		if (live[c].expires >= last.expires) {
+			break;
+		}
+		live[i] = live[c];
+		i = c;
+	}
+	live[i] = last;
+	return top;
+}
+
+static uint32_t rnd(uint32_t n) {
+	return (uint32_t)(rand() % n);
+}
+
+// Exponential, for lifetimes
+static uint32_t lifetime(uint32_t mean) {
+	double u = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+	return 1 + (uint32_t)(-(double)mean * log(u));
+}
+
+static void generate_trace(uint32_t count, uint32_t seed) {
+	srand(seed);
+	uint32_t long_lived = 0;
+
+	for (uint32_t step = 0; op_count < count; ++step) {
+		uint32_t slot = take_slot();
+		uint32_t size;
+		uint32_t life;
+		int keep = 0;
+		uint32_t kind = rnd(1000);
+
+		if (kind < 700) {
+			// Strings, delegates, timers, pbuf wrappers
+			size = (rnd(2) == 0) ? 16 + rnd(17) : 8 + rnd(57);
+			life = lifetime(30);
+		} else if (kind < 820) {
+			// String built up by concatenation
+			size = 8 + rnd(24);
+			add_op(OP_ALLOC, slot, size);
+			for (uint32_t n = 1 + rnd(6); n != 0; --n) {
+				size += 8 + rnd(40);
+				add_op(OP_REALLOC, slot, size);
+			}
+			live_push(step + lifetime(40), slot, 0);
+			size = 0;
+			life = 0;
+		} else if (kind < 970) {
+			// Request headers, small streams
+			size = 65 + rnd(448);
+			life = lifetime(80);
+		} else if (kind < 995) {
+			// Packet and file buffers
+			size = 1024 + rnd(1897);
+			life = lifetime(40);
+		} else if (long_lived < 128) {
+			// Connections, objects the application keeps
+			size = 16 + rnd(241);
+			life = 2000 + rnd(18000);
+			keep = 1;
+			++long_lived;
+		} else {
+			size = 16 + rnd(49);
+			life = lifetime(30);
+		}
+
+		if (size != 0) {
+			add_op(OP_ALLOC, slot, size);
+			live_push(step + life, slot, keep);
+		}
+
+		while (live_count != 0 && live[0].expires <= step) {
+			live_t l = live_pop();
+			if (l.long_lived) {
+				--long_lived;
+			}
+			add_op(OP_FREE, l.slot, 0);
+			release_slot(l.slot);
+		}
+	}
+}
+
+static void write_trace(const char *filename) {
+	FILE *f = fopen(filename, "w");
+	if (f == NULL) {
+		perror(filename);
+		exit(1);
+	}
+	for (uint32_t i = 0; i < op_count; ++i) {
+		const op_t *op = &ops[i];
+		switch (op->type) {
+			case OP_ALLOC:
+				fprintf(f, "a %u %u\n", op->slot, op->size);
+				break;
+			case OP_REALLOC:
+				fprintf(f, "r %u %u\n", op->slot, op->size);
+				break;
+			default:
+				fprintf(f, "f %u\n", op->slot);
+		}
+	}
+	fclose(f);
+}
+
+/*
+ * Replay
+ */
+
+typedef struct {
+	const char *name;
+	void *(*malloc)(size_t size);
+	void *(*realloc)(void *ptr, size_t size);
+	void (*free)(void *ptr);
+	size_t (*reserved)(void);     // Free memory the allocator holds outside umm_malloc
+} allocator_t;
+
+static size_t no_reserve(void) {
+	return 0;
+}
+
+static const allocator_t allocators[] = {
+	{"umm_malloc", umm_malloc, umm_realloc, umm_free, no_reserve},
+	{"umm_malloc with pools", heap_pool_malloc, heap_pool_realloc, heap_pool_free, heap_pool_free_size},
+};
+
+typedef struct {
+	uint32_t count;
+	uint64_t total;
+	uint64_t max;
+	uint32_t hist[HIST_SIZE + 1];
+} timing_t;
+
+typedef struct {
+	timing_t timing[OP_COUNT];
+	uint32_t failed;
+	uint32_t corrupt;
+	size_t min_free;
+	size_t min_largest;
+	size_t end_largest;
+	double frag_total;
+	double frag_worst;
+	uint32_t samples;
+} results_t;
+
+static void **blocks;
+static uint32_t *sizes;
+static uint64_t overhead;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void calibrate(void) {
+	uint64_t best = ~0ull;
+	for (int i = 0; i < 10000; ++i) {
+		uint64_t t = now_ns();
+		uint64_t d = now_ns() - t;
+		if (d < best) {
+			best = d;
+		}
+	}
+	overhead = best;
+}
+
+static void record(timing_t *t, uint64_t ns) {
+	ns = (ns > overhead) ? ns - overhead : 0;
+	++t->count;
+	t->total += ns;
+	if (ns > t->max) {
+		t->max = ns;
+	}
+	uint64_t bucket = ns / HIST_STEP;
+	++t->hist[bucket < HIST_SIZE ? bucket : HIST_SIZE];
+}
+
+static uint64_t percentile(const timing_t *t, double p) {
+	uint32_t target = (uint32_t)(t->count * p);
+	uint32_t n = 0;
+	for (uint32_t i = 0; i <= HIST_SIZE; ++i) {
+		n += t->hist[i];
+		if (n > target) {
+			return (uint64_t)i * HIST_STEP;
+		}
+	}
+	return t->max;
+}
+
+static uint8_t fill_byte(uint32_t slot, uint32_t i) {
+	return (uint8_t)(slot * 31 + i);
+}
+
+static void fill(uint32_t slot, uint32_t from, uint32_t to) {
+	uint8_t *p = blocks[slot];
+	for (uint32_t i = from; i < to; ++i) {
+		p[i] = fill_byte(slot, i);
+	}
+}
+
+static int check(uint32_t slot, uint32_t length) {
+	const uint8_t *p = blocks[slot];
+	for (uint32_t i = 0; i < length; ++i) {
+		if (p[i] != fill_byte(slot, i)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void sample(const allocator_t *a, results_t *r) {
+	umm_info(NULL, 0);
+	size_t free_size = (size_t)ummHeapInfo.freeBlocks * 8 + a->reserved();
+	size_t largest = (size_t)ummHeapInfo.maxFreeContiguousBlocks * 8;
+	if (free_size < r->min_free) {
+		r->min_free = free_size;
+	}
+	if (largest < r->min_largest) {
+		r->min_largest = largest;
+	}
+	double frag = free_size ? 1.0 - (double)largest / free_size : 0;
+	r->frag_total += frag;
+	if (frag > r->frag_worst) {
+		r->frag_worst = frag;
+	}
+	++r->samples;
+}
+
+static void replay(const allocator_t *a, results_t *r, uint32_t passes, uint32_t interval) {
+	memset(r, 0, sizeof(*r));
+	r->min_free = r->min_largest = ~(size_t)0;
+	blocks = calloc(slot_count, sizeof(void *));
+	sizes = calloc(slot_count, sizeof(uint32_t));
+
+	umm_init();
+	for (uint32_t pass = 0; pass < passes; ++pass) {
+		for (uint32_t i = 0; i < op_count; ++i) {
+			const op_t *op = &ops[i];
+			uint32_t slot = op->slot;
+			void *p;
+			uint64_t t;
+
+			switch (op->type) {
+				case OP_ALLOC:
+					t = now_ns();
+					p = a->malloc(op->size);
+					record(&r->timing[OP_ALLOC], now_ns() - t);
+					blocks[slot] = p;
+					sizes[slot] = p ? op->size : 0;
+					if (p == NULL) {
+						++r->failed;
+					}
+					fill(slot, 0, sizes[slot]);
+					break;
+
+				case OP_REALLOC:
+					if (blocks[slot] == NULL) {
+						break;
+					}
+					t = now_ns();
+					p = a->realloc(blocks[slot], op->size);
+					record(&r->timing[OP_REALLOC], now_ns() - t);
+					if (p == NULL) {
+						// The old block stays as it was
+						++r->failed;
+						break;
+					}
+					blocks[slot] = p;
+					if (!check(slot, sizes[slot] < op->size ? sizes[slot] : op->size)) {
+						++r->corrupt;
+					}
+					fill(slot, 0, op->size);
+					sizes[slot] = op->size;
+					break;
+
+				default:
+					if (blocks[slot] == NULL) {
+						break;
+					}
+					if (!check(slot, sizes[slot])) {
+						++r->corrupt;
+					}
+					t = now_ns();
+					a->free(blocks[slot]);
+					record(&r->timing[OP_FREE], now_ns() - t);
+					blocks[slot] = NULL;
+			}
+
+			if (interval != 0 && i % interval == 0) {
+				sample(a, r);
+			}
+		}
+
+		for (uint32_t slot = 0; slot < slot_count; ++slot) {
+			if (blocks[slot] != NULL) {
+				if (!check(slot, sizes[slot])) {
+					++r->corrupt;
+				}
+				a->free(blocks[slot]);
+				blocks[slot] = NULL;
+			}
+		}
+	}
+
+	umm_info(NULL, 0);
+	r->end_largest = (size_t)ummHeapInfo.maxFreeContiguousBlocks * 8;
+	free(blocks);
+	free(sizes);
+}
+
+static void print_results(const allocator_t *a, const results_t *r) {
+	printf("%s:\n", a->name);
+	for (int i = 0; i < OP_COUNT; ++i) {
+		const timing_t *t = &r->timing[i];
+		if (t->count == 0) {
+			continue;
+		}
+		printf("  %-8s %8u calls, ns mean %4u, median %4u, 99%% %5u, max %6u\n", op_names[i], t->count,
+			(unsigned)(t->total / t->count), (unsigned)percentile(t, 0.5), (unsigned)percentile(t, 0.99),
+			(unsigned)t->max);
+	}
+	printf("  failed allocations %u\n", r->failed);
+	if (r->corrupt != 0) {
+		printf("  CORRUPTED BLOCKS %u\n", r->corrupt);
+	}
+	if (r->samples != 0) {
+		printf("  lowest free heap %zu, smallest largest free block %zu\n", r->min_free, r->min_largest);
+		printf("  fragmentation mean %.1f%%, worst %.1f%%\n", 100 * r->frag_total / r->samples,
+			100 * r->frag_worst);
+	}
+	printf("  largest free block once all freed %zu of %zu\n", r->end_largest, heapbench_heap_size);
+}
+
+static void usage(const char *name) {
+	printf("Usage: %s [options]\n"
+		"  -t file       Replay a trace instead of making one up\n"
+		"  -w file       Save the trace made up\n"
+		"  -n ops        Calls to make up (default 200000)\n"
+		"  -r seed       Random seed (default 1)\n"
+		"  -s size       Heap size, up to %u (default %zu)\n"
+		"  -p passes     Times to replay the trace (default 1)\n"
+		"  -i ops        Sample fragmentation every so many calls, 0 for never (default 100)\n",
+		name, MAX_HEAP, heapbench_heap_size);
+}
+
+int main(int argc, char **argv) {
+	const char *trace_file = NULL;
+	const char *save_file = NULL;
+	uint32_t count = 200000;
+	uint32_t seed = 1;
+	uint32_t passes = 1;
+	uint32_t interval = 100;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:w:n:r:s:p:i:h")) != -1) {
+		switch (opt) {
+			case 't': trace_file = optarg; break;
+			case 'w': save_file = optarg; break;
+			case 'n': count = strtoul(optarg, NULL, 0); break;
+			case 'r': seed = strtoul(optarg, NULL, 0); break;
+			case 's': heapbench_heap_size = strtoul(optarg, NULL, 0); break;
+			case 'p': passes = strtoul(optarg, NULL, 0); break;
+			case 'i': interval = strtoul(optarg, NULL, 0); break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (heapbench_heap_size < 1024 || heapbench_heap_size > MAX_HEAP || passes == 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (trace_file != NULL) {
+		read_trace(trace_file);
+		printf("%s: %u calls, %u slots", trace_file, op_count, slot_count);
+		if (skipped != 0) {
+			printf(", %u calls on blocks allocated before the trace started skipped", skipped);
+		}
+		printf("\n");
+	} else {
+		generate_trace(count, seed);
+		printf("Made up trace: %u calls, %u slots, seed %u\n", op_count, slot_count, seed);
+		if (save_file != NULL) {
+			write_trace(save_file);
+		}
+	}
+	printf("Heap %zu bytes, %u pass(es)\n\n", heapbench_heap_size, passes);
+
+	calibrate();
+	for (unsigned i = 0; i < sizeof(allocators) / sizeof(allocators[0]); ++i) {
+		fflush(stdout);
+		pid_t pid = fork();
+		if (pid < 0) {
+			perror("fork");
+			return 1;
+		}
+		if (pid == 0) {
+			results_t r;
+			replay(&allocators[i], &r, passes, interval);
+			print_results(&allocators[i], &r);
+			if (allocators[i].reserved != no_reserve) {
+				heap_pool_info();
+			}
+			printf("\n");
+			return 0;
+		}
+		waitpid(pid, NULL, 0);
+	}
+
+	return 0;
+}
@@ -0,0 +1,55 @@
+/*
+ * umm_malloc configuration for heapbench, used in place of the ESP8266 one in
+ * third-party/umm_malloc/src/umm_malloc_cfg.h: it is force-included first and
+ * takes that file's include guard. Settings match the device apart from the
+ * heap, which is a buffer of the size given on the command line, and the
+ * critical sections, which aren't needed.
+ */
+
+#ifndef _UMM_MALLOC_CFG_H
+#define _UMM_MALLOC_CFG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+extern char heapbench_heap[];
+extern size_t heapbench_heap_size;
+
+#define UMM_MALLOC_CFG_HEAP_ADDR (heapbench_heap)
+#define UMM_MALLOC_CFG_HEAP_SIZE (heapbench_heap_size)
+
+#define UMM_H_ATTPACKPRE
+#define UMM_H_ATTPACKSUF __attribute__((__packed__))
+
+#define UMM_BEST_FIT
+#undef UMM_FIRST_FIT
+
+#define UMM_INFO
+
+typedef struct UMM_HEAP_INFO_t {
+	unsigned short int totalEntries;
+	unsigned short int usedEntries;
+	unsigned short int freeEntries;
+	unsigned short int totalBlocks;
+	unsigned short int usedBlocks;
+	unsigned short int freeBlocks;
+	unsigned short int maxFreeContiguousBlocks;
+} UMM_HEAP_INFO;
+
+extern UMM_HEAP_INFO ummHeapInfo;
+void* umm_info(void* ptr, int force);
+size_t umm_free_heap_size(void);
+
+#define UMM_CRITICAL_ENTRY()
+#define UMM_CRITICAL_EXIT()
+
+#define INTEGRITY_CHECK() 0
+#define POISON_CHECK() 0
+#define UMM_POISON_SIZE_BEFORE 4
+#define UMM_POISON_SIZE_AFTER 4
+#define UMM_POISONED_BLOCK_LEN_TYPE uint32_t
+
+#define ets_printf printf
+
+#endif /* _UMM_MALLOC_CFG_H */
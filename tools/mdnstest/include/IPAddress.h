@@ -0,0 +1,44 @@
+/*
+ * Stand-in for Sming's IPAddress for mdnstest
+ */
+
+#ifndef _IPADDRESS_H_
+#define _IPADDRESS_H_
+
+#include "WString.h"
+
+class IPAddress
+{
+public:
+	IPAddress()
+	{
+	}
+
+	IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address{a, b, c, d}
+	{
+	}
+
+	operator uint32_t() const
+	{
+		uint32_t value;
+		memcpy(&value, address, sizeof(value));
+		return value;
+	}
+
+	uint8_t operator[](int index) const
+	{
+		return address[index];
+	}
+
+	String toString() const
+	{
+		char buf[16];
+		sprintf(buf, "%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+		return buf;
+	}
+
+private:
+	uint8_t address[4] = {0};
+};
+
+#endif /* _IPADDRESS_H_ */
@@ -0,0 +1,63 @@
+/*
+ * Stand-in for Sming's UdpConnection for mdnstest. Nothing goes near a
+ * network: the test captures output by overriding MdnsResponder::sendPacket().
+ */
+
+#ifndef SMINGCORE_NETWORK_UDPCONNECTION_H_
+#define SMINGCORE_NETWORK_UDPCONNECTION_H_
+
+#include "../IPAddress.h"
+
+struct pbuf {
+	pbuf* next;
+	void* payload;
+	uint16_t tot_len;
+	uint16_t len;
+};
+
+static inline uint16_t pbuf_copy_partial(pbuf* buf, void* data, uint16_t length, uint16_t offset)
+{
+	memcpy(data, static_cast<uint8_t*>(buf->payload) + offset, length);
+	return length;
+}
+
+struct udp_pcb {
+	uint8_t ttl;
+};
+
+class UdpConnection
+{
+public:
+	virtual ~UdpConnection()
+	{
+	}
+
+	virtual bool listen(int port)
+	{
+		udp = &pcb;
+		return true;
+	}
+
+	virtual void close()
+	{
+		udp = nullptr;
+	}
+
+	virtual bool sendTo(IPAddress remoteIP, uint16_t remotePort, const char* data, int length)
+	{
+		return false;
+	}
+
+protected:
+	virtual void onReceive(pbuf* buf, IPAddress remoteIP, uint16_t remotePort)
+	{
+	}
+
+protected:
+	udp_pcb* udp = nullptr;
+
+private:
+	udp_pcb pcb = {};
+};
+
+#endif /* SMINGCORE_NETWORK_UDPCONNECTION_H_ */
@@ -0,0 +1,42 @@
+/*
+ * Stand-in for Sming's TimerScheduler for mdnstest: the real TimerWheel,
+ * run by the test from its fake millis() clock
+ */
+
+#ifndef _SMING_CORE_TIMER_SCHEDULER_H_
+#define _SMING_CORE_TIMER_SCHEDULER_H_
+
+#include <user_config.h>
+#include "TimerWheel.h"
+
+class TimerScheduler
+{
+public:
+	typedef TimerWheel::Entry Entry;
+
+	void arm(Entry& entry, uint32_t milliseconds, bool repeating)
+	{
+		wheel.arm(entry, millis(), milliseconds, repeating);
+	}
+
+	void disarm(Entry& entry)
+	{
+		wheel.disarm(entry);
+	}
+
+	/** @brief Run the callbacks of timers which have expired by millis() */
+	void process()
+	{
+		Entry* entry;
+		while((entry = wheel.expire(millis())) != nullptr) {
+			entry->callback(entry->arg);
+		}
+	}
+
+private:
+	TimerWheel wheel;
+};
+
+extern TimerScheduler timerScheduler;
+
+#endif /* _SMING_CORE_TIMER_SCHEDULER_H_ */
@@ -0,0 +1,47 @@
+/*
+ * Stand-in for Sming's String for mdnstest, with just what MdnsResponder uses
+ */
+
+#ifndef _WSTRING_H_
+#define _WSTRING_H_
+
+#include <user_config.h>
+#include <string>
+#include <strings.h>
+
+class String : public std::string
+{
+public:
+	String()
+	{
+	}
+
+	String(const char* s) : std::string(s ? s : "")
+	{
+	}
+
+	String(const std::string& s) : std::string(s)
+	{
+	}
+
+	using std::string::operator+=;
+
+	// Sming's String appends numbers as text
+	String& operator+=(int value)
+	{
+		append(std::to_string(value));
+		return *this;
+	}
+
+	unsigned length() const
+	{
+		return size();
+	}
+
+	bool equalsIgnoreCase(const String& s) const
+	{
+		return strcasecmp(c_str(), s.c_str()) == 0;
+	}
+};
+
+#endif /* _WSTRING_H_ */
@@ -0,0 +1,18 @@
+/*
+ * Stand-in for lwIP's IGMP interface for mdnstest
+ */
+
+#ifndef __LWIP_IGMP_H__
+#define __LWIP_IGMP_H__
+
+static inline int igmp_joingroup(const IPAddress& ifaddr, const IPAddress& groupaddr)
+{
+	return 0;
+}
+
+static inline int igmp_leavegroup(const IPAddress& ifaddr, const IPAddress& groupaddr)
+{
+	return 0;
+}
+
+#endif /* __LWIP_IGMP_H__ */
@@ -0,0 +1,26 @@
+/*
+ * Stand-in for the SDK and Sming headers MdnsResponder uses, for mdnstest.
+ * Time and randomness come from mdnstest.cpp.
+ */
+
+#ifndef _USER_CONFIG_H_
+#define _USER_CONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+extern int debug_enabled;
+#define debug_e(fmt, ...) (debug_enabled ? printf(fmt "\n", ##__VA_ARGS__) : 0)
+#define debug_w(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+#define debug_i(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+#define debug_d(fmt, ...) debug_e(fmt, ##__VA_ARGS__)
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+uint32_t millis(void);
+uint32_t os_random(void);
+
+#endif /* _USER_CONFIG_H_ */
@@ -0,0 +1,684 @@
+/*
+ * mdnstest - host test for MdnsResponder, built from the Sming sources with
+ * the network replaced by a loopback.
+ *
+ * Queries and responses from other hosts are built here and fed to
+ * processPacket(), and everything the responder sends is captured through
+ * sendPacket() and decoded again. Time is a fake millisecond clock which runs
+ * the responder's timers, so response delays and rate limits are checked to
+ * the millisecond.
+ *
+ * Covered: probing, announcing and renaming on conflict ("name-2",
+ * "Name (2)"), known-answer suppression with the half-TTL rule, aggregation
+ * of queries within the response delay, the one second multicast rate limit,
+ * unicast (QU) and legacy port replies, and splitting a response which won't
+ * fit in MDNS_MAX_PACKET.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <string>
+#include <vector>
+#include "MdnsResponder.h"
+
+#define TYPE_A 1
+#define TYPE_PTR 12
+#define TYPE_TXT 16
+#define TYPE_SRV 33
+#define TYPE_ANY 255
+#define CLASS_IN 1
+#define CACHE_FLUSH 0x8000
+#define UNICAST_RESPONSE 0x8000
+#define FLAGS_RESPONSE 0x8400
+
+int debug_enabled;
+TimerScheduler timerScheduler;
+
+static uint32_t clock_ms = 1000000;
+
+uint32_t millis(void) {
+	return clock_ms;
+}
+
+uint32_t os_random(void) {
+	return rand();
+}
+
+static unsigned checks;
+static unsigned failures;
+
+#define CHECK(cond) check(cond, #cond, __LINE__)
+
+static bool check(bool ok, const char *what, unsigned line) {
+	++checks;
+	if (!ok) {
+		++failures;
+		printf("FAIL at line %u: %s\n", line, what);
+	}
+	return ok;
+}
+
+/*
+ * Packets from other hosts
+ */
+
+class Packet {
+public:
+	Packet(uint16_t id, uint16_t flags) {
+		u16(id);
+		u16(flags);
+		for (unsigned i = 0; i < 4; ++i) {
+			u16(0);
+		}
+	}
+
+	Packet &question(const char *name, uint16_t type, uint16_t qclass = CLASS_IN) {
+		this->name(name);
+		u16(type);
+		u16(qclass);
+		count(0);
+		return *this;
+	}
+
+	/** Add a record to a section: 1 answer, 2 authority, 3 additional */
+	Packet &record(unsigned section, const char *name, uint16_t type, uint32_t ttl, const std::vector<uint8_t> &rdata) {
+		this->name(name);
+		u16(type);
+		u16(CLASS_IN);
+		u16(ttl >> 16);
+		u16(ttl);
+		u16(rdata.size());
+		data.insert(data.end(), rdata.begin(), rdata.end());
+		count(section);
+		return *this;
+	}
+
+	Packet &a(unsigned section, const char *name, IPAddress ip, uint32_t ttl = 120) {
+		return record(section, name, TYPE_A, ttl, {ip[0], ip[1], ip[2], ip[3]});
+	}
+
+	Packet &ptr(unsigned section, const char *name, const char *target, uint32_t ttl = 4500) {
+		return record(section, name, TYPE_PTR, ttl, encode(target));
+	}
+
+	Packet &srv(unsigned section, const char *name, uint16_t port, const char *target, uint32_t ttl = 120) {
+		std::vector<uint8_t> rdata = {0, 0, 0, 0, uint8_t(port >> 8), uint8_t(port)};
+		std::vector<uint8_t> wire = encode(target);
+		rdata.insert(rdata.end(), wire.begin(), wire.end());
+		return record(section, name, TYPE_SRV, ttl, rdata);
+	}
+
+	std::vector<uint8_t> data;
+
+private:
+	void u16(uint16_t value) {
+		data.push_back(value >> 8);
+		data.push_back(value);
+	}
+
+	void count(unsigned index) {
+		unsigned n = (data[4 + index * 2] << 8 | data[5 + index * 2]) + 1;
+		data[4 + index * 2] = n >> 8;
+		data[5 + index * 2] = n;
+	}
+
+	void name(const char *name) {
+		std::vector<uint8_t> wire = encode(name);
+		data.insert(data.end(), wire.begin(), wire.end());
+	}
+
+	static std::vector<uint8_t> encode(const char *name) {
+		std::vector<uint8_t> wire;
+		while (*name != 0) {
+			const char *dot = strchr(name, '.');
+			size_t length = dot ? size_t(dot - name) : strlen(name);
+			wire.push_back(length);
+			wire.insert(wire.end(), name, name + length);
+			name += length + (dot ? 1 : 0);
+		}
+		wire.push_back(0);
+		return wire;
+	}
+};
+
+/*
+ * Packets from the responder, decoded
+ */
+
+struct Record {
+	std::string name;
+	uint16_t type;
+	uint16_t rclass;
+	uint32_t ttl;
+	std::string data; ///< Address, target name or TXT strings
+	uint16_t port;
+};
+
+struct Message {
+	IPAddress to;
+	uint16_t port;
+	unsigned length;
+	uint16_t id;
+	uint16_t flags;
+	std::vector<Record> sections[4]; ///< Questions, answers, authority, additional
+	uint32_t time;
+
+	bool isQuery() const {
+		return (flags & 0x8000) == 0;
+	}
+
+	bool isMulticast() const {
+		return to == IPAddress(224, 0, 0, 251) && port == MDNS_PORT;
+	}
+
+	const Record *find(unsigned section, const char *name, uint16_t type) const {
+		for (auto &r : sections[section]) {
+			if (r.type == type && strcasecmp(r.name.c_str(), name) == 0) {
+				return &r;
+			}
+		}
+		return nullptr;
+	}
+};
+
+static bool read_name(const uint8_t *data, unsigned length, unsigned &offset, std::string &name) {
+	name.clear();
+	unsigned pos = offset;
+	bool jumped = false;
+	for (unsigned jumps = 0; jumps < 16; ) {
+		if (pos >= length) {
+			return false;
+		}
+		uint8_t n = data[pos];
+		if ((n & 0xC0) == 0xC0) {
+			if (pos + 1 >= length) {
+				return false;
+			}
+			if (!jumped) {
+				offset = pos + 2;
+			}
+			jumped = true;
+			++jumps;
+			pos = ((n & 0x3F) << 8) | data[pos + 1];
+			continue;
+		}
+		if (n == 0) {
+			if (!jumped) {
+				offset = pos + 1;
+			}
+			return true;
+		}
+		if (pos + 1 + n > length) {
+			return false;
+		}
+		if (!name.empty()) {
+			name += '.';
+		}
+		name.append(reinterpret_cast<const char *>(&data[pos + 1]), n);
+		pos += n + 1;
+	}
+	return false;
+}
+
+static bool decode(const uint8_t *data, unsigned length, Message &msg) {
+	if (length < 12) {
+		return false;
+	}
+	msg.length = length;
+	msg.id = data[0] << 8 | data[1];
+	msg.flags = data[2] << 8 | data[3];
+	unsigned offset = 12;
+	for (unsigned section = 0; section < 4; ++section) {
+		unsigned count = data[4 + section * 2] << 8 | data[5 + section * 2];
+		for (unsigned i = 0; i < count; ++i) {
+			Record r = {};
+			if (!read_name(data, length, offset, r.name) || offset + 4 > length) {
+				return false;
+			}
+			r.type = data[offset] << 8 | data[offset + 1];
+			r.rclass = data[offset + 2] << 8 | data[offset + 3];
+			offset += 4;
+			if (section != 0) {
+				if (offset + 6 > length) {
+					return false;
+				}
+				r.ttl = uint32_t(data[offset]) << 24 | data[offset + 1] << 16 | data[offset + 2] << 8 | data[offset + 3];
+				unsigned rdlength = data[offset + 4] << 8 | data[offset + 5];
+				offset += 6;
+				if (offset + rdlength > length) {
+					return false;
+				}
+				unsigned rdata = offset;
+				char buf[16];
+				switch (r.type) {
+					case TYPE_A:
+						if (rdlength != 4) {
+							return false;
+						}
+						sprintf(buf, "%u.%u.%u.%u", data[rdata], data[rdata + 1], data[rdata + 2], data[rdata + 3]);
+						r.data = buf;
+						break;
+					case TYPE_PTR:
+						if (!read_name(data, length, rdata, r.data)) {
+							return false;
+						}
+						break;
+					case TYPE_SRV:
+						r.port = data[rdata + 4] << 8 | data[rdata + 5];
+						rdata += 6;
+						if (!read_name(data, length, rdata, r.data)) {
+							return false;
+						}
+						break;
+					default:
+						r.data.assign(reinterpret_cast<const char *>(&data[rdata]), rdlength);
+				}
+				offset += rdlength;
+			}
+			msg.sections[section].push_back(r);
+		}
+	}
+	return offset == length;
+}
+
+/*
+ * The responder, with its output captured
+ */
+
+class TestResponder : public MdnsResponder {
+public:
+	std::vector<Message> sent;
+
+	/** Take the packets sent since the last call */
+	std::vector<Message> take() {
+		std::vector<Message> result;
+		result.swap(sent);
+		return result;
+	}
+
+	bool receive(const Packet &packet, IPAddress from, uint16_t port = MDNS_PORT) {
+		return processPacket(packet.data.data(), packet.data.size(), from, port);
+	}
+
+protected:
+	bool sendPacket(const uint8_t *data, unsigned length, IPAddress remoteIP, uint16_t remotePort) override {
+		Message msg;
+		CHECK(length <= MDNS_MAX_PACKET);
+		if (!CHECK(decode(data, length, msg))) {
+			return false;
+		}
+		msg.to = remoteIP;
+		msg.port = remotePort;
+		msg.time = clock_ms;
+		sent.push_back(msg);
+		return true;
+	}
+};
+
+static const IPAddress deviceIp(192, 168, 1, 10);
+static const IPAddress otherIp(192, 168, 1, 20);
+static const IPAddress legacyIp(192, 168, 1, 30);
+
+/** Run the clock forward, a millisecond at a time so timers fire when they should */
+static void run(uint32_t milliseconds) {
+	for (; milliseconds != 0; --milliseconds) {
+		++clock_ms;
+		timerScheduler.process();
+	}
+}
+
+/** Run the clock until the responder sends something, or the time is up */
+static std::vector<Message> wait_for_packets(TestResponder &mdns, uint32_t milliseconds) {
+	for (; milliseconds != 0 && mdns.sent.empty(); --milliseconds) {
+		run(1);
+	}
+	return mdns.take();
+}
+
+static unsigned count_answers(const std::vector<Message> &messages) {
+	unsigned n = 0;
+	for (auto &msg : messages) {
+		n += msg.sections[1].size();
+	}
+	return n;
+}
+
+/** Start up, checking probes and announcements, and return once running */
+static void start(TestResponder &mdns, const char *hostName) {
+	CHECK(mdns.begin(hostName, deviceIp));
+	CHECK(mdns.getState() == eMRS_Probing);
+	run(3000);
+	CHECK(mdns.getState() == eMRS_Running);
+	mdns.take();
+}
+
+static void test_startup(void) {
+	TestResponder mdns;
+	MdnsService *service = mdns.addService("Kitchen", "_http._tcp", 80);
+	CHECK(service != nullptr);
+	service->addText("path", "/");
+
+	CHECK(mdns.begin("esp", deviceIp));
+	CHECK(mdns.getState() == eMRS_Probing);
+	CHECK(mdns.sent.empty());
+
+	// Three probes 250 ms apart, the first asking for unicast replies
+	// Timers may run late by 1/64 of their interval, so nearby deadlines share a tick
+	const uint32_t probeSlack = MDNS_PROBE_INTERVAL_MS / 64;
+	auto sent = wait_for_packets(mdns, MDNS_PROBE_INTERVAL_MS + 1);
+	uint32_t lastProbe = 0;
+	for (unsigned i = 0; i < 3; ++i) {
+		if (i != 0) {
+			sent = wait_for_packets(mdns, MDNS_PROBE_INTERVAL_MS + probeSlack + 1);
+		}
+		if (!CHECK(sent.size() == 1)) {
+			return;
+		}
+		auto &probe = sent[0];
+		CHECK(probe.isQuery() && probe.isMulticast());
+		if (i != 0) {
+			CHECK(probe.time - lastProbe >= MDNS_PROBE_INTERVAL_MS);
+			CHECK(probe.time - lastProbe <= MDNS_PROBE_INTERVAL_MS + probeSlack);
+		}
+		lastProbe = probe.time;
+		CHECK(probe.sections[0].size() == 2);
+		auto q = probe.find(0, "esp.local", TYPE_ANY);
+		CHECK(q != nullptr && (q->rclass & UNICAST_RESPONSE) == (i == 0 ? UNICAST_RESPONSE : 0));
+		CHECK(probe.find(0, "Kitchen._http._tcp.local", TYPE_ANY) != nullptr);
+		// Proposed unique records in the authority section
+		auto a = probe.find(2, "esp.local", TYPE_A);
+		CHECK(a != nullptr && a->data == "192.168.1.10" && a->rclass == CLASS_IN);
+		CHECK(probe.find(2, "Kitchen._http._tcp.local", TYPE_SRV) != nullptr);
+		CHECK(probe.find(2, "Kitchen._http._tcp.local", TYPE_TXT) != nullptr);
+		CHECK(probe.find(2, "_http._tcp.local", TYPE_PTR) == nullptr);
+	}
+
+	// Then two announcements a second apart
+	sent = wait_for_packets(mdns, MDNS_PROBE_INTERVAL_MS + probeSlack + 1);
+	CHECK(mdns.getState() == eMRS_Announcing);
+	if (CHECK(sent.size() == 1)) {
+		auto &msg = sent[0];
+		CHECK(!msg.isQuery() && msg.isMulticast());
+		CHECK(msg.sections[1].size() == 5);
+		auto a = msg.find(1, "esp.local", TYPE_A);
+		CHECK(a != nullptr && a->ttl == MDNS_HOST_TTL && a->rclass == (CLASS_IN | CACHE_FLUSH));
+		auto ptr = msg.find(1, "_http._tcp.local", TYPE_PTR);
+		CHECK(ptr != nullptr && ptr->data == "Kitchen._http._tcp.local" && ptr->rclass == CLASS_IN);
+		CHECK(ptr != nullptr && ptr->ttl == MDNS_SERVICE_TTL);
+		auto srv = msg.find(1, "Kitchen._http._tcp.local", TYPE_SRV);
+		CHECK(srv != nullptr && srv->port == 80 && srv->data == "esp.local");
+		auto txt = msg.find(1, "Kitchen._http._tcp.local", TYPE_TXT);
+		CHECK(txt != nullptr && txt->data == std::string("\x06path=/"));
+		CHECK(msg.find(1, "_services._dns-sd._udp.local", TYPE_PTR) != nullptr);
+	}
+	uint32_t announced = sent.empty() ? clock_ms : sent[0].time;
+	run(announced + MDNS_ANNOUNCE_INTERVAL_MS - 1 - clock_ms);
+	CHECK(mdns.sent.empty());
+	run(MDNS_ANNOUNCE_INTERVAL_MS / 64 + 1);
+	sent = mdns.take();
+	CHECK(sent.size() == 1 && sent[0].time - announced >= MDNS_ANNOUNCE_INTERVAL_MS);
+	CHECK(mdns.getState() == eMRS_Running);
+
+	// Goodbye on the way out
+	mdns.end();
+	sent = mdns.take();
+	CHECK(sent.size() == 1 && count_answers(sent) == 5);
+	for (auto &msg : sent) {
+		for (auto &r : msg.sections[1]) {
+			CHECK(r.ttl == 0);
+		}
+	}
+	CHECK(mdns.getState() == eMRS_Idle);
+}
+
+static void test_conflict(void) {
+	TestResponder mdns;
+	mdns.addService("Kitchen", "_http._tcp", 80);
+	CHECK(mdns.begin("esp", deviceIp));
+	CHECK(wait_for_packets(mdns, MDNS_PROBE_INTERVAL_MS + 1).size() == 1);
+
+	// Another host already has the name
+	Packet claim(0, FLAGS_RESPONSE);
+	claim.a(1, "esp.local", otherIp);
+	mdns.receive(claim, otherIp);
+	CHECK(mdns.getHostName() == "esp-2");
+	CHECK(mdns.getState() == eMRS_Probing);
+	CHECK(mdns.getStats().conflicts == 1);
+
+	// And the service instance
+	auto sent = wait_for_packets(mdns, MDNS_PROBE_INTERVAL_MS + 1);
+	CHECK(sent.size() == 1 && sent[0].find(0, "esp-2.local", TYPE_ANY) != nullptr);
+	Packet claimService(0, FLAGS_RESPONSE);
+	claimService.srv(1, "Kitchen._http._tcp.local", 8080, "other.local");
+	mdns.receive(claimService, otherIp);
+	CHECK(mdns.getStats().conflicts == 2);
+	CHECK(mdns.getHostName() == "esp-2");
+
+	run(3000);
+	CHECK(mdns.getState() == eMRS_Running);
+	sent = mdns.take();
+	bool announced = false;
+	for (auto &msg : sent) {
+		auto srv = msg.find(1, "Kitchen (2)._http._tcp.local", TYPE_SRV);
+		if (srv != nullptr) {
+			announced = true;
+			CHECK(srv->data == "esp-2.local");
+		}
+		CHECK(msg.find(1, "Kitchen._http._tcp.local", TYPE_SRV) == nullptr);
+	}
+	CHECK(announced);
+
+	// Once running, a matching record is no conflict, a different address is
+	Packet same(0, FLAGS_RESPONSE);
+	same.a(1, "esp-2.local", deviceIp);
+	mdns.receive(same, otherIp);
+	CHECK(mdns.getState() == eMRS_Running && mdns.getStats().conflicts == 2);
+
+	Packet different(0, FLAGS_RESPONSE);
+	different.a(1, "esp-2.local", otherIp);
+	mdns.receive(different, otherIp);
+	CHECK(mdns.getHostName() == "esp-3");
+	CHECK(mdns.getState() == eMRS_Probing);
+	mdns.end();
+}
+
+static void test_queries(void) {
+	TestResponder mdns;
+	mdns.addService("Kitchen", "_http._tcp", 80);
+	start(mdns, "esp");
+	run(1000);
+	MdnsResponderStats stats = mdns.getStats();
+
+	// A unique record is answered straight away, with the service records for a PTR after a delay
+	Packet query(0, 0);
+	query.question("esp.local", TYPE_A);
+	mdns.receive(query, otherIp);
+	auto sent = mdns.take();
+	if (CHECK(sent.size() == 1)) {
+		CHECK(sent[0].isMulticast());
+		CHECK(sent[0].sections[1].size() == 1 && sent[0].find(1, "esp.local", TYPE_A) != nullptr);
+	}
+
+	// Queries within the response delay are aggregated into one response
+	uint32_t start = clock_ms;
+	Packet ptrQuery(0, 0);
+	ptrQuery.question("_http._tcp.local", TYPE_PTR);
+	mdns.receive(ptrQuery, otherIp);
+	CHECK(mdns.sent.empty());
+	run(10);
+	Packet enumQuery(0, 0);
+	enumQuery.question("_services._dns-sd._udp.local", TYPE_PTR);
+	mdns.receive(enumQuery, legacyIp, MDNS_PORT);
+	run(120);
+	sent = mdns.take();
+	if (CHECK(sent.size() == 1)) {
+		auto &msg = sent[0];
+		CHECK(msg.time - start >= 20 && msg.time - start <= 120);
+		CHECK(msg.find(1, "_http._tcp.local", TYPE_PTR) != nullptr);
+		CHECK(msg.find(1, "_services._dns-sd._udp.local", TYPE_PTR) != nullptr);
+		// The instance's records come along as additionals
+		CHECK(msg.find(3, "Kitchen._http._tcp.local", TYPE_SRV) != nullptr);
+		CHECK(msg.find(3, "Kitchen._http._tcp.local", TYPE_TXT) != nullptr);
+		CHECK(msg.find(3, "esp.local", TYPE_A) != nullptr);
+	}
+	CHECK(mdns.getStats().aggregated == stats.aggregated + 1);
+
+	// Not multicast again within a second
+	run(500);
+	mdns.receive(ptrQuery, otherIp);
+	run(200);
+	CHECK(mdns.take().empty());
+	CHECK(mdns.getStats().rateLimited == stats.rateLimited + 1);
+	run(300);
+	mdns.receive(ptrQuery, otherIp);
+	run(200);
+	CHECK(mdns.take().size() == 1);
+
+	// But a question asking for a unicast reply is answered at once, directly
+	Packet quQuery(0, 0);
+	quQuery.question("_http._tcp.local", TYPE_PTR, CLASS_IN | UNICAST_RESPONSE);
+	mdns.receive(quQuery, otherIp);
+	sent = mdns.take();
+	if (CHECK(sent.size() == 1)) {
+		CHECK(sent[0].to == otherIp && sent[0].port == MDNS_PORT);
+		CHECK(sent[0].find(1, "_http._tcp.local", TYPE_PTR) != nullptr);
+	}
+
+	// A legacy resolver gets its ID and question back, short TTLs and no cache-flush bit
+	Packet legacy(0x1234, 0x0100);
+	legacy.question("esp.local", TYPE_A);
+	mdns.receive(legacy, legacyIp, 40000);
+	sent = mdns.take();
+	if (CHECK(sent.size() == 1)) {
+		auto &msg = sent[0];
+		CHECK(msg.to == legacyIp && msg.port == 40000);
+		CHECK(msg.id == 0x1234 && !msg.isQuery());
+		CHECK(msg.sections[0].size() == 1 && msg.find(0, "esp.local", TYPE_A) != nullptr);
+		auto a = msg.find(1, "esp.local", TYPE_A);
+		CHECK(a != nullptr && a->ttl == 10 && a->rclass == CLASS_IN && a->data == "192.168.1.10");
+	}
+	mdns.end();
+}
+
+static void test_known_answers(void) {
+	TestResponder mdns;
+	mdns.addService("Kitchen", "_http._tcp", 80);
+	start(mdns, "esp");
+	run(1000);
+	MdnsResponderStats stats = mdns.getStats();
+
+	// The querier holds the answer with more than half its TTL left, so nothing is sent
+	Packet known(0, 0);
+	known.question("_http._tcp.local", TYPE_PTR);
+	known.ptr(1, "_http._tcp.local", "Kitchen._http._tcp.local", MDNS_SERVICE_TTL / 2);
+	mdns.receive(known, otherIp);
+	run(200);
+	CHECK(mdns.take().empty());
+	CHECK(mdns.getStats().suppressed == stats.suppressed + 1);
+
+	// With less than half left it is answered
+	Packet stale(0, 0);
+	stale.question("_http._tcp.local", TYPE_PTR);
+	stale.ptr(1, "_http._tcp.local", "Kitchen._http._tcp.local", MDNS_SERVICE_TTL / 2 - 1);
+	mdns.receive(stale, otherIp);
+	run(200);
+	auto sent = mdns.take();
+	CHECK(sent.size() == 1 && sent[0].find(1, "_http._tcp.local", TYPE_PTR) != nullptr);
+	CHECK(mdns.getStats().suppressed == stats.suppressed + 1);
+
+	// A known answer pointing elsewhere doesn't count
+	run(1000);
+	Packet other(0, 0);
+	other.question("_http._tcp.local", TYPE_PTR);
+	other.ptr(1, "_http._tcp.local", "Lounge._http._tcp.local");
+	mdns.receive(other, otherIp);
+	run(200);
+	CHECK(mdns.take().size() == 1);
+
+	// Additionals the querier knows are left out
+	run(1000);
+	Packet knownSrv(0, 0);
+	knownSrv.question("_http._tcp.local", TYPE_PTR);
+	knownSrv.srv(1, "Kitchen._http._tcp.local", 80, "esp.local");
+	mdns.receive(knownSrv, otherIp);
+	run(200);
+	sent = mdns.take();
+	if (CHECK(sent.size() == 1)) {
+		CHECK(sent[0].find(3, "Kitchen._http._tcp.local", TYPE_SRV) == nullptr);
+		CHECK(sent[0].find(3, "Kitchen._http._tcp.local", TYPE_TXT) != nullptr);
+	}
+
+	// Another responder multicasting the answer first suppresses ours (duplicate answer suppression)
+	run(1000);
+	Packet query(0, 0);
+	query.question("_http._tcp.local", TYPE_PTR);
+	mdns.receive(query, otherIp);
+	Packet response(0, FLAGS_RESPONSE);
+	response.ptr(1, "_http._tcp.local", "Kitchen._http._tcp.local");
+	mdns.receive(response, legacyIp);
+	run(200);
+	CHECK(mdns.take().empty());
+	mdns.end();
+}
+
+static void test_split(void) {
+	TestResponder mdns;
+	const char *names[] = {"Living room", "Kitchen", "Bedroom", "Garage"};
+	for (auto name : names) {
+		MdnsService *service = mdns.addService(name, "_http._tcp", 80);
+		if (!CHECK(service != nullptr)) {
+			return;
+		}
+		for (unsigned i = 0; i < 9; ++i) {
+			service->addText("key" + std::to_string(i), "0123456789abcdef");
+		}
+	}
+
+	CHECK(mdns.begin("esp", deviceIp));
+	while (mdns.getState() == eMRS_Probing) {
+		run(1);
+	}
+	// The first announcement
+	auto sent = mdns.take();
+	while (!sent.empty() && sent[0].isQuery()) {
+		sent.erase(sent.begin());
+	}
+	CHECK(sent.size() > 1);
+	// A, then PTR, SRV and TXT per service, with one enumeration PTR for the shared type
+	CHECK(count_answers(sent) == 1 + 4 * 3 + 1);
+	for (auto name : names) {
+		std::string instance = std::string(name) + "._http._tcp.local";
+		unsigned found = 0;
+		for (auto &msg : sent) {
+			CHECK(msg.length <= MDNS_MAX_PACKET);
+			if (msg.find(1, instance.c_str(), TYPE_SRV) != nullptr) {
+				++found;
+			}
+			if (msg.find(1, instance.c_str(), TYPE_TXT) != nullptr) {
+				++found;
+			}
+		}
+		CHECK(found == 2);
+	}
+	mdns.end();
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+		debug_enabled = 1;
+	}
+
+	srand(1);
+	test_startup();
+	test_conflict();
+	test_queries();
+	test_known_answers();
+	test_split();
+
+	printf("%u checks, %u failed\n", checks, failures);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,403 @@
+/*
+ * sdbench - host benchmark for FatFs on an SD card, built against the
+ * ffconf.h and sector cache Sming ships.
+ *
+ * The card is an image file: an existing one (dd of a card, or made with
+ * mkfs.vfat) or a new one formatted here. As with spiffsbench, host time says
+ * nothing about the device, so every command is charged to a modelled clock
+ * instead: SPI bytes at the bus clock plus a set-up cost for each 64 byte
+ * burst the ESP8266 SPI FIFO takes, the time the card takes to find data or
+ * finish programming it, and the polling the SDCard driver does while it waits.
+ * The driver's old behaviour (one block per command, 100us between polls, no
+ * cache) can be selected to compare against.
+ *
+ * Three runs: a file written as a stream of frames, as a camera logger
+ * would; the file read back and checked; random reads, with and without a
+ * fast seek link map.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <ff.h>
+#include <diskio.h>
+#include <SDCardCache.h>
+
+#define SECTOR_SIZE 512
+#define BURST_SIZE 64    // SPI_W0..W15
+#define POLL_FAST 64     // As SDCard.cpp
+#define POLL_DELAY 100
+#define MAX_LINKMAP 256
+
+static FILE *image;
+static DWORD image_sectors;
+static double now;       // modelled microseconds
+
+// Model, in microseconds unless noted
+static double spi_clock = 20;       // MHz
+static double t_burst = 1.5;        // register set-up per SPI transfer
+static double t_access = 250;       // read command to first data token
+static double t_next = 40;          // between blocks of a multiple block read
+static double t_program = 800;      // busy after a single block write
+static double t_program_multi = 150; // busy after each block of a multiple block write
+
+// Driver behaviour
+static int multi_block = 1;
+static int fast_poll = 1;
+static UINT cache_sectors = SDCARD_CACHE_SECTORS;
+
+static struct {
+	DWORD commands;
+	DWORD read_commands;
+	DWORD write_commands;
+	DWORD sectors_read;
+	DWORD sectors_written;
+} counters;
+
+static double transfer_time(UINT bytes)
+{
+	return bytes * 8 / spi_clock + ((bytes + BURST_SIZE - 1) / BURST_SIZE) * t_burst;
+}
+
+// Time taken to notice the card is done, polling a byte at a time as the driver does
+static double wait_time(double busy)
+{
+	double poll = transfer_time(1);
+	double fast = fast_poll ? POLL_FAST * poll : 0;
+	if (busy <= fast) {
+		return (int)(busy / poll + 1) * poll;
+	}
+	double slow = POLL_DELAY + poll;
+	return fast + (int)((busy - fast) / slow + 1) * slow;
+}
+
+static void command(void)
+{
+	// deselect, select + ready check, command, dummy, response
+	now += transfer_time(1) * 3 + transfer_time(6) + transfer_time(1) * 2;
+	counters.commands++;
+}
+
+static int seek_image(DWORD sector, UINT count)
+{
+	if (sector + count > image_sectors) return 0;
+	return fseek(image, (long)sector * SECTOR_SIZE, SEEK_SET) == 0;
+}
+
+DSTATUS disk_initialize(BYTE pdrv)
+{
+	return pdrv ? STA_NOINIT : 0;
+}
+
+DSTATUS disk_status(BYTE pdrv)
+{
+	return pdrv ? STA_NOINIT : 0;
+}
+
+DRESULT disk_read(BYTE pdrv, BYTE *buff, DWORD sector, UINT count)
+{
+	UINT i;
+
+	if (pdrv) return RES_PARERR;
+	if (count == 1 && sdcache_read(sector, buff)) return RES_OK;
+	if (!seek_image(sector, count) || fread(buff, SECTOR_SIZE, count, image) != count) return RES_ERROR;
+
+	if (multi_block) {
+		command();
+		for (i = 0; i < count; i++) {
+			now += wait_time(i ? t_next : t_access) + transfer_time(SECTOR_SIZE + 2);
+		}
+		if (count > 1) command();	// CMD12
+		counters.read_commands++;
+	} else {
+		for (i = 0; i < count; i++) {
+			command();
+			now += wait_time(t_access) + transfer_time(SECTOR_SIZE + 2);
+			counters.read_commands++;
+		}
+	}
+	counters.sectors_read += count;
+
+	if (count == 1) sdcache_store(sector, buff);
+	return RES_OK;
+}
+
+DRESULT disk_write(BYTE pdrv, const BYTE *buff, DWORD sector, UINT count)
+{
+	UINT i;
+
+	if (pdrv) return RES_PARERR;
+	sdcache_write(sector, buff, count);
+	if (!seek_image(sector, count) || fwrite(buff, SECTOR_SIZE, count, image) != count) {
+		sdcache_invalidate();
+		return RES_ERROR;
+	}
+
+	if (multi_block && count > 1) {
+		command();	// ACMD23
+		command();
+		command();	// CMD25
+		for (i = 0; i < count; i++) {
+			now += wait_time(i ? t_program_multi : 0) + transfer_time(1 + SECTOR_SIZE + 3);
+		}
+		now += wait_time(t_program_multi) + transfer_time(1);	// Stop token
+		now += wait_time(t_program);
+		counters.write_commands++;
+	} else {
+		for (i = 0; i < count; i++) {
+			command();
+			now += transfer_time(1 + SECTOR_SIZE + 3) + wait_time(t_program);
+			counters.write_commands++;
+		}
+	}
+	counters.sectors_written += count;
+	return RES_OK;
+}
+
+DRESULT disk_ioctl(BYTE pdrv, BYTE cmd, void *buff)
+{
+	if (pdrv) return RES_PARERR;
+	switch (cmd) {
+	case CTRL_SYNC:
+		return fflush(image) == 0 ? RES_OK : RES_ERROR;
+	case GET_SECTOR_COUNT:
+		*(DWORD *)buff = image_sectors;
+		return RES_OK;
+	case GET_BLOCK_SIZE:
+		*(DWORD *)buff = 128;
+		return RES_OK;
+	default:
+		return RES_PARERR;
+	}
+}
+
+static void reset_counters(void)
+{
+	memset(&counters, 0, sizeof(counters));
+	now = 0;
+}
+
+static void report(const char *name, double bytes, int csv)
+{
+	double secs = now / 1e6;
+	DWORD cmds = counters.read_commands + counters.write_commands;
+	double per_cmd = cmds ? (double)(counters.sectors_read + counters.sectors_written) / cmds : 0;
+	if (csv) {
+		printf("%s,%.0f,%.1f,%lu,%lu,%lu,%.2f\n", name, now, secs ? bytes / 1024 / secs : 0,
+			   (unsigned long)counters.commands, (unsigned long)counters.sectors_read,
+			   (unsigned long)counters.sectors_written, per_cmd);
+	} else {
+		printf("%-12s %10.0f us %9.1f kB/s %7lu cmds %7lu rd %7lu wr %6.2f sectors/cmd\n", name, now,
+			   secs ? bytes / 1024 / secs : 0, (unsigned long)counters.commands,
+			   (unsigned long)counters.sectors_read, (unsigned long)counters.sectors_written, per_cmd);
+	}
+}
+
+static BYTE pattern(DWORD pos)
+{
+	return (BYTE)(pos * 7 + (pos >> 9));
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+			"Usage: %s [options]\n"
+			"  -i FILE   SD card image (sd.img), created if missing\n"
+			"  -s MB     Size of a new image (64)\n"
+			"  -m        Format the image, even if it exists\n"
+			"  -n N      Frames to write (200)\n"
+			"  -f BYTES  Frame size (16384)\n"
+			"  -w BYTES  Size of each f_write()/f_read() (4096)\n"
+			"  -r N      Random reads (500)\n"
+			"  -k N      Sectors cached (%u), 0 to disable\n"
+			"  -L        Model the old driver: single blocks, slow polling, no cache\n"
+			"  -c MHZ    SPI clock (%.0f)\n"
+			"  -t A,N,P,M  Card timings in us: read access, next block, program, program in a run\n"
+			"  -S SEED   Random seed\n"
+			"  -o        CSV output\n",
+			prog, SDCARD_CACHE_SECTORS, spi_clock);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *image_name = "sd.img";
+	unsigned size_mb = 64;
+	int format = 0;
+	unsigned frames = 200;
+	unsigned frame_size = 16384;
+	unsigned chunk = 4096;
+	unsigned reads = 500;
+	unsigned seed = 1;
+	int csv = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "i:s:mn:f:w:r:k:Lc:t:S:o")) != -1) {
+		switch (opt) {
+		case 'i': image_name = optarg; break;
+		case 's': size_mb = atoi(optarg); break;
+		case 'm': format = 1; break;
+		case 'n': frames = atoi(optarg); break;
+		case 'f': frame_size = atoi(optarg); break;
+		case 'w': chunk = atoi(optarg); break;
+		case 'r': reads = atoi(optarg); break;
+		case 'k': cache_sectors = atoi(optarg); break;
+		case 'L':
+			multi_block = 0;
+			fast_poll = 0;
+			cache_sectors = 0;
+			break;
+		case 'c': spi_clock = atof(optarg); break;
+		case 't':
+			if (sscanf(optarg, "%lf,%lf,%lf,%lf", &t_access, &t_next, &t_program, &t_program_multi) != 4) {
+				usage(argv[0]);
+			}
+			break;
+		case 'S': seed = atoi(optarg); break;
+		case 'o': csv = 1; break;
+		default: usage(argv[0]);
+		}
+	}
+	if (frame_size == 0 || chunk == 0 || size_mb == 0 || spi_clock <= 0) usage(argv[0]);
+	srand(seed);
+
+	image = fopen(image_name, "r+b");
+	if (!image) {
+		image = fopen(image_name, "w+b");
+		if (!image || ftruncate(fileno(image), (off_t)size_mb << 20) != 0) {
+			perror(image_name);
+			return 1;
+		}
+		format = 1;
+	}
+	fseek(image, 0, SEEK_END);
+	image_sectors = ftell(image) / SECTOR_SIZE;
+
+	if (!sdcache_init(cache_sectors)) {
+		fprintf(stderr, "No memory for cache\n");
+		return 1;
+	}
+
+	static FATFS fs;
+	FRESULT res;
+	f_mount(&fs, "", 0);
+	if (format) {
+		res = f_mkfs("", 0, 0);
+		if (res != FR_OK) {
+			fprintf(stderr, "f_mkfs failed: %d\n", res);
+			return 1;
+		}
+	}
+	res = f_mount(&fs, "", 1);
+	if (res != FR_OK) {
+		fprintf(stderr, "f_mount failed: %d\n", res);
+		return 1;
+	}
+
+	if (csv) {
+		printf("test,time_us,kbps,commands,sectors_read,sectors_written,sectors_per_command\n");
+	} else {
+		printf("%s: %lu sectors, FAT%u, %u sectors/cluster, cache %u, %s blocks, %s polling, _FS_TINY %u\n",
+			   image_name, (unsigned long)image_sectors, fs.fs_type == FS_FAT12 ? 12 : fs.fs_type == FS_FAT16 ? 16 : 32,
+			   fs.csize, cache_sectors, multi_block ? "multiple" : "single", fast_poll ? "fast" : "slow", _FS_TINY);
+	}
+
+	BYTE *buf = malloc(chunk);
+	FIL file;
+	UINT n;
+	DWORD pos = 0;
+	DWORD total = (DWORD)frames * frame_size;
+
+	// Stream of frames, each one written in chunks as it comes out of the camera FIFO
+	f_unlink("frames.bin");
+	reset_counters();
+	res = f_open(&file, "frames.bin", FA_WRITE | FA_CREATE_ALWAYS);
+	while (res == FR_OK && pos < total) {
+		unsigned len = chunk;
+		unsigned left_in_frame = frame_size - pos % frame_size;
+		if (len > left_in_frame) len = left_in_frame;
+		for (n = 0; n < len; n++) buf[n] = pattern(pos + n);
+		res = f_write(&file, buf, len, &n);
+		if (res == FR_OK && n != len) res = FR_DENIED;	// Disk full
+		pos += n;
+	}
+	if (res == FR_OK) res = f_close(&file);
+	if (res != FR_OK) {
+		fprintf(stderr, "write failed at %lu: %d\n", (unsigned long)pos, res);
+		return 1;
+	}
+	report("write", total, csv);
+
+	// Read back
+	reset_counters();
+	res = f_open(&file, "frames.bin", FA_READ);
+	for (pos = 0; res == FR_OK && pos < total; pos += n) {
+		res = f_read(&file, buf, chunk, &n);
+		if (res == FR_OK && n == 0) break;
+		for (UINT i = 0; i < n; i++) {
+			if (buf[i] != pattern(pos + i)) {
+				fprintf(stderr, "mismatch at %lu\n", (unsigned long)(pos + i));
+				return 1;
+			}
+		}
+	}
+	if (res != FR_OK || pos != total) {
+		fprintf(stderr, "read failed at %lu: %d\n", (unsigned long)pos, res);
+		return 1;
+	}
+	report("read", total, csv);
+
+	// Random reads, following the FAT chain and then with a link map
+	static DWORD linkmap[MAX_LINKMAP];
+	DWORD *offsets = malloc(reads * sizeof(DWORD));
+	for (n = 0; n < reads; n++) {
+		offsets[n] = (DWORD)(((double)rand() / RAND_MAX) * (total - 1));
+	}
+	for (int fast = 0; fast < 2; fast++) {
+		f_lseek(&file, 0);
+		if (fast) {
+			file.cltbl = linkmap;
+			linkmap[0] = MAX_LINKMAP;
+			res = f_lseek(&file, CREATE_LINKMAP);
+			if (res != FR_OK) {
+				fprintf(stderr, "link map needs %lu items\n", (unsigned long)linkmap[0]);
+				return 1;
+			}
+		}
+		reset_counters();
+		for (n = 0; n < reads && res == FR_OK; n++) {
+			BYTE b;
+			UINT got;
+			res = f_lseek(&file, offsets[n]);
+			if (res == FR_OK) res = f_read(&file, &b, 1, &got);
+			if (res == FR_OK && (got != 1 || b != pattern(offsets[n]))) {
+				fprintf(stderr, "seek read mismatch at %lu\n", (unsigned long)offsets[n]);
+				return 1;
+			}
+		}
+		if (res != FR_OK) {
+			fprintf(stderr, "seek failed: %d\n", res);
+			return 1;
+		}
+		report(fast ? "seek+map" : "seek", 0, csv);
+		if (!csv) {
+			printf("%-12s %10.1f us per read\n", "", reads ? now / reads : 0);
+		}
+	}
+	f_close(&file);
+
+	sdcache_stats stats;
+	sdcache_get_stats(&stats);
+	if (!csv) {
+		printf("cache: %lu hits, %lu misses, %lu updates\n", (unsigned long)stats.hits, (unsigned long)stats.misses,
+			   (unsigned long)stats.updates);
+	}
+
+	f_mount(NULL, "", 0);
+	fclose(image);
+	free(offsets);
+	free(buf);
+	sdcache_free();
+	return 0;
+}
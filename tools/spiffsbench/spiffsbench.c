@@ -0,0 +1,543 @@
+/*
+ * spiffsbench - host benchmark and randomised workload for SPIFFS, built
+ * against the spiffs_config.h Sming ships.
+ *
+ * Flash is emulated in RAM with NOR semantics (erase to 0xFF, writes can only
+ * clear bits). Time is not measured on the host, which would say nothing about
+ * the device: each flash access is charged to a modelled clock instead, using
+ * sector erase, page program and page read times which can be set to match
+ * the flash chip. Latency of an operation is the flash time it used, so a
+ * write which had to wait for garbage collection shows up as a stall.
+ *
+ * Every read is checked against the content expected, and the file system is
+ * checked and remounted at the end, so the workload doubles as a fuzzer: on
+ * failure the seed and operation number are reported so the run can be
+ * repeated.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <spiffs.h>
+#include <spiffs_nucleus.h>
+
+#define SPI_FLASH_SEC_SIZE 4096
+#define ROM_ERASE 0xFF
+
+// What spiffs_sming.c sets up on the device
+#define DEFAULT_FS_SIZE    0x100000
+#define DEFAULT_PAGE_SIZE  256
+#define DEFAULT_BLOCK_SIZE (SPI_FLASH_SEC_SIZE * 2)
+#define DEFAULT_FDS        7
+#define DEFAULT_CACHE      4
+
+#if !SPIFFS_GC_STATS
+#error "spiffsbench needs SPIFFS_GC_STATS"
+#endif
+
+#define MAX_FILES 256
+#define MAX_CHUNK 4096
+
+enum {
+	OP_CREATE,
+	OP_APPEND,
+	OP_READ,
+	OP_OVERWRITE,
+	OP_DELETE,
+	OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {"create", "append", "read", "overwrite", "delete"};
+
+typedef struct {
+	u32_t count;
+	u32_t capacity;
+	u32_t *latency;  // modelled microseconds, one per operation
+	uint64_t bytes;
+	uint64_t time;
+	u32_t stalls;    // operations which had to erase
+	u32_t failures;  // operations refused for lack of space
+} op_stats;
+
+typedef struct {
+	u32_t size;
+	u32_t seed;
+	u8_t exists;
+} file_info;
+
+static spiffs fs;
+static spiffs_config cfg;
+static u8_t *flash;
+static u32_t *sector_erases;
+static u8_t *work_buf;
+static u8_t *fds_buf;
+static u8_t *cache_buf;
+static u32_t fds_size;
+static u32_t cache_size;
+
+// Flash timing model, in microseconds
+static u32_t t_erase = 45000;   // per sector
+static u32_t t_program = 700;   // per 256 bytes
+static u32_t t_read = 15;       // per 256 bytes
+static uint64_t clock_us;
+static u32_t op_erases;
+
+static file_info files[MAX_FILES];
+static op_stats stats[OP_COUNT];
+static u32_t rand_state;
+
+static u32_t next_rand() {
+	// xorshift32, so runs repeat exactly on every host
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static u8_t content_byte(u32_t seed, u32_t offset) {
+	u32_t x = seed ^ (offset * 0x9E3779B1);
+	x ^= x >> 15;
+	x *= 0x85EBCA77;
+	x ^= x >> 13;
+	return (u8_t)x;
+}
+
+static s32_t bench_read(u32_t addr, u32_t size, u8_t *dst) {
+	if (addr + size > cfg.phys_size) return SPIFFS_ERR_INTERNAL;
+	memcpy(dst, flash + addr, size);
+	clock_us += ((uint64_t)t_read * size + 255) / 256;
+	return SPIFFS_OK;
+}
+
+static s32_t bench_write(u32_t addr, u32_t size, u8_t *src) {
+	u32_t i;
+	if (addr + size > cfg.phys_size) return SPIFFS_ERR_INTERNAL;
+	for (i = 0; i < size; i++) flash[addr + i] &= src[i];
+	clock_us += ((uint64_t)t_program * size + 255) / 256;
+	return SPIFFS_OK;
+}
+
+static s32_t bench_erase(u32_t addr, u32_t size) {
+	if (addr % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE || addr + size > cfg.phys_size) {
+		printf("Bad erase of %u bytes at 0x%x.\n", size, addr);
+		return SPIFFS_ERR_INTERNAL;
+	}
+	memset(flash + addr, ROM_ERASE, size);
+	for (; size; size -= SPI_FLASH_SEC_SIZE, addr += SPI_FLASH_SEC_SIZE) {
+		sector_erases[addr / SPI_FLASH_SEC_SIZE]++;
+		clock_us += t_erase;
+		op_erases++;
+	}
+	return SPIFFS_OK;
+}
+
+static int bench_mount() {
+	return SPIFFS_mount(&fs, &cfg, work_buf, fds_buf, fds_size, cache_buf, cache_size, 0);
+}
+
+static void record(int op, uint64_t start, u32_t bytes) {
+	op_stats *s = &stats[op];
+	u32_t elapsed = (u32_t)(clock_us - start);
+	if (s->count == s->capacity) {
+		s->capacity = s->capacity ? s->capacity * 2 : 1024;
+		s->latency = realloc(s->latency, s->capacity * sizeof(u32_t));
+		if (!s->latency) {
+			printf("Out of memory.\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+	s->latency[s->count++] = elapsed;
+	s->bytes += bytes;
+	s->time += elapsed;
+	if (op_erases) s->stalls++;
+}
+
+static u32_t random_size(u32_t max_size) {
+	// Mostly small files, as configuration and logs are, with the odd large one
+	u32_t bits = 4 + next_rand() % 10;
+	u32_t size = 1 + next_rand() % (1u << bits);
+	return size > max_size ? max_size : size;
+}
+
+static int write_content(spiffs_file fd, u32_t seed, u32_t offset, u32_t size, u32_t chunk) {
+	u8_t buf[MAX_CHUNK];
+	while (size) {
+		u32_t len = size < chunk ? size : chunk;
+		u32_t i;
+		for (i = 0; i < len; i++) buf[i] = content_byte(seed, offset + i);
+		s32_t res = SPIFFS_write(&fs, fd, buf, len);
+		if (res != (s32_t)len) return res < 0 ? res : SPIFFS_ERR_INTERNAL;
+		offset += len;
+		size -= len;
+	}
+	return SPIFFS_OK;
+}
+
+static int verify_file(int index, u32_t chunk) {
+	char name[SPIFFS_OBJ_NAME_LEN];
+	u8_t buf[MAX_CHUNK];
+	u32_t offset = 0;
+	file_info *f = &files[index];
+
+	sprintf(name, "f%d", index);
+	spiffs_file fd = SPIFFS_open(&fs, name, SPIFFS_RDONLY, 0);
+	if (fd < 0) {
+		printf("Unable to open '%s', error %d.\n", name, fd);
+		return 0;
+	}
+	for (;;) {
+		s32_t res = SPIFFS_read(&fs, fd, buf, chunk);
+		if (res < 0 && SPIFFS_errno(&fs) == SPIFFS_ERR_END_OF_OBJECT) res = 0;
+		if (res < 0) {
+			printf("Unable to read '%s', error %d.\n", name, SPIFFS_errno(&fs));
+			SPIFFS_close(&fs, fd);
+			return 0;
+		}
+		if (res == 0) break;
+		s32_t i;
+		for (i = 0; i < res; i++) {
+			if (buf[i] != content_byte(f->seed, offset + i)) {
+				printf("'%s' is corrupt at offset %u.\n", name, offset + i);
+				SPIFFS_close(&fs, fd);
+				return 0;
+			}
+		}
+		offset += res;
+	}
+	SPIFFS_clearerr(&fs);
+	SPIFFS_close(&fs, fd);
+	if (offset != f->size) {
+		printf("'%s' is %u bytes, expected %u.\n", name, offset, f->size);
+		return 0;
+	}
+	return 1;
+}
+
+static int pick_file(int exists, u32_t max_files) {
+	u32_t i, start = next_rand() % max_files;
+	for (i = 0; i < max_files; i++) {
+		int index = (start + i) % max_files;
+		if (files[index].exists == exists) return index;
+	}
+	return -1;
+}
+
+static u32_t free_pages() {
+	return (SPIFFS_PAGES_PER_BLOCK(&fs) - SPIFFS_OBJ_LOOKUP_PAGES(&fs)) * (fs.block_count - 2)
+		- fs.stats_p_allocated - fs.stats_p_deleted;
+}
+
+static int compare_u32(const void *a, const void *b) {
+	u32_t x = *(const u32_t *)a, y = *(const u32_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+static u32_t percentile(op_stats *s, int pct) {
+	if (!s->count) return 0;
+	return s->latency[(u32_t)(((uint64_t)s->count - 1) * pct / 100)];
+}
+
+static void usage(const char *name) {
+	printf("Usage: %s [options]\n"
+		"  -s size       File system size (default 0x%x)\n"
+		"  -p page       Logical page size (default %d)\n"
+		"  -b block      Logical block size, a multiple of %d (default %d)\n"
+		"  -f fds        File descriptors (default %d)\n"
+		"  -c pages      Cache pages (default %d)\n"
+		"  -n ops        Number of operations (default 20000)\n"
+		"  -r seed       Random seed (default 1)\n"
+		"  -m c,a,r,o,d  Weights for create, append, read, overwrite and delete (default 20,25,30,10,15)\n"
+		"  -z size       Largest file (default 16384)\n"
+		"  -k chunk      Size of each read and write call, up to %d (default 128)\n"
+		"  -u percent    Space to keep in use (default 70)\n"
+		"  -g ops        Erase fully deleted blocks every so many operations, as idle GC would (default off)\n"
+		"  -t e,p,r      Sector erase, page program and page read times in microseconds (default 45000,700,15)\n"
+		"  -o            Print results as one CSV line with a header\n",
+		name, DEFAULT_FS_SIZE, DEFAULT_PAGE_SIZE, SPI_FLASH_SEC_SIZE, DEFAULT_BLOCK_SIZE, DEFAULT_FDS, DEFAULT_CACHE,
+		MAX_CHUNK);
+}
+
+int main(int argc, char **argv) {
+
+	u32_t fs_size = DEFAULT_FS_SIZE;
+	u32_t page_size = DEFAULT_PAGE_SIZE;
+	u32_t block_size = DEFAULT_BLOCK_SIZE;
+	u32_t fd_count = DEFAULT_FDS;
+	u32_t cache_pages = DEFAULT_CACHE;
+	u32_t op_count = 20000;
+	u32_t seed = 1;
+	u32_t weights[OP_COUNT] = {20, 25, 30, 10, 15};
+	u32_t max_size = 16384;
+	u32_t chunk = 128;
+	u32_t fill = 70;
+	u32_t gc_interval = 0;
+	int csv = 0;
+	int opt, ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "s:p:b:f:c:n:r:m:z:k:u:g:t:oh")) != -1) {
+		switch (opt) {
+		case 's': fs_size = strtoul(optarg, NULL, 0); break;
+		case 'p': page_size = strtoul(optarg, NULL, 0); break;
+		case 'b': block_size = strtoul(optarg, NULL, 0); break;
+		case 'f': fd_count = strtoul(optarg, NULL, 0); break;
+		case 'c': cache_pages = strtoul(optarg, NULL, 0); break;
+		case 'n': op_count = strtoul(optarg, NULL, 0); break;
+		case 'r': seed = strtoul(optarg, NULL, 0); break;
+		case 'm':
+			if (sscanf(optarg, "%u,%u,%u,%u,%u", &weights[0], &weights[1], &weights[2], &weights[3], &weights[4]) != 5) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'z': max_size = strtoul(optarg, NULL, 0); break;
+		case 'k': chunk = strtoul(optarg, NULL, 0); break;
+		case 'u': fill = strtoul(optarg, NULL, 0); break;
+		case 'g': gc_interval = strtoul(optarg, NULL, 0); break;
+		case 't':
+			if (sscanf(optarg, "%u,%u,%u", &t_erase, &t_program, &t_read) != 3) {
+				usage(argv[0]);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'o': csv = 1; break;
+		default:
+			usage(argv[0]);
+			exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	u32_t weight_total = 0;
+	int op;
+	for (op = 0; op < OP_COUNT; op++) weight_total += weights[op];
+	if (weight_total == 0 || chunk == 0 || chunk > MAX_CHUNK || fill > 95 || block_size % SPI_FLASH_SEC_SIZE ||
+		fs_size % block_size || fd_count == 0 || cache_pages == 0) {
+		printf("Invalid options.\n");
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	cfg.phys_size = fs_size;
+	cfg.phys_addr = 0;
+	cfg.phys_erase_block = SPI_FLASH_SEC_SIZE;
+	cfg.log_block_size = block_size;
+	cfg.log_page_size = page_size;
+	cfg.hal_read_f = bench_read;
+	cfg.hal_write_f = bench_write;
+	cfg.hal_erase_f = bench_erase;
+
+	// Buffers are sized from the structures, which are larger on a 64-bit host than on the device
+	fds_size = fd_count * sizeof(spiffs_fd);
+	cache_size = sizeof(spiffs_cache) + cache_pages * (sizeof(spiffs_cache_page) + page_size);
+	flash = malloc(fs_size);
+	sector_erases = calloc(fs_size / SPI_FLASH_SEC_SIZE, sizeof(u32_t));
+	work_buf = malloc(page_size * 2);
+	fds_buf = malloc(fds_size);
+	cache_buf = malloc(cache_size);
+	if (!flash || !sector_erases || !work_buf || !fds_buf || !cache_buf) {
+		printf("Out of memory.\n");
+		exit(EXIT_FAILURE);
+	}
+	memset(flash, ROM_ERASE, fs_size);
+
+	// Mount has to be attempted before format, as spiffy does
+	if (bench_mount() == SPIFFS_OK) SPIFFS_unmount(&fs);
+	int res = SPIFFS_format(&fs);
+	if (res == SPIFFS_OK) res = bench_mount();
+	if (res != SPIFFS_OK) {
+		printf("Unable to create file system, error %d.\n", res);
+		exit(EXIT_FAILURE);
+	}
+
+	// More files than pages would only measure running out of space
+	u32_t max_files = fs.block_count * SPIFFS_OBJ_LOOKUP_MAX_ENTRIES(&fs) / 8;
+	if (max_files > MAX_FILES) max_files = MAX_FILES;
+	u32_t total_pages = free_pages();
+	u32_t max_deleted = 0;
+	u32_t min_free_blocks = fs.free_blocks;
+	u32_t n;
+	rand_state = seed ? seed : 1;
+	clock_us = 0;
+
+	for (n = 0; n < op_count && ret == EXIT_SUCCESS; n++) {
+		char name[SPIFFS_OBJ_NAME_LEN];
+		u32_t pick = next_rand() % weight_total;
+		for (op = 0; pick >= weights[op]; op++) pick -= weights[op];
+
+		u32_t used = total_pages - free_pages() - fs.stats_p_deleted;
+		if (used * 100 > total_pages * fill && (op == OP_CREATE || op == OP_APPEND)) op = OP_DELETE;
+
+		int index = pick_file(op != OP_CREATE, max_files);
+		if (index < 0) {
+			if (op == OP_CREATE) op = OP_DELETE;
+			else op = OP_CREATE;
+			index = pick_file(op != OP_CREATE, max_files);
+			if (index < 0) continue;
+		}
+		file_info *f = &files[index];
+		sprintf(name, "f%d", index);
+
+		uint64_t start = clock_us;
+		u32_t bytes = 0;
+		spiffs_file fd;
+		op_erases = 0;
+
+		switch (op) {
+		case OP_CREATE:
+		case OP_OVERWRITE:
+		case OP_APPEND: {
+			u32_t size = random_size(max_size);
+			u32_t seed_new = op == OP_APPEND ? f->seed : next_rand();
+			u32_t offset = op == OP_APPEND ? f->size : 0;
+			if (op == OP_APPEND) {
+				if (f->size >= max_size) {
+					// Full grown, read it instead
+					op = OP_READ;
+					break;
+				}
+				if (size > max_size - f->size) size = max_size - f->size;
+			}
+			spiffs_flags flags = op == OP_APPEND ? SPIFFS_APPEND | SPIFFS_WRONLY : SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_WRONLY;
+			fd = SPIFFS_open(&fs, name, flags, 0);
+			res = fd < 0 ? fd : write_content(fd, seed_new, offset, size, chunk);
+			if (fd >= 0) {
+				s32_t close_res = SPIFFS_close(&fs, fd);
+				if (res == SPIFFS_OK) res = close_res;
+			}
+			if (res == SPIFFS_ERR_FULL || SPIFFS_errno(&fs) == SPIFFS_ERR_FULL) {
+				// Whatever made it to flash is unknown, so start the file again
+				SPIFFS_clearerr(&fs);
+				SPIFFS_remove(&fs, name);
+				f->exists = 0;
+				f->size = 0;
+				stats[op].failures++;
+				record(op, start, 0);
+				continue;
+			}
+			if (res < SPIFFS_OK) {
+				printf("%s '%s' failed, error %d.\n", op_names[op], name, res);
+				ret = EXIT_FAILURE;
+				break;
+			}
+			f->exists = 1;
+			f->seed = seed_new;
+			f->size = offset + size;
+			bytes = size;
+			break;
+		}
+
+		case OP_DELETE:
+			res = SPIFFS_remove(&fs, name);
+			if (res != SPIFFS_OK) {
+				printf("delete '%s' failed, error %d.\n", name, res);
+				ret = EXIT_FAILURE;
+			}
+			f->exists = 0;
+			f->size = 0;
+			break;
+		}
+
+		if (ret != EXIT_SUCCESS) break;
+
+		if (op == OP_READ) {
+			if (!verify_file(index, chunk)) {
+				ret = EXIT_FAILURE;
+				break;
+			}
+			bytes = f->size;
+		}
+
+		record(op, start, bytes);
+
+		if (fs.stats_p_deleted > max_deleted) max_deleted = fs.stats_p_deleted;
+		if (fs.free_blocks < min_free_blocks) min_free_blocks = fs.free_blocks;
+
+		if (gc_interval && (n + 1) % gc_interval == 0) {
+			// Not charged to any operation, the device would do this while idle
+			while (SPIFFS_gc_quick(&fs, 0) == SPIFFS_OK);
+			SPIFFS_clearerr(&fs);
+		}
+	}
+
+	if (ret != EXIT_SUCCESS) {
+		printf("Failed at operation %u, repeat with -r %u -n %u.\n", n, seed, n + 1);
+		exit(ret);
+	}
+
+	// Leave the file system as a reboot would find it, and check it survived
+	u32_t deleted_at_end = fs.stats_p_deleted;
+	u32_t free_blocks_at_end = fs.free_blocks;
+	u32_t gc_runs = fs.stats_gc_runs;
+	if ((res = SPIFFS_check(&fs)) != SPIFFS_OK) {
+		printf("Check failed, error %d.\n", res);
+		ret = EXIT_FAILURE;
+	}
+	SPIFFS_unmount(&fs);
+	if ((res = bench_mount()) != SPIFFS_OK) {
+		printf("Remount failed, error %d.\n", res);
+		exit(EXIT_FAILURE);
+	}
+	u32_t i, file_count = 0;
+	for (i = 0; i < max_files; i++) {
+		if (!files[i].exists) continue;
+		file_count++;
+		if (!verify_file(i, chunk)) ret = EXIT_FAILURE;
+	}
+
+	u32_t sectors = fs_size / SPI_FLASH_SEC_SIZE;
+	u32_t erase_min = ~0u, erase_max = 0;
+	uint64_t erase_total = 0;
+	for (i = 0; i < sectors; i++) {
+		if (sector_erases[i] < erase_min) erase_min = sector_erases[i];
+		if (sector_erases[i] > erase_max) erase_max = sector_erases[i];
+		erase_total += sector_erases[i];
+	}
+
+	for (op = 0; op < OP_COUNT; op++) {
+		qsort(stats[op].latency, stats[op].count, sizeof(u32_t), compare_u32);
+	}
+
+	if (csv) {
+		printf("size,page,block,fds,cache,ops,seed,chunk,fill,gc");
+		for (op = 0; op < OP_COUNT; op++) {
+			printf(",%s_count,%s_kbps,%s_p50,%s_p90,%s_p99,%s_max,%s_stalls,%s_full",
+				op_names[op], op_names[op], op_names[op], op_names[op], op_names[op], op_names[op], op_names[op], op_names[op]);
+		}
+		printf(",erase_min,erase_avg,erase_max,deleted_pages_max,deleted_pages_end,free_blocks_min,free_blocks_end,gc_runs,files,flash_seconds\n");
+		printf("%u,%u,%u,%u,%u,%u,%u,%u,%u,%u", fs_size, page_size, block_size, fd_count, cache_pages, op_count, seed, chunk, fill, gc_interval);
+		for (op = 0; op < OP_COUNT; op++) {
+			op_stats *s = &stats[op];
+			printf(",%u,%.1f,%u,%u,%u,%u,%u,%u", s->count, s->time ? s->bytes * 1e6 / 1024 / s->time : 0.0,
+				percentile(s, 50), percentile(s, 90), percentile(s, 99), percentile(s, 100), s->stalls, s->failures);
+		}
+		printf(",%u,%.1f,%u,%u,%u,%u,%u,%u,%u,%.1f\n", erase_min, (double)erase_total / sectors, erase_max, max_deleted,
+			deleted_at_end, min_free_blocks, free_blocks_at_end, gc_runs, file_count, clock_us / 1e6);
+	} else {
+		printf("File system %u KB, %u byte pages, %u byte blocks, %u fds, %u cache pages\n", fs_size / 1024,
+			page_size, block_size, fd_count, cache_pages);
+		printf("%u operations, seed %u, %u byte chunks, %u%% in use, idle GC %s\n\n", op_count, seed, chunk, fill,
+			gc_interval ? "on" : "off");
+		printf("%-10s %8s %10s %9s %9s %9s %9s %8s %6s\n", "operation", "count", "KB/s", "p50 us", "p90 us", "p99 us",
+			"max us", "stalls", "full");
+		for (op = 0; op < OP_COUNT; op++) {
+			op_stats *s = &stats[op];
+			printf("%-10s %8u %10.1f %9u %9u %9u %9u %8u %6u\n", op_names[op], s->count,
+				s->time ? s->bytes * 1e6 / 1024 / s->time : 0.0, percentile(s, 50), percentile(s, 90),
+				percentile(s, 99), percentile(s, 100), s->stalls, s->failures);
+		}
+		printf("\nSector erases: min %u, average %.1f, max %u\n", erase_min, (double)erase_total / sectors, erase_max);
+		printf("Deleted pages: %u at most, %u at end, of %u\n", max_deleted, deleted_at_end, total_pages);
+		printf("Free blocks: %u at least, %u at end, of %u\n", min_free_blocks, free_blocks_at_end, fs.block_count);
+		printf("GC runs: %u\n", gc_runs);
+		printf("Files verified after remount: %u\n", file_count);
+		printf("Flash time: %.1f s\n", clock_us / 1e6);
+	}
+
+	SPIFFS_unmount(&fs);
+	for (op = 0; op < OP_COUNT; op++) free(stats[op].latency);
+	free(cache_buf);
+	free(fds_buf);
+	free(work_buf);
+	free(sector_erases);
+	free(flash);
+	if (ret != EXIT_SUCCESS) printf("FAILED\n");
+	exit(ret);
+}
@@ -0,0 +1,245 @@
+/*
+ * timerwheeltest - host test for TimerWheel, built from the Sming sources and
+ * driven by a fake clock.
+ *
+ * A random mix of one-shot and repeating timers, from one tick to beyond the
+ * span of the wheel, is armed, disarmed and re-armed from their own callbacks
+ * while the clock runs. The wheel is serviced as TimerScheduler does it: at the
+ * tick getNextTick() asks for, or some way after it to stand in for a busy
+ * system. A model of each timer's deadline checks that:
+ *  - arming only defers a deadline by the slack allowed for its interval
+ *  - nothing fires before its deadline
+ *  - nothing is left unfired once the wheel has been serviced past its
+ *    deadline, so a timer serviced on time fires on time
+ *  - a repeating timer which has fallen behind fires once and resumes a period
+ *    after it was serviced, rather than firing a burst
+ * The clock starts just short of wrapping, so wraparound is covered as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <vector>
+#include "TimerWheel.h"
+
+// Span of the wheel, beyond which entries are parked and re-inserted
+#define WHEEL_SPAN (1U << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+struct Timer {
+	TimerWheel::Entry entry;
+	unsigned index;
+	bool armed;
+	bool repeating;
+	bool rearm;          // One-shot which re-arms itself when it fires
+	uint32_t interval;
+	uint32_t expires;    // What the model expects
+	unsigned fired;
+};
+
+static TimerWheel wheel;
+static std::vector<Timer> timers;
+static uint32_t clock_now;
+static unsigned failures;
+static unsigned current_step;
+static unsigned fire_count, late_services, rearms;
+
+static void fail(const char *what, const Timer &t) {
+	++failures;
+	if (failures <= 10) {
+		printf("FAIL at step %u, tick 0x%08x: %s, timer %u (%s, interval %u, due 0x%08x)\n", current_step,
+			clock_now, what, t.index, t.repeating ? "repeating" : "one-shot", t.interval, t.expires);
+	}
+}
+
+static uint32_t random_interval(void) {
+	switch (rand() % 8) {
+		case 0:
+			return 1 + rand() % 4;
+		case 1:
+		case 2:
+		case 3:
+			return 1 + rand() % 1000;
+		case 4:
+		case 5:
+			return 1 + rand() % 100000;
+		case 6:
+			return 1 + rand() % WHEEL_SPAN;
+		default:
+			// Parked at the top level at first
+			return WHEEL_SPAN + rand() % (WHEEL_SPAN * 3);
+	}
+}
+
+static void arm(Timer &t, uint32_t tick, bool repeating) {
+	t.interval = random_interval();
+	t.repeating = repeating;
+	t.rearm = !repeating && (rand() % 3 == 0);
+	wheel.arm(t.entry, tick, t.interval, repeating);
+
+	// Deferred by up to 1 / 2^TIMER_WHEEL_SLACK_SHIFT of the interval, so deadlines coalesce
+	uint32_t deadline = tick + t.interval;
+	uint32_t slack = t.interval >> TIMER_WHEEL_SLACK_SHIFT;
+	int32_t deferred = int32_t(t.entry.expires - deadline);
+	if (deferred < 0 || uint32_t(deferred) > slack) {
+		t.expires = deadline;
+		fail("armed with the wrong deadline", t);
+	}
+	t.expires = t.entry.expires;
+	t.armed = true;
+}
+
+static void on_fire(void *arg) {
+	Timer &t = *static_cast<Timer *>(arg);
+	++t.fired;
+	++fire_count;
+
+	if (!t.armed) {
+		fail("fired while disarmed", t);
+		return;
+	}
+	if (int32_t(clock_now - t.expires) < 0) {
+		fail("fired early", t);
+	}
+
+	if (t.repeating) {
+		t.expires += t.interval;
+		if (int32_t(t.expires - clock_now) <= 0) {
+			t.expires = clock_now + t.interval;
+		}
+		if (!t.entry.isArmed() || t.entry.expires != t.expires) {
+			fail("repeating timer not re-armed a period on", t);
+		}
+		return;
+	}
+
+	t.armed = false;
+	if (t.entry.isArmed()) {
+		fail("one-shot timer still armed", t);
+	}
+	if (t.rearm) {
+		++rearms;
+		arm(t, clock_now, false);
+	}
+}
+
+/*
+ * Service the wheel at the current tick, as TimerScheduler::process() does,
+ * then check nothing due has been left behind
+ */
+static void service(void) {
+	TimerWheel::Entry *entry;
+	while ((entry = wheel.expire(clock_now)) != nullptr) {
+		entry->callback(entry->arg);
+	}
+
+	unsigned armed = 0;
+	for (auto &t : timers) {
+		if (!t.armed) {
+			continue;
+		}
+		++armed;
+		if (!t.entry.isArmed()) {
+			fail("timer lost", t);
+			t.armed = false;
+		} else if (int32_t(t.expires - clock_now) <= 0) {
+			fail("fired late", t);
+		}
+	}
+	if (armed != wheel.count()) {
+		++failures;
+		printf("FAIL at step %u: count() is %u, %u timers armed\n", current_step, wheel.count(), armed);
+	}
+
+	uint32_t next;
+	if (wheel.getNextTick(next) && int32_t(next - clock_now) <= 0) {
+		++failures;
+		printf("FAIL at step %u: next tick 0x%08x isn't after 0x%08x\n", current_step, next, clock_now);
+	}
+}
+
+static void usage(const char *name) {
+	printf("Usage: %s [options]\n"
+		"  -n steps      Number of steps (default 200000)\n"
+		"  -r seed       Random seed (default 1)\n"
+		"  -t timers     Number of timers (default 100)\n"
+		"  -l percent    Steps serviced late (default 20)\n",
+		name);
+}
+
+int main(int argc, char **argv) {
+	unsigned step_count = 200000;
+	unsigned seed = 1;
+	unsigned timer_count = 100;
+	unsigned late_percent = 20;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:r:t:l:h")) != -1) {
+		switch (opt) {
+			case 'n': step_count = strtoul(optarg, NULL, 0); break;
+			case 'r': seed = strtoul(optarg, NULL, 0); break;
+			case 't': timer_count = strtoul(optarg, NULL, 0); break;
+			case 'l': late_percent = strtoul(optarg, NULL, 0); break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if (timer_count == 0 || late_percent > 100) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	srand(seed);
+	clock_now = 0 - WHEEL_SPAN / 2;
+	timers.resize(timer_count);
+	for (unsigned i = 0; i < timer_count; ++i) {
+		Timer &t = timers[i];
+		t.index = i;
+		t.entry.callback = on_fire;
+		t.entry.arg = &t;
+	}
+
+	unsigned arms = 0, disarms = 0;
+	for (unsigned step = 0; step < step_count && failures == 0; ++step) {
+		current_step = step;
+
+		// Change a few timers between services
+		for (unsigned n = rand() % 3; n != 0; --n) {
+			Timer &t = timers[rand() % timer_count];
+			if (t.armed && rand() % 4 == 0) {
+				wheel.disarm(t.entry);
+				t.armed = false;
+				++disarms;
+			} else {
+				arm(t, clock_now, rand() % 2 == 0);
+				++arms;
+			}
+		}
+
+		// Move on to when the wheel asks to be serviced, or later if busy
+		uint32_t next;
+		if (!wheel.getNextTick(next)) {
+			next = clock_now + 1 + rand() % 1000;
+		}
+		if (unsigned(rand() % 100) < late_percent) {
+			++late_services;
+			next += 1 + ((rand() % 2) ? rand() % 10 : rand() % 100000);
+		}
+		clock_now = next;
+		service();
+	}
+
+	unsigned never_fired = 0;
+	for (auto &t : timers) {
+		if (t.fired == 0) {
+			++never_fired;
+		}
+	}
+
+	printf("%u arms, %u disarms, %u one-shot re-arms, %u timers fired %u times\n", arms, disarms, rearms,
+		timer_count - never_fired, fire_count);
+	printf("%u of %u steps serviced late, ended at tick 0x%08x\n", late_services, step_count, clock_now);
+	printf("%s\n", failures ? "FAILED" : "OK");
+	return failures ? 1 : 0;
+}